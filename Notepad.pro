@@ -1,4 +1,4 @@
-QT       += core gui texttospeech
+QT       += core gui texttospeech concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -9,11 +9,81 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    autosaver.cpp \
+    benchmark.cpp \
+    diffview.cpp \
+    documentoverview.cpp \
+    fileloader.cpp \
+    filesaver.cpp \
+    filesearch.cpp \
+    findbar.cpp \
+    findinfilesdock.cpp \
+    formatengine.cpp \
+    largefileview.cpp \
+    linediff.cpp \
+    logfollower.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    overviewscrollbar.cpp \
+    perfoverlay.cpp \
+    perftrace.cpp \
+    piecetable.cpp \
+    richdocument.cpp \
+    selectionlayers.cpp \
+    sessionstore.cpp \
+    speechreader.cpp \
+    spellchecker.cpp \
+    spellhighlighter.cpp \
+    syntaxhighlighter.cpp \
+    tabplaceholder.cpp \
+    textcodec.cpp \
+    textreplace.cpp \
+    textsearch.cpp \
+    tracededit.cpp \
+    trigramindex.cpp \
+    undohistory.cpp \
+    wordcompleter.cpp \
+    wordcounter.cpp \
+    wordindex.cpp
 
 HEADERS += \
-    mainwindow.h
+    autosaver.h \
+    benchmark.h \
+    blockchange.h \
+    diffview.h \
+    documentoverview.h \
+    fileloader.h \
+    filesaver.h \
+    filesearch.h \
+    findbar.h \
+    findinfilesdock.h \
+    formatengine.h \
+    largefileview.h \
+    linediff.h \
+    logfollower.h \
+    mainwindow.h \
+    overviewscrollbar.h \
+    perfoverlay.h \
+    perftrace.h \
+    piecetable.h \
+    richdocument.h \
+    selectionlayers.h \
+    sessionstore.h \
+    simd.h \
+    speechreader.h \
+    spellchecker.h \
+    spellhighlighter.h \
+    syntaxhighlighter.h \
+    tabplaceholder.h \
+    textcodec.h \
+    textreplace.h \
+    textsearch.h \
+    tracededit.h \
+    trigramindex.h \
+    undohistory.h \
+    wordcompleter.h \
+    wordcounter.h \
+    wordindex.h
 
 FORMS += \
     mainwindow.ui
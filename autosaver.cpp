@@ -0,0 +1,171 @@
+#include "autosaver.h"
+#include "filesaver.h"
+#include <QTextDocument>
+#include <QTimer>
+
+static const int idleDelay = 2000;   // ms without edits before dirty documents are written
+
+AutoSaver::AutoSaver(QObject *parent) : QObject(parent)
+{
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(idleDelay);
+    connect(idleTimer, &QTimer::timeout, this, &AutoSaver::flush);
+
+    maximumDelayTimer = new QTimer(this);
+    maximumDelayTimer->setSingleShot(true);
+    maximumDelayTimer->setInterval(5 * 60000);
+    connect(maximumDelayTimer, &QTimer::timeout, this, &AutoSaver::flush);
+}
+
+void AutoSaver::setEnabled(bool enable)
+{
+    enabled = enable;
+    if (!enabled) {
+        idleTimer->stop();
+        maximumDelayTimer->stop();
+        queue.clear();  // A save already running is left to finish
+        return;
+    }
+
+    for (auto it = documents.cbegin(); it != documents.cend(); ++it) {
+        if (isDirty(it.key())) {
+            schedule();
+            break;
+        }
+    }
+}
+
+void AutoSaver::setMaximumDelay(int milliseconds)
+{
+    maximumDelayTimer->setInterval(qMax(idleDelay, milliseconds));
+}
+
+// Start following a document; its current content counts as saved
+void AutoSaver::track(QTextDocument *document, const QString &fileName)
+{
+    auto it = documents.find(document);
+    if (it != documents.end()) {
+        it->fileName = fileName;
+        return;
+    }
+
+    DocumentState state;
+    state.fileName = fileName;
+    documents.insert(document, state);
+
+    connect(document, &QTextDocument::contentsChange, this, &AutoSaver::onContentsChange);
+    connect(document, &QObject::destroyed, this, [this, document] {
+        documents.remove(document);
+        queue.removeAll(document);
+        if (activeDocument == document) activeDocument = nullptr;  // Its save still completes
+    });
+}
+
+// Stop following a document; a save of it already running still completes
+void AutoSaver::untrack(QTextDocument *document)
+{
+    if (!documents.remove(document)) return;
+    disconnect(document, nullptr, this, nullptr);
+    queue.removeAll(document);
+    if (activeDocument == document) activeDocument = nullptr;
+}
+
+quint64 AutoSaver::generation(const QTextDocument *document) const
+{
+    return documents.value(const_cast<QTextDocument *>(document)).generation;
+}
+
+// The document's content as of generation is on disk
+void AutoSaver::markSaved(QTextDocument *document, quint64 generation)
+{
+    auto it = documents.find(document);
+    if (it == documents.end()) return;
+
+    it->savedGeneration = qMax(it->savedGeneration, generation);
+    if (it->savedGeneration == it->generation) document->setModified(false);
+}
+
+void AutoSaver::cancelSave(QTextDocument *document)
+{
+    queue.removeAll(document);
+    if (activeDocument == document && activeSaver) {
+        activeSaver->cancel();
+        activeDocument = nullptr;
+    }
+}
+
+bool AutoSaver::isDirty(QTextDocument *document) const
+{
+    auto it = documents.constFind(document);
+    return it != documents.cend() && !it->fileName.isEmpty() && it->generation != it->savedGeneration;
+}
+
+void AutoSaver::onContentsChange(int, int, int)
+{
+    QTextDocument *document = qobject_cast<QTextDocument *>(sender());
+    auto it = documents.find(document);
+    if (it == documents.end()) return;
+
+    ++it->generation;
+    if (enabled) schedule();
+}
+
+// Restart the idle countdown; the maximum delay keeps running from the first unsaved edit
+void AutoSaver::schedule()
+{
+    idleTimer->start();
+    if (!maximumDelayTimer->isActive()) maximumDelayTimer->start();
+}
+
+// Queue every dirty document; many edits to one document become a single write
+void AutoSaver::flush()
+{
+    idleTimer->stop();
+    maximumDelayTimer->stop();
+
+    for (auto it = documents.cbegin(); it != documents.cend(); ++it) {
+        QTextDocument *document = it.key();
+        if (isDirty(document) && document != activeDocument && !queue.contains(document)) {
+            queue.append(document);
+        }
+    }
+    saveNext();
+}
+
+// Snapshot the next dirty document and write it on the worker; one save runs at a time
+void AutoSaver::saveNext()
+{
+    if (activeSaver) return;
+
+    while (!queue.isEmpty()) {
+        QTextDocument *document = queue.takeFirst();
+        if (!isDirty(document)) continue;  // Saved by hand in the meantime
+
+        const DocumentState &state = documents[document];
+        FileSaver *saver = FileSaver::create(state.fileName, document, this);
+        activeSaver = saver;
+        activeDocument = document;
+        activeGeneration = state.generation;
+
+        connect(saver, &FileSaver::finished, this, [this, saver](bool completed, const QString &errorString) {
+            saver->deleteLater();
+            if (activeSaver == saver) {
+                QTextDocument *document = activeDocument;
+                activeSaver = nullptr;
+                activeDocument = nullptr;
+
+                if (completed) emit saved(saver->fileName());
+                if (document && completed) {
+                    markSaved(document, activeGeneration);
+                    if (enabled && isDirty(document)) schedule();  // Edited while the save ran
+                } else if (document && !errorString.isEmpty()) {
+                    emit saveFailed(saver->fileName(), errorString);
+                }
+            }
+            saveNext();
+        });
+        saver->start();
+        return;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef AUTOSAVER_H
+#define AUTOSAVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+#include <QString>
+
+class QTextDocument;
+class QTimer;
+class FileSaver;
+
+// Auto-save scheduler for every open document that has a file.
+// Each document carries a modification generation that every edit bumps; a
+// document is dirty while its generation is ahead of the last one written.
+// Saves start once the user has been idle for a moment (or the maximum delay
+// has passed during continuous typing), and then only the dirty documents are
+// written, one at a time, by a FileSaver on a worker thread. Nothing here
+// opens a dialog: failures are reported through saveFailed().
+class AutoSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AutoSaver(QObject *parent = nullptr);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled; }
+    void setMaximumDelay(int milliseconds);   // Longest an edit waits while typing never pauses
+
+    void track(QTextDocument *document, const QString &fileName);   // Also updates the file of a tracked document
+    void untrack(QTextDocument *document);
+    quint64 generation(const QTextDocument *document) const;
+    void markSaved(QTextDocument *document, quint64 generation);
+    void cancelSave(QTextDocument *document);  // A manual save of the document supersedes the auto-save
+
+public slots:
+    void flush();
+
+signals:
+    void saved(const QString &fileName);
+    void saveFailed(const QString &fileName, const QString &errorString);
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    struct DocumentState
+    {
+        QString fileName;
+        quint64 generation = 0;
+        quint64 savedGeneration = 0;
+    };
+
+    bool isDirty(QTextDocument *document) const;
+    void schedule();
+    void saveNext();
+
+    QHash<QTextDocument *, DocumentState> documents;
+    QList<QTextDocument *> queue;        // Dirty documents waiting for the worker
+    QPointer<FileSaver> activeSaver;
+    QTextDocument *activeDocument = nullptr;
+    quint64 activeGeneration = 0;
+
+    QTimer *idleTimer;
+    QTimer *maximumDelayTimer;
+    bool enabled = false;
+};
+
+#endif // AUTOSAVER_H
@@ -0,0 +1,386 @@
+#include "benchmark.h"
+#include "mainwindow.h"
+#include "findbar.h"
+#include "largefileview.h"
+#include "sessionstore.h"
+#include "textcodec.h"
+#include "textreplace.h"
+#include "undohistory.h"
+#include "wordcounter.h"
+#include <QApplication>
+#include <QCloseEvent>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QDeadlineTimer>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextStream>
+#include <QTimer>
+#include <algorithm>
+#include <memory>
+
+static const qint64 singleRunSize = 64 * 1024 * 1024;    // Corpora this large are measured once per case
+static const int waitTimeout = 30 * 60 * 1000;            // ms any asynchronous step may take
+static const char needle[] = "needle";                    // Planted in the corpus for find and replace
+
+// Replace to with a copy of the tree at from
+static bool copyDirectory(const QString &from, const QString &to)
+{
+    QDir(to).removeRecursively();
+    const QDir source(from);
+    QDirIterator it(from, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        const QString target = to + '/' + source.relativeFilePath(path);
+        if (!QDir().mkpath(QFileInfo(target).path()) || !QFile::copy(path, target)) return false;
+    }
+    return true;
+}
+
+bool Benchmark::parseArguments(const QStringList &arguments, Options *options, QString *errorString)
+{
+    QCommandLineParser parser;
+    parser.addOption({"benchmark", "Run the benchmarks headlessly and exit."});
+    parser.addOption({"sizes", "Comma-separated corpus sizes, e.g. 1M,100M,1G.", "sizes", "1M"});
+    parser.addOption({"iterations", "Runs per case on corpora under 64 MB.", "count", "3"});
+    parser.addOption({"filter", "Only run cases whose name contains text.", "text"});
+    parser.addOption({"output", "Write the JSON results to file instead of standard output.", "file"});
+    if (!parser.parse(arguments)) {
+        *errorString = parser.errorText();
+        return false;
+    }
+
+    options->corpusSizes.clear();
+    const QStringList sizes = parser.value("sizes").split(',', Qt::SkipEmptyParts);
+    for (QString size : sizes) {
+        size = size.trimmed().toUpper();
+        qint64 unit = 1;
+        if (size.endsWith('K')) unit = 1024;
+        if (size.endsWith('M')) unit = 1024 * 1024;
+        if (size.endsWith('G')) unit = 1024 * 1024 * 1024;
+        if (unit > 1) size.chop(1);
+        bool ok = false;
+        const qint64 value = size.toLongLong(&ok);
+        if (!ok || value <= 0) {
+            *errorString = QString("Invalid corpus size: %1").arg(size);
+            return false;
+        }
+        options->corpusSizes.append(value * unit);
+    }
+
+    bool ok = false;
+    options->iterations = qMax(1, parser.value("iterations").toInt(&ok));
+    if (!ok) {
+        *errorString = "Invalid iteration count";
+        return false;
+    }
+    options->filter = parser.value("filter");
+    options->outputPath = parser.value("output");
+    return true;
+}
+
+Benchmark::Benchmark(const Options &options) : options(options)
+{
+}
+
+int Benchmark::run()
+{
+    QTemporaryDir temporary;
+    if (!temporary.isValid()) {
+        QTextStream(stderr) << "Cannot create a working directory: " << temporary.errorString() << '\n';
+        return 1;
+    }
+    workDirectory = temporary.path();
+
+    for (qint64 size : std::as_const(options.corpusSizes)) {
+        Corpus corpus;
+        corpus.size = size;
+        QString errorString;
+        if (!generateCorpus(&corpus, &errorString)) {
+            QTextStream(stderr) << "Cannot generate corpus: " << errorString << '\n';
+            return 1;
+        }
+        runCorpus(corpus);
+        QFile::remove(corpus.filePath);
+    }
+
+    QJsonObject report;
+    report["version"] = 1;
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["qt"] = QString(qVersion());
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["os"] = QSysInfo::prettyProductName();
+    report["results"] = results;
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (options.outputPath.isEmpty()) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+    QFile output(options.outputPath);
+    if (!output.open(QIODevice::WriteOnly) || output.write(json) != json.size()) {
+        QTextStream(stderr) << "Cannot write results: " << output.errorString() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Lines of pseudo-random words from a fixed seed, with the needle planted every few hundred words
+bool Benchmark::generateCorpus(Corpus *corpus, QString *errorString) const
+{
+    static const char *const words[] = {
+        "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do",
+        "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore", "magna", "aliqua", "enim",
+        "ad", "minim", "veniam", "quis", "nostrud", "exercitation", "ullamco", "laboris", "nisi", "aliquip",
+        "ex", "ea", "commodo", "consequat", "duis", "aute", "irure", "in", "reprehenderit", "voluptate"
+    };
+    const int wordCount = int(sizeof(words) / sizeof(words[0]));
+
+    corpus->label = corpus->size % (1024 * 1024 * 1024) == 0 ? QString("%1G").arg(corpus->size >> 30)
+                  : corpus->size % (1024 * 1024) == 0     ? QString("%1M").arg(corpus->size >> 20)
+                                                           : QString("%1K").arg(corpus->size >> 10);
+    corpus->filePath = workDirectory + "/corpus-" + corpus->label + ".txt";
+
+    QFile file(corpus->filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *errorString = file.errorString();
+        return false;
+    }
+
+    QRandomGenerator random(42);
+    QByteArray buffer;
+    qint64 written = 0;
+    int lineLength = 0;
+    while (written + buffer.size() < corpus->size) {
+        const char *word = random.bounded(400) == 0 ? needle : words[random.bounded(wordCount)];
+        buffer.append(word);
+        lineLength += int(qstrlen(word)) + 1;
+        if (lineLength >= 80) {
+            buffer.append(random.bounded(10) == 0 ? ".\n" : "\n");
+            lineLength = 0;
+        } else {
+            buffer.append(' ');
+        }
+        if (buffer.size() >= 4 * 1024 * 1024) {
+            written += file.write(buffer);
+            buffer.clear();
+        }
+    }
+    buffer.truncate(qMax<qint64>(0, corpus->size - written));
+    if (file.write(buffer) != buffer.size()) {
+        *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void Benchmark::runCorpus(const Corpus &corpus)
+{
+    const QString dataDirectory = workDirectory + "/data-" + corpus.label;
+    const QString savePath = workDirectory + "/saved-" + corpus.label + ".txt";
+    std::unique_ptr<MainWindow> window(new MainWindow(nullptr, dataDirectory));
+    window->show();
+
+    // A tab is ready once streaming has finished or the line index is built
+    auto currentTabReady = [&window] {
+        QWidget *widget = window->tabWidget->currentWidget();
+        if (LargeFileView *view = qobject_cast<LargeFileView *>(widget)) return !view->isIndexing();
+        QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
+        return editor && !editor->isReadOnly();
+    };
+
+    measure("open", corpus, [&] {
+        window->openFile(corpus.filePath);
+        if (!waitFor(currentTabReady)) failure = "Timed out opening the corpus";
+    }, {}, [&] {
+        window->on_tabCloseRequested(window->tabWidget->currentIndex());
+    });
+
+    {
+        // Encoding detection and transcoding alone, without the editor
+        QFile file(corpus.filePath);
+        const QByteArray bytes = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+        measure("decode", corpus, [&] { TextCodec::decode(bytes); });
+    }
+
+    // The remaining cases work on one open copy
+    window->openFile(corpus.filePath);
+    if (!waitFor(currentTabReady)) {
+        const QString reason = "Timed out opening the corpus";
+        for (const char *name : {"save", "session save", "session restore", "find", "replace-all", "word count",
+                                 "edit + word count", "highlight", "bold", "italic", "clear format"}) {
+            skip(name, corpus, reason);
+        }
+        return;
+    }
+    QTextEdit *editor = window->currentEditor();
+    LargeFileView *view = qobject_cast<LargeFileView *>(window->tabWidget->currentWidget());
+
+    measure("save", corpus, [&] {
+        if (view) {
+            window->saveLargeFileView(view, savePath);
+        } else {
+            window->saveEditor(editor, savePath);
+            if (!waitFor([&] { return !window->tabSavers.contains(editor); })) failure = "Timed out saving";
+        }
+    });
+
+    auto typeOneCharacter = [&] {
+        if (!editor) return;
+        QTextCursor cursor(editor->document());
+        cursor.setPosition(editor->document()->characterCount() / 2);
+        cursor.insertText("x");
+    };
+
+    measure("session save", corpus, [&] {
+        QCloseEvent event;
+        window->closeEvent(&event);
+    }, typeOneCharacter);
+
+    // The restored window gets a copy of the session: two windows on one directory would prune each other's files
+    const QString restoreDirectory = workDirectory + "/restore-" + corpus.label;
+    std::unique_ptr<MainWindow> restored;
+    measure("session restore", corpus, [&] {
+        // The constructor reads the manifest and builds the current tab
+        restored.reset(new MainWindow(nullptr, restoreDirectory));
+        QApplication::processEvents();
+    }, [&] {
+        if (!copyDirectory(dataDirectory, restoreDirectory)) failure = "Cannot copy the session";
+    }, [&] {
+        restored.reset();
+    });
+    QDir(restoreDirectory).removeRecursively();
+
+    if (!editor) {
+        const QString reason = "Opens in a LargeFileView, which has no rich text";
+        for (const char *name : {"find", "replace-all", "word count", "edit + word count",
+                                 "highlight", "bold", "italic", "clear format"}) {
+            skip(name, corpus, reason);
+        }
+        QFile::remove(savePath);
+        return;
+    }
+
+    measure("find", corpus, [&] {
+        // Results arrive through the event loop, so connecting after the search has started is safe
+        window->findBar->setEditor(editor);
+        window->findBar->activate(needle);
+        QEventLoop loop;
+        bool found = false;
+        QObject::connect(window->findBar, &FindBar::matchesChanged, &loop, [&] {
+            found = true;
+            loop.quit();
+        });
+        QTimer::singleShot(waitTimeout, &loop, &QEventLoop::quit);
+        loop.exec();
+        if (!found) failure = "Timed out searching";
+    }, [&] {
+        window->findBar->setEditor(nullptr);  // Drop the cached snapshot so it is taken again
+    });
+    window->findBar->closeBar();
+
+    measure("replace-all", corpus, [&] {
+        TextReplace::replaceAll(editor->document(), needle, "pin", TextReplace::Options());
+    }, {}, [&] {
+        UndoHistory::forDocument(editor->document())->undo();
+    });
+
+    measure("word count", corpus, [&] {
+        delete new WordCounter(editor->document());  // A full count, as when a document is opened
+    });
+
+    measure("edit + word count", corpus, [&] {
+        typeOneCharacter();
+        window->updateWordCount();
+    });
+
+    auto selectAll = [&] { editor->selectAll(); };
+    auto undo = [&] { UndoHistory::forDocument(editor->document())->undo(); };
+    measure("highlight", corpus, [&] { window->on_actionHighlight_Yellow_triggered(); }, selectAll, undo);
+    measure("bold", corpus, [&] { window->on_actionBold_triggered(); }, selectAll, undo);
+    measure("italic", corpus, [&] { window->on_actionItalic_triggered(); }, selectAll, undo);
+    measure("clear format", corpus, [&] { window->on_actionClear_All_Format_triggered(); }, selectAll, undo);
+
+    window.reset();
+    QFile::remove(savePath);
+}
+
+// Time body over the configured iterations; setup and teardown run around each one untimed
+void Benchmark::measure(const QString &name, const Corpus &corpus, const std::function<void()> &body,
+                        const std::function<void()> &setup, const std::function<void()> &teardown)
+{
+    if (!options.filter.isEmpty() && !name.contains(options.filter)) return;
+
+    const int iterations = corpus.size >= singleRunSize ? 1 : options.iterations;
+    QVector<double> samples;
+    failure.clear();
+    for (int i = 0; i < iterations && failure.isEmpty(); ++i) {
+        if (setup) setup();
+        if (!failure.isEmpty()) break;
+        QApplication::processEvents();  // Start every run with an idle event queue
+
+        QElapsedTimer timer;
+        timer.start();
+        body();
+        samples.append(timer.nsecsElapsed() / 1e6);
+
+        if (teardown) teardown();
+    }
+
+    QJsonObject result;
+    result["case"] = name;
+    result["corpus"] = corpus.label;
+    result["bytes"] = corpus.size;
+    if (!failure.isEmpty()) {
+        // A run that did not finish says nothing about the time it takes
+        result["failed"] = failure;
+        results.append(result);
+        QTextStream(stderr) << corpus.label << ' ' << name << ": " << failure << '\n';
+        failure.clear();
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    result["iterations"] = iterations;
+    result["minMs"] = samples.first();
+    result["medianMs"] = samples.at(samples.size() / 2);
+    result["maxMs"] = samples.last();
+    results.append(result);
+
+    QTextStream(stderr) << corpus.label << ' ' << name << ": " << samples.at(samples.size() / 2) << " ms\n";
+}
+
+void Benchmark::skip(const QString &name, const Corpus &corpus, const QString &reason)
+{
+    if (!options.filter.isEmpty() && !name.contains(options.filter)) return;
+
+    QJsonObject result;
+    result["case"] = name;
+    result["corpus"] = corpus.label;
+    result["bytes"] = corpus.size;
+    result["skipped"] = reason;
+    results.append(result);
+}
+
+// Run the event loop until done() holds; false on timeout
+bool Benchmark::waitFor(const std::function<bool()> &done)
+{
+    QDeadlineTimer deadline(waitTimeout);
+    while (!done()) {
+        if (deadline.hasExpired()) return false;
+        QEventLoop loop;
+        QTimer::singleShot(5, &loop, &QEventLoop::quit);  // Sleep in the event loop rather than spin
+        loop.exec();
+    }
+    return true;
+}
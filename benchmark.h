@@ -0,0 +1,56 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QJsonArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+class MainWindow;
+
+// Headless benchmarks of the editor's hot paths, run with `Notepad --benchmark`.
+// Each case drives a MainWindow the way its menu actions do (open, save, session
+// save and restore, find, replace-all, word count, highlight and format toggles)
+// against generated corpora of the requested sizes. The window gets a scratch
+// data directory, so the user's session and index are never touched. Results are
+// written as JSON, one record per case and corpus, to compare builds against.
+class Benchmark
+{
+public:
+    struct Options
+    {
+        QList<qint64> corpusSizes;      // Bytes
+        int iterations = 3;             // Per case; corpora of 64 MB and more run once
+        QString filter;                 // Only cases whose name contains this
+        QString outputPath;             // Standard output when empty
+    };
+
+    // Options from the command line, or false with *errorString set
+    static bool parseArguments(const QStringList &arguments, Options *options, QString *errorString);
+
+    explicit Benchmark(const Options &options);
+    int run();   // Process exit code
+
+private:
+    struct Corpus
+    {
+        QString label;
+        QString filePath;
+        qint64 size;
+    };
+
+    bool generateCorpus(Corpus *corpus, QString *errorString) const;
+    void runCorpus(const Corpus &corpus);
+    void measure(const QString &name, const Corpus &corpus, const std::function<void()> &body,
+                 const std::function<void()> &setup = {}, const std::function<void()> &teardown = {});
+    void skip(const QString &name, const Corpus &corpus, const QString &reason);
+    static bool waitFor(const std::function<bool()> &done);
+
+    Options options;
+    QString workDirectory;
+    QJsonArray results;
+    QString failure;                    // Set by a case that could not finish a run; it is reported as failed
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,35 @@
+#ifndef BLOCKCHANGE_H
+#define BLOCKCHANGE_H
+
+#include <QTextDocument>
+#include <QTextBlock>
+
+// Blocks touched by one QTextDocument::contentsChange: before the edit they were
+// [first, first + removedBlocks), after it they are [first, first + addedBlocks).
+// Per-block caches use this to replace only the affected entries.
+struct BlockChange
+{
+    int first;
+    int removedBlocks;
+    int addedBlocks;
+};
+
+// previousBlockCount is the block count before the edit. Returns false when the
+// change cannot be mapped onto the old block list (the caller should rebuild).
+inline bool mapBlockChange(const QTextDocument *document, int previousBlockCount,
+                           int position, int charsAdded, BlockChange *change)
+{
+    QTextBlock first = document->findBlock(position);
+    QTextBlock last = document->findBlock(position + charsAdded);
+    if (!first.isValid()) first = document->lastBlock();
+    if (!last.isValid()) last = document->lastBlock();
+
+    change->first = first.blockNumber();
+    change->addedBlocks = last.blockNumber() - change->first + 1;
+    change->removedBlocks = change->addedBlocks - (document->blockCount() - previousBlockCount);
+
+    return change->first >= 0 && change->addedBlocks > 0 && change->removedBlocks > 0
+           && change->first + change->removedBlocks <= previousBlockCount;
+}
+
+#endif // BLOCKCHANGE_H
@@ -0,0 +1,286 @@
+#include "diffview.h"
+#include "linediff.h"
+#include "blockchange.h"
+#include "perftrace.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QScrollBar>
+#include <QPainter>
+#include <QKeyEvent>
+#include <QFontDatabase>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+#include <utility>
+
+static const int diffDelay = 200;           // ms of quiet after an edit before diffing again
+static const int textMargin = 4;
+static const int tabWidth = 4;
+
+// One hash per block. The raw text separates blocks with U+2029, so the lines can be
+// hashed in parallel straight from it; documents with frames do not split that way
+// and are hashed a block at a time.
+static QVector<quint64> hashDocument(const QTextDocument *document)
+{
+    QVector<quint64> hashes = LineDiff::hashLines(document->toRawText(), QChar::ParagraphSeparator);
+    if (hashes.size() != document->blockCount()) {
+        hashes.clear();
+        hashes.reserve(document->blockCount());
+        for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+            hashes.append(LineDiff::hashLine(block.text()));
+        }
+    }
+    return hashes;
+}
+
+DiffView::DiffView(QTextEdit *left, QTextEdit *right, QWidget *parent)
+    : QAbstractScrollArea(parent), differences(0), generation(0), widestLine(0)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    const QFontMetrics metrics(font());
+    lineHeight = qMax(1, metrics.height());
+    charWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char(' ')));
+    setFocusPolicy(Qt::StrongFocus);
+
+    diffTimer = new QTimer(this);
+    diffTimer->setSingleShot(true);
+    diffTimer->setInterval(diffDelay);
+    connect(diffTimer, &QTimer::timeout, this, &DiffView::recompute);
+
+    attach(0, left);
+    attach(1, right);
+    recompute();
+}
+
+void DiffView::attach(int side, QTextEdit *editor)
+{
+    PERF_SCOPE("diff hash");
+    sides[side].editor = editor;
+    sides[side].hashes = hashDocument(editor->document());
+
+    connect(editor->document(), &QTextDocument::contentsChange, this, [this, side](int position, int, int charsAdded) {
+        onContentsChange(side, position, charsAdded);
+    });
+    connect(editor, &QObject::destroyed, this, [this, side] {
+        sides[side].hashes.clear();  // The tab was closed; its side shows as removed
+        diffTimer->start();
+    });
+}
+
+// Rehash the blocks touched by the edit and leave the rest alone
+void DiffView::onContentsChange(int side, int position, int charsAdded)
+{
+    if (!sides[side].editor) return;
+    const QTextDocument *document = sides[side].editor->document();
+    QVector<quint64> &hashes = sides[side].hashes;
+
+    BlockChange change;
+    if (!mapBlockChange(document, hashes.size(), position, charsAdded, &change)) {
+        hashes = hashDocument(document);
+        diffTimer->start();
+        return;
+    }
+
+    QVector<quint64> updated;
+    updated.reserve(change.addedBlocks);
+    QTextBlock block = document->findBlockByNumber(change.first);
+    for (int i = 0; i < change.addedBlocks && block.isValid(); ++i, block = block.next()) {
+        updated.append(LineDiff::hashLine(block.text()));
+    }
+
+    // Same-sized ranges (typing within a line) are overwritten in place
+    const int common = qMin(change.removedBlocks, int(updated.size()));
+    for (int i = 0; i < common; ++i) {
+        hashes[change.first + i] = updated[i];
+    }
+    if (change.removedBlocks > common) {
+        hashes.remove(change.first + common, change.removedBlocks - common);
+    } else if (updated.size() > common) {
+        hashes.insert(change.first + common, updated.size() - common, quint64(0));
+        for (int i = common; i < updated.size(); ++i) {
+            hashes[change.first + i] = updated[i];
+        }
+    }
+    diffTimer->start();
+}
+
+// Diff the hashes on a worker thread and lay the result out as rows
+void DiffView::recompute()
+{
+    diffTimer->stop();
+    const quint64 diffGeneration = ++generation;
+    const QVector<quint64> left = sides[0].hashes;
+    const QVector<quint64> right = sides[1].hashes;
+
+    using Result = std::pair<QVector<Row>, int>;
+    QFutureWatcher<Result> *watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcher<Result>::finished, this, [this, watcher, diffGeneration] {
+        watcher->deleteLater();
+        if (diffGeneration != generation) return;  // Edited again meanwhile; a newer diff is coming
+
+        const Result result = watcher->result();
+        rows = result.first;
+        differences = result.second;
+        updateScrollBars();
+        viewport()->update();
+        emit differencesChanged(differences);
+    });
+
+    watcher->setFuture(QtConcurrent::run([left, right] {
+        const QVector<LineDiff::Edit> edits = LineDiff::diff(left, right);
+
+        // Modified lines pair up in order; the rest of a region is removed or added lines
+        QVector<Row> laidOut;
+        laidOut.reserve(qMax(left.size(), right.size()));
+        int i = 0, j = 0;
+        for (const LineDiff::Edit &edit : edits) {
+            while (i < edit.oldStart) laidOut.append({i++, j++, Equal});
+            const int paired = qMin(edit.oldCount, edit.newCount);
+            for (int k = 0; k < paired; ++k) laidOut.append({i++, j++, Changed});
+            for (int k = paired; k < edit.oldCount; ++k) laidOut.append({i++, -1, Removed});
+            for (int k = paired; k < edit.newCount; ++k) laidOut.append({-1, j++, Added});
+        }
+        while (i < left.size()) laidOut.append({i++, j++, Equal});
+        return Result(laidOut, int(edits.size()));
+    }));
+}
+
+QString DiffView::lineText(int side, int line) const
+{
+    const QTextEdit *editor = sides[side].editor;
+    if (!editor || line < 0) return QString();
+    QString text = editor->document()->findBlockByNumber(line).text();  // Empty for lines gone since the diff
+    return text.replace(QLatin1Char('\t'), QString(tabWidth, QLatin1Char(' ')));
+}
+
+void DiffView::paintEvent(QPaintEvent *)
+{
+    PERF_SCOPE("diff paint");
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().base());
+    painter.setFont(font());
+
+    const int widest = widestLine;
+    const int half = viewport()->width() / 2;
+    paintPane(painter, 0, 0, half);
+    paintPane(painter, 1, half + 1, viewport()->width() - half - 1);
+    painter.fillRect(half, 0, 1, viewport()->height(), palette().mid());
+
+    // Lines are only measured when painted, so the horizontal range grows as wider lines come into view
+    if (widestLine != widest) QTimer::singleShot(0, this, &DiffView::updateScrollBars);
+}
+
+void DiffView::paintPane(QPainter &painter, int side, int x, int width)
+{
+    painter.save();
+    painter.setClipRect(x, 0, width, viewport()->height());
+
+    const int ascent = QFontMetrics(font()).ascent();
+    const int gutter = (int(QString::number(sides[side].hashes.size()).size()) + 1) * charWidth;
+    const int textX = x + gutter + textMargin - horizontalScrollBar()->value();
+    const int firstColumn = horizontalScrollBar()->value() / charWidth;
+    const int columns = width / charWidth + 2;
+
+    // Tints rather than colors, so they read on light and dark palettes alike
+    const QColor removedColor(255, 0, 0, 40);
+    const QColor addedColor(0, 200, 0, 40);
+    const QColor changedColor(255, 200, 0, 45);
+    const QColor changedTextColor = side == 0 ? QColor(255, 0, 0, 80) : QColor(0, 200, 0, 80);
+    const QBrush fillerBrush(palette().color(QPalette::Mid), Qt::BDiagPattern);
+
+    const int first = verticalScrollBar()->value();
+    const int count = visibleRows() + 1;
+    for (int r = 0; r < count && first + r < rows.size(); ++r) {
+        const Row &row = rows[first + r];
+        const int line = side == 0 ? row.left : row.right;
+        const int y = r * lineHeight;
+        if (line < 0) {
+            painter.fillRect(x, y, width, lineHeight, fillerBrush);
+            continue;
+        }
+
+        if (row.kind == Removed || row.kind == Added) {
+            painter.fillRect(x, y, width, lineHeight, row.kind == Removed ? removedColor : addedColor);
+        } else if (row.kind == Changed) {
+            painter.fillRect(x, y, width, lineHeight, changedColor);
+        }
+
+        const QString text = lineText(side, line);
+        if (row.kind == Changed) {
+            // The changed part of the line: what is left after the start and end both sides share
+            const QString other = lineText(1 - side, side == 0 ? row.right : row.left);
+            int prefix = 0;
+            while (prefix < text.size() && prefix < other.size() && text[prefix] == other[prefix]) ++prefix;
+            int suffix = 0;
+            while (suffix < text.size() - prefix && suffix < other.size() - prefix
+                   && text[text.size() - 1 - suffix] == other[other.size() - 1 - suffix]) {
+                ++suffix;
+            }
+            const int length = int(text.size()) - prefix - suffix;
+            if (length > 0) painter.fillRect(textX + prefix * charWidth, y, length * charWidth, lineHeight, changedTextColor);
+        }
+
+        // Only the columns in view are drawn, so a huge line costs no more than a short one
+        painter.setPen(palette().text().color());
+        painter.drawText(textX + firstColumn * charWidth, y + ascent, text.mid(firstColumn, columns));
+        widestLine = qMax(widestLine, int(text.size()));
+
+        painter.fillRect(x, y, gutter, lineHeight, palette().window());
+        painter.setPen(palette().placeholderText().color());
+        painter.drawText(QRect(x, y, gutter - charWidth / 2, lineHeight), Qt::AlignRight | Qt::AlignVCenter, QString::number(line + 1));
+    }
+    painter.restore();
+}
+
+void DiffView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void DiffView::scrollContentsBy(int, int)
+{
+    viewport()->update();
+}
+
+// F7 and Shift+F7 scroll to the next and previous difference
+void DiffView::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_F7) {
+        jumpToDifference(event->modifiers() & Qt::ShiftModifier ? -1 : 1);
+        return;
+    }
+    QAbstractScrollArea::keyPressEvent(event);
+}
+
+// Scroll the first row of the next (or previous) run of differing rows a third of the way down
+void DiffView::jumpToDifference(int direction)
+{
+    const int anchor = verticalScrollBar()->value() + visibleRows() / 3;
+    for (int row = anchor + direction; row >= 0 && row < rows.size(); row += direction) {
+        const bool starts = rows[row].kind != Equal && (row == 0 || rows[row - 1].kind == Equal);
+        if (starts) {
+            verticalScrollBar()->setValue(row - visibleRows() / 3);
+            return;
+        }
+    }
+}
+
+int DiffView::visibleRows() const
+{
+    return viewport()->height() / lineHeight;
+}
+
+void DiffView::updateScrollBars()
+{
+    verticalScrollBar()->setRange(0, qMax(0, int(rows.size()) - visibleRows()));
+    verticalScrollBar()->setPageStep(qMax(1, visibleRows()));
+    verticalScrollBar()->setSingleStep(1);
+
+    const int digits = int(QString::number(qMax(sides[0].hashes.size(), sides[1].hashes.size())).size());
+    const int paneText = viewport()->width() / 2 - (digits + 1) * charWidth - 2 * textMargin;
+    horizontalScrollBar()->setRange(0, qMax(0, widestLine * charWidth - paneText));
+    horizontalScrollBar()->setPageStep(qMax(1, paneText));
+    horizontalScrollBar()->setSingleStep(charWidth);
+}
@@ -0,0 +1,79 @@
+#ifndef DIFFVIEW_H
+#define DIFFVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QPointer>
+#include <QVector>
+
+class QTextEdit;
+class QTimer;
+
+// Two editors side by side, aligned line by line, with the lines that differ
+// marked and the changed part of each modified line picked out. Both panes
+// scroll together, being one scroll area.
+// Each side keeps a hash per block, hashed in parallel when the view opens and
+// then rehashed only for the blocks an edit touches; once edits pause, the
+// hashes are diffed on a worker thread (see LineDiff) and the rows are swapped
+// in. Text is read from the editors only for the rows being painted.
+class DiffView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    DiffView(QTextEdit *left, QTextEdit *right, QWidget *parent = nullptr);
+
+    int differenceCount() const { return differences; }
+
+signals:
+    void differencesChanged(int count);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private slots:
+    void recompute();
+
+private:
+    enum RowKind : quint8 {
+        Equal,
+        Changed,                    // Both sides have a line, and they differ
+        Removed,                    // Only the left side has a line
+        Added
+    };
+
+    struct Row
+    {
+        int left;                   // Block number, -1 for a filler row
+        int right;
+        RowKind kind;
+    };
+
+    struct Side
+    {
+        QPointer<QTextEdit> editor;
+        QVector<quint64> hashes;    // One per block
+    };
+
+    void attach(int side, QTextEdit *editor);
+    void onContentsChange(int side, int position, int charsAdded);
+    QString lineText(int side, int line) const;
+    void paintPane(QPainter &painter, int side, int x, int width);
+    void jumpToDifference(int direction);
+    int visibleRows() const;
+    void updateScrollBars();
+
+    Side sides[2];
+    QVector<Row> rows;
+    int differences;
+    QTimer *diffTimer;
+    quint64 generation;             // Results of an older diff are dropped
+
+    int lineHeight;
+    int charWidth;
+    int widestLine;                 // In characters, of the lines painted so far
+};
+
+#endif // DIFFVIEW_H
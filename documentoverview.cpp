@@ -0,0 +1,121 @@
+#include "documentoverview.h"
+#include "blockchange.h"
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextLayout>
+
+DocumentOverview::DocumentOverview(QTextDocument *document) : QObject(document), document(document)
+{
+    connect(document, &QTextDocument::contentsChange, this, &DocumentOverview::onContentsChange);
+    summarizeAll();
+}
+
+DocumentOverview *DocumentOverview::forDocument(QTextDocument *document)
+{
+    return document ? document->findChild<DocumentOverview *>(QString(), Qt::FindDirectChildrenOnly) : nullptr;
+}
+
+DocumentOverview::BlockSummary DocumentOverview::summarize(const QTextBlock &block)
+{
+    BlockSummary summary = {0, 0, 0};
+
+    const QString text = block.text();
+    int visible = 0;
+    for (const QChar c : text) {
+        if (!c.isSpace() && ++visible == 255) break;
+    }
+    summary.density = quint8(visible);
+
+    if (block.blockFormat().headingLevel() > 0 || text.startsWith(QLatin1String("# ")) || text.startsWith(QLatin1String("##"))) {
+        summary.marks |= Structure;
+    }
+
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QBrush background = it.fragment().charFormat().background();
+        if (background.style() != Qt::NoBrush) {
+            summary.marks |= Highlighted;
+            summary.highlight = background.color().rgb();
+            break;
+        }
+    }
+
+    // The underlines are highlighter formats in the layout, not part of the text's formats
+    if (const QTextLayout *layout = block.layout()) {
+        for (const QTextLayout::FormatRange &range : layout->formats()) {
+            if (range.format.underlineStyle() == QTextCharFormat::SpellCheckUnderline) {
+                summary.marks |= Misspelled;
+                break;
+            }
+        }
+    }
+    return summary;
+}
+
+void DocumentOverview::summarizeAll()
+{
+    summaries.clear();
+    summaries.reserve(document->blockCount());
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        summaries.append(summarize(block));
+    }
+    emit reset();
+}
+
+void DocumentOverview::setSearchHits(const QVector<int> &blocks)
+{
+    if (blocks == hitBlocks) return;
+    hitBlocks = blocks;
+    emit reset();
+}
+
+// Formats changed without an edit; only tell the view when the summary did too
+void DocumentOverview::refreshBlock(const QTextBlock &block)
+{
+    const int number = block.blockNumber();
+    if (number < 0 || number >= summaries.size()) return;
+
+    const BlockSummary summary = summarize(block);
+    BlockSummary &current = summaries[number];
+    if (summary.density == current.density && summary.marks == current.marks && summary.highlight == current.highlight) return;
+    current = summary;
+    emit blocksChanged(number, 1);
+}
+
+// Replace the summaries of the blocks touched by the edit and leave the rest alone
+void DocumentOverview::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    BlockChange change;
+    if (!mapBlockChange(document, summaries.size(), position, charsAdded, &change)) {
+        summarizeAll();
+        return;
+    }
+
+    QVector<BlockSummary> updated;
+    updated.reserve(change.addedBlocks);
+    QTextBlock block = document->findBlockByNumber(change.first);
+    for (int i = 0; i < change.addedBlocks && block.isValid(); ++i, block = block.next()) {
+        updated.append(summarize(block));
+    }
+
+    // Same-sized ranges (typing within a line, formatting) are overwritten in place
+    const int common = qMin(change.removedBlocks, int(updated.size()));
+    for (int i = 0; i < common; ++i) {
+        summaries[change.first + i] = updated[i];
+    }
+    if (change.removedBlocks > common) {
+        summaries.remove(change.first + common, change.removedBlocks - common);
+    } else if (updated.size() > common) {
+        summaries.insert(change.first + common, updated.size() - common, BlockSummary());
+        for (int i = common; i < updated.size(); ++i) {
+            summaries[change.first + i] = updated[i];
+        }
+    }
+
+    if (change.removedBlocks == updated.size()) {
+        emit blocksChanged(change.first, int(updated.size()));
+    } else {
+        emit reset();
+    }
+}
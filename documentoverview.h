@@ -0,0 +1,60 @@
+#ifndef DOCUMENTOVERVIEW_H
+#define DOCUMENTOVERVIEW_H
+
+#include <QObject>
+#include <QVector>
+#include <QRgb>
+
+class QTextDocument;
+class QTextBlock;
+
+// What an overview ruler needs to know about each block of a document, a few
+// bytes per block. Kept like WordCounter's counts: an edit re-summarizes only
+// the blocks it touched. Formats that change without an edit (spelling
+// underlines arriving from the worker threads) are reported through
+// refreshBlock(). The overview is a child of its document.
+class DocumentOverview : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mark {
+        Structure = 0x1,            // A heading
+        Misspelled = 0x2,
+        Highlighted = 0x4           // Has a background color, see MainWindow::highlightTextWithColor
+    };
+
+    struct BlockSummary
+    {
+        quint8 density;             // Non-space characters, capped at 255
+        quint8 marks;
+        QRgb highlight;             // First background color in the block, when Highlighted
+    };
+
+    explicit DocumentOverview(QTextDocument *document);
+
+    static DocumentOverview *forDocument(QTextDocument *document);
+
+    const QVector<BlockSummary> &blocks() const { return summaries; }
+    const QVector<int> &searchHits() const { return hitBlocks; }   // Sorted block numbers
+
+    void setSearchHits(const QVector<int> &blocks);
+    void refreshBlock(const QTextBlock &block);
+
+signals:
+    void blocksChanged(int first, int count);   // The block count is unchanged
+    void reset();                               // Blocks came or went, or the search hits changed
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    void summarizeAll();
+    static BlockSummary summarize(const QTextBlock &block);
+
+    QTextDocument *document;
+    QVector<BlockSummary> summaries;   // One entry per QTextBlock, in document order
+    QVector<int> hitBlocks;
+};
+
+#endif // DOCUMENTOVERVIEW_H
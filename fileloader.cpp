@@ -0,0 +1,98 @@
+#include "fileloader.h"
+#include "perftrace.h"
+#include <QFile>
+#include <QThread>
+#include <cstring>
+
+static const qint64 chunkSize = 4 * 1024 * 1024;      // Bytes decoded per chunk
+static const qint64 maxLineExtension = 64 * 1024;     // How far a chunk may grow to end on a line break
+static const int chunksInFlight = 4;                  // Chunks decoded ahead of the GUI
+
+FileLoader::FileLoader(const QString &fileName, QObject *parent)
+    : QObject(parent), filePath(fileName), decodingErrors(false), thread(nullptr), freeSlots(chunksInFlight), canceled(false)
+{
+}
+
+FileLoader::~FileLoader()
+{
+    cancel();
+    if (thread) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+// Start decoding on a worker thread
+void FileLoader::start()
+{
+    if (thread) return;
+    thread = QThread::create([this] { run(); });
+    thread->start();
+}
+
+// The GUI has inserted a chunk: the worker may decode another one
+void FileLoader::chunkConsumed()
+{
+    freeSlots.release();
+}
+
+// Stop the worker at the next chunk boundary
+void FileLoader::cancel()
+{
+    if (canceled.exchange(true)) return;
+    freeSlots.release(chunksInFlight);  // Wake the worker if it is waiting for the GUI
+}
+
+// Worker thread: map the file and decode it chunk by chunk
+void FileLoader::run()
+{
+    PERF_SCOPE("load file");
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit finished(false, file.errorString());
+        return;
+    }
+
+    const qint64 size = file.size();
+    const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if (size > 0 && !data) {
+        emit finished(false, file.errorString());
+        return;
+    }
+
+    detectedEncoding = TextCodec::detect(QByteArrayView(data, size));
+    const TextCodec::Charset charset = detectedEncoding.charset;
+    const bool byteLines = charset == TextCodec::Utf8 || charset == TextCodec::Latin1 || charset == TextCodec::Windows1252;
+
+    // The decoder is stateful, so a multi-byte sequence split across two chunks still decodes correctly
+    TextCodec::Decoder decoder(charset);
+    qint64 offset = TextCodec::bomSize(detectedEncoding);
+
+    while (offset < size) {
+        freeSlots.acquire();
+        if (canceled) break;
+
+        qint64 end = qMin(offset + chunkSize, size);
+
+        // End each chunk on a line break so every insert appends whole blocks; in
+        // UTF-16/32 a 0x0A byte need not be one, so those chunks end anywhere
+        if (end < size && byteLines) {
+            const void *lineBreak = std::memchr(data + end, '\n', size_t(qMin(size - end, maxLineExtension)));
+            if (lineBreak) end = static_cast<const uchar *>(lineBreak) - data + 1;
+        }
+
+        QString text = decoder.decode(QByteArrayView(data + offset, end - offset));
+        offset = end;
+
+        emit chunkReady(text);
+        emit progressChanged(offset, size);
+    }
+
+    if (data) file.unmap(const_cast<uchar *>(data));
+    file.close();
+
+    // Only if the file changed while it was read, or is broken UTF-16/32
+    decodingErrors = decoder.hasError();
+
+    emit finished(!canceled, QString());
+}
@@ -0,0 +1,51 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QSemaphore>
+#include <atomic>
+#include "textcodec.h"
+
+class QThread;
+
+// Streams a file into an editor without blocking the GUI thread.
+// The file is memory-mapped, its encoding detected from the whole file (a
+// UTF-8 check runs at memory speed, and a file that is ASCII for its first
+// megabytes can still be Latin-1 further on), and it is decoded chunk by
+// chunk on a worker thread;
+// every decoded chunk is handed back through chunkReady(). The worker stays
+// at most a few chunks ahead of the GUI so memory use does not depend on the file size.
+class FileLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileLoader(const QString &fileName, QObject *parent = nullptr);
+    ~FileLoader();
+
+    void start();
+    void chunkConsumed();   // Called by the GUI once a chunk has been inserted
+    TextCodec::Encoding encoding() const { return detectedEncoding; }   // Known once the first chunk is ready
+    bool hasDecodingErrors() const { return decodingErrors; }           // Some bytes became U+FFFD; known once finished
+
+public slots:
+    void cancel();
+
+signals:
+    void chunkReady(const QString &text);
+    void progressChanged(qint64 bytesDone, qint64 bytesTotal);
+    void finished(bool completed, const QString &errorString);
+
+private:
+    void run();
+
+    QString filePath;
+    TextCodec::Encoding detectedEncoding;
+    bool decodingErrors;
+    QThread *thread;
+    QSemaphore freeSlots;       // Number of chunks the worker may decode ahead of the GUI
+    std::atomic_bool canceled;
+};
+
+#endif // FILELOADER_H
@@ -0,0 +1,160 @@
+#include "filesaver.h"
+#include "perftrace.h"
+#include <QSaveFile>
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QFileInfo>
+#include <QTextDocument>
+
+static const qsizetype chunkSize = 1024 * 1024;   // Characters encoded per write
+
+// Held from the last cancellation check through the rename, so two saves of one
+// file never commit at the same time and cancel() cannot slip in between
+static QMutex commitMutex;
+static quint64 lastSequence = 0;                   // Guarded by commitMutex
+static QHash<QString, quint64> committedSequence;  // Newest save committed to each file; guarded by commitMutex
+
+FileSaver::FileSaver(const QString &fileName, const QString &text, const TextCodec::Encoding &encoding, QObject *parent)
+    : QObject(parent), filePath(fileName), text(text), encoding(encoding), rich(false), sequence(0), thread(nullptr), canceled(false)
+{
+}
+
+FileSaver::FileSaver(const QString &fileName, const RichDocument::Content &content, QObject *parent)
+    : QObject(parent), filePath(fileName), rich(true), content(content), sequence(0), thread(nullptr), canceled(false)
+{
+}
+
+// Only the snapshot is taken here; encoding happens on the worker
+FileSaver *FileSaver::create(const QString &fileName, const QTextDocument *document, QObject *parent)
+{
+    if (RichDocument::isRichFileName(fileName)) return new FileSaver(fileName, RichDocument::capture(document), parent);
+    return new FileSaver(fileName, document->toPlainText(), TextCodec::documentEncoding(document), parent);
+}
+
+// A save that is still running is finished rather than abandoned
+FileSaver::~FileSaver()
+{
+    if (thread) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+// Start writing on a worker thread
+void FileSaver::start()
+{
+    if (thread) return;
+    {
+        QMutexLocker locker(&commitMutex);
+        sequence = ++lastSequence;
+    }
+    thread = QThread::create([this] { run(); });
+    thread->start();
+}
+
+// Same steps and ordering as start(), but without a worker or an event loop to wait in
+bool FileSaver::save(QString *errorString)
+{
+    if (thread) return false;
+    {
+        QMutexLocker locker(&commitMutex);
+        sequence = ++lastSequence;
+    }
+    bool completed = false;
+    const QMetaObject::Connection connection = connect(this, &FileSaver::finished, this, [&](bool ok, const QString &error) {
+        completed = ok;
+        if (errorString) *errorString = error;
+    }, Qt::DirectConnection);
+    run();
+    disconnect(connection);
+    return completed;
+}
+
+// Stop the worker at the next chunk boundary; once it is committing, the save completes
+void FileSaver::cancel()
+{
+    canceled = true;
+}
+
+// Worker thread: encode and write the snapshot, then commit it over the target
+void FileSaver::run()
+{
+    PERF_SCOPE("save file");
+    QSaveFile file(filePath);
+    // Text mode would turn the 0x0A bytes of UTF-16/32 into line breaks of their own
+    const TextCodec::Charset charset = encoding.charset;
+    const bool byteText = !rich && (charset == TextCodec::Utf8 || charset == TextCodec::Latin1 || charset == TextCodec::Windows1252);
+    if (!file.open(byteText ? QIODevice::WriteOnly | QIODevice::Text : QIODevice::WriteOnly)) {
+        emit finished(false, file.errorString());
+        return;
+    }
+
+    if (rich) {
+        // Encoded whole (the format tables precede the text), then written in chunks
+        const QByteArray data = RichDocument::encode(content);
+        const qsizetype size = data.size();
+        for (qsizetype offset = 0; offset < size; ) {
+            if (canceled) break;
+
+            const qsizetype length = qMin(chunkSize, size - offset);
+            if (file.write(data.constData() + offset, length) != length) {
+                const QString errorString = file.errorString();
+                file.cancelWriting();
+                emit finished(false, errorString);
+                return;
+            }
+            offset += length;
+            emit progressChanged(offset, size);
+        }
+    } else {
+        const QByteArray bom = encoding.bom ? TextCodec::byteOrderMark(charset) : QByteArray();
+        if (file.write(bom) != bom.size()) {
+            const QString errorString = file.errorString();
+            file.cancelWriting();
+            emit finished(false, errorString);
+            return;
+        }
+
+        // The encoder is stateful, so a surrogate pair split across two chunks still encodes correctly
+        TextCodec::Encoder encoder(charset);
+        const qsizetype size = text.size();
+        qsizetype offset = 0;
+
+        while (offset < size) {
+            if (canceled) break;
+
+            const qsizetype length = qMin(chunkSize, size - offset);
+            const QByteArray bytes = encoder.encode(QStringView(text).mid(offset, length));
+            if (file.write(bytes) != bytes.size()) {
+                const QString errorString = file.errorString();
+                file.cancelWriting();
+                emit finished(false, errorString);
+                return;
+            }
+            offset += length;
+            emit progressChanged(offset, size);
+        }
+    }
+
+    // A save started later that has already committed holds newer text, which this one must not replace
+    const QString key = QFileInfo(filePath).absoluteFilePath();
+    QMutexLocker locker(&commitMutex);
+    if (canceled || committedSequence.value(key) > sequence) {
+        file.cancelWriting();
+        locker.unlock();
+        emit finished(false, QString());
+        return;
+    }
+
+    // commit() syncs the temporary file to disk and renames it over the target
+    if (!file.commit()) {
+        const QString errorString = file.errorString();
+        locker.unlock();
+        emit finished(false, errorString);
+        return;
+    }
+    committedSequence[key] = sequence;
+    locker.unlock();
+    emit finished(true, QString());
+}
@@ -0,0 +1,59 @@
+#ifndef FILESAVER_H
+#define FILESAVER_H
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+#include "richdocument.h"
+#include "textcodec.h"
+
+class QThread;
+class QTextDocument;
+
+// Saves a snapshot of a document's text without blocking the GUI thread.
+// The text is encoded (in the file's original encoding) and written chunk by chunk on a worker thread into a
+// temporary file next to the target, which is synced to disk and then renamed
+// over the target, so a crash mid-save leaves the old file intact. Saves of
+// one file commit in the order they were started: one that finishes after a
+// later save has committed is dropped rather than put back over it. Native
+// documents (*.ntd) are encoded with RichDocument on the worker instead.
+// save() runs the same steps on the calling thread, for a caller that cannot
+// go on before the file is written.
+class FileSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileSaver(const QString &fileName, const QString &text, const TextCodec::Encoding &encoding = TextCodec::Encoding(),
+              QObject *parent = nullptr);
+    FileSaver(const QString &fileName, const RichDocument::Content &content, QObject *parent = nullptr);
+    ~FileSaver();
+
+    // A saver for document in the format its file name asks for, and in the encoding it was read in
+    static FileSaver *create(const QString &fileName, const QTextDocument *document, QObject *parent = nullptr);
+
+    void start();
+    bool save(QString *errorString = nullptr);   // Save on the calling thread instead, returning once it is done
+    QString fileName() const { return filePath; }
+
+public slots:
+    void cancel();   // Abandon the save, leaving the target untouched, unless it is already being committed
+
+signals:
+    void progressChanged(qint64 charactersDone, qint64 charactersTotal);   // Bytes for native documents
+    void finished(bool completed, const QString &errorString);
+
+private:
+    void run();
+
+    QString filePath;
+    QString text;               // Implicitly shared snapshot, never modified
+    TextCodec::Encoding encoding;
+    bool rich;
+    RichDocument::Content content;
+    quint64 sequence;           // Order in which saves were started
+    QThread *thread;
+    std::atomic_bool canceled;
+};
+
+#endif // FILESAVER_H
@@ -0,0 +1,300 @@
+#include "filesearch.h"
+#include "perftrace.h"
+#include "textsearch.h"
+#include "simd.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QSet>
+#include <QtAlgorithms>
+#include <QThread>
+#include <cstring>
+
+static const qint64 chunkSize = 32 * 1024 * 1024;    // Files larger than this are split between workers
+static const qint64 binaryProbeSize = 8192;          // A NUL byte in this many leading bytes marks a binary file
+static const int maxHits = 10000;                    // The search stops once this many lines have matched
+static const int maxPreviewLength = 300;
+
+struct FileSearch::Chunk
+{
+    int job;
+    int indexInFile;
+};
+
+// Hits of a split file wait here until every chunk is done, because a chunk's
+// first line number is only known once the chunks before it have counted theirs
+struct FileSearch::FileJob
+{
+    QString filePath;
+    int tab = -1;
+    int chunkCount = 1;
+
+    QMutex mutex;
+    int remaining = 1;
+    QVector<qint64> chunkLines;
+    QVector<QVector<SearchHit>> chunkHits;
+};
+
+static qint64 countNewlines(const char *data, qsizetype length)
+{
+    qint64 count = 0;
+    qsizetype i = 0;
+#ifdef NOTEPAD_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= length; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        count += qPopulationCount(unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline))));
+    }
+#endif
+    for (; i < length; ++i) {
+        if (data[i] == '\n') ++count;
+    }
+    return count;
+}
+
+// Chunks start right after the first line break at or past their nominal offset, so
+// neighbouring chunks agree on the boundary and no line is split between two of them
+static qint64 lineBoundary(const char *data, qint64 size, qint64 offset)
+{
+    if (offset <= 0) return 0;
+    if (offset >= size) return size;
+    const void *lineBreak = std::memchr(data + offset - 1, '\n', size_t(size - offset + 1));
+    return lineBreak ? static_cast<const char *>(lineBreak) - data + 1 : size;
+}
+
+FileSearch::FileSearch(QObject *parent)
+    : QObject(parent), nextChunk(0), hitCount(0), canceled(false), thread(nullptr)
+{
+}
+
+FileSearch::~FileSearch()
+{
+    cancel();
+    if (thread) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void FileSearch::start(const Query &searchQuery, const QVector<OpenTab> &openTabs, const QStringList &filePaths,
+                       const QString &directoryPath, const QStringList &filters)
+{
+    if (thread) return;
+    query = searchQuery;
+    tabs = openTabs;
+    files = filePaths;
+    directory = directoryPath;
+    nameFilters = filters;
+
+    // Decide what the byte kernel scans for and whether a hit still needs the expression
+    const Qt::CaseSensitivity cs = query.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    bool ascii = true;
+    for (QChar c : std::as_const(query.text)) ascii = ascii && c.unicode() < 0x80;
+
+    if (!query.regularExpression && (query.caseSensitive || ascii)) {
+        literal = query.text.toUtf8();
+        literalIsExact = true;
+        literalLength = int(query.text.size());
+    } else {
+        // Case-insensitive non-ASCII text goes through an escaped expression: the byte kernel only folds ASCII
+        pattern = query.regularExpression ? query.text : QRegularExpression::escape(query.text);
+        const QString required = query.regularExpression ? TextSearch::requiredLiteral(query.text) : QString();
+        bool requiredAscii = true;
+        for (QChar c : required) requiredAscii = requiredAscii && c.unicode() < 0x80;
+        if (cs == Qt::CaseSensitive || requiredAscii) literal = required.toUtf8();
+    }
+
+    thread = QThread::create([this] { run(); });
+    thread->start();
+}
+
+void FileSearch::cancel()
+{
+    canceled = true;
+}
+
+// Coordinator thread: list the work, then search it with one worker per core
+void FileSearch::run()
+{
+    QSet<QString> seen;   // Files already covered, by absolute path
+    for (int i = 0; i < tabs.size(); ++i) {
+        std::unique_ptr<FileJob> job = std::make_unique<FileJob>();
+        job->filePath = tabs[i].filePath;
+        job->tab = i;
+        if (!job->filePath.isEmpty()) seen.insert(QFileInfo(job->filePath).absoluteFilePath());
+        chunks.append({int(jobs.size()), 0});
+        jobs.push_back(std::move(job));
+    }
+
+    auto addFile = [&](const QFileInfo &info) {
+        const QString path = info.absoluteFilePath();
+        if (seen.contains(path) || info.size() == 0) return;
+        seen.insert(path);
+
+        std::unique_ptr<FileJob> job = std::make_unique<FileJob>();
+        job->filePath = path;
+        job->chunkCount = int((info.size() + chunkSize - 1) / chunkSize);
+        job->remaining = job->chunkCount;
+        job->chunkLines.resize(job->chunkCount);
+        job->chunkHits.resize(job->chunkCount);
+        for (int k = 0; k < job->chunkCount; ++k) chunks.append({int(jobs.size()), k});
+        jobs.push_back(std::move(job));
+    };
+
+    for (const QString &file : std::as_const(files)) {
+        const QFileInfo info(file);
+        if (info.isFile()) addFile(info);
+    }
+    if (!directory.isEmpty()) {
+        QDirIterator it(directory, nameFilters, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext() && !canceled) {
+            it.next();
+            addFile(it.fileInfo());
+        }
+    }
+
+    QVector<QThread *> helpers;
+    const int workers = qMin(QThread::idealThreadCount(), int(chunks.size()));
+    for (int i = 1; i < workers; ++i) {
+        QThread *helper = QThread::create([this] { work(); });
+        helper->start();
+        helpers.append(helper);
+    }
+    work();
+    for (QThread *helper : std::as_const(helpers)) {
+        helper->wait();
+        delete helper;
+    }
+
+    emit finished(int(jobs.size()), qMin(hitCount.load(), maxHits), !canceled);
+}
+
+// Worker: claim chunks until none are left
+void FileSearch::work()
+{
+    while (!canceled) {
+        const int chunk = nextChunk.fetch_add(1);
+        if (chunk >= chunks.size()) return;
+        searchChunk(chunk);
+    }
+}
+
+void FileSearch::searchChunk(int chunkIndex)
+{
+    PERF_SCOPE("find in files chunk");
+    const Chunk &chunk = chunks[chunkIndex];
+    FileJob &job = *jobs[chunk.job];
+    QVector<SearchHit> hits;
+    qint64 lines = 0;
+
+    if (job.tab >= 0) {
+        const OpenTab &tab = tabs[job.tab];
+        const QByteArray bytes = tab.readText ? tab.readText() : tab.text.toUtf8();
+        searchBytes(bytes.constData(), 0, bytes.size(), &hits, &lines);
+    } else {
+        QFile file(job.filePath);
+        const qint64 size = file.open(QIODevice::ReadOnly) ? file.size() : 0;
+        const char *data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : nullptr;
+        if (data && !std::memchr(data, '\0', size_t(qMin(size, binaryProbeSize)))) {
+            const qint64 begin = lineBoundary(data, size, chunk.indexInFile * chunkSize);
+            const qint64 end = chunk.indexInFile == job.chunkCount - 1
+                                   ? size   // The last chunk also takes whatever the file grew by
+                                   : lineBoundary(data, size, (chunk.indexInFile + 1) * chunkSize);
+            if (begin < end) searchBytes(data, begin, end, &hits, &lines);
+        }
+        if (data) file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+    }
+
+    for (SearchHit &hit : hits) {
+        hit.filePath = job.filePath;
+        hit.tab = job.tab;
+    }
+    if (hitCount.fetch_add(int(hits.size())) + hits.size() >= maxHits) canceled = true;
+    report(job, chunk.indexInFile, hits, lines);
+}
+
+// Scan [begin, end) line by line. Each line is reported at most once; hit.line counts
+// the line breaks before it inside this range, and *lines gets the range's total.
+void FileSearch::searchBytes(const char *data, qsizetype begin, qsizetype end, QVector<SearchHit> *hits, qint64 *lines) const
+{
+    const Qt::CaseSensitivity cs = query.caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    QRegularExpression expression;
+    if (!pattern.isEmpty()) {
+        // Built per call: every worker gets its own compiled expression
+        expression = QRegularExpression(pattern, query.caseSensitive ? QRegularExpression::NoPatternOption
+                                                                     : QRegularExpression::CaseInsensitiveOption);
+    }
+
+    qint64 line = 0;
+    qsizetype counted = begin;      // Line breaks before this offset are in `line`
+    qsizetype position = begin;
+
+    while (position < end && !canceled) {
+        qsizetype hit = position;
+        if (!literal.isEmpty()) {
+            const qsizetype found = TextSearch::indexOf(data + position, end - position, literal, cs);
+            if (found < 0) break;
+            hit = position + found;
+        }
+
+        qsizetype lineStart = hit;
+        while (lineStart > begin && data[lineStart - 1] != '\n') --lineStart;
+        const void *lineBreak = std::memchr(data + hit, '\n', size_t(end - hit));
+        const qsizetype lineEnd = lineBreak ? static_cast<const char *>(lineBreak) - data : end;
+        position = lineEnd + 1;
+
+        line += countNewlines(data + counted, lineStart - counted);
+        counted = lineStart;
+
+        const qsizetype textEnd = lineEnd > lineStart && data[lineEnd - 1] == '\r' ? lineEnd - 1 : lineEnd;
+        const QString text = QString::fromUtf8(data + lineStart, textEnd - lineStart);
+
+        SearchHit result;
+        result.line = line;
+        if (literalIsExact) {
+            result.column = int(QString::fromUtf8(data + lineStart, hit - lineStart).size());
+            result.length = literalLength;
+        } else {
+            const QRegularExpressionMatch match = expression.match(text);
+            if (!match.hasMatch()) continue;
+            result.column = int(match.capturedStart());
+            result.length = int(match.capturedLength());
+        }
+
+        const int previewStart = text.size() > maxPreviewLength ? qMax(0, result.column - maxPreviewLength / 3) : 0;
+        result.preview = text.mid(previewStart, maxPreviewLength);
+        hits->append(result);
+    }
+
+    *lines = line + countNewlines(data + counted, end - counted);
+}
+
+void FileSearch::report(FileJob &job, int chunkInFile, QVector<SearchHit> hits, qint64 lines)
+{
+    if (job.chunkCount == 1) {
+        for (SearchHit &hit : hits) ++hit.line;
+        if (!hits.isEmpty()) emit hitsFound(hits);
+        return;
+    }
+
+    QMutexLocker locker(&job.mutex);
+    job.chunkHits[chunkInFile] = hits;
+    job.chunkLines[chunkInFile] = lines;
+    if (--job.remaining > 0) return;
+
+    // The last chunk of the file is in: shift every chunk's lines by the breaks before it
+    QVector<SearchHit> all;
+    qint64 firstLine = 1;
+    for (int k = 0; k < job.chunkCount; ++k) {
+        for (SearchHit &hit : job.chunkHits[k]) {
+            hit.line += firstLine;
+            all.append(hit);
+        }
+        firstLine += job.chunkLines[k];
+    }
+    job.chunkHits.clear();
+    if (!all.isEmpty()) emit hitsFound(all);
+}
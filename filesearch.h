@@ -0,0 +1,100 @@
+#ifndef FILESEARCH_H
+#define FILESEARCH_H
+
+#include <QObject>
+#include <QMetaType>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class QThread;
+
+// One matching line
+struct SearchHit
+{
+    QString filePath;
+    int tab = -1;           // Index into the request's open tabs, or -1 for a file on disk
+    qint64 line = 0;        // 1-based
+    int column = 0;         // In characters
+    int length = 0;         // In characters
+    QString preview;        // The line, cut down around the match when it is long
+};
+Q_DECLARE_METATYPE(QVector<SearchHit>)
+
+// Grep-style search over open tabs and a directory tree.
+// A coordinator thread lists the files, splits large ones into line-aligned
+// chunks and starts one worker per core. The workers claim chunks through a
+// shared atomic counter, so a core that finishes early keeps taking work
+// until none is left. Files are memory-mapped and scanned with the SSE2
+// byte kernel from TextSearch; regular expressions are only run on the lines
+// that contain their required literal, when they have one. Hits are reported
+// per file through hitsFound() as soon as the file is done.
+class FileSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Query
+    {
+        QString text;
+        bool regularExpression = false;
+        bool caseSensitive = false;
+    };
+
+    struct OpenTab
+    {
+        QString filePath;       // Empty for untitled tabs
+        QString text;
+        std::function<QByteArray()> readText;   // When set, gives the UTF-8 text on a worker instead (tabs not in an editor)
+    };
+
+    explicit FileSearch(QObject *parent = nullptr);
+    ~FileSearch();
+
+    // Search the given tabs, the given files, and (when directory is not empty) every
+    // file below directory whose name matches nameFilters. Files open in a tab are
+    // searched through the tab only.
+    void start(const Query &query, const QVector<OpenTab> &tabs, const QStringList &files,
+               const QString &directory, const QStringList &nameFilters);
+
+public slots:
+    void cancel();
+
+signals:
+    void hitsFound(const QVector<SearchHit> &hits);
+    void finished(int filesSearched, int hitCount, bool complete);
+
+private:
+    struct Chunk;
+    struct FileJob;
+
+    void run();
+    void work();
+    void searchChunk(int chunkIndex);
+    void searchBytes(const char *data, qsizetype begin, qsizetype end, QVector<SearchHit> *hits, qint64 *lines) const;
+    void report(FileJob &job, int chunkInFile, QVector<SearchHit> hits, qint64 lines);
+
+    Query query;
+    QVector<OpenTab> tabs;
+    QStringList files;
+    QString directory;
+    QStringList nameFilters;
+
+    QByteArray literal;             // What the byte kernel looks for
+    QString pattern;                // Regular expression run on candidate lines; empty for literal searches
+    bool literalIsExact = false;    // A literal hit is a match without running the expression
+    int literalLength = 0;          // In characters
+
+    std::vector<std::unique_ptr<FileJob>> jobs;
+    QVector<Chunk> chunks;
+    std::atomic_int nextChunk;
+    std::atomic_int hitCount;
+    std::atomic_bool canceled;
+    QThread *thread;
+};
+
+#endif // FILESEARCH_H
@@ -0,0 +1,437 @@
+#include "findbar.h"
+#include "perftrace.h"
+#include "textsearch.h"
+#include "selectionlayers.h"
+#include "documentoverview.h"
+#include "largefileview.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QLabel>
+#include <QToolButton>
+#include <QHBoxLayout>
+#include <QScrollBar>
+#include <QTimer>
+#include <QKeyEvent>
+#include <QGuiApplication>
+#include <QStyle>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+
+static const int typingDelay = 150;          // ms of quiet in the query field before searching
+static const int editDelay = 400;            // ms of quiet in the document before refreshing matches
+static const int maxVisibleHighlights = 2000;
+static const qsizetype maxViewMatches = 1000000;  // Offsets kept for a large file; the count shows "+" past it
+
+namespace {
+struct SearchResult
+{
+    QVector<qsizetype> offsets;
+    QString foldedText;
+    bool truncated = false;
+};
+}
+
+FindBar::FindBar(QWidget *parent) : QWidget(parent)
+{
+    QHBoxLayout *layout = new QHBoxLayout(this);
+    layout->setContentsMargins(4, 2, 4, 2);
+
+    queryEdit = new QLineEdit(this);
+    queryEdit->setPlaceholderText(tr("Find"));
+    queryEdit->setClearButtonEnabled(true);
+
+    QToolButton *previousButton = new QToolButton(this);
+    previousButton->setArrowType(Qt::UpArrow);
+    previousButton->setToolTip(tr("Previous match (Shift+Enter)"));
+
+    QToolButton *nextButton = new QToolButton(this);
+    nextButton->setArrowType(Qt::DownArrow);
+    nextButton->setToolTip(tr("Next match (Enter)"));
+
+    caseCheck = new QCheckBox(tr("Match case"), this);
+    countLabel = new QLabel(this);
+
+    QToolButton *closeButton = new QToolButton(this);
+    closeButton->setIcon(style()->standardIcon(QStyle::SP_TitleBarCloseButton));
+    closeButton->setToolTip(tr("Close (Esc)"));
+    closeButton->setAutoRaise(true);
+
+    layout->addWidget(new QLabel(tr("Find:"), this));
+    layout->addWidget(queryEdit, 1);
+    layout->addWidget(previousButton);
+    layout->addWidget(nextButton);
+    layout->addWidget(caseCheck);
+    layout->addWidget(countLabel, 1);
+    layout->addWidget(closeButton);
+
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    connect(searchTimer, &QTimer::timeout, this, &FindBar::startSearch);
+
+    connect(queryEdit, &QLineEdit::textEdited, this, [this] {
+        jumpToResults = true;
+        searchTimer->start(typingDelay);
+    });
+    connect(caseCheck, &QCheckBox::toggled, this, [this] {
+        jumpToResults = true;
+        startSearch();
+    });
+    connect(queryEdit, &QLineEdit::returnPressed, this, [this] {
+        if (QGuiApplication::keyboardModifiers() & Qt::ShiftModifier) {
+            findPrevious();
+        } else {
+            findNext();
+        }
+    });
+    connect(previousButton, &QToolButton::clicked, this, &FindBar::findPrevious);
+    connect(nextButton, &QToolButton::clicked, this, &FindBar::findNext);
+    connect(closeButton, &QToolButton::clicked, this, &FindBar::closeBar);
+
+    hide();
+}
+
+// Follow the current tab's editor; a null editor disables the bar
+void FindBar::setEditor(QTextEdit *newEditor)
+{
+    if (editor == newEditor && !view) return;
+
+    detach();
+    editor = newEditor;
+
+    if (editor) {
+        connect(editor->document(), &QTextDocument::contentsChanged, this, &FindBar::onDocumentChanged);
+        connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &FindBar::refreshHighlights);
+        connect(editor->horizontalScrollBar(), &QScrollBar::valueChanged, this, &FindBar::refreshHighlights);
+        editor->viewport()->installEventFilter(this);
+        if (isVisible()) startSearch();
+    }
+}
+
+// Follow the current tab's large file view instead of an editor
+void FindBar::setLargeFileView(LargeFileView *newView)
+{
+    if (view == newView && !editor) return;
+
+    detach();
+    view = newView;
+
+    if (view) {
+        connect(view, &LargeFileView::contentsChanged, this, &FindBar::onDocumentChanged);
+        if (isVisible()) startSearch();
+    }
+}
+
+// Drop the highlights, connections and results of the editor or view searched so far
+void FindBar::detach()
+{
+    if (cancelFlag) *cancelFlag = true;
+    ++generation;  // Offsets found in the old text mean nothing in the new one
+    if (editor) {
+        SelectionLayers::of(editor)->clear(SelectionLayers::FindMatches);
+        if (DocumentOverview *overview = DocumentOverview::forDocument(editor->document())) overview->setSearchHits({});
+        disconnect(editor->document(), nullptr, this, nullptr);
+        disconnect(editor->verticalScrollBar(), nullptr, this, nullptr);
+        disconnect(editor->horizontalScrollBar(), nullptr, this, nullptr);
+        editor->viewport()->removeEventFilter(this);
+    }
+    if (view) disconnect(view, nullptr, this, nullptr);
+
+    editor = nullptr;
+    view = nullptr;
+    snapshot.clear();
+    foldedSnapshot.clear();
+    snapshotValid = false;
+    setResults({}, 0);
+}
+
+void FindBar::activate(const QString &text)
+{
+    if (!text.isEmpty()) queryEdit->setText(text);
+    show();
+    queryEdit->setFocus();
+    queryEdit->selectAll();
+    jumpToResults = true;
+    startSearch();
+}
+
+// Search the whole snapshot on a worker thread; the GUI thread only copies the text
+// when the document changed since the last search
+void FindBar::startSearch()
+{
+    PERF_SCOPE("find snapshot");
+    searchTimer->stop();
+    if (cancelFlag) *cancelFlag = true;
+    ++generation;
+
+    const QString query = queryEdit->text();
+    if ((!editor && !view) || query.isEmpty()) {
+        setResults({}, 0);
+        return;
+    }
+    if (view) {
+        startViewSearch(query);
+        return;
+    }
+
+    if (!snapshotValid) {
+        snapshot = editor->toPlainText();
+        foldedSnapshot.clear();
+        snapshotValid = true;
+    }
+
+    const bool caseSensitive = caseCheck->isChecked();
+    const quint64 searchGeneration = generation;
+    const QString text = snapshot;
+    const QString folded = foldedSnapshot;
+    cancelFlag = std::make_shared<std::atomic_bool>(false);
+    std::shared_ptr<std::atomic_bool> cancel = cancelFlag;
+
+    countLabel->setText(tr("Searching..."));
+
+    QFutureWatcher<SearchResult> *watcher = new QFutureWatcher<SearchResult>(this);
+    connect(watcher, &QFutureWatcher<SearchResult>::finished, this, [this, watcher, searchGeneration, caseSensitive, query] {
+        watcher->deleteLater();
+        if (searchGeneration != generation) return;  // A newer search is running
+
+        const SearchResult result = watcher->result();
+        if (!caseSensitive && snapshotValid && foldedSnapshot.isEmpty()) {
+            foldedSnapshot = result.foldedText;
+        }
+
+        // Offsets into toPlainText() are document positions, so findBlock() gives each match's
+        // block; counting '\n' would not, as line separators and frame boundaries become '\n' too
+        QVector<int> lines;
+        QTextBlock block;
+        for (const qsizetype offset : result.offsets) {
+            if (block.isValid() && offset < block.position() + block.length()) continue;
+            block = editor->document()->findBlock(int(offset));
+            if (!block.isValid()) break;  // Stale offsets past an edit
+            lines.append(block.blockNumber());
+        }
+        setResults(result.offsets, int(query.size()), lines);
+    });
+
+    watcher->setFuture(QtConcurrent::run([text, folded, query, caseSensitive, cancel] {
+        PERF_SCOPE("find");
+        SearchResult result;
+        if (caseSensitive) {
+            result.offsets = TextSearch::findAll(text, query, cancel.get());
+        } else {
+            // Simple case folding keeps every character at its offset, so matches map straight back
+            result.foldedText = folded.isEmpty() ? text.toCaseFolded() : folded;
+            result.offsets = TextSearch::findAll(result.foldedText, query.toCaseFolded(), cancel.get());
+        }
+        return result;
+    }));
+}
+
+// A piece table copy shares its buffers, so the snapshot costs no copy of the text.
+// The offsets are bytes of UTF-8, and so is the match length.
+void FindBar::startViewSearch(const QString &query)
+{
+    const QByteArray needle = query.toUtf8();
+    const Qt::CaseSensitivity cs = caseCheck->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive;
+    const PieceTable text = view->pieceTable();
+    const quint64 searchGeneration = generation;
+    cancelFlag = std::make_shared<std::atomic_bool>(false);
+    std::shared_ptr<std::atomic_bool> cancel = cancelFlag;
+
+    countLabel->setText(tr("Searching..."));
+
+    QFutureWatcher<SearchResult> *watcher = new QFutureWatcher<SearchResult>(this);
+    connect(watcher, &QFutureWatcher<SearchResult>::finished, this, [this, watcher, searchGeneration, needle] {
+        watcher->deleteLater();
+        if (searchGeneration != generation) return;  // A newer search is running
+
+        const SearchResult result = watcher->result();
+        setResults(result.offsets, int(needle.size()));
+        truncated = result.truncated;
+        updateCountLabel();
+    });
+
+    watcher->setFuture(QtConcurrent::run([text, needle, cs, cancel] {
+        PERF_SCOPE("find");
+        SearchResult result;
+        const QVector<qint64> offsets = LargeFileView::findAll(text, needle, cs, maxViewMatches, cancel.get());
+        result.offsets = QVector<qsizetype>(offsets.cbegin(), offsets.cend());
+        result.truncated = offsets.size() >= maxViewMatches;
+        return result;
+    }));
+}
+
+// Selection of the editor in characters, or of the view in bytes
+qsizetype FindBar::selectionStart() const
+{
+    if (view) return qsizetype(view->selectionStart());
+    return editor ? editor->textCursor().selectionStart() : 0;
+}
+
+qsizetype FindBar::selectionEnd() const
+{
+    if (view) return qsizetype(view->selectionEnd());
+    return editor ? editor->textCursor().selectionEnd() : 0;
+}
+
+void FindBar::onDocumentChanged()
+{
+    snapshotValid = false;
+    if (isVisible() && !queryEdit->text().isEmpty()) {
+        searchTimer->start(editDelay);
+    }
+}
+
+void FindBar::setResults(const QVector<qsizetype> &offsets, int length, const QVector<int> &lines)
+{
+    matchOffsets = offsets;
+    searchedLength = length;
+    currentMatch = -1;
+    truncated = false;
+    if (editor) {
+        if (DocumentOverview *overview = DocumentOverview::forDocument(editor->document())) overview->setSearchHits(lines);
+    }
+
+    if (!matchOffsets.isEmpty() && (editor || view)) {
+        // Start from the first match at or after the cursor
+        const qsizetype position = selectionStart();
+        auto it = std::lower_bound(matchOffsets.cbegin(), matchOffsets.cend(), position);
+        currentMatch = it == matchOffsets.cend() ? 0 : int(it - matchOffsets.cbegin());
+        if (jumpToResults) {
+            selectMatch(currentMatch);
+        }
+    }
+    jumpToResults = false;
+
+    updateCountLabel();
+    refreshHighlights();
+    emit matchesChanged();
+}
+
+void FindBar::selectMatch(int index)
+{
+    if ((!editor && !view) || index < 0 || index >= matchOffsets.size()) return;
+    currentMatch = index;
+
+    if (view) {
+        view->setSelection(matchOffsets[index], searchedLength);
+        updateCountLabel();
+        return;
+    }
+
+    const int documentEnd = editor->document()->characterCount() - 1;
+    const int start = int(qMin<qsizetype>(matchOffsets[index], documentEnd));
+    QTextCursor cursor(editor->document());
+    cursor.setPosition(start);
+    cursor.setPosition(qMin(start + searchedLength, documentEnd), QTextCursor::KeepAnchor);
+    editor->setTextCursor(cursor);  // Scrolls the match into view
+
+    updateCountLabel();
+    refreshHighlights();
+}
+
+void FindBar::findNext()
+{
+    if ((!editor && !view) || matchOffsets.isEmpty()) return;
+
+    int index;
+    if (currentMatch >= 0 && selectionStart() == matchOffsets[currentMatch]) {
+        index = (currentMatch + 1) % matchOffsets.size();
+    } else {
+        // The cursor moved since the last jump: continue from where it is now
+        auto it = std::lower_bound(matchOffsets.cbegin(), matchOffsets.cend(), selectionEnd());
+        index = it == matchOffsets.cend() ? 0 : int(it - matchOffsets.cbegin());
+    }
+    selectMatch(index);
+}
+
+void FindBar::findPrevious()
+{
+    if ((!editor && !view) || matchOffsets.isEmpty()) return;
+
+    int index;
+    if (currentMatch >= 0 && selectionStart() == matchOffsets[currentMatch]) {
+        index = currentMatch > 0 ? currentMatch - 1 : matchOffsets.size() - 1;
+    } else {
+        auto it = std::lower_bound(matchOffsets.cbegin(), matchOffsets.cend(), selectionStart());
+        index = it == matchOffsets.cbegin() ? matchOffsets.size() - 1 : int(it - matchOffsets.cbegin()) - 1;
+    }
+    selectMatch(index);
+}
+
+void FindBar::closeBar()
+{
+    if (cancelFlag) *cancelFlag = true;
+    ++generation;
+    hide();
+    if (editor) {
+        SelectionLayers::of(editor)->clear(SelectionLayers::FindMatches);
+        if (DocumentOverview *overview = DocumentOverview::forDocument(editor->document())) overview->setSearchHits({});
+        editor->setFocus();
+    }
+    if (view) view->setFocus();
+}
+
+void FindBar::updateCountLabel()
+{
+    if (queryEdit->text().isEmpty()) {
+        countLabel->clear();
+    } else if (matchOffsets.isEmpty()) {
+        countLabel->setText(tr("No matches"));
+    } else if (truncated) {
+        countLabel->setText(tr("%1 of %2+").arg(currentMatch + 1).arg(matchOffsets.size()));
+    } else {
+        countLabel->setText(tr("%1 of %2").arg(currentMatch + 1).arg(matchOffsets.size()));
+    }
+}
+
+// Give ExtraSelections only to the matches inside the viewport
+void FindBar::refreshHighlights()
+{
+    if (!editor) return;
+
+    QList<QTextEdit::ExtraSelection> selections;
+    if (isVisible() && !matchOffsets.isEmpty()) {
+        const QWidget *viewport = editor->viewport();
+        const int first = editor->cursorForPosition(QPoint(0, 0)).position();
+        const int last = editor->cursorForPosition(QPoint(viewport->width(), viewport->height())).position();
+        const int documentEnd = editor->document()->characterCount() - 1;
+
+        QTextCharFormat matchFormat;
+        matchFormat.setBackground(QColor(255, 230, 120));
+        QTextCharFormat currentFormat;
+        currentFormat.setBackground(QColor(255, 150, 50));
+
+        auto it = std::lower_bound(matchOffsets.cbegin(), matchOffsets.cend(), qsizetype(first - searchedLength));
+        for (; it != matchOffsets.cend() && *it <= last && selections.size() < maxVisibleHighlights; ++it) {
+            if (*it + searchedLength > documentEnd) break;  // Stale offsets past an edit
+
+            QTextEdit::ExtraSelection selection;
+            selection.cursor = QTextCursor(editor->document());
+            selection.cursor.setPosition(int(*it));
+            selection.cursor.setPosition(int(*it) + searchedLength, QTextCursor::KeepAnchor);
+            selection.format = int(it - matchOffsets.cbegin()) == currentMatch ? currentFormat : matchFormat;
+            selections.append(selection);
+        }
+    }
+    SelectionLayers::of(editor)->setSelections(SelectionLayers::FindMatches, selections);
+}
+
+void FindBar::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_Escape) {
+        closeBar();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+bool FindBar::eventFilter(QObject *watched, QEvent *event)
+{
+    if (editor && watched == editor->viewport() && event->type() == QEvent::Resize) {
+        refreshHighlights();
+    }
+    return QWidget::eventFilter(watched, event);
+}
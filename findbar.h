@@ -0,0 +1,83 @@
+#ifndef FINDBAR_H
+#define FINDBAR_H
+
+#include <QWidget>
+#include <QPointer>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+class QTextEdit;
+class LargeFileView;
+class QLineEdit;
+class QCheckBox;
+class QLabel;
+class QTimer;
+
+// Non-modal find bar that searches as you type.
+// The match offsets for the whole document are computed on a worker thread
+// from a snapshot of the text; the editor only gets ExtraSelections for the
+// matches inside the viewport, and next/previous jump through the offset list.
+// A LargeFileView is searched the same way over a snapshot of its piece table,
+// with byte offsets; the view shows the current match as its selection.
+class FindBar : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit FindBar(QWidget *parent = nullptr);
+
+    void setEditor(QTextEdit *editor);
+    void setLargeFileView(LargeFileView *view);
+    void activate(const QString &text);   // Show, focus and search for text
+
+    const QVector<qsizetype> &matches() const { return matchOffsets; }
+    int matchLength() const { return searchedLength; }
+
+public slots:
+    void findNext();
+    void findPrevious();
+    void closeBar();
+
+signals:
+    void matchesChanged();
+
+protected:
+    void keyPressEvent(QKeyEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void startSearch();
+    void onDocumentChanged();
+    void refreshHighlights();
+
+private:
+    void detach();
+    void startViewSearch(const QString &query);
+    qsizetype selectionStart() const;
+    qsizetype selectionEnd() const;
+    void setResults(const QVector<qsizetype> &offsets, int length, const QVector<int> &lines = {});
+    void selectMatch(int index);
+    void updateCountLabel();
+
+    QPointer<QTextEdit> editor;
+    QPointer<LargeFileView> view;   // Searched instead of an editor, for large files
+    QLineEdit *queryEdit;
+    QCheckBox *caseCheck;
+    QLabel *countLabel;
+    QTimer *searchTimer;        // Debounces typing in the query and edits in the document
+
+    QString snapshot;           // Plain text of the document, reused until it changes
+    QString foldedSnapshot;     // Case-folded copy for case-insensitive searches
+    bool snapshotValid = false;
+    quint64 generation = 0;     // Results from older searches are dropped
+    std::shared_ptr<std::atomic_bool> cancelFlag;
+
+    QVector<qsizetype> matchOffsets;
+    int searchedLength = 0;
+    int currentMatch = -1;
+    bool truncated = false;      // The view search stopped at maxViewMatches
+    bool jumpToResults = false;  // Select the first match when results arrive (query edits only)
+};
+
+#endif // FINDBAR_H
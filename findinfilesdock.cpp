@@ -0,0 +1,250 @@
+#include "findinfilesdock.h"
+#include "textsearch.h"
+#include "trigramindex.h"
+#include "sessionstore.h"
+#include "tabplaceholder.h"
+#include "largefileview.h"
+#include <QTabWidget>
+#include <QTextEdit>
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QToolButton>
+#include <QTreeWidget>
+#include <QHeaderView>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
+#include <QRegularExpression>
+
+enum ResultRole {
+    TabRole = Qt::UserRole,     // Index into searchedTabs, or -1
+    PathRole,
+    LineRole,
+    ColumnRole,
+    LengthRole
+};
+
+FindInFilesDock::FindInFilesDock(QTabWidget *tabWidget, const QMap<QWidget *, QString> *tabFiles, SessionStore *sessionStore,
+                                 TrigramIndex *index, QWidget *parent)
+    : QDockWidget(tr("Find in Files"), parent), tabWidget(tabWidget), tabFiles(tabFiles), sessionStore(sessionStore), index(index)
+{
+    setObjectName("findInFilesDock");
+    QWidget *content = new QWidget(this);
+    QVBoxLayout *layout = new QVBoxLayout(content);
+    layout->setContentsMargins(4, 4, 4, 4);
+
+    queryEdit = new QLineEdit(content);
+    queryEdit->setPlaceholderText(tr("Find in open tabs and files"));
+    queryEdit->setClearButtonEnabled(true);
+    searchButton = new QPushButton(tr("Search"), content);
+    stopButton = new QPushButton(tr("Stop"), content);
+    stopButton->setEnabled(false);
+
+    QHBoxLayout *queryRow = new QHBoxLayout;
+    queryRow->addWidget(queryEdit, 1);
+    queryRow->addWidget(searchButton);
+    queryRow->addWidget(stopButton);
+
+    caseCheck = new QCheckBox(tr("Match case"), content);
+    regexCheck = new QCheckBox(tr("Regular expression"), content);
+    indexCheck = new QCheckBox(tr("Indexed files"), content);
+    indexCheck->setToolTip(tr("Also search every file opened or saved before, and the notes folder"));
+    indexCheck->setChecked(true);
+    QHBoxLayout *optionRow = new QHBoxLayout;
+    optionRow->addWidget(caseCheck);
+    optionRow->addWidget(regexCheck);
+    optionRow->addWidget(indexCheck);
+    optionRow->addStretch();
+
+    directoryCheck = new QCheckBox(tr("Folder:"), content);
+    directoryEdit = new QLineEdit(QDir::homePath(), content);
+    directoryEdit->setEnabled(false);
+    QToolButton *browseButton = new QToolButton(content);
+    browseButton->setText("...");
+    browseButton->setEnabled(false);
+    filterEdit = new QLineEdit("*.txt", content);
+    filterEdit->setToolTip(tr("File name patterns, separated by spaces or semicolons"));
+    filterEdit->setEnabled(false);
+    QHBoxLayout *directoryRow = new QHBoxLayout;
+    directoryRow->addWidget(directoryCheck);
+    directoryRow->addWidget(directoryEdit, 2);
+    directoryRow->addWidget(browseButton);
+    directoryRow->addWidget(filterEdit, 1);
+
+    resultTree = new QTreeWidget(content);
+    resultTree->setHeaderHidden(true);
+    resultTree->setUniformRowHeights(true);   // Keeps scrolling cheap with thousands of hits
+    statusLabel = new QLabel(content);
+
+    layout->addLayout(queryRow);
+    layout->addLayout(optionRow);
+    layout->addLayout(directoryRow);
+    layout->addWidget(resultTree, 1);
+    layout->addWidget(statusLabel);
+    setWidget(content);
+
+    connect(queryEdit, &QLineEdit::returnPressed, this, &FindInFilesDock::startSearch);
+    connect(searchButton, &QPushButton::clicked, this, &FindInFilesDock::startSearch);
+    connect(stopButton, &QPushButton::clicked, this, &FindInFilesDock::stopSearch);
+    connect(browseButton, &QToolButton::clicked, this, &FindInFilesDock::browseDirectory);
+    connect(directoryCheck, &QCheckBox::toggled, directoryEdit, &QLineEdit::setEnabled);
+    connect(directoryCheck, &QCheckBox::toggled, browseButton, &QToolButton::setEnabled);
+    connect(directoryCheck, &QCheckBox::toggled, filterEdit, &QLineEdit::setEnabled);
+    connect(resultTree, &QTreeWidget::itemActivated, this, &FindInFilesDock::onItemActivated);
+}
+
+void FindInFilesDock::activate(const QString &text)
+{
+    index->rescan();  // Notes may have been edited outside the editor; unchanged files cost a stat each
+    show();
+    raise();
+    if (!text.isEmpty() && !text.contains(QChar::ParagraphSeparator)) queryEdit->setText(text);
+    queryEdit->setFocus();
+    queryEdit->selectAll();
+}
+
+void FindInFilesDock::browseDirectory()
+{
+    const QString directory = QFileDialog::getExistingDirectory(this, tr("Search Folder"), directoryEdit->text());
+    if (!directory.isEmpty()) directoryEdit->setText(directory);
+}
+
+// Snapshot the tabs and start a new search, dropping the previous one
+void FindInFilesDock::startSearch()
+{
+    if (queryEdit->text().isEmpty()) return;
+    if (regexCheck->isChecked()) {
+        QRegularExpression expression(queryEdit->text());
+        if (!expression.isValid()) {
+            statusLabel->setText(tr("Invalid regular expression: %1").arg(expression.errorString()));
+            return;
+        }
+    }
+
+    if (search) {
+        search->disconnect(this);
+        search->cancel();
+        search->deleteLater();
+    }
+    resultTree->clear();
+    fileItems.clear();
+    searchedTabs.clear();
+
+    QVector<FileSearch::OpenTab> tabs;
+    QStringList files;
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        QWidget *tab = tabWidget->widget(i);
+        const QString filePath = tabFiles->value(tab);
+        if (QTextEdit *editor = qobject_cast<QTextEdit *>(tab)) {
+            tabs.append({filePath, editor->toPlainText()});
+            searchedTabs.append(tab);
+        } else if (TabPlaceholder *placeholder = qobject_cast<TabPlaceholder *>(tab); placeholder && !placeholder->entry().id.isEmpty()) {
+            // Unsaved and untitled text lives in the journal, which is only read on the worker
+            SessionStore *store = sessionStore;
+            const QString id = placeholder->entry().id;
+            tabs.append({filePath, QString(), [store, id] { return SessionStore::plainText(store->readTab(id)).toUtf8(); }});
+            searchedTabs.append(tab);
+        } else if (LargeFileView *view = qobject_cast<LargeFileView *>(tab); view && view->isModified()) {
+            const PieceTable text = view->pieceTable();   // A snapshot sharing the view's buffers
+            tabs.append({filePath, QString(), [text] { return text.read(0, text.size()); }});
+            searchedTabs.append(tab);
+        } else if (!filePath.isEmpty()) {
+            files.append(filePath);   // Not loaded into an editor: the file on disk stands in for it
+        }
+    }
+
+    // The index only narrows the candidates down; FileSearch verifies every one of them
+    indexCandidates = indexedFiles = 0;
+    if (indexCheck->isChecked()) {
+        const QString literal = regexCheck->isChecked() ? TextSearch::requiredLiteral(queryEdit->text()) : queryEdit->text();
+        const QStringList candidates = index->candidates(literal, caseCheck->isChecked() ? Qt::CaseSensitive : Qt::CaseInsensitive,
+                                                         &indexedFiles);
+        indexCandidates = int(candidates.size());
+        files += candidates;
+    }
+
+    QString directory;
+    QStringList nameFilters;
+    if (directoryCheck->isChecked()) {
+        directory = directoryEdit->text();
+        nameFilters = filterEdit->text().split(QRegularExpression("[;\\s]+"), Qt::SkipEmptyParts);
+    }
+
+    FileSearch::Query query;
+    query.text = queryEdit->text();
+    query.regularExpression = regexCheck->isChecked();
+    query.caseSensitive = caseCheck->isChecked();
+
+    search = new FileSearch(this);
+    connect(search, &FileSearch::hitsFound, this, &FindInFilesDock::addHits);
+    connect(search, &FileSearch::finished, this, &FindInFilesDock::searchFinished);
+    search->start(query, tabs, files, directory, nameFilters);
+
+    searchButton->setEnabled(false);
+    stopButton->setEnabled(true);
+    statusLabel->setText(tr("Searching..."));
+}
+
+void FindInFilesDock::stopSearch()
+{
+    if (search) search->cancel();
+}
+
+QTreeWidgetItem *FindInFilesDock::fileItem(const SearchHit &hit)
+{
+    const QString key = hit.filePath.isEmpty() ? QString("#%1").arg(hit.tab) : hit.filePath;
+    QTreeWidgetItem *&item = fileItems[key];
+    if (!item) {
+        item = new QTreeWidgetItem(resultTree);
+        item->setText(0, hit.filePath.isEmpty() ? tr("Untitled (tab %1)").arg(hit.tab + 1)
+                                                : QDir::toNativeSeparators(hit.filePath));
+        item->setToolTip(0, item->text(0));
+        item->setExpanded(true);
+    }
+    return item;
+}
+
+void FindInFilesDock::addHits(const QVector<SearchHit> &hits)
+{
+    QTreeWidgetItem *parentItem = fileItem(hits.first());
+    QList<QTreeWidgetItem *> items;
+    items.reserve(hits.size());
+    for (const SearchHit &hit : hits) {
+        QTreeWidgetItem *item = new QTreeWidgetItem;
+        item->setText(0, QString("%1: %2").arg(hit.line).arg(hit.preview.trimmed()));
+        item->setData(0, TabRole, hit.tab);
+        item->setData(0, PathRole, hit.filePath);
+        item->setData(0, LineRole, hit.line);
+        item->setData(0, ColumnRole, hit.column);
+        item->setData(0, LengthRole, hit.length);
+        items.append(item);
+    }
+    parentItem->addChildren(items);
+    parentItem->setText(0, QString("%1 (%2)").arg(parentItem->toolTip(0)).arg(parentItem->childCount()));
+}
+
+void FindInFilesDock::searchFinished(int filesSearched, int hitCount, bool complete)
+{
+    search->deleteLater();
+    search = nullptr;
+    searchButton->setEnabled(true);
+    stopButton->setEnabled(false);
+
+    QString status = tr("%1 matching lines in %2 of %3 files").arg(hitCount).arg(fileItems.size()).arg(filesSearched);
+    if (indexedFiles > 0) status += tr(", %1 of %2 indexed files read").arg(indexCandidates).arg(indexedFiles);
+    if (!complete) status += tr(" (stopped)");
+    statusLabel->setText(status);
+}
+
+void FindInFilesDock::onItemActivated(QTreeWidgetItem *item)
+{
+    if (!item->parent()) return;   // A file row
+    const int tab = item->data(0, TabRole).toInt();
+    QWidget *tabWidgetPage = tab >= 0 && tab < searchedTabs.size() ? searchedTabs[tab].data() : nullptr;
+    emit openHit(tabWidgetPage, item->data(0, PathRole).toString(), item->data(0, LineRole).toLongLong(),
+                 item->data(0, ColumnRole).toInt(), item->data(0, LengthRole).toInt());
+}
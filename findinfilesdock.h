@@ -0,0 +1,75 @@
+#ifndef FINDINFILESDOCK_H
+#define FINDINFILESDOCK_H
+
+#include <QDockWidget>
+#include <QMap>
+#include <QPointer>
+#include <QVector>
+#include "filesearch.h"
+
+class QTabWidget;
+class QLineEdit;
+class QCheckBox;
+class QLabel;
+class QPushButton;
+class QTreeWidget;
+class QTreeWidgetItem;
+class TrigramIndex;
+class SessionStore;
+
+// Dock that runs a FileSearch over the open tabs and, optionally, a folder and
+// the indexed files. The text of every editor tab is snapshotted when the search
+// starts. Restored tabs not built yet are searched through their journal, large
+// file views with unsaved edits through their pieces, and other tabs on disk
+// through their file. Indexed files are narrowed down through the trigram index first.
+// Results are grouped per file and stream in while the search runs.
+class FindInFilesDock : public QDockWidget
+{
+    Q_OBJECT
+
+public:
+    FindInFilesDock(QTabWidget *tabWidget, const QMap<QWidget *, QString> *tabFiles, SessionStore *sessionStore,
+                    TrigramIndex *index, QWidget *parent = nullptr);
+
+    void activate(const QString &text);   // Show, focus and seed the query with text
+
+signals:
+    // tab is null for files that are not open
+    void openHit(QWidget *tab, const QString &filePath, qint64 line, int column, int length);
+
+private slots:
+    void startSearch();
+    void stopSearch();
+    void browseDirectory();
+    void addHits(const QVector<SearchHit> &hits);
+    void searchFinished(int filesSearched, int hitCount, bool complete);
+    void onItemActivated(QTreeWidgetItem *item);
+
+private:
+    QTreeWidgetItem *fileItem(const SearchHit &hit);
+
+    QTabWidget *tabWidget;
+    const QMap<QWidget *, QString> *tabFiles;
+    SessionStore *sessionStore;
+    TrigramIndex *index;
+
+    QLineEdit *queryEdit;
+    QCheckBox *caseCheck;
+    QCheckBox *regexCheck;
+    QCheckBox *indexCheck;
+    QCheckBox *directoryCheck;
+    QLineEdit *directoryEdit;
+    QLineEdit *filterEdit;
+    QPushButton *searchButton;
+    QPushButton *stopButton;
+    QTreeWidget *resultTree;
+    QLabel *statusLabel;
+
+    FileSearch *search = nullptr;
+    QVector<QPointer<QWidget>> searchedTabs;     // The tab behind each FileSearch::OpenTab
+    QMap<QString, QTreeWidgetItem *> fileItems;  // Top-level result item per file (or untitled tab)
+    int indexCandidates = 0;                     // Of the last search, for the status line
+    int indexedFiles = 0;
+};
+
+#endif // FINDINFILESDOCK_H
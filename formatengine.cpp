@@ -0,0 +1,188 @@
+#include "formatengine.h"
+#include "perftrace.h"
+#include <QTextEdit>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QHash>
+#include <QVector>
+
+namespace FormatEngine
+{
+
+namespace {
+
+struct Run
+{
+    int start;
+    int end;
+    QTextCharFormat format;
+};
+
+bool has(const QTextCharFormat &format, Attribute attribute)
+{
+    switch (attribute) {
+    case Bold:        return format.fontWeight() == QFont::Bold;
+    case Italic:      return format.fontItalic();
+    case Underline:   return format.fontUnderline();
+    case StrikeOut:   return format.fontStrikeOut();
+    case SubScript:   return format.verticalAlignment() == QTextCharFormat::AlignSubScript;
+    case SuperScript: return format.verticalAlignment() == QTextCharFormat::AlignSuperScript;
+    }
+    return false;
+}
+
+// Turning an attribute off removes its property, which leads back to the format the text had before
+void set(QTextCharFormat &format, Attribute attribute, bool on)
+{
+    switch (attribute) {
+    case Bold:
+        if (on) format.setFontWeight(QFont::Bold);
+        else format.clearProperty(QTextFormat::FontWeight);
+        break;
+    case Italic:
+        if (on) format.setFontItalic(true);
+        else format.clearProperty(QTextFormat::FontItalic);
+        break;
+    case Underline:
+        if (on) {
+            format.setFontUnderline(true);
+        } else {
+            format.clearProperty(QTextFormat::TextUnderlineStyle);
+            format.clearProperty(QTextFormat::FontUnderline);
+        }
+        break;
+    case StrikeOut:
+        if (on) format.setFontStrikeOut(true);
+        else format.clearProperty(QTextFormat::FontStrikeOut);
+        break;
+    case SubScript:
+    case SuperScript:
+        if (on) format.setVerticalAlignment(attribute == SubScript ? QTextCharFormat::AlignSubScript
+                                                                   : QTextCharFormat::AlignSuperScript);
+        else format.clearProperty(QTextFormat::TextVerticalAlignment);
+        break;
+    }
+}
+
+// Call visit(fragment, from, to) for the part of every fragment inside [start, end),
+// and blockEnd(block) after each block; stops early when visit returns false
+template <typename Visit, typename BlockEnd>
+void forEachFragment(QTextDocument *document, int start, int end, Visit visit, BlockEnd blockEnd)
+{
+    for (QTextBlock block = document->findBlock(start); block.isValid() && block.position() < end; block = block.next()) {
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            const int from = qMax(fragment.position(), start);
+            const int to = qMin(fragment.position() + fragment.length(), end);
+            if (from < to && !visit(fragment, from, to)) return;
+        }
+        blockEnd(block);
+    }
+}
+
+}
+
+bool hasAttribute(const QTextCursor &cursor, Attribute attribute)
+{
+    if (!cursor.hasSelection()) return has(cursor.charFormat(), attribute);
+
+    PERF_SCOPE("format state");
+    QHash<int, bool> known;   // By format index: most selections use only a few formats
+    bool all = true;
+    forEachFragment(cursor.document(), cursor.selectionStart(), cursor.selectionEnd(),
+                    [&](const QTextFragment &fragment, int, int) {
+                        const int index = fragment.charFormatIndex();
+                        auto it = known.constFind(index);
+                        if (it == known.cend()) it = known.insert(index, has(fragment.charFormat(), attribute));
+                        all = it.value();
+                        return all;
+                    },
+                    [](const QTextBlock &) {});
+    return all;
+}
+
+void toggle(QTextEdit *editor, Attribute attribute)
+{
+    QTextCursor cursor = editor->textCursor();
+    const bool on = !hasAttribute(cursor, attribute);
+
+    if (!cursor.hasSelection()) {
+        // Merged, so an explicit "off" value is needed for the typed text to override the text around it
+        QTextCharFormat format;
+        switch (attribute) {
+        case Bold:        format.setFontWeight(on ? QFont::Bold : QFont::Normal); break;
+        case Italic:      format.setFontItalic(on); break;
+        case Underline:   format.setFontUnderline(on); break;
+        case StrikeOut:   format.setFontStrikeOut(on); break;
+        case SubScript:   format.setVerticalAlignment(on ? QTextCharFormat::AlignSubScript : QTextCharFormat::AlignNormal); break;
+        case SuperScript: format.setVerticalAlignment(on ? QTextCharFormat::AlignSuperScript : QTextCharFormat::AlignNormal); break;
+        }
+        editor->mergeCurrentCharFormat(format);
+        return;
+    }
+
+    apply(cursor, [attribute, on](QTextCharFormat &format) { set(format, attribute, on); });
+}
+
+int apply(const QTextCursor &cursor, const std::function<void(QTextCharFormat &)> &transform)
+{
+    if (!cursor.hasSelection()) return 0;
+    PERF_SCOPE("format selection");
+
+    QTextDocument *document = cursor.document();
+    struct Target
+    {
+        bool changed;
+        QTextCharFormat format;
+    };
+    QHash<int, Target> targets;   // Transformed format, by the index of the original
+    QVector<Run> runs;
+    int bridge = -1;              // Where the last run may continue: past the separators after it
+
+    forEachFragment(document, cursor.selectionStart(), cursor.selectionEnd(),
+                    [&](const QTextFragment &fragment, int from, int to) {
+                        const int index = fragment.charFormatIndex();
+                        auto target = targets.constFind(index);
+                        if (target == targets.cend()) {
+                            const QTextCharFormat original = fragment.charFormat();
+                            QTextCharFormat format = original;
+                            transform(format);
+                            target = targets.insert(index, {format != original, format});
+                        }
+                        if (!target->changed) return true;
+
+                        if (!runs.isEmpty() && (runs.last().end == from || bridge == from)
+                            && runs.last().format == target->format) {
+                            runs.last().end = to;
+                        } else {
+                            runs.append({from, to, target->format});
+                        }
+                        return true;
+                    },
+                    [&](const QTextBlock &block) {
+                        // A run reaching the end of a block also covers its separator, and those of empty blocks after it
+                        const int blockEnd = block.position() + block.length() - 1;
+                        if (!runs.isEmpty() && runs.last().end == blockEnd) {
+                            bridge = blockEnd + 1;
+                        } else if (block.length() == 1 && bridge == block.position()) {
+                            bridge = blockEnd + 1;
+                        } else {
+                            bridge = -1;
+                        }
+                    });
+
+    if (runs.isEmpty()) return 0;
+
+    QTextCursor editCursor(document);
+    editCursor.beginEditBlock();
+    for (const Run &run : std::as_const(runs)) {
+        editCursor.setPosition(run.start);
+        editCursor.setPosition(run.end, QTextCursor::KeepAnchor);
+        editCursor.setCharFormat(run.format);
+    }
+    editCursor.endEditBlock();
+    return int(runs.size());
+}
+
+}
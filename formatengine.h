@@ -0,0 +1,43 @@
+#ifndef FORMATENGINE_H
+#define FORMATENGINE_H
+
+#include <QTextCharFormat>
+#include <functional>
+
+class QTextCursor;
+class QTextEdit;
+
+// Character formatting over selections of any size
+namespace FormatEngine
+{
+
+enum Attribute
+{
+    Bold,
+    Italic,
+    Underline,
+    StrikeOut,
+    SubScript,
+    SuperScript
+};
+
+// True when every character of the selection has attribute; without a
+// selection, when the format at the cursor has it
+bool hasAttribute(const QTextCursor &cursor, Attribute attribute);
+
+// Turn attribute on across the editor's selection unless all of it already has
+// it, in which case it is turned off. Without a selection the editor's current
+// format (for the next typed text) is toggled instead.
+void toggle(QTextEdit *editor, Attribute attribute);
+
+// Rewrite the character format of every character in the cursor's selection.
+// Each distinct format in the selection is transformed once; fragments that
+// end up with the same format are coalesced into runs, and each run is set
+// with one setCharFormat inside a single edit block. Transforms that turn
+// something off should clear the property rather than set its default, so the
+// result is a format the document already has. Returns the number of runs.
+int apply(const QTextCursor &cursor, const std::function<void(QTextCharFormat &)> &transform);
+
+}
+
+#endif // FORMATENGINE_H
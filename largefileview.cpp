@@ -0,0 +1,837 @@
+#include "largefileview.h"
+#include "perftrace.h"
+#include "textsearch.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QScrollBar>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSaveFile>
+#include <QTemporaryFile>
+#include <QFileInfo>
+#include <QFontDatabase>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const qint64 checkpointInterval = 4096;    // Lines between two index checkpoints
+static const qint64 maxDisplayBytes = 64 * 1024;  // Longest part of a line that is decoded and painted
+static const int tabColumns = 4;
+static const int textMargin = 4;
+static const qint64 minimumSegmentBytes = 16;      // Narrowest segment in long-line mode
+static const qint64 searchChunkBytes = 4 * 1024 * 1024;  // Bytes copied out of the piece table per search step
+
+// Step over one UTF-8 sequence, treating CRLF as a single line break
+static qint64 nextPosition(const PieceTable &table, qint64 position)
+{
+    if (position >= table.size()) return table.size();
+    if (table.at(position) == '\r' && position + 1 < table.size() && table.at(position + 1) == '\n') return position + 2;
+    ++position;
+    while (position < table.size() && (uchar(table.at(position)) & 0xC0) == 0x80) ++position;
+    return position;
+}
+
+static qint64 previousPosition(const PieceTable &table, qint64 position)
+{
+    if (position <= 0) return 0;
+    --position;
+    if (table.at(position) == '\n' && position > 0 && table.at(position - 1) == '\r') return position - 1;
+    while (position > 0 && (uchar(table.at(position)) & 0xC0) == 0x80) --position;
+    return position;
+}
+
+LargeFileView::LargeFileView(QWidget *parent) : QAbstractScrollArea(parent), stopIndexing(false)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    const QFontMetrics metrics(font());
+    lineHeight = qMax(1, metrics.height());
+    charWidth = qMax(1, metrics.horizontalAdvance(QLatin1Char(' ')));
+
+    setFocusPolicy(Qt::StrongFocus);
+    viewport()->setCursor(Qt::IBeamCursor);
+    checkpoints.append({0, 0});
+
+    // Segments follow the viewport width once resizing settles
+    rewrapTimer = new QTimer(this);
+    rewrapTimer->setSingleShot(true);
+    rewrapTimer->setInterval(150);
+    connect(rewrapTimer, &QTimer::timeout, this, [this] {
+        if (longLines && wrapColumns() != segmentBytes) reindex();
+    });
+}
+
+LargeFileView::~LargeFileView()
+{
+    stopIndexing = true;
+    if (indexThread) {
+        indexThread->wait();
+        delete indexThread;
+    }
+}
+
+// Map the file and start indexing its lines; the first screen is painted right away
+bool LargeFileView::openFile(const QString &fileName, QString *errorString)
+{
+    PERF_SCOPE("map file");
+    std::shared_ptr<const MappedFile> file = MappedFile::open(fileName, errorString);
+    if (!file) return false;
+
+    stopIndexer();
+
+    mappedFile = file;
+    table = PieceTable(file);
+    checkpoints.clear();
+    checkpoints.append({0, 0});
+    totalLines = 1;
+    cursorPosition = 0;
+    selectionAnchor = -1;
+    preferredColumn = -1;
+    widestLine = 0;
+    restoreTopOffset = -1;
+    setModified(false);
+
+    startIndexing();
+    updateScrollBars();
+    viewport()->update();
+    return true;
+}
+
+// Save through a temporary file. Saved over the mapped original, the pieces point
+// into the very file being replaced, and Windows will not rename over a mapped
+// file: the copy is written in full first, then the mapping is released and the
+// copy renamed over the original and mapped in its place. Its bytes are the text,
+// so the line index stays valid. As QSaveFile does, the copy takes the original's
+// permissions and is synced to disk before the rename.
+bool LargeFileView::saveFile(const QString &fileName, QString *errorString)
+{
+    if (!mappedFile || QFileInfo(mappedFile->fileName()) != QFileInfo(fileName)) {
+        QSaveFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly) || !table.writeTo(&file) || !file.commit()) {
+            if (errorString) *errorString = file.errorString();
+            return false;
+        }
+        setModified(false);
+        return true;
+    }
+
+    QTemporaryFile copy(fileName + ".XXXXXX");
+    if (!copy.open() || !table.writeTo(&copy) || !copy.flush()) {
+        if (errorString) *errorString = copy.errorString();
+        return false;   // The copy is removed; the edits are still in the pieces
+    }
+#ifdef Q_OS_WIN
+    const bool synced = _commit(copy.handle()) == 0;
+#else
+    const bool synced = ::fsync(copy.handle()) == 0;
+#endif
+    if (!synced || !copy.setPermissions(QFileInfo(fileName).permissions())) {
+        if (errorString) *errorString = synced ? copy.errorString() : QString("Cannot sync the file to disk");
+        return false;
+    }
+    copy.setAutoRemove(false);
+    copy.close();
+    const QString copyName = copy.fileName();
+
+    const bool wasIndexing = indexing;
+    stopIndexer();
+    table = PieceTable();
+    mappedFile.reset();
+
+    // If the rename fails the edits are safe in the copy, which the view maps instead
+    std::error_code error;
+    std::filesystem::rename(QFileInfo(copyName).filesystemAbsoluteFilePath(), QFileInfo(fileName).filesystemAbsoluteFilePath(), error);
+    const QString savedName = error ? copyName : fileName;
+    QString mapError;
+    std::shared_ptr<const MappedFile> saved = MappedFile::open(savedName, &mapError);
+    if (saved) {
+        mappedFile = saved;
+        table = PieceTable(saved);
+    }
+    if (wasIndexing) reindex();
+    viewport()->update();
+
+    if (error || !saved) {
+        if (errorString) {
+            *errorString = error ? QString::fromLocal8Bit(error.message().c_str()) + "; the text was saved to " + copyName
+                                 : mapError + "; the text was saved to " + savedName;
+        }
+        return false;
+    }
+    setModified(false);
+    return true;
+}
+
+// Line indexing
+
+// Scan a snapshot of the text for display lines on a worker thread, recording a
+// checkpoint every checkpointInterval lines and handing batches to the GUI as they are found
+void LargeFileView::startIndexing()
+{
+    indexing = true;
+    stopIndexing = false;
+    segmentBytes = wrapColumns();
+
+    const PieceTable snapshot = table;   // Edits wait for the index, but the snapshot keeps it safe regardless
+    const qint64 segment = longLines ? segmentBytes : snapshot.size() + 1;
+    const quint64 generation = ++indexGeneration;
+    indexThread = QThread::create([this, snapshot, segment, generation] {
+        QVector<Checkpoint> batch;
+        qint64 lines = 0;
+        qint64 lineStart = 0;
+        QElapsedTimer sinceReport;
+        sinceReport.start();
+
+        auto addLine = [&](qint64 offset) {
+            lineStart = offset;
+            if (++lines % checkpointInterval == 0) {
+                batch.append({lines, offset});
+                // Report a few times per second so the view can scroll while indexing continues
+                if (sinceReport.elapsed() > 100) {
+                    QMetaObject::invokeMethod(this, [this, batch, lines, generation] {
+                        if (generation == indexGeneration) appendCheckpoints(batch, lines, false);
+                    }, Qt::QueuedConnection);
+                    batch.clear();
+                    sinceReport.restart();
+                }
+            }
+        };
+
+        // A display line ends at the first line break within segment bytes of its start,
+        // or otherwise right after those bytes; the rule of nextLineStart(), whose checkpoint bound a fresh index never hits
+        qint64 spanOffset = 0;
+        snapshot.visit(0, snapshot.size(), [&](const char *data, qint64 length) {
+            const char *p = data;
+            const char *end = data + length;
+            while (p < end) {
+                if (stopIndexing) return false;
+                const qint64 segmentEnd = lineStart + segment;   // Last byte that may still hold the break
+                const char *limit = data + qMin(length, segmentEnd + 1 - spanOffset);
+                const void *lineBreak = std::memchr(p, '\n', size_t(limit - p));
+                if (lineBreak) {
+                    p = static_cast<const char *>(lineBreak) + 1;
+                    addLine(spanOffset + (p - data));
+                    continue;
+                }
+                p = limit;
+                if (spanOffset + (p - data) > segmentEnd) addLine(segmentEnd);   // Byte segmentEnd is no break, so scanning goes on after it
+            }
+            spanOffset += length;
+            return true;
+        });
+
+        if (!stopIndexing) {
+            QMetaObject::invokeMethod(this, [this, batch, lines, generation] {
+                if (generation == indexGeneration) appendCheckpoints(batch, lines, true);
+            }, Qt::QueuedConnection);
+        }
+    });
+    indexThread->start();
+}
+
+void LargeFileView::stopIndexer()
+{
+    if (!indexThread) return;
+    stopIndexing = true;
+    indexThread->wait();
+    delete indexThread;
+    indexThread = nullptr;
+    indexing = false;
+}
+
+// Index the display lines again, e.g. for another segment width; the line at the top stays there
+void LargeFileView::reindex()
+{
+    const qint64 topOffset = restoreTopOffset >= 0 ? restoreTopOffset : lineStart(verticalScrollBar()->value());
+    stopIndexer();
+    checkpoints.clear();
+    checkpoints.append({0, 0});
+    totalLines = 1;
+    widestLine = 0;
+    preferredColumn = -1;
+    restoreTopOffset = topOffset;
+    startIndexing();
+    updateScrollBars();
+    viewport()->update();
+}
+
+void LargeFileView::appendCheckpoints(const QVector<Checkpoint> &batch, qint64 lines, bool done)
+{
+    checkpoints += batch;
+    totalLines = lines + 1;
+
+    if (done) {
+        indexing = false;
+        indexThread->wait();
+        delete indexThread;
+        indexThread = nullptr;
+        emit indexingFinished();
+    }
+
+    updateScrollBars();
+    if (done && restoreTopOffset >= 0) {
+        verticalScrollBar()->setValue(int(qMin<qint64>(lineOf(restoreTopOffset), INT_MAX)));
+        restoreTopOffset = -1;
+    }
+    viewport()->update();
+}
+
+// Index of the last checkpoint at or before line
+int LargeFileView::checkpointBefore(qint64 line) const
+{
+    auto it = std::upper_bound(checkpoints.cbegin(), checkpoints.cend(), line,
+                               [](qint64 value, const Checkpoint &checkpoint) { return value < checkpoint.line; });
+    return qMax(0, int(it - checkpoints.cbegin()) - 1);
+}
+
+// Index of the last checkpoint at or before offset
+int LargeFileView::checkpointBeforeOffset(qint64 offset) const
+{
+    auto it = std::upper_bound(checkpoints.cbegin(), checkpoints.cend(), offset,
+                               [](qint64 value, const Checkpoint &checkpoint) { return value < checkpoint.offset; });
+    return qMax(0, int(it - checkpoints.cbegin()) - 1);
+}
+
+// Offset of the first byte of line, or the document size when the line does not exist
+qint64 LargeFileView::lineStart(qint64 line) const
+{
+    const Checkpoint &checkpoint = checkpoints[checkpointBefore(line)];
+    qint64 start = checkpoint.offset;
+    for (qint64 remaining = line - checkpoint.line; remaining > 0; --remaining) {
+        start = nextLineStart(start);
+        if (start < 0) return table.size();
+    }
+    return start;
+}
+
+// A line ends at the first line break within segmentBytes of its start; in
+// long-line mode a line without one ends after segmentBytes bytes instead, or at
+// the next checkpoint if that comes first. A fresh index only puts checkpoints
+// where segments end anyway; after an edit they keep the segments further on
+// where they were, so the edit only moves the boundaries up to the next one.
+qint64 LargeFileView::nextLineStart(qint64 start) const
+{
+    const qint64 size = table.size();
+    qint64 span = size - start;        // Bytes that may hold the line break
+    qint64 segmentEnd = -1;            // Where the line ends without one
+    if (longLines) {
+        span = segmentBytes + 1;
+        segmentEnd = start + segmentBytes;
+        const int next = checkpointBeforeOffset(start) + 1;
+        if (next < checkpoints.size() && checkpoints[next].offset <= segmentEnd) {
+            segmentEnd = checkpoints[next].offset;
+            span = segmentEnd - start;
+        }
+    }
+
+    qint64 spanOffset = start;
+    qint64 found = -1;
+    table.visit(start, span, [&](const char *data, qint64 length) {
+        const void *lineBreak = std::memchr(data, '\n', size_t(length));
+        if (!lineBreak) {
+            spanOffset += length;
+            return true;
+        }
+        found = spanOffset + (static_cast<const char *>(lineBreak) - data) + 1;
+        return false;
+    });
+    if (found >= 0) return found;
+    if (segmentEnd >= 0 && segmentEnd < size) return segmentEnd;
+    return -1;
+}
+
+qint64 LargeFileView::lineEnd(qint64 start) const
+{
+    const qint64 next = nextLineStart(start);
+    if (next < 0) return table.size();
+    return table.at(next - 1) == '\n' ? next - 1 : next;
+}
+
+// Before the CR of CRLF, and before the last character of a segment, whose end is the next line's start
+qint64 LargeFileView::caretEnd(qint64 start) const
+{
+    const qint64 end = lineEnd(start);
+    if (end < table.size() && table.at(end) != '\n') return qMax(start, previousPosition(table, end));
+    if (end > start && table.at(end - 1) == '\r') return end - 1;
+    return end;
+}
+
+qint64 LargeFileView::lineOf(qint64 offset) const
+{
+    const Checkpoint &checkpoint = checkpoints[checkpointBeforeOffset(offset)];
+    qint64 line = checkpoint.line;
+    for (qint64 start = nextLineStart(checkpoint.offset); start >= 0 && start <= offset; start = nextLineStart(start)) {
+        ++line;
+    }
+    return line;
+}
+
+// A segment may begin or end inside a UTF-8 sequence, which then belongs to the earlier line
+qint64 LargeFileView::characterStart(qint64 offset) const
+{
+    const qint64 size = table.size();
+    for (int i = 0; i < 3 && offset < size && (uchar(table.at(offset)) & 0xC0) == 0x80; ++i) ++offset;
+    return offset;
+}
+
+int LargeFileView::wrapColumns() const
+{
+    return int(qMax<qint64>(minimumSegmentBytes, (viewport()->width() - 2 * textMargin) / charWidth));
+}
+
+// Text of [start, end) as painted: capped at maxDisplayBytes, without the CR of CRLF, tabs expanded
+QString LargeFileView::displayText(qint64 start, qint64 end) const
+{
+    start = characterStart(start);
+    end = characterStart(end);
+    QByteArray bytes = table.read(start, qMin(end - start, maxDisplayBytes));
+    if (bytes.endsWith('\r')) bytes.chop(1);
+    QString text = QString::fromUtf8(bytes);
+    text.replace(QLatin1Char('\t'), QString(tabColumns, QLatin1Char(' ')));
+    if (displayColumns > 0 && text.size() > displayColumns) text.truncate(displayColumns);
+    return text;
+}
+
+int LargeFileView::columnForOffset(qint64 start, qint64 offset) const
+{
+    start = characterStart(start);
+    const QString prefix = QString::fromUtf8(table.read(start, qMin(offset - start, maxDisplayBytes)));
+    int column = 0;
+    for (QChar c : prefix) {
+        column += c == QLatin1Char('\t') ? tabColumns : 1;
+    }
+    return column;
+}
+
+qint64 LargeFileView::offsetForColumn(qint64 start, qint64 end, int column) const
+{
+    start = characterStart(start);
+    end = characterStart(end);
+    QByteArray bytes = table.read(start, qMin(end - start, maxDisplayBytes));
+    if (bytes.endsWith('\r')) bytes.chop(1);
+    const QString text = QString::fromUtf8(bytes);
+
+    int columns = 0;
+    int index = 0;
+    while (index < text.size()) {
+        const int width = text.at(index) == QLatin1Char('\t') ? tabColumns : 1;
+        if (columns + width > column) break;
+        columns += width;
+        ++index;
+    }
+    return start + text.left(index).toUtf8().size();
+}
+
+qint64 LargeFileView::positionAt(const QPoint &point) const
+{
+    qint64 line = verticalScrollBar()->value() + qMax(0, point.y()) / lineHeight;
+    line = qMin(line, totalLines - 1);
+    const qint64 start = lineStart(line);
+    const int column = qRound((point.x() - textMargin + horizontalScrollBar()->value()) / double(charWidth));
+    return qMin(offsetForColumn(start, lineEnd(start), qMax(0, column)), caretEnd(start));
+}
+
+// Editing
+
+void LargeFileView::insertText(const QByteArray &text)
+{
+    const qint64 position = cursorPosition;
+    table.insert(position, text);
+    reindexAfterEdit(position, 0, text.size());
+    cursorPosition = position + text.size();
+    setModified(true);
+    updateScrollBars();
+    emit contentsChanged();
+}
+
+void LargeFileView::removeText(qint64 position, qint64 length)
+{
+    if (length <= 0) return;
+    table.remove(position, length);
+    reindexAfterEdit(position, length, 0);
+    setModified(true);
+    updateScrollBars();
+    emit contentsChanged();
+}
+
+// Lines from the edit on may have moved, and in long-line mode the segments of
+// the edited line shift too. Walk the lines again from the last checkpoint the
+// edit cannot have affected until the walk meets a later checkpoint at its
+// shifted offset: from there on the lines are the same as before, one number
+// off at most by the lines the edit added or removed. In long-line mode the
+// later checkpoints bound the segments (see nextLineStart()), so the walk
+// always stops at the next one, however long the edited line is.
+void LargeFileView::reindexAfterEdit(qint64 position, qint64 removed, qint64 inserted)
+{
+    // A segment starting within segmentBytes before the edit may now end at a new line break
+    const qint64 safeOffset = longLines ? position - segmentBytes - 1 : position;
+    QVector<Checkpoint> kept;
+    QVector<Checkpoint> later;   // Old line numbers, new offsets
+    kept.reserve(checkpoints.size());
+    for (const Checkpoint &checkpoint : std::as_const(checkpoints)) {
+        if (checkpoint.offset <= safeOffset || checkpoint.offset == 0) {
+            kept.append(checkpoint);
+        } else if (checkpoint.offset >= position + removed) {
+            later.append({checkpoint.line, checkpoint.offset + inserted - removed});
+        }
+    }
+    const int keptCount = kept.size();
+    checkpoints = kept + later;   // The walk only looks at the offsets
+
+    qint64 line = kept.last().line;
+    qint64 offset = kept.last().offset;
+    QVector<Checkpoint> walked;
+    int next = 0;
+    for (;;) {
+        offset = nextLineStart(offset);
+        if (offset < 0) {
+            totalLines = line + 1;
+            checkpoints.resize(keptCount);
+            break;
+        }
+        ++line;
+        while (next < later.size() && later[next].offset < offset) ++next;
+        if (next < later.size() && later[next].offset == offset) {
+            const qint64 shift = line - later[next].line;
+            checkpoints.resize(keptCount);
+            for (int i = next; i < later.size(); ++i) walked.append({later[i].line + shift, later[i].offset});
+            totalLines += shift;
+            break;
+        }
+        if (line % checkpointInterval == 0) walked.append({line, offset});
+    }
+    checkpoints += walked;
+}
+
+void LargeFileView::setModified(bool value)
+{
+    if (modified == value) return;
+    modified = value;
+    emit modificationChanged(modified);
+}
+
+void LargeFileView::moveCursorToLine(qint64 line)
+{
+    if (preferredColumn < 0) {
+        preferredColumn = columnForOffset(lineStart(lineOf(cursorPosition)), cursorPosition);
+    }
+    line = qBound<qint64>(0, line, totalLines - 1);
+    const qint64 start = lineStart(line);
+    cursorPosition = qMin(offsetForColumn(start, lineEnd(start), preferredColumn), caretEnd(start));
+}
+
+// In long-line mode display lines are not the file's lines, so the file is scanned for the line
+void LargeFileView::goToLine(qint64 line, int column)
+{
+    qint64 offset = 0;
+    if (!longLines) {
+        offset = lineStart(qBound<qint64>(0, line, totalLines - 1));
+    } else if (line > 0) {
+        qint64 remaining = line;
+        qint64 spanOffset = 0;
+        offset = table.size();
+        table.visit(0, table.size(), [&](const char *data, qint64 length) {
+            const char *p = data;
+            const char *end = data + length;
+            while (remaining > 0) {
+                const void *lineBreak = std::memchr(p, '\n', size_t(end - p));
+                if (!lineBreak) {
+                    spanOffset += length;
+                    return true;
+                }
+                p = static_cast<const char *>(lineBreak) + 1;
+                --remaining;
+            }
+            offset = spanOffset + (p - data);
+            return false;
+        });
+    }
+
+    // Columns count UTF-16 units, as QString does: a four-byte sequence is two of them
+    qint64 units = 0;
+    table.visit(offset, table.size() - offset, [&](const char *data, qint64 length) {
+        for (qint64 i = 0; i < length; ++i) {
+            const uchar byte = uchar(data[i]);
+            const bool sequenceStart = (byte & 0xC0) != 0x80;
+            if (byte == '\n' || (sequenceStart && units >= column)) {
+                offset += i;
+                return false;
+            }
+            if (sequenceStart) units += byte >= 0xF0 ? 2 : 1;
+        }
+        offset += length;
+        return true;
+    });
+
+    cursorPosition = offset;
+    selectionAnchor = -1;
+    preferredColumn = -1;
+    ensureCursorVisible();
+    viewport()->update();
+}
+
+qint64 LargeFileView::selectionStart() const
+{
+    return selectionAnchor < 0 ? cursorPosition : qMin(selectionAnchor, cursorPosition);
+}
+
+qint64 LargeFileView::selectionEnd() const
+{
+    return selectionAnchor < 0 ? cursorPosition : qMax(selectionAnchor, cursorPosition);
+}
+
+void LargeFileView::setSelection(qint64 start, qint64 length)
+{
+    start = qBound<qint64>(0, start, table.size());
+    selectionAnchor = start;
+    cursorPosition = qMin(start + qMax<qint64>(0, length), table.size());
+    preferredColumn = -1;
+    ensureCursorVisible();
+    viewport()->update();
+}
+
+void LargeFileView::setLongLineMode(bool enabled)
+{
+    if (longLines == enabled) return;
+    longLines = enabled;
+    reindex();
+}
+
+void LargeFileView::setColumnLimit(int columns)
+{
+    displayColumns = qMax(0, columns);
+    widestLine = 0;
+    updateScrollBars();
+    viewport()->update();
+}
+
+bool LargeFileView::hasLineLongerThan(const QString &fileName, qint64 length)
+{
+    std::shared_ptr<const MappedFile> file = MappedFile::open(fileName);
+    if (!file) return false;
+    const char *data = file->data();
+    const qint64 size = file->size();
+    for (qint64 offset = 0; offset < size; ) {
+        const void *lineBreak = std::memchr(data + offset, '\n', size_t(qMin(size - offset, length + 1)));
+        if (!lineBreak) return size - offset > length;
+        offset = static_cast<const char *>(lineBreak) - data + 1;
+    }
+    return false;
+}
+
+// The text is copied out a chunk at a time; chunks overlap by one byte less than
+// the needle, so a match straddling two pieces or two chunks is still found
+QVector<qint64> LargeFileView::findAll(const PieceTable &text, const QByteArray &needle, Qt::CaseSensitivity cs,
+                                       qsizetype limit, const std::atomic_bool *cancel)
+{
+    QVector<qint64> offsets;
+    const qint64 size = text.size();
+    const qint64 needleSize = needle.size();
+    if (needleSize == 0) return offsets;
+    const qint64 chunk = qMax(searchChunkBytes, 2 * needleSize);
+
+    for (qint64 from = 0; from + needleSize <= size; ) {
+        if (cancel && *cancel) break;
+        const QByteArray window = text.read(from, qMin(chunk, size - from));
+        qsizetype next = 0;   // Where the search goes on inside the window, past the last match
+        for (;;) {
+            const qsizetype found = TextSearch::indexOf(window.constData() + next, window.size() - next, needle, cs);
+            if (found < 0) break;
+            offsets.append(from + next + found);
+            if (offsets.size() >= limit) return offsets;
+            next += found + needleSize;
+        }
+        if (from + window.size() >= size) break;
+        from += qMax<qint64>(next, window.size() - needleSize + 1);
+    }
+    return offsets;
+}
+
+void LargeFileView::ensureCursorVisible()
+{
+    const qint64 line = lineOf(cursorPosition);
+    const qint64 first = verticalScrollBar()->value();
+    const int rows = qMax(1, visibleLines());
+    if (line < first) {
+        verticalScrollBar()->setValue(int(qMin<qint64>(line, INT_MAX)));
+    } else if (line >= first + rows) {
+        verticalScrollBar()->setValue(int(qMin<qint64>(line - rows + 1, INT_MAX)));
+    }
+
+    const int caretX = columnForOffset(lineStart(line), cursorPosition) * charWidth;
+    const int left = horizontalScrollBar()->value();
+    const int width = viewport()->width() - 2 * textMargin;
+    if (caretX < left) {
+        horizontalScrollBar()->setValue(caretX);
+    } else if (caretX > left + width) {
+        widestLine = qMax(widestLine, caretX);
+        updateScrollBars();
+        horizontalScrollBar()->setValue(caretX - width);
+    }
+}
+
+// Events
+
+void LargeFileView::keyPressEvent(QKeyEvent *event)
+{
+    const bool control = event->modifiers() & Qt::ControlModifier;
+    const bool editable = !indexing;  // Checkpoints are only adjusted for edits once the index is complete
+    selectionAnchor = -1;
+
+    switch (event->key()) {
+    case Qt::Key_Left:
+        cursorPosition = previousPosition(table, cursorPosition);
+        preferredColumn = -1;
+        break;
+    case Qt::Key_Right:
+        cursorPosition = nextPosition(table, cursorPosition);
+        preferredColumn = -1;
+        break;
+    case Qt::Key_Up:
+        moveCursorToLine(lineOf(cursorPosition) - 1);
+        break;
+    case Qt::Key_Down:
+        moveCursorToLine(lineOf(cursorPosition) + 1);
+        break;
+    case Qt::Key_PageUp:
+        moveCursorToLine(lineOf(cursorPosition) - visibleLines());
+        break;
+    case Qt::Key_PageDown:
+        moveCursorToLine(lineOf(cursorPosition) + visibleLines());
+        break;
+    case Qt::Key_Home:
+        cursorPosition = control ? 0 : lineStart(lineOf(cursorPosition));
+        preferredColumn = -1;
+        break;
+    case Qt::Key_End:
+        if (control) {
+            cursorPosition = table.size();
+        } else {
+            cursorPosition = caretEnd(lineStart(lineOf(cursorPosition)));
+        }
+        preferredColumn = -1;
+        break;
+    case Qt::Key_Backspace:
+        if (editable && cursorPosition > 0) {
+            const qint64 previous = previousPosition(table, cursorPosition);
+            removeText(previous, cursorPosition - previous);
+            cursorPosition = previous;
+        }
+        preferredColumn = -1;
+        break;
+    case Qt::Key_Delete:
+        if (editable) removeText(cursorPosition, nextPosition(table, cursorPosition) - cursorPosition);
+        preferredColumn = -1;
+        break;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        if (editable) insertText("\n");
+        preferredColumn = -1;
+        break;
+    default:
+        if (editable && !control && !event->text().isEmpty() && event->text().at(0).isPrint()) {
+            insertText(event->text().toUtf8());
+            preferredColumn = -1;
+            break;
+        }
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+
+    ensureCursorVisible();
+    viewport()->update();
+}
+
+void LargeFileView::mousePressEvent(QMouseEvent *event)
+{
+    setFocus();
+    selectionAnchor = -1;
+    cursorPosition = positionAt(event->pos());
+    preferredColumn = -1;
+    viewport()->update();
+}
+
+// Paint only the lines inside the viewport
+void LargeFileView::paintEvent(QPaintEvent *event)
+{
+    PERF_SCOPE("paint");
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().base());
+    painter.setPen(palette().text().color());
+    painter.setFont(font());
+
+    const int ascent = QFontMetrics(font()).ascent();
+    const int x = textMargin - horizontalScrollBar()->value();
+    const int rows = visibleLines() + 1;
+    int widest = widestLine;
+
+    const qint64 selectedFrom = selectionStart();
+    const qint64 selectedTo = selectionEnd();
+
+    qint64 start = lineStart(verticalScrollBar()->value());
+    for (int row = 0; row < rows; ++row) {
+        const qint64 end = lineEnd(start);
+        const bool segment = end < table.size() && table.at(end) != '\n';   // The next line starts at end
+        const QString text = displayText(start, end);
+        const int y = row * lineHeight;
+
+        if (selectedFrom < end && selectedTo > start) {
+            const int left = x + columnForOffset(start, qMax(selectedFrom, start)) * charWidth;
+            const int right = x + columnForOffset(start, qMin(selectedTo, end)) * charWidth;
+            painter.fillRect(left, y, right - left, lineHeight, palette().highlight());
+        }
+        painter.drawText(x, y + ascent, text);
+        widest = qMax(widest, int(text.size()) * charWidth);
+
+        if (hasFocus() && cursorPosition >= start && (cursorPosition < end || (!segment && cursorPosition == end))) {
+            const int caretX = x + columnForOffset(start, cursorPosition) * charWidth;
+            painter.fillRect(caretX, y, 1, lineHeight, palette().text());
+        }
+
+        if (end >= table.size()) break;
+        start = segment ? end : end + 1;
+    }
+
+    // Lines are only measured when painted, so the horizontal range grows as wider lines come into view
+    if (widest != widestLine) {
+        widestLine = widest;
+        QTimer::singleShot(0, this, &LargeFileView::updateScrollBars);
+    }
+}
+
+void LargeFileView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+    if (longLines) rewrapTimer->start();
+}
+
+void LargeFileView::scrollContentsBy(int, int)
+{
+    viewport()->update();
+}
+
+int LargeFileView::visibleLines() const
+{
+    return viewport()->height() / lineHeight;
+}
+
+void LargeFileView::updateScrollBars()
+{
+    const qint64 maxFirstLine = qMax<qint64>(0, totalLines - visibleLines());
+    verticalScrollBar()->setRange(0, int(qMin<qint64>(maxFirstLine, INT_MAX)));
+    verticalScrollBar()->setPageStep(qMax(1, visibleLines()));
+    verticalScrollBar()->setSingleStep(1);
+
+    horizontalScrollBar()->setRange(0, qMax(0, widestLine + 2 * textMargin - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+    horizontalScrollBar()->setSingleStep(charWidth);
+}
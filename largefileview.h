@@ -0,0 +1,129 @@
+#ifndef LARGEFILEVIEW_H
+#define LARGEFILEVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QVector>
+#include <atomic>
+#include <memory>
+#include "piecetable.h"
+
+class QThread;
+class QTimer;
+
+// Read-mostly editor for files too large for a QTextEdit.
+// The text lives in a piece table over the memory-mapped file, so opening costs
+// a mapping rather than a copy. Line starts are found through a sparse index
+// (one checkpoint every few thousand lines) built on a worker thread, and only
+// the lines inside the viewport are ever decoded, laid out and painted.
+// Editing is enabled once the index is complete.
+//
+// Lines here are display lines. In long-line mode (for minified JSON, base64
+// dumps and the like) a line longer than the viewport is split into segments
+// of that many bytes, each a display line of its own, so no single line is
+// ever laid out whole; the file itself is untouched.
+class LargeFileView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    explicit LargeFileView(QWidget *parent = nullptr);
+    ~LargeFileView();
+
+    bool openFile(const QString &fileName, QString *errorString = nullptr);
+    bool saveFile(const QString &fileName, QString *errorString = nullptr);
+
+    const PieceTable &pieceTable() const { return table; }
+    qint64 lineCount() const { return totalLines; }
+    bool isIndexing() const { return indexing; }
+    bool isModified() const { return modified; }
+    void goToLine(qint64 line, int column = 0);   // 0-based line of the file; column in UTF-16 units
+
+    qint64 selectionStart() const;
+    qint64 selectionEnd() const;
+    void setSelection(qint64 start, qint64 length);   // Byte range; moves the caret to its end and scrolls it into view
+
+    bool longLineMode() const { return longLines; }
+    void setLongLineMode(bool enabled);
+    int columnLimit() const { return displayColumns; }
+    void setColumnLimit(int columns);             // Lines are cut at columns when painted; 0 for no limit
+
+    // True when a line of the file is longer than length bytes
+    static bool hasLineLongerThan(const QString &fileName, qint64 length);
+
+    // Byte offsets of the first limit non-overlapping occurrences of needle in a snapshot
+    // of the text, found across piece, segment and checkpoint boundaries alike.
+    // Case-insensitive search folds ASCII letters only. Safe to call on any thread.
+    static QVector<qint64> findAll(const PieceTable &text, const QByteArray &needle, Qt::CaseSensitivity cs,
+                                   qsizetype limit, const std::atomic_bool *cancel = nullptr);
+
+signals:
+    void modificationChanged(bool modified);
+    void contentsChanged();
+    void indexingFinished();
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+
+private:
+    struct Checkpoint {
+        qint64 line;
+        qint64 offset;   // Offset of the first byte of line
+    };
+
+    void startIndexing();
+    void stopIndexer();
+    void reindex();
+    void reindexAfterEdit(qint64 position, qint64 removed, qint64 inserted);
+    void appendCheckpoints(const QVector<Checkpoint> &batch, qint64 lines, bool done);
+    int checkpointBefore(qint64 line) const;
+    int checkpointBeforeOffset(qint64 offset) const;
+
+    qint64 lineStart(qint64 line) const;
+    qint64 nextLineStart(qint64 start) const;    // -1 for the last line
+    qint64 lineEnd(qint64 start) const;          // Offset of the line break ending the line, the next segment, or the document size
+    qint64 caretEnd(qint64 start) const;         // Furthest caret position on the line
+    qint64 lineOf(qint64 offset) const;
+    qint64 characterStart(qint64 offset) const;  // First offset at or after offset that starts a UTF-8 sequence
+    int wrapColumns() const;
+    QString displayText(qint64 start, qint64 end) const;
+    int columnForOffset(qint64 start, qint64 offset) const;
+    qint64 offsetForColumn(qint64 start, qint64 end, int column) const;
+    qint64 positionAt(const QPoint &point) const;
+
+    void insertText(const QByteArray &text);
+    void removeText(qint64 position, qint64 length);
+    void setModified(bool value);
+    void moveCursorToLine(qint64 line);
+    void ensureCursorVisible();
+    void updateScrollBars();
+    int visibleLines() const;
+
+    std::shared_ptr<const MappedFile> mappedFile;
+    PieceTable table;
+    QVector<Checkpoint> checkpoints;   // Sorted by line and by offset
+    qint64 totalLines = 1;
+    bool longLines = false;
+    qint64 segmentBytes = 0;           // Longest display line in long-line mode, fixed while an index is built
+    int displayColumns = 0;
+    qint64 restoreTopOffset = -1;      // Scrolled back to once a new index is complete
+    QTimer *rewrapTimer;
+
+    QThread *indexThread = nullptr;
+    std::atomic_bool stopIndexing;
+    quint64 indexGeneration = 0;       // Batches queued by an index that has been replaced are dropped
+    bool indexing = false;
+    bool modified = false;
+
+    qint64 cursorPosition = 0;         // Byte offset of the caret
+    qint64 selectionAnchor = -1;       // Other end of the selection, or -1 for none
+    int preferredColumn = -1;          // Column kept while moving up and down
+    int lineHeight = 1;
+    int charWidth = 1;
+    int widestLine = 0;
+};
+
+#endif // LARGEFILEVIEW_H
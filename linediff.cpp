@@ -0,0 +1,275 @@
+#include "linediff.h"
+#include "perftrace.h"
+#include <QSet>
+#include <QtConcurrent/QtConcurrentMap>
+#include <climits>
+
+static const int linesPerChunk = 16384;     // Lines hashed per parallel task
+static const int maxCost = 256;             // Edit steps searched in one region before it is split heuristically
+
+namespace {
+
+// Myers' bidirectional search, after the version in GNU diff. Marks the lines of
+// a that are not in the common subsequence as removed, and those of b as added.
+class Differ
+{
+public:
+    Differ(const QVector<quint64> &a, const QVector<quint64> &b)
+        : a(a.constData()), b(b.constData()), forward(a.size() + b.size() + 3), backward(a.size() + b.size() + 3),
+          offset(int(b.size()) + 1), removed(a.size(), false), added(b.size(), false)
+    {
+    }
+
+    void run(int n, int m);
+
+    const quint64 *a;
+    const quint64 *b;
+    QVector<int> forward;            // Furthest x reached on each diagonal (x - y), shifted by offset
+    QVector<int> backward;
+    int offset;
+    QVector<bool> removed;
+    QVector<bool> added;
+
+private:
+    struct Range
+    {
+        int xoff, xlim, yoff, ylim;
+    };
+
+    bool split(const Range &range, int *xmid, int *ymid);
+};
+
+void Differ::run(int n, int m)
+{
+    // Regions left to compare; a stack rather than recursion, since lopsided splits can nest deeply
+    QVector<Range> stack = {{0, n, 0, m}};
+    while (!stack.isEmpty()) {
+        Range range = stack.takeLast();
+        while (range.xoff < range.xlim && range.yoff < range.ylim && a[range.xoff] == b[range.yoff]) {
+            ++range.xoff;
+            ++range.yoff;
+        }
+        while (range.xoff < range.xlim && range.yoff < range.ylim && a[range.xlim - 1] == b[range.ylim - 1]) {
+            --range.xlim;
+            --range.ylim;
+        }
+
+        int xmid, ymid;
+        if (range.xoff == range.xlim || range.yoff == range.ylim || !split(range, &xmid, &ymid)) {
+            for (int x = range.xoff; x < range.xlim; ++x) removed[x] = true;
+            for (int y = range.yoff; y < range.ylim; ++y) added[y] = true;
+            continue;
+        }
+        stack.append({range.xoff, xmid, range.yoff, ymid});
+        stack.append({xmid, range.xlim, ymid, range.ylim});
+    }
+}
+
+// Find a point an optimal path passes through, searching from both ends until the
+// two searches meet. False when the only point found is a corner of the range.
+bool Differ::split(const Range &range, int *xmid, int *ymid)
+{
+    const int xoff = range.xoff, xlim = range.xlim, yoff = range.yoff, ylim = range.ylim;
+    int *fd = forward.data() + offset;
+    int *bd = backward.data() + offset;
+
+    const int dmin = xoff - ylim;
+    const int dmax = xlim - yoff;
+    const int fmid = xoff - yoff;
+    const int bmid = xlim - ylim;
+    int fmin = fmid, fmax = fmid;
+    int bmin = bmid, bmax = bmid;
+    const bool odd = (fmid - bmid) & 1;   // The searches can only meet going forward
+
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+
+    for (int cost = 1;; ++cost) {
+        if (fmin > dmin) fd[--fmin - 1] = -1; else ++fmin;
+        if (fmax < dmax) fd[++fmax + 1] = -1; else --fmax;
+        for (int d = fmax; d >= fmin; d -= 2) {
+            int x = fd[d - 1] >= fd[d + 1] ? fd[d - 1] + 1 : fd[d + 1];
+            int y = x - d;
+            while (x < xlim && y < ylim && a[x] == b[y]) {
+                ++x;
+                ++y;
+            }
+            fd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+                *xmid = x;
+                *ymid = y;
+                return !((x == xoff && y == yoff) || (x == xlim && y == ylim));
+            }
+        }
+
+        if (bmin > dmin) bd[--bmin - 1] = INT_MAX; else ++bmin;
+        if (bmax < dmax) bd[++bmax + 1] = INT_MAX; else --bmax;
+        for (int d = bmax; d >= bmin; d -= 2) {
+            int x = bd[d - 1] < bd[d + 1] ? bd[d - 1] : bd[d + 1] - 1;
+            int y = x - d;
+            while (x > xoff && y > yoff && a[x - 1] == b[y - 1]) {
+                --x;
+                --y;
+            }
+            bd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+                *xmid = x;
+                *ymid = y;
+                return !((x == xoff && y == yoff) || (x == xlim && y == ylim));
+            }
+        }
+
+        if (cost >= maxCost) {
+            // Too expensive: split where either search got furthest
+            int forwardBest = -1, forwardX = xoff;
+            for (int d = fmax; d >= fmin; d -= 2) {
+                int x = qMin(fd[d], xlim);
+                int y = x - d;
+                if (ylim < y) {
+                    x = ylim + d;
+                    y = ylim;
+                }
+                if (forwardBest < x + y) {
+                    forwardBest = x + y;
+                    forwardX = x;
+                }
+            }
+            int backwardBest = INT_MAX, backwardX = xlim;
+            for (int d = bmax; d >= bmin; d -= 2) {
+                int x = qMax(xoff, bd[d]);
+                int y = x - d;
+                if (y < yoff) {
+                    x = yoff + d;
+                    y = yoff;
+                }
+                if (x + y < backwardBest) {
+                    backwardBest = x + y;
+                    backwardX = x;
+                }
+            }
+            if ((xlim + ylim) - backwardBest < forwardBest - (xoff + yoff)) {
+                *xmid = forwardX;
+                *ymid = forwardBest - forwardX;
+            } else {
+                *xmid = backwardX;
+                *ymid = backwardBest - backwardX;
+            }
+            return !((*xmid == xoff && *ymid == yoff) || (*xmid == xlim && *ymid == ylim));
+        }
+    }
+}
+
+}
+
+namespace LineDiff
+{
+
+quint64 hashLine(QStringView line)
+{
+    if constexpr (sizeof(size_t) >= sizeof(quint64)) {
+        return qHash(line, 0);
+    } else {
+        return (quint64(qHash(line, 0x9e3779b9)) << 32) | qHash(line, 0);
+    }
+}
+
+QVector<quint64> hashLines(QStringView text, QChar separator)
+{
+    PERF_SCOPE("hash lines");
+    QVector<qsizetype> starts = {0};
+    for (qsizetype i = text.indexOf(separator); i >= 0; i = text.indexOf(separator, i + 1)) {
+        starts.append(i + 1);
+    }
+
+    QVector<quint64> hashes(starts.size());
+    quint64 *out = hashes.data();
+    const qsizetype *lineStarts = starts.constData();
+    const int lineCount = int(starts.size());
+
+    QVector<int> chunks;
+    for (int first = 0; first < lineCount; first += linesPerChunk) chunks.append(first);
+    QtConcurrent::blockingMap(chunks, [=](int first) {
+        const int end = qMin(first + linesPerChunk, lineCount);
+        for (int i = first; i < end; ++i) {
+            const qsizetype lineEnd = i + 1 < lineCount ? lineStarts[i + 1] - 1 : text.size();
+            out[i] = hashLine(text.mid(lineStarts[i], lineEnd - lineStarts[i]));
+        }
+    });
+    return hashes;
+}
+
+QVector<Edit> diff(const QVector<quint64> &oldLines, const QVector<quint64> &newLines)
+{
+    PERF_SCOPE("diff lines");
+    const int oldCount = int(oldLines.size());
+    const int newCount = int(newLines.size());
+
+    // An edit usually leaves most of both ends alone
+    int prefix = 0;
+    while (prefix < oldCount && prefix < newCount && oldLines[prefix] == newLines[prefix]) ++prefix;
+    int suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix
+           && oldLines[oldCount - 1 - suffix] == newLines[newCount - 1 - suffix]) {
+        ++suffix;
+    }
+
+    // Lines missing from the other side are changes whatever the search finds; leave them out of it
+    QSet<quint64> inOld(oldLines.cbegin() + prefix, oldLines.cend() - suffix);
+    QSet<quint64> inNew(newLines.cbegin() + prefix, newLines.cend() - suffix);
+    QVector<bool> removed(oldCount, false);
+    QVector<bool> added(newCount, false);
+    QVector<quint64> a, b;
+    QVector<int> aLines, bLines;
+    for (int i = prefix; i < oldCount - suffix; ++i) {
+        if (inNew.contains(oldLines[i])) {
+            a.append(oldLines[i]);
+            aLines.append(i);
+        } else {
+            removed[i] = true;
+        }
+    }
+    for (int i = prefix; i < newCount - suffix; ++i) {
+        if (inOld.contains(newLines[i])) {
+            b.append(newLines[i]);
+            bLines.append(i);
+        } else {
+            added[i] = true;
+        }
+    }
+
+    Differ differ(a, b);
+    differ.run(int(a.size()), int(b.size()));
+    for (int x = 0; x < a.size(); ++x) {
+        if (differ.removed[x]) removed[aLines[x]] = true;
+    }
+    for (int y = 0; y < b.size(); ++y) {
+        if (differ.added[y]) added[bLines[y]] = true;
+    }
+
+    // The lines left unmarked pair up in order
+    QVector<Edit> edits;
+    int i = 0, j = 0;
+    while (i < oldCount || j < newCount) {
+        if (i < oldCount && j < newCount && !removed[i] && !added[j]) {
+            ++i;
+            ++j;
+            continue;
+        }
+        Edit edit = {i, 0, j, 0};
+        while (i < oldCount && removed[i]) ++i;
+        while (j < newCount && added[j]) ++j;
+        edit.oldCount = i - edit.oldStart;
+        edit.newCount = j - edit.newStart;
+        if (edit.oldCount == 0 && edit.newCount == 0) {
+            // Only one side has lines left; they are all changes
+            edit.oldCount = oldCount - i;
+            edit.newCount = newCount - j;
+            i = oldCount;
+            j = newCount;
+        }
+        edits.append(edit);
+    }
+    return edits;
+}
+
+}
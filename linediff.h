@@ -0,0 +1,39 @@
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+// Line-wise diff over 64-bit line hashes.
+// Lines are compared by hash only, so a diff never touches the text: hashing
+// is one parallel pass, and an edit only rehashes the lines it changed.
+// Lines found on one side only are set aside before the search (they cannot
+// match anyway), common prefixes and suffixes are trimmed, and the rest goes
+// through Myers' linear-space O(ND) algorithm. A region that would need more
+// than a bounded number of edit steps is split at the furthest point reached
+// instead of searched to the end, which keeps unrelated files fast at the cost
+// of a less minimal diff there.
+namespace LineDiff
+{
+
+// A region that differs: old lines [oldStart, oldStart + oldCount) became new
+// lines [newStart, newStart + newCount). The lines between regions are equal.
+struct Edit
+{
+    int oldStart;
+    int oldCount;
+    int newStart;
+    int newCount;
+};
+
+quint64 hashLine(QStringView line);
+
+// One hash per line of text, lines separated by separator; hashed in parallel
+QVector<quint64> hashLines(QStringView text, QChar separator = QLatin1Char('\n'));
+
+QVector<Edit> diff(const QVector<quint64> &oldLines, const QVector<quint64> &newLines);
+
+}
+
+#endif // LINEDIFF_H
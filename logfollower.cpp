@@ -0,0 +1,129 @@
+#include "logfollower.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QScrollBar>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QTimer>
+
+static const qint64 initialTailBytes = 4 * 1024 * 1024;   // Of an existing file, only this much is shown at first
+static const qint64 maxReadSlice = 1024 * 1024;            // Larger appends are added a slice per event loop turn
+static const int coalesceDelay = 50;                       // ms to gather change notifications into one read
+static const int pollInterval = 1000;
+
+LogFollower::LogFollower(QTextEdit *editor, const QString &fileName)
+    : QObject(editor), editor(editor), path(fileName), decoder(QStringDecoder::Utf8),
+      wasReadOnly(editor->isReadOnly()), undoWasEnabled(editor->document()->isUndoRedoEnabled())
+{
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, &LogFollower::onFileChanged);
+
+    readTimer = new QTimer(this);
+    readTimer->setSingleShot(true);
+    connect(readTimer, &QTimer::timeout, this, &LogFollower::readNewBytes);
+
+    pollTimer = new QTimer(this);
+    pollTimer->setInterval(pollInterval);
+    connect(pollTimer, &QTimer::timeout, this, &LogFollower::onFileChanged);
+}
+
+LogFollower::~LogFollower()
+{
+    if (!editor) return;
+    QTextDocument *document = editor->document();
+    document->setMaximumBlockCount(0);
+    document->setUndoRedoEnabled(undoWasEnabled);
+    editor->setReadOnly(wasReadOnly);
+}
+
+void LogFollower::setMaximumLines(int lines)
+{
+    maximumLines = qMax(0, lines);
+}
+
+// Replace the document with the tail of the file and start watching it
+bool LogFollower::start(QString *errorString)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    const qint64 size = file.size();
+    file.close();
+
+    offset = size > initialTailBytes ? size - initialTailBytes : 0;
+    skipPartialLine = offset > 0;
+    complete = offset == 0;
+
+    QTextDocument *document = editor->document();
+    editor->setReadOnly(true);
+    document->setUndoRedoEnabled(false);
+    document->clear();
+    document->setMaximumBlockCount(maximumLines);   // Qt drops the oldest blocks past this count
+
+    watcher->addPath(path);
+    pollTimer->start();
+    readNewBytes();
+    return true;
+}
+
+void LogFollower::onFileChanged()
+{
+    // A rotated or recreated file drops out of the watcher
+    if (!watcher->files().contains(path)) watcher->addPath(path);
+    if (!readTimer->isActive()) readTimer->start(coalesceDelay);
+}
+
+// Read what has been appended since the last read, a slice at a time
+void LogFollower::readNewBytes()
+{
+    if (!editor) return;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return;  // Mid-rotation; the poll tries again
+
+    const qint64 size = file.size();
+    if (size < offset) {
+        // Truncated or replaced: follow the new content from its start
+        offset = 0;
+        skipPartialLine = false;
+        complete = false;
+        decoder.resetState();
+    }
+    if (size == offset || !file.seek(offset)) return;
+
+    QByteArray bytes = file.read(qMin(size - offset, maxReadSlice));
+    offset += bytes.size();
+    if (skipPartialLine) {
+        const qsizetype lineBreak = bytes.indexOf('\n');
+        if (lineBreak >= 0) {
+            bytes.remove(0, lineBreak + 1);
+            skipPartialLine = false;
+        } else {
+            bytes.clear();
+        }
+    }
+
+    QString text = decoder.decode(bytes);
+    text.remove(QLatin1Char('\r'));
+    if (!text.isEmpty()) append(text);
+    if (offset < size) readTimer->start(0);  // Let the event loop breathe before the next slice
+}
+
+void LogFollower::append(const QString &text)
+{
+    QTextDocument *document = editor->document();
+    QScrollBar *scrollBar = editor->verticalScrollBar();
+    const bool followEnd = scrollBar->value() >= scrollBar->maximum();  // Stay put if the user scrolled up
+
+    QTextCursor cursor(document);
+    cursor.movePosition(QTextCursor::End);
+    cursor.beginEditBlock();
+    cursor.insertText(text);
+    cursor.endEditBlock();
+
+    if (maximumLines > 0 && document->blockCount() >= maximumLines) complete = false;
+    document->setModified(false);   // The text matches the file
+    if (followEnd) scrollBar->setValue(scrollBar->maximum());
+}
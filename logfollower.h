@@ -0,0 +1,56 @@
+#ifndef LOGFOLLOWER_H
+#define LOGFOLLOWER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringDecoder>
+
+class QTextEdit;
+class QFileSystemWatcher;
+class QTimer;
+
+// tail -f for an editor. The document shows the end of a file and the bytes
+// appended to it since the last read are added at the end as one edit, so a
+// log that grows quickly never gets re-read. Change notifications from the
+// file system watcher are coalesced; a slow poll covers file systems without
+// them and picks the file up again after it has been rotated. With a line
+// limit the document keeps only the newest lines, like a ring buffer.
+// While it follows, the editor is read-only and keeps no undo history.
+class LogFollower : public QObject
+{
+    Q_OBJECT
+
+public:
+    LogFollower(QTextEdit *editor, const QString &fileName);   // A child of editor
+    ~LogFollower();                                            // Gives the editor back its previous state
+
+    void setMaximumLines(int lines);     // 0 keeps every line
+    bool start(QString *errorString = nullptr);
+
+    QString fileName() const { return path; }
+    bool isComplete() const { return complete; }   // The document holds the whole file
+
+private slots:
+    void onFileChanged();
+    void readNewBytes();
+
+private:
+    void append(const QString &text);
+
+    QPointer<QTextEdit> editor;
+    QString path;
+    QFileSystemWatcher *watcher;
+    QTimer *readTimer;          // Coalesces change notifications; also reads the rest of a large append
+    QTimer *pollTimer;
+    QStringDecoder decoder;     // Keeps a character split between two reads
+
+    qint64 offset = 0;          // Bytes of the file read so far
+    int maximumLines = 0;
+    bool complete = true;
+    bool skipPartialLine = false;   // The first read started mid-file
+    bool wasReadOnly;
+    bool undoWasEnabled;
+};
+
+#endif // LOGFOLLOWER_H
@@ -1,10 +1,31 @@
 #include "mainwindow.h"
+#include "benchmark.h"
 
 #include <QApplication>
+#include <QTextStream>
 
 int main(int argc, char *argv[])
 {
+    // Benchmarks run headless: pick the offscreen platform before the application starts
+    bool benchmark = false;
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "--benchmark") == 0) benchmark = true;
+    }
+    if (benchmark && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
     QApplication a(argc, argv);
+    if (benchmark) {
+        Benchmark::Options options;
+        QString errorString;
+        if (!Benchmark::parseArguments(a.arguments(), &options, &errorString)) {
+            QTextStream(stderr) << errorString << '\n';
+            return 2;
+        }
+        return Benchmark(options).run();
+    }
+
     MainWindow w;
     w.show();
     return a.exec();
@@ -19,62 +19,165 @@
 #include <QTextTable>
 #include <QTextList>
 #include <QTextBlockFormat>
+#include <QProgressDialog>
+#include <QPointer>
+#include "fileloader.h"
+#include "largefileview.h"
+#include "wordcounter.h"
+#include "findbar.h"
+#include "textreplace.h"
+#include "sessionstore.h"
+#include "tabplaceholder.h"
+#include "richdocument.h"
+#include "textcodec.h"
+#include "filesaver.h"
+#include "autosaver.h"
+#include "spellchecker.h"
+#include "spellhighlighter.h"
+#include "syntaxhighlighter.h"
+#include "documentoverview.h"
+#include "overviewscrollbar.h"
+#include "diffview.h"
+#include "wordcompleter.h"
+#include "findinfilesdock.h"
+#include "trigramindex.h"
+#include "logfollower.h"
+#include "speechreader.h"
+#include "perftrace.h"
+#include "perfoverlay.h"
+#include "tracededit.h"
+#include "undohistory.h"
+#include "formatengine.h"
+#include <QSignalBlocker>
+#include <QScrollBar>
+#include <QAbstractTextDocumentLayout>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QVBoxLayout>
+#include <QTabBar>
+
+// Files at least this large are streamed in on a worker thread instead of read in one go
+static const qint64 streamingOpenThreshold = 8 * 1024 * 1024;
+// Files at least this large open in a LargeFileView instead of a QTextEdit
+static const qint64 largeFileViewThreshold = 256 * 1024 * 1024;
+// Files with a line longer than this open in a LargeFileView too: QTextEdit lays a line out as one block
+static const qint64 longLineThreshold = 256 * 1024;
+// Placeholder tabs this many positions either side of the current one are read ahead (0 turns preloading off)
+static const int neighbourPreloadRadius = 1;
+// Tabs with more characters than this are only read when they are shown
+static const qint64 maxPreloadSize = 4 * 1024 * 1024;
+// Followed logs keep this many of their newest lines
+static const int followHistoryLines = 200000;
+
+// Detect the encoding of a whole file and decode it with line endings normalized;
+// decodingErrors tells whether any bytes had to become replacement characters
+static QString decodeFile(const QByteArray &bytes, TextCodec::Encoding *encoding, bool *decodingErrors)
+{
+    *encoding = TextCodec::detect(bytes);
+    TextCodec::Decoder decoder(encoding->charset);
+    QString text = decoder.decode(QByteArrayView(bytes).mid(TextCodec::bomSize(*encoding)));
+    *decodingErrors = decoder.hasError();
+    if (text.contains(QLatin1Char('\r'))) text.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    return text;
+}
 
 // Constructor
-MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), ui(new Ui::MainWindow)
+MainWindow::MainWindow(QWidget *parent, const QString &dataDirectory) : QMainWindow(parent), ui(new Ui::MainWindow)
 {
+    PERF_SCOPE("startup");
     ui->setupUi(this); // Setup the UI components
-    autoSaveEnabled = false;  // Auto-save is initially disabled
-    autoSaveTimer = new QTimer(this);  // Create the auto-save timer
+    autoSaver = new AutoSaver(this);  // Auto-save is initially disabled
+
+           // Spell checking is on whenever a dictionary ships next to the executable
+    spellChecker = new SpellChecker(this);
+    QString dictionaryError;
+    if (!spellChecker->loadDictionary("en_US", &dictionaryError)) {
+        statusBar()->showMessage(tr("Spell checking disabled: %1").arg(dictionaryError), 10000);
+    }
+    wordCompleter = new WordCompleter(spellChecker, this);
     //darkmode init
     isDarkmode = false;
 
-    connect(autoSaveTimer, &QTimer::timeout, this, &MainWindow::autoSaveDocument); // Connect the timer signal to the auto-save function
+    connect(autoSaver, &AutoSaver::saveFailed, this, [this](const QString &fileName, const QString &errorString) {
+        statusBar()->showMessage(tr("Auto-save of %1 failed: %2").arg(QFileInfo(fileName).fileName(), errorString), 10000);
+    });
     tabWidth = 4;
+    longLineColumnLimit = 0;
     useSpacesForTabs = true;
 
            // Initialize word count label
     wordCountLabel = new QLabel("Words: 0", this);
     statusBar()->addPermanentWidget(wordCountLabel);
 
-           // Get document path
-    QString documentsPath = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
-    QString sessionFilePath = documentsPath + "/NotepadAppSession.ini";
-
-           // Load search history from document
-    QSettings settings(sessionFilePath, QSettings::IniFormat);
-
            // Initialize the tab widget and set it as the central widget
     tabWidget = new QTabWidget(this);
     tabWidget->setTabsClosable(true);
     tabWidget->setMovable(true);  // Enable drag-and-drop rearrangement
-    setCentralWidget(tabWidget);
+
+           // The find bar sits under the tabs and follows the current editor
+    findBar = new FindBar(this);
+    QWidget *central = new QWidget(this);
+    QVBoxLayout *centralLayout = new QVBoxLayout(central);
+    centralLayout->setContentsMargins(0, 0, 0, 0);
+    centralLayout->setSpacing(0);
+    centralLayout->addWidget(tabWidget);
+    centralLayout->addWidget(findBar);
+    setCentralWidget(central);
+
+           // The journals of every tab's text, read by find in files for tabs not built yet
+    sessionStore = new SessionStore(dataDirectory.isEmpty() ? SessionStore::defaultDirectory() : dataDirectory + "/session", this);
+    if (dataDirectory.isEmpty()) {
+        sessionStore->importLegacySession(QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/NotepadAppSession.ini");
+    }
+
+           // Find in files searches every tab plus, optionally, a folder and the indexed files
+    trigramIndex = new TrigramIndex(dataDirectory.isEmpty() ? TrigramIndex::defaultDirectory() : dataDirectory + "/index", this);
+    connect(autoSaver, &AutoSaver::saved, trigramIndex, &TrigramIndex::addFile);
+    findInFilesDock = new FindInFilesDock(tabWidget, &tabFileMap, sessionStore, trigramIndex, this);
+    addDockWidget(Qt::BottomDockWidgetArea, findInFilesDock);
+    findInFilesDock->hide();
+    connect(findInFilesDock, &FindInFilesDock::openHit, this, &MainWindow::openSearchHit);
+
+           // Timings of the traced hot paths: a summary in the status bar, details in the overlay
+    perfOverlay = new PerfOverlay(tabWidget);
+    QLabel *perfLabel = new QLabel(this);
+    statusBar()->addPermanentWidget(perfLabel);
+    connect(perfOverlay, &PerfOverlay::summaryChanged, perfLabel, &QLabel::setText);
 
            // Connect the tab close signal
     connect(tabWidget, &QTabWidget::tabCloseRequested, this, &MainWindow::on_tabCloseRequested);
 
-           // Load session data
-    int tabCount = settings.value("tabCount", 0).toInt();
-    for (int i = 0; i < tabCount; ++i) {
-        QString filePath = settings.value(QString("tab%1_filePath").arg(i)).toString();
-        QString content = settings.value(QString("tab%1_content").arg(i)).toString();
-
-        QTextEdit *editor = new QTextEdit(this);
-        editor->setPlainText(content);
-        int tabIndex = tabWidget->addTab(editor, filePath.isEmpty() ? tr("Untitled") : QFileInfo(filePath).fileName());
-        tabFileMap[editor] = filePath;
+           // Keep the manifest in step with the tab strip so a crash loses no tabs
+    manifestTimer = new QTimer(this);
+    manifestTimer->setSingleShot(true);
+    manifestTimer->setInterval(500);
+    connect(manifestTimer, &QTimer::timeout, this, &MainWindow::saveSessionManifest);
+    connect(tabWidget->tabBar(), &QTabBar::tabMoved, manifestTimer, qOverload<>(&QTimer::start));
+
+           // Load the session manifest; restored tabs start as placeholders and are built when first shown
+    int currentTab = 0;
+    const QVector<SessionStore::TabEntry> tabs = sessionStore->loadManifest(&currentTab);
+    for (const SessionStore::TabEntry &entry : tabs) {
+        TabPlaceholder *placeholder = new TabPlaceholder(entry, this);
+        int tabIndex = tabWidget->addTab(placeholder, entry.filePath.isEmpty() ? tr("Untitled") : QFileInfo(entry.filePath).fileName());
+        if (!entry.filePath.isEmpty()) tabWidget->setTabToolTip(tabIndex, entry.filePath);
+        tabFileMap[placeholder] = entry.filePath;
+        if (!entry.id.isEmpty()) tabSessionIds[placeholder] = entry.id;  // Journaled tabs only
     }
 
            // Restore the current tab index
-    int currentTab = settings.value("currentTab", 0).toInt();
-    tabWidget->setCurrentIndex(currentTab);
+    connect(tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onCurrentTabChanged);
+    if (!tabs.isEmpty()) {
+        tabWidget->setCurrentIndex(qBound(0, currentTab, tabWidget->count() - 1));
+        onCurrentTabChanged(tabWidget->currentIndex());  // Not emitted when the index stays at 0
+    }
 
            // If no tabs were restored, open a new one
-    if (tabCount == 0) {
+    if (tabWidget->count() == 0) {
         on_actionNew_triggered();
     }
     //speech init
     speech = new QTextToSpeech(this);
+    speechReader = new SpeechReader(speech, this);
 }
 
 // Destructor
@@ -91,14 +194,330 @@ QTextEdit* MainWindow::currentEditor()
     return qobject_cast<QTextEdit*>(tabWidget->currentWidget());
 }
 
+// Create an editor for a new tab, with its per-document helpers attached
+QTextEdit* MainWindow::createEditor()
+{
+    QTextEdit *editor = new TracedTextEdit(this);
+    OverviewScrollBar *overviewBar = new OverviewScrollBar(editor);
+    editor->setVerticalScrollBar(overviewBar);  // Before anything connects to the scroll bar
+
+           // Keep the status bar counts live for whichever editor is current
+    WordCounter *counter = new WordCounter(editor->document());
+    connect(counter, &WordCounter::countsChanged, this, [this, editor] {
+        if (currentEditor() == editor) updateWordCount();
+    });
+
+    if (spellChecker->isAvailable()) {
+        new SpellHighlighter(editor, spellChecker);  // Owned by the document
+    } else {
+        new SyntaxHighlighter(editor);  // Owned by the document
+    }
+    wordCompleter->attach(editor);
+
+    // After the highlighter, so an edited block is summarized with its new spelling underlines
+    overviewBar->setOverview(new DocumentOverview(editor->document()));  // Owned by the document
+
+    return editor;
+}
+
+// LargeFileView with the long-line settings applied
+LargeFileView *MainWindow::createLargeFileView()
+{
+    LargeFileView *view = new LargeFileView(this);
+    view->setLongLineMode(ui->actionWrap_Long_Lines->isChecked());
+    view->setColumnLimit(longLineColumnLimit);
+    return view;
+}
+
 // Handle tab close requests
 void MainWindow::on_tabCloseRequested(int index)
 {
     QWidget *widget = tabWidget->widget(index);
     if (widget) {
+        if (!maybeSaveTab(widget)) return;
         tabWidget->removeTab(index);
+        tabFileMap.remove(widget);
+        tabSavers.remove(qobject_cast<QTextEdit *>(widget));  // A save in flight still completes
+        if (tabSessionIds.contains(widget)) {
+            sessionStore->removeTab(tabSessionIds.take(widget));  // A closed tab is not restored
+        }
         delete widget;  // Delete the widget to free memory
+        manifestTimer->start();
+    }
+}
+
+// Offer to save a tab whose edits the session does not keep; false if the user cancels.
+// Native documents and large files are reopened from their file, so their unsaved edits would be lost.
+bool MainWindow::maybeSaveTab(QWidget *widget)
+{
+    QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
+    LargeFileView *view = qobject_cast<LargeFileView *>(widget);
+    const QString fileName = tabFileMap.value(widget);
+    const bool unsaved = view ? view->isModified()
+                              : editor && editor->document()->isModified() && RichDocument::isRichFileName(fileName);
+    if (!unsaved) return true;
+
+    tabWidget->setCurrentWidget(widget);
+    const QMessageBox::StandardButton answer = QMessageBox::question(this, tr("Close"),
+        tr("Save changes to %1?").arg(QFileInfo(fileName).fileName()),
+        QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
+    if (answer == QMessageBox::Cancel) return false;
+    if (answer == QMessageBox::Discard) return true;
+
+    if (view) {
+        QString errorString;
+        if (!view->saveFile(fileName, &errorString)) {
+            QMessageBox::warning(this, "Warning", "Cannot save file: " + errorString);
+            return false;
+        }
+        return true;
+    }
+
+    // The tab is about to go, so save right here rather than showing its progress;
+    // no events are processed meanwhile, so nothing can close or edit the tab under the save
+    if (FileSaver *previous = tabSavers.take(editor)) previous->cancel();
+    autoSaver->cancelSave(editor->document());
+    FileSaver *saver = FileSaver::create(fileName, editor->document());
+    const quint64 generation = autoSaver->generation(editor->document());
+    QString errorString;
+    const bool completed = saver->save(&errorString);
+    delete saver;
+
+    if (!completed) {
+        QMessageBox::warning(this, "Warning", "Cannot save file: " + errorString);
+        return false;
+    }
+    autoSaver->markSaved(editor->document(), generation);
+    editor->document()->setModified(false);  // Also when auto-save does not follow the document
+    return true;
+}
+
+// Session Functions
+
+// Give an editor's tab a journal in the session store, and put it under auto-save.
+// Native documents get no journal, so crash recovery is deliberately dropped for them:
+// the journal only records plain text, and restoring that would lose their formatting.
+// They are reopened from their file; auto-save, when on, is what keeps their edits,
+// and closing one with unsaved edits asks first (see maybeSaveTab()).
+void MainWindow::journalTab(QTextEdit *editor)
+{
+    if (!RichDocument::isRichFileName(tabFileMap.value(editor))) {
+        const QString id = SessionStore::createTabId();
+        tabSessionIds[editor] = id;
+        sessionStore->track(id, editor->document());
+    }
+    autoSaver->track(editor->document(), tabFileMap.value(editor));
+    new UndoHistory(editor);  // Owned by the document
+    updateSyntaxLanguage(editor);
+    manifestTimer->start();
+}
+
+// Keep a tab whose file did not decode cleanly read-only: saving would write the
+// replacement characters over the bytes they stand for. It gets no journal either,
+// so the session reopens it from disk, read-only again, instead of restoring it editable.
+void MainWindow::keepReadOnly(QTextEdit *editor)
+{
+    editor->setReadOnly(true);
+    updateSyntaxLanguage(editor);
+    manifestTimer->start();
+    QMessageBox::warning(this, "Warning", "Cannot decode file as " + TextCodec::name(TextCodec::documentEncoding(editor->document()))
+                         + ": it is opened read-only");
+}
+
+// Highlight an editor as its file's language, judged by the extension or else the first lines
+void MainWindow::updateSyntaxLanguage(QTextEdit *editor)
+{
+    SyntaxHighlighter *highlighter = SyntaxHighlighter::forDocument(editor->document());
+    if (!highlighter) return;
+
+    QString sample;
+    for (QTextBlock block = editor->document()->begin(); block.isValid() && sample.size() < 4096; block = block.next()) {
+        sample += block.text() + '\n';
+    }
+    highlighter->setLanguage(SyntaxLanguage::detect(tabFileMap.value(editor), sample));
+}
+
+// Build the current tab if it is still a placeholder, then point the helpers at it
+void MainWindow::onCurrentTabChanged(int index)
+{
+    if (qobject_cast<TabPlaceholder *>(tabWidget->widget(index))) {
+        if (!materializeTab(index)) return;  // The tab was dropped, which changed the current tab again
+    }
+
+    updateWordCount();
+    if (LargeFileView *view = qobject_cast<LargeFileView *>(tabWidget->currentWidget())) {
+        findBar->setLargeFileView(view);
+    } else {
+        findBar->setEditor(currentEditor());
+    }
+    manifestTimer->start();
+    preloadNeighbourTabs(tabWidget->currentIndex());
+}
+
+// Swap a placeholder for the real editor, filled from its journal (or its file, for large files)
+bool MainWindow::materializeTab(int index)
+{
+    PERF_SCOPE("restore tab");
+    TabPlaceholder *placeholder = qobject_cast<TabPlaceholder *>(tabWidget->widget(index));
+    const SessionStore::TabEntry entry = placeholder->entry();
+
+    QWidget *widget;
+    QTextEdit *editor = nullptr;
+    bool decodingErrors = false;
+    if (entry.largeFile) {
+        LargeFileView *view = createLargeFileView();
+        QString errorString;
+        if (!view->openFile(entry.filePath, &errorString)) {
+            delete view;
+            QMessageBox::warning(this, "Warning", "Cannot open file: " + errorString);
+            on_tabCloseRequested(index);
+            return false;
+        }
+        widget = view;
+    } else if (entry.follow) {
+        editor = createEditor();  // Filled by its follower below
+        widget = editor;
+    } else if (entry.rich) {
+        RichDocument::Content content;
+        QString errorString;
+        if (!RichDocument::read(entry.filePath, &content, &errorString)) {
+            QMessageBox::warning(this, "Warning", "Cannot open file: " + errorString);
+            on_tabCloseRequested(index);
+            return false;
+        }
+        editor = createEditor();
+        RichDocument::build(editor->document(), content);
+        widget = editor;
+    } else if (entry.readOnly) {
+        QFile file(entry.filePath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            QMessageBox::warning(this, "Warning", "Cannot open file: " + file.errorString());
+            on_tabCloseRequested(index);
+            return false;
+        }
+        TextCodec::Encoding encoding;
+        editor = createEditor();
+        editor->setPlainText(decodeFile(file.readAll(), &encoding, &decodingErrors));
+        TextCodec::setDocumentEncoding(editor->document(), encoding);
+        widget = editor;
+    } else {
+        editor = createEditor();
+        SessionStore::TabContent content = placeholder->isPreloading() ? placeholder->takePreload()
+                                                                       : sessionStore->readTab(entry.id);
+        SessionStore::applyContent(editor->document(), content);
+        sessionStore->repairLog(entry.id, content);
+        TextCodec::setDocumentEncoding(editor->document(), TextCodec::fromName(entry.encoding));
+        widget = editor;
+    }
+
+    {
+        // Swap in place without announcing the intermediate tab changes
+        QSignalBlocker blocker(tabWidget);
+        const QString title = tabWidget->tabText(index);
+        const QString toolTip = tabWidget->tabToolTip(index);
+        tabWidget->insertTab(index, widget, title);
+        tabWidget->setTabToolTip(index, toolTip);
+        tabWidget->setCurrentIndex(index);
+        tabWidget->removeTab(index + 1);
+    }
+
+    tabFileMap[widget] = tabFileMap.take(placeholder);
+    if (entry.follow) {
+        delete placeholder;
+        if (!followFile(editor, entry.filePath)) {
+            on_tabCloseRequested(tabWidget->indexOf(editor));
+            return false;
+        }
+        return true;
+    }
+    if (editor && entry.readOnly && decodingErrors) {
+        editor->setReadOnly(true);
+        updateSyntaxLanguage(editor);
+    } else if (editor && (entry.rich || entry.readOnly)) {
+        journalTab(editor);  // A read-only file that now decodes becomes an ordinary tab
+    } else if (editor) {
+        tabSessionIds[editor] = tabSessionIds.take(placeholder);
+        sessionStore->track(entry.id, editor->document());
+        autoSaver->track(editor->document(), entry.filePath);
+
+               // The history saved at the last exit only applies if the journal ended on the same text
+        UndoHistory *history = new UndoHistory(editor);
+        history->load(sessionStore->undoPath(entry.id));
+        updateSyntaxLanguage(editor);
+    }
+    if (editor) {
+        // Scroll back to where the tab was left once the editor has its final width
+        const int scrollPosition = qMin(entry.scrollPosition, editor->document()->characterCount() - 1);
+        if (scrollPosition > 0) {
+            QTimer::singleShot(0, editor, [editor, scrollPosition] {
+                QTextBlock block = editor->document()->findBlock(scrollPosition);
+                QRectF rect = editor->document()->documentLayout()->blockBoundingRect(block);
+                editor->verticalScrollBar()->setValue(int(rect.top()));
+            });
+        }
+    }
+    delete placeholder;
+    return true;
+}
+
+// Read the journals of the placeholders next to index on worker threads, so switching to them is quick
+void MainWindow::preloadNeighbourTabs(int index)
+{
+    for (int i = index - neighbourPreloadRadius; i <= index + neighbourPreloadRadius; ++i) {
+        TabPlaceholder *placeholder = qobject_cast<TabPlaceholder *>(tabWidget->widget(i));
+        if (!placeholder || placeholder->isPreloading()) continue;
+
+        const SessionStore::TabEntry &entry = placeholder->entry();
+        if (entry.largeFile || entry.follow || entry.rich || entry.readOnly || entry.size > maxPreloadSize) continue;
+
+        SessionStore *store = sessionStore;
+        const QString id = entry.id;
+        placeholder->setPreload(QtConcurrent::run([store, id] { return store->readTab(id); }));
+    }
+}
+
+// Write the list of tabs; their contents live in the per-tab journals
+void MainWindow::saveSessionManifest()
+{
+    PERF_SCOPE("session manifest");
+    QVector<SessionStore::TabEntry> tabs;
+    int currentTab = 0;
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        QWidget *widget = tabWidget->widget(i);
+        SessionStore::TabEntry entry;
+        if (TabPlaceholder *placeholder = qobject_cast<TabPlaceholder *>(widget)) {
+            entry = placeholder->entry();  // Never shown, so nothing has changed
+        } else if (LargeFileView *view = qobject_cast<LargeFileView *>(widget)) {
+            // Huge files are reopened from disk rather than copied into the session
+            entry.largeFile = true;
+            entry.size = view->pieceTable().size();
+        } else if (widget->findChild<LogFollower *>(QString(), Qt::FindDirectChildrenOnly)) {
+            entry.follow = true;  // Followed logs are read from disk again
+        } else if (RichDocument::isRichFileName(tabFileMap.value(widget))) {
+            // Native documents are read from disk again, since only the file has their formatting
+            QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
+            entry.rich = true;
+            entry.size = editor->document()->characterCount();
+            entry.scrollPosition = editor->cursorForPosition(QPoint(0, 0)).position();
+        } else if (tabSessionIds.contains(widget)) {
+            QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
+            entry.id = tabSessionIds.value(widget);
+            entry.size = editor->document()->characterCount();
+            entry.scrollPosition = editor->cursorForPosition(QPoint(0, 0)).position();
+            entry.encoding = TextCodec::name(TextCodec::documentEncoding(editor->document()));
+        } else if (QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
+                   editor && editor->isReadOnly() && !editor->findChild<FileLoader *>(QString(), Qt::FindDirectChildrenOnly)) {
+            entry.readOnly = true;  // Did not decode, so it has no journal (see keepReadOnly())
+            entry.size = editor->document()->characterCount();
+            entry.scrollPosition = editor->cursorForPosition(QPoint(0, 0)).position();
+        } else {
+            continue;  // Still streaming in
+        }
+        entry.filePath = tabFileMap.value(widget);
+        if (i == tabWidget->currentIndex()) currentTab = tabs.size();
+        tabs.append(entry);
     }
+    sessionStore->saveManifest(tabs, currentTab);
 }
 
 // Document Management Functions
@@ -106,39 +525,184 @@ void MainWindow::on_tabCloseRequested(int index)
 // New file action: Clears current content
 void MainWindow::on_actionNew_triggered()
 {
-    qDebug() << "New tab triggered";  // Debugging statement
+    PerfTrace::mark("new tab");
 
            // Create a new text editor and add it to a new tab
-    QTextEdit *editor = new QTextEdit(this);
+    QTextEdit *editor = createEditor();
     int tabIndex = tabWidget->addTab(editor, tr("Untitled"));
     tabWidget->setCurrentIndex(tabIndex);
+    journalTab(editor);
 }
 
 // Open file action: Opens and reads a file into the text editor
 void MainWindow::on_actionOpen_triggered()
 {
-    QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("Text Files (*.txt);;All Files (*)"));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"), "", tr("Text Files (*.txt);;Notepad Documents (*.ntd);;All Files (*)"));
     if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            QTextEdit *editor = new QTextEdit(this);
-            editor->setPlainText(file.readAll());
-            int tabIndex = tabWidget->addTab(editor, QFileInfo(fileName).fileName());
-            tabWidget->setCurrentIndex(tabIndex);
+        openFile(fileName);
+    }
+}
+
+// Minified JSON, base64 dumps and the like; LargeFileView only shows UTF-8, so the
+// whole file is checked, as FileLoader does, not just its start
+static bool hasOverlongLines(const QString &fileName)
+{
+    std::shared_ptr<const MappedFile> file = MappedFile::open(fileName);
+    if (!file || TextCodec::detect(QByteArrayView(file->data(), file->size())).charset != TextCodec::Utf8) return false;
+    return LargeFileView::hasLineLongerThan(fileName, longLineThreshold);
+}
 
-                   // Store the file path in tabFileMap
-            tabFileMap[editor] = fileName;
+// Open a file in a new tab, streaming it in when it is large
+void MainWindow::openFile(const QString &fileName)
+{
+    PERF_SCOPE("open file");
+    if (RichDocument::isRichFile(fileName)) {
+        openRichFile(fileName);
+        return;
+    }
+    trigramIndex->addFile(fileName);
+    const qint64 size = QFileInfo(fileName).size();
+    if (size >= largeFileViewThreshold || (size > longLineThreshold && hasOverlongLines(fileName))) {
+        openLargeFileView(fileName);
+        return;
+    }
+    if (size >= streamingOpenThreshold) {
+        openFileStreamed(fileName);
+        return;
+    }
 
-            file.close();
+    // Read as bytes: the encoding is detected before decoding, and line endings are normalized after
+    QFile file(fileName);
+    if (file.open(QIODevice::ReadOnly)) {
+        TextCodec::Encoding encoding;
+        bool decodingErrors = false;
+        const QString text = decodeFile(file.readAll(), &encoding, &decodingErrors);
+        QTextEdit *editor = createEditor();
+        editor->setPlainText(text);
+        TextCodec::setDocumentEncoding(editor->document(), encoding);
+        int tabIndex = tabWidget->addTab(editor, QFileInfo(fileName).fileName());
+        tabWidget->setCurrentIndex(tabIndex);
+
+               // Store the file path in tabFileMap
+        tabFileMap[editor] = fileName;
+        if (decodingErrors) {
+            keepReadOnly(editor);
+        } else {
+            journalTab(editor);
         }
+
+        file.close();
     }
 }
 
+// Native document open: decoded in one pass and built with one call per format run
+void MainWindow::openRichFile(const QString &fileName)
+{
+    RichDocument::Content content;
+    QString errorString;
+    if (!RichDocument::read(fileName, &content, &errorString)) {
+        QMessageBox::warning(this, "Warning", "Cannot open file: " + errorString);
+        return;
+    }
+
+    QTextEdit *editor = createEditor();
+    RichDocument::build(editor->document(), content);
+    int tabIndex = tabWidget->addTab(editor, QFileInfo(fileName).fileName());
+    tabWidget->setCurrentIndex(tabIndex);
+    tabFileMap[editor] = fileName;
+    journalTab(editor);
+}
+
+// Huge file open: the file is mapped into a LargeFileView, which only ever lays out the visible lines
+void MainWindow::openLargeFileView(const QString &fileName)
+{
+    LargeFileView *view = createLargeFileView();
+    QString errorString;
+    if (!view->openFile(fileName, &errorString)) {
+        delete view;
+        QMessageBox::warning(this, "Warning", "Cannot open file: " + errorString);
+        return;
+    }
+
+    int tabIndex = tabWidget->addTab(view, QFileInfo(fileName).fileName());
+    tabWidget->setCurrentIndex(tabIndex);
+    tabFileMap[view] = fileName;
+}
+
+// Large file open: the file is mapped and decoded on a worker thread and the
+// editor is filled chunk by chunk, with a progress dialog that can cancel the load
+void MainWindow::openFileStreamed(const QString &fileName)
+{
+    QTextEdit *editor = createEditor();
+    editor->setReadOnly(true);  // Keep edits out until the whole file is in
+    editor->document()->setUndoRedoEnabled(false);  // Loading is not an undoable edit
+    int tabIndex = tabWidget->addTab(editor, QFileInfo(fileName).fileName());
+    tabWidget->setCurrentIndex(tabIndex);
+    tabFileMap[editor] = fileName;
+
+           // The dialog and the loader are children of the editor, so closing the tab mid-load cleans both up
+    QProgressDialog *progress = new QProgressDialog(tr("Opening %1...").arg(QFileInfo(fileName).fileName()),
+                                                    tr("Cancel"), 0, 1000, editor);
+    progress->setWindowModality(Qt::NonModal);
+    progress->setMinimumDuration(500);
+    progress->setAutoClose(false);
+    progress->setAutoReset(false);
+
+    FileLoader *loader = new FileLoader(fileName, editor);
+
+    connect(loader, &FileLoader::chunkReady, loader, [editor, loader](const QString &text) {
+        QTextCursor cursor(editor->document());
+        cursor.movePosition(QTextCursor::End);
+        cursor.insertText(text);
+        loader->chunkConsumed();
+    });
+    connect(loader, &FileLoader::progressChanged, progress, [progress](qint64 bytesDone, qint64 bytesTotal) {
+        progress->setValue(bytesTotal > 0 ? int(bytesDone * 1000 / bytesTotal) : 1000);
+    });
+    connect(progress, &QProgressDialog::canceled, loader, &FileLoader::cancel);
+    QPointer<QTextEdit> guard(editor);
+    connect(loader, &FileLoader::finished, this, [this, guard, loader, progress](bool completed, const QString &errorString) {
+        QTextEdit *editor = guard.data();
+        if (!editor) return;  // The tab was closed while loading
+
+        progress->deleteLater();
+        loader->deleteLater();
+
+        if (!completed) {
+            // Canceled or failed: drop the half-filled tab
+            int index = tabWidget->indexOf(editor);
+            if (index >= 0) on_tabCloseRequested(index);
+            if (!errorString.isEmpty()) {
+                QMessageBox::warning(this, "Warning", "Cannot open file: " + errorString);
+            }
+            return;
+        }
+
+        editor->document()->setUndoRedoEnabled(true);
+        editor->document()->setModified(false);
+        editor->moveCursor(QTextCursor::Start);
+        TextCodec::setDocumentEncoding(editor->document(), loader->encoding());
+        if (loader->hasDecodingErrors()) {
+            keepReadOnly(editor);
+            return;
+        }
+        journalTab(editor);  // Only complete files become part of the session
+        editor->setReadOnly(false);
+    });
+
+    loader->start();
+}
+
 
 
 // Save file action: Saves the current content to the current file
 void MainWindow::on_actionSave_triggered()
 {
+    if (LargeFileView *view = qobject_cast<LargeFileView *>(tabWidget->currentWidget())) {
+        saveLargeFileView(view, tabFileMap.value(view));
+        return;
+    }
+
     QTextEdit *editor = currentEditor();
     if (!editor) return;
 
@@ -147,73 +711,223 @@ void MainWindow::on_actionSave_triggered()
     if (currentFile.isEmpty()) {
         on_actionSave_As_triggered();
     } else {
-        QFile file(currentFile);
-        if (!file.open(QIODevice::WriteOnly | QFile::Text)) {
-            QMessageBox::warning(this, "Warning", "Cannot save file: " + file.errorString());
-            return;
-        }
-        QTextStream out(&file);
-        QString text = editor->toPlainText();
-        out << text;
-        file.close();
-
-        tabWidget->setTabText(tabWidget->currentIndex(), QFileInfo(currentFile).fileName());
+        saveEditor(editor, currentFile);
     }
 }
 
 // Save As action: Opens dialog to save current content to a new file
 void MainWindow::on_actionSave_As_triggered()
 {
+    LargeFileView *view = qobject_cast<LargeFileView *>(tabWidget->currentWidget());
     QTextEdit *editor = currentEditor();
-    if (!editor) return;
+    if (!editor && !view) return;
 
-    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File"), "", tr("Text Files (*.txt);;All Files (*)"));
-    if (!fileName.isEmpty()) {
-        QFile file(fileName);
-        if (!file.open(QIODevice::WriteOnly | QFile::Text)) {
-            QMessageBox::warning(this, "Warning", "Cannot save file: " + file.errorString());
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save File"), "", tr("Text Files (*.txt);;Notepad Documents (*.ntd);;All Files (*)"));
+    if (!fileName.isEmpty() && view) {
+        saveLargeFileView(view, fileName);
+    } else if (!fileName.isEmpty()) {
+        saveEditor(editor, fileName);
+    }
+}
+
+// Save an editor's text on a worker thread; the tab title shows the progress.
+// The only work left on the GUI thread is taking the plain-text snapshot.
+void MainWindow::saveEditor(QTextEdit *editor, const QString &fileName)
+{
+    if (editor->findChild<LogFollower *>(QString(), Qt::FindDirectChildrenOnly)) {
+        QMessageBox::warning(this, "Warning", "Cannot save file: stop following the log first");
+        return;
+    }
+    if (editor->isReadOnly()) {
+        QMessageBox::warning(this, "Warning", "Cannot save file: the tab is read-only");  // Still loading, or not decodable
+        return;
+    }
+
+    // A newer snapshot supersedes a save still in flight
+    if (FileSaver *previous = tabSavers.take(editor)) previous->cancel();
+    autoSaver->cancelSave(editor->document());
+
+    FileSaver *saver = FileSaver::create(fileName, editor->document(), this);
+    tabSavers[editor] = saver;
+    const quint64 generation = autoSaver->generation(editor->document());
+    const QString title = QFileInfo(fileName).fileName();
+
+    QPointer<QTextEdit> guard(editor);
+    connect(saver, &FileSaver::progressChanged, this, [this, guard, saver, title](qint64 done, qint64 total) {
+        if (!guard || tabSavers.value(guard) != saver) return;
+        const int percent = total > 0 ? int(done * 100 / total) : 100;
+        tabWidget->setTabText(tabWidget->indexOf(guard), tr("%1 (saving %2%)").arg(title).arg(percent));
+    });
+    connect(saver, &FileSaver::finished, this, [this, guard, editor, saver, fileName, generation](bool completed, const QString &errorString) {
+        saver->deleteLater();
+        if (tabSavers.value(editor) != saver) return;  // Superseded by a newer save, or the tab was closed
+        tabSavers.remove(editor);
+
+        QTextEdit *target = guard.data();
+        const int index = tabWidget->indexOf(target);
+        if (!completed) {
+            if (index >= 0) tabWidget->setTabText(index, QFileInfo(tabFileMap.value(target)).fileName());
+            if (!errorString.isEmpty()) {
+                QMessageBox::warning(this, "Warning", "Cannot save file: " + errorString);
+            }
             return;
         }
-        QTextStream out(&file);
-        QString text = editor->toPlainText();
-        out << text;
-        file.close();
+
+        // Saved as a native document, the tab is reopened from the file; saved as text, it needs a journal again
+        const bool wasRich = RichDocument::isRichFileName(tabFileMap.value(target));
+        if (RichDocument::isRichFileName(fileName) && tabSessionIds.contains(target)) {
+            sessionStore->removeTab(tabSessionIds.take(target));
+        } else if (wasRich && !RichDocument::isRichFileName(fileName) && !tabSessionIds.contains(target)) {
+            const QString id = SessionStore::createTabId();
+            tabSessionIds[target] = id;
+            sessionStore->track(id, target->document());
+        }
 
                // Update the file path in tabFileMap
-        tabFileMap[editor] = fileName;
-        tabWidget->setTabText(tabWidget->currentIndex(), QFileInfo(fileName).fileName());
+        tabFileMap[target] = fileName;
+        tabWidget->setTabText(index, QFileInfo(fileName).fileName());
+        autoSaver->track(target->document(), fileName);
+        autoSaver->markSaved(target->document(), generation);  // Clears the modified flag unless it was typed into meanwhile
+        updateSyntaxLanguage(target);
+        trigramIndex->addFile(fileName);
+        manifestTimer->start();
+    });
+
+    const int index = tabWidget->indexOf(editor);
+    tabWidget->setTabText(index, tr("%1 (saving)").arg(title));
+    saver->start();
+}
+
+
+
+// Save a LargeFileView tab by writing its pieces out
+void MainWindow::saveLargeFileView(LargeFileView *view, const QString &fileName)
+{
+    PERF_SCOPE("save large file");
+    QString errorString;
+    if (!view->saveFile(fileName, &errorString)) {
+        QMessageBox::warning(this, "Warning", "Cannot save file: " + errorString);
+        return;
     }
+
+    tabFileMap[view] = fileName;
+    tabWidget->setTabText(tabWidget->indexOf(view), QFileInfo(fileName).fileName());
+    trigramIndex->addFile(fileName);
+    manifestTimer->start();
 }
 
+// Performance overlay action: Shows or hides the timing panel over the tabs
+void MainWindow::on_actionPerformance_Overlay_triggered()
+{
+    perfOverlay->setVisible(!perfOverlay->isVisible());
+}
 
+// Export trace action: Writes the recorded timings as a Chrome trace
+void MainWindow::on_actionExport_Trace_triggered()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export Trace"), "trace.json", tr("Chrome Trace (*.json)"));
+    if (fileName.isEmpty()) return;
 
-//close file
-void MainWindow::closeEvent(QCloseEvent *event)
+    QString errorString;
+    if (!PerfTrace::exportChromeTrace(fileName, &errorString)) {
+        QMessageBox::warning(this, "Warning", "Cannot export trace: " + errorString);
+    }
+}
+
+// Follow File action: Shows new lines of the current tab's file as they are written, or stops doing so
+void MainWindow::on_actionFollow_File_triggered()
 {
-    QString documentsPath = QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation);
-    QString sessionFilePath = documentsPath + "/NotepadAppSession.ini";
+    QTextEdit *editor = currentEditor();
+    if (!editor) return;
 
-    QSettings settings(sessionFilePath, QSettings::IniFormat);
+    if (editor->findChild<LogFollower *>(QString(), Qt::FindDirectChildrenOnly)) {
+        stopFollowing(editor);
+        return;
+    }
 
-    settings.clear();
+    const QString fileName = tabFileMap.value(editor);
+    if (fileName.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Cannot follow file: the tab has no file");
+        return;
+    }
+    if (editor->isReadOnly() || editor->document()->isModified()) {
+        QMessageBox::warning(this, "Warning", "Cannot follow file: the tab is loading or has unsaved changes");
+        return;
+    }
+    followFile(editor, fileName);
+}
 
-    int tabCount = tabWidget->count();
-    settings.setValue("tabCount", tabCount);
+// Turn an editor into a live view of fileName. The file is the record of the
+// tab now, so it leaves the session journal and auto-save.
+bool MainWindow::followFile(QTextEdit *editor, const QString &fileName)
+{
+    if (tabSessionIds.contains(editor)) sessionStore->removeTab(tabSessionIds.take(editor));
+    autoSaver->untrack(editor->document());
+    delete UndoHistory::forDocument(editor->document());  // Appended log text is not undoable
+
+    LogFollower *follower = new LogFollower(editor, fileName);
+    follower->setMaximumLines(followHistoryLines);
+    QString errorString;
+    if (!follower->start(&errorString)) {
+        delete follower;
+        journalTab(editor);
+        QMessageBox::warning(this, "Warning", "Cannot follow file: " + errorString);
+        return false;
+    }
 
-    for (int i = 0; i < tabCount; ++i) {
-        QWidget *widget = tabWidget->widget(i);
-        QTextEdit *editor = qobject_cast<QTextEdit *>(widget);
+    tabWidget->setTabText(tabWidget->indexOf(editor), tr("%1 (following)").arg(QFileInfo(fileName).fileName()));
+    updateSyntaxLanguage(editor);
+    manifestTimer->start();
+    return true;
+}
 
-        if (editor) {
-            QString filePath = tabFileMap.value(editor, QString());
-            settings.setValue(QString("tab%1_filePath").arg(i), filePath);
-            settings.setValue(QString("tab%1_content").arg(i), editor->toPlainText());
-        }
+// Make a followed tab an ordinary one again
+void MainWindow::stopFollowing(QTextEdit *editor)
+{
+    LogFollower *follower = editor->findChild<LogFollower *>(QString(), Qt::FindDirectChildrenOnly);
+    const bool complete = follower->isComplete();
+    const QString title = QFileInfo(follower->fileName()).fileName();
+    delete follower;
+
+    const int index = tabWidget->indexOf(editor);
+    if (complete) {
+        tabWidget->setTabText(index, title);
+    } else {
+        // Only the tail is loaded: saving it over the log would lose the rest
+        tabFileMap[editor] = QString();
+        tabWidget->setTabText(index, tr("%1 (tail)").arg(title));
     }
+    journalTab(editor);
+}
 
-    settings.setValue("currentTab", tabWidget->currentIndex());
+//close file
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        if (!maybeSaveTab(tabWidget->widget(i))) {
+            event->ignore();
+            return;
+        }
+    }
 
-    qDebug() << "Session saved with tab count:" << tabCount;
+    // Only the edits since the last flush and the tab list are left to write
+    {
+        PERF_SCOPE("session save");
+        sessionStore->flush();
+        saveSessionManifest();
+
+        const bool keepUndo = ui->actionKeep_Undo_History->isChecked();
+        for (auto it = tabSessionIds.cbegin(); it != tabSessionIds.cend(); ++it) {
+            const QString undoPath = sessionStore->undoPath(it.value());
+            QTextEdit *editor = qobject_cast<QTextEdit *>(it.key());
+            UndoHistory *history = editor ? UndoHistory::forDocument(editor->document()) : nullptr;
+            if (!keepUndo) {
+                QFile::remove(undoPath);
+            } else if (history) {
+                history->save(undoPath);  // Placeholders still have the history they were restored with
+            }
+        }
+    }
 
     QMainWindow::closeEvent(event);
 }
@@ -254,15 +968,11 @@ void MainWindow::on_actionAdd_Numberings_triggered() {
 // Auto-save trigger
 void MainWindow::on_actionAuto_Save_triggered()
 {
-    autoSaveEnabled = !autoSaveEnabled;  // Toggle the auto-save state
+    autoSaver->setEnabled(!autoSaver->isEnabled());  // Toggle the auto-save state
 
-    if (autoSaveEnabled) {
-        // Enable auto-save with the default interval (e.g., 5 minutes)
-        autoSaveTimer->start(300000); // 5 minutes in milliseconds
-        QMessageBox::information(this, tr("Auto-Save"), tr("Auto-save enabled. Documents will be saved every 5 minutes."));
+    if (autoSaver->isEnabled()) {
+        QMessageBox::information(this, tr("Auto-Save"), tr("Auto-save enabled. Changed documents are saved a few seconds after you stop typing."));
     } else {
-        // Disable auto-save
-        autoSaveTimer->stop();
         QMessageBox::information(this, tr("Auto-Save"), tr("Auto-save disabled."));
     }
 }
@@ -270,37 +980,40 @@ void MainWindow::on_actionAuto_Save_triggered()
 // Save interval setting
 void MainWindow::on_actionSave_Interval_triggered()
 {
-    // Prompt user for auto-save interval in minutes
+    // Prompt user for the longest time an edit may stay unsaved while typing continues
     bool ok;
-    int interval = QInputDialog::getInt(this, tr("Auto-Save Interval"), tr("Set auto-save interval (in minutes):"), 5, 1, 60, 1, &ok);
+    int interval = QInputDialog::getInt(this, tr("Auto-Save Interval"), tr("Save at least every (in minutes) while typing:"), 5, 1, 60, 1, &ok);
 
     if (ok) {
-        autoSaveTimer->setInterval(interval * 60000); // Convert minutes to milliseconds
+        autoSaver->setMaximumDelay(interval * 60000); // Convert minutes to milliseconds
         QMessageBox::information(this, tr("Auto-Save"), tr("Auto-save interval set to %1 minutes.").arg(interval));
     }
 }
 
-// Auto-save document function
-void MainWindow::autoSaveDocument(){
-    if (!currentFile.isEmpty()){
-        on_actionSave_triggered(); // save the file
-    }
-}
-
 // Text Editing Functions
 
 // Undo action: Undo the last action in the text editor
 void MainWindow::on_actionUndo_triggered()
 {
     QTextEdit *editor = currentEditor();
-    if (editor) editor->undo();
+    if (!editor) return;
+    if (UndoHistory *history = UndoHistory::forDocument(editor->document())) {
+        history->undo();
+    } else {
+        editor->undo();
+    }
 }
 
 // Redo action: Redo the previously undone action in the text editor
 void MainWindow::on_actionRedo_triggered()
 {
     QTextEdit *editor = currentEditor();
-    if (editor) editor->redo();
+    if (!editor) return;
+    if (UndoHistory *history = UndoHistory::forDocument(editor->document())) {
+        history->redo();
+    } else {
+        editor->redo();
+    }
 }
 
 // Cut action: Cut the selected text
@@ -333,69 +1046,111 @@ void MainWindow::on_actionSelect_All_triggered()
 
 // Find and Replace Functions
 
-// Find action: Finds the text in the document
+// Find action: Opens the find bar, seeded with the selected text
 void MainWindow::on_actionFind_triggered()
 {
+    if (LargeFileView *view = qobject_cast<LargeFileView *>(tabWidget->currentWidget())) {
+        findBar->setLargeFileView(view);
+        findBar->activate(QString());
+        return;
+    }
+
     QTextEdit *editor = currentEditor();
     if (!editor) return;
 
-    static QString lastSearchText = ""; // Keep track of the last searched text
-    static QTextDocument::FindFlags lastSearchOptions; // Keep track of the last search options
-    static QStringList searchHistory; // Search history list
-
-    bool ok;
+    findBar->setEditor(editor);
+    findBar->activate(editor->textCursor().selectedText());
+}
 
-           // Prompt the user to select or enter the search text
-    QString text = QInputDialog::getItem(this, tr("Find"), tr("Find what:"), searchHistory, 0, true, &ok);
+// Find in Files action: Opens the find in files dock, seeded with the selected text
+void MainWindow::on_actionFind_in_Files_triggered()
+{
+    QTextEdit *editor = currentEditor();
+    findInFilesDock->activate(editor ? editor->textCursor().selectedText() : QString());
+}
 
-    QTextDocument::FindFlags options;
+// Open a tab comparing the current editor with another tab's, picked from a list
+void MainWindow::on_actionCompare_Tabs_triggered()
+{
+    QTextEdit *editor = currentEditor();
+    if (!editor) {
+        QMessageBox::warning(this, "Warning", "Cannot compare tabs: the current tab is not a text editor");
+        return;
+    }
 
-           // Create a custom dialog for case sensitivity
-    QMessageBox::StandardButton caseReply = QMessageBox::question(this, tr("Find"), tr("Match case?"), QMessageBox::Yes|QMessageBox::No);
-    if (caseReply == QMessageBox::Yes) {
-        options |= QTextDocument::FindCaseSensitively;
+    QStringList names;
+    QVector<int> indexes;
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        QWidget *widget = tabWidget->widget(i);
+        if (widget == editor || !(qobject_cast<QTextEdit *>(widget) || qobject_cast<TabPlaceholder *>(widget))) continue;
+        names.append(tr("%1: %2").arg(i + 1).arg(tabWidget->tabText(i)));
+        indexes.append(i);
+    }
+    if (names.isEmpty()) {
+        QMessageBox::warning(this, "Warning", "Cannot compare tabs: there is no other text tab");
+        return;
     }
 
-    lastSearchText = text;
-    lastSearchOptions = options;
+    bool ok = false;
+    const QString choice = QInputDialog::getItem(this, tr("Compare Tabs"), tr("Compare %1 with:").arg(tabWidget->tabText(tabWidget->indexOf(editor))), names, 0, false, &ok);
+    if (!ok) return;
+    const int index = indexes[names.indexOf(choice)];
+    if (qobject_cast<TabPlaceholder *>(tabWidget->widget(index)) && !materializeTab(index)) return;
+
+    QTextEdit *other = qobject_cast<QTextEdit *>(tabWidget->widget(index));
+    const QString title = tr("%1 vs %2").arg(tabWidget->tabText(tabWidget->indexOf(editor)), tabWidget->tabText(index));
+    DiffView *view = new DiffView(editor, other, this);
+    const int tabIndex = tabWidget->addTab(view, title);
+    connect(view, &DiffView::differencesChanged, this, [this, view, title](int count) {
+        tabWidget->setTabToolTip(tabWidget->indexOf(view), tr("%1 (%n difference(s))", nullptr, count).arg(title));
+    });
+    tabWidget->setCurrentIndex(tabIndex);
+    view->setFocus();
+}
 
-    editor->moveCursor(QTextCursor::Start); // Start from the beginning of the document
+// Show a find in files hit: switch to its tab, opening the file when no tab has it
+void MainWindow::openSearchHit(QWidget *tab, const QString &filePath, qint64 line, int column, int length)
+{
+    if (!tab || tabWidget->indexOf(tab) < 0) {
+        tab = filePath.isEmpty() ? nullptr : tabFileMap.key(filePath, nullptr);
+    }
+    if (!tab) {
+        if (filePath.isEmpty()) return;  // An untitled tab that has been closed since
+        openFile(filePath);
+        tab = tabFileMap.key(filePath, nullptr);
+        if (!tab) return;
+    }
+    tabWidget->setCurrentIndex(tabWidget->indexOf(tab));
 
-           // Perform the search
-    if (!editor->find(text, options)) {
-        QMessageBox::information(this, tr("Find"), tr("Cannot find \"%1\"").arg(text)); // Show message if text not found
+           // Placeholders are swapped for their editor when they are shown, so look again
+    QWidget *current = tabWidget->currentWidget();
+    if (LargeFileView *view = qobject_cast<LargeFileView *>(current)) {
+        view->goToLine(line - 1, column);
+        view->setFocus();
         return;
     }
+    QTextEdit *editor = qobject_cast<QTextEdit *>(current);
+    if (!editor) return;
 
-           // Loop to find next/previous occurrences
-    while (true) {
-        QMessageBox::StandardButton nextReply = QMessageBox::question(this, tr("Find Next"), tr("Do you want to find the next occurrence?"), QMessageBox::Yes|QMessageBox::No|QMessageBox::Cancel);
-
-        if (nextReply == QMessageBox::Yes) {
-            if (!editor->find(text, options)) {
-                QMessageBox::information(this, tr("Find Next"), tr("No more occurrences of \"%1\"").arg(text));
-                break;
-            }
-        } else if (nextReply == QMessageBox::No) {
-            nextReply = QMessageBox::question(this, tr("Find Previous"), tr("Do you want to find the previous occurrence?"), QMessageBox::Yes|QMessageBox::Cancel);
-
-            if (nextReply == QMessageBox::Yes) {
-                if (!editor->find(text, options | QTextDocument::FindBackward)) {
-                    QMessageBox::information(this, tr("Find Previous"), tr("No previous occurrences of \"%1\"").arg(text));
-                    break;
-                }
-            } else {
-                break;
-            }
-        } else {
-            break;
-        }
-    }
+    QTextBlock block = editor->document()->findBlockByNumber(int(line - 1));
+    if (!block.isValid()) return;  // The text has changed since the search
+    const int start = block.position() + qMin(column, block.length() - 1);
+    QTextCursor cursor(editor->document());
+    cursor.setPosition(start);
+    cursor.setPosition(qMin(start + length, block.position() + block.length() - 1), QTextCursor::KeepAnchor);
+    editor->setTextCursor(cursor);
+    editor->ensureCursorVisible();
+    editor->setFocus();
 }
 
 // Replace action: Replaces occurrences of text in the document
 void MainWindow::on_actionReplace_triggered()
 {
+    if (qobject_cast<LargeFileView *>(tabWidget->currentWidget())) {
+        QMessageBox::warning(this, "Warning", "Cannot replace: large files can be searched with Find but not replaced in");
+        return;
+    }
+
     QTextEdit *editor = currentEditor();
     if (!editor) return;
 
@@ -407,36 +1162,25 @@ void MainWindow::on_actionReplace_triggered()
         // Prompt the user for the replacement text
         QString replaceText = QInputDialog::getText(this, tr("Replace"), tr("Replace with:"), QLineEdit::Normal, "", &ok);
         if (ok) {
-            QTextCursor cursor = editor->textCursor(); // Get the current cursor
-            QTextDocument *document = editor->document(); // Get the document
+            TextReplace::Options options;
+            options.regularExpression = QMessageBox::question(this, tr("Replace"), tr("Use regular expression?"), QMessageBox::Yes|QMessageBox::No) == QMessageBox::Yes;
+            options.caseSensitive = QMessageBox::question(this, tr("Replace"), tr("Match case?"), QMessageBox::Yes|QMessageBox::No) == QMessageBox::Yes;
 
-            cursor.beginEditBlock(); // Begin the undo block
+            int position = editor->textCursor().position(); // Remember where the user was
 
-            int count = 0; // Counter for replacements
-
-                   // Move the cursor to the start of the document
-            cursor.movePosition(QTextCursor::Start);
-
-                   // Loop through the document to find all occurrences
-            while (!cursor.isNull() && !cursor.atEnd()) {
-                // Find the next occurrence of the text
-                cursor = document->find(findText, cursor);
-
-                       // Check if text is found and selected
-                if (!cursor.isNull() && cursor.hasSelection()) {
-                    QTextCharFormat originalFormat = cursor.charFormat(); // Save the original formatting
-
-                    cursor.insertText(replaceText); // Replace the found text
-
-                    cursor.setCharFormat(originalFormat); // Restore the original formatting
-                    count++; // Increment the counter
-                }
+                   // Find every match in one pass and apply them as a single undoable edit
+            TextReplace::Result result = TextReplace::replaceAll(editor->document(), findText, replaceText, options);
+            if (!result.errorString.isEmpty()) {
+                QMessageBox::warning(this, tr("Replace"), tr("Invalid regular expression: %1").arg(result.errorString));
+                return;
             }
 
-            cursor.endEditBlock(); // End the undo block
+            QTextCursor cursor = editor->textCursor();
+            cursor.setPosition(qMin(position, editor->document()->characterCount() - 1));
+            editor->setTextCursor(cursor);
 
                    // Inform the user about the number of replacements made
-            QMessageBox::information(this, tr("Replace"), tr("Replaced %1 occurrences of '%2'.").arg(count).arg(findText));
+            QMessageBox::information(this, tr("Replace"), tr("Replaced %1 occurrences of '%2' in %3 ms.").arg(result.count).arg(findText).arg(result.elapsedMs));
         }
     }
 }
@@ -455,10 +1199,9 @@ void MainWindow::on_actionHighlight_triggered()
         QTextCursor cursor = editor->textCursor(); // Get the current text cursor
         if (!cursor.hasSelection()) return; // If no text is selected, exit early
 
-        QTextCharFormat format;
-        format.setBackground(color); // Set the background color to the selected color
-
-        cursor.mergeCharFormat(format); // Apply the formatting to the selected text
+        FormatEngine::apply(cursor, [color](QTextCharFormat &format) {
+            format.setBackground(color); // Set the background color to the selected color
+        });
     }
 }
 
@@ -488,15 +1231,21 @@ void MainWindow::highlightTextWithColor(const QColor &color)
     QTextCursor cursor = editor->textCursor(); // Get the current text cursor
     if (!cursor.hasSelection()) return; // If no text is selected, exit early
 
-    QTextCharFormat format;
-    format.setBackground(color); // Set the background to the specified color
-    cursor.mergeCharFormat(format); // Apply the formatting
+    FormatEngine::apply(cursor, [color](QTextCharFormat &format) {
+        format.setBackground(color); // Set the background to the specified color
+    });
 }
 
 // Clear highlight action: Clears the highlight color
 void MainWindow::on_actionClear_Highlight_triggered()
 {
-    highlightTextWithColor(Qt::transparent); // Clear highlight by setting color to transparent
+    QTextEdit *editor = currentEditor();
+    if (!editor) return;
+
+    // Removing the background (rather than painting it transparent) gives the text back its old format
+    FormatEngine::apply(editor->textCursor(), [](QTextCharFormat &format) {
+        format.clearBackground();
+    });
 }
 
 // Text styling actions
@@ -506,19 +1255,7 @@ void MainWindow::on_actionBold_triggered() {
     QTextEdit *editor = currentEditor();
     if (!editor) return;  // Ensure there is a valid text editor
 
-    QTextCursor cursor = editor->textCursor();
-
-    if (!cursor.hasSelection()) {
-        // Apply format to new text or the cursor position
-        QTextCharFormat format;
-        format.setFontWeight(cursor.charFormat().fontWeight() == QFont::Bold ? QFont::Normal : QFont::Bold);
-        editor->setCurrentCharFormat(format);
-        return;
-    }
-
-    QTextCharFormat format = cursor.charFormat();
-    format.setFontWeight(format.fontWeight() == QFont::Bold ? QFont::Normal : QFont::Bold);
-    cursor.mergeCharFormat(format);
+    FormatEngine::toggle(editor, FormatEngine::Bold);
 }
 
 // Italic action: Toggles italic formatting on the selected text
@@ -526,18 +1263,7 @@ void MainWindow::on_actionItalic_triggered() {
     QTextEdit *editor = currentEditor();
     if (!editor) return;  // Ensure there is a valid text editor
 
-    QTextCursor cursor = editor->textCursor();
-
-    if (!cursor.hasSelection()) {
-        QTextCharFormat format;
-        format.setFontItalic(!cursor.charFormat().fontItalic());
-        editor->setCurrentCharFormat(format);
-        return;
-    }
-
-    QTextCharFormat format = cursor.charFormat();
-    format.setFontItalic(!format.fontItalic());
-    cursor.mergeCharFormat(format);
+    FormatEngine::toggle(editor, FormatEngine::Italic);
 }
 
 // Underline action: Toggles underline formatting on the selected text
@@ -545,18 +1271,7 @@ void MainWindow::on_actionUnderline_triggered() {
     QTextEdit *editor = currentEditor();
     if (!editor) return;  // Ensure there is a valid text editor
 
-    QTextCursor cursor = editor->textCursor();
-
-    if (!cursor.hasSelection()) {
-        QTextCharFormat format;
-        format.setFontUnderline(!cursor.charFormat().fontUnderline());
-        editor->setCurrentCharFormat(format);
-        return;
-    }
-
-    QTextCharFormat format = cursor.charFormat();
-    format.setFontUnderline(!format.fontUnderline());
-    cursor.mergeCharFormat(format);
+    FormatEngine::toggle(editor, FormatEngine::Underline);
 }
 
 // Strikethrough action: Toggles strikethrough formatting on the selected text
@@ -564,18 +1279,7 @@ void MainWindow::on_actionStrike_through_triggered() {
     QTextEdit *editor = currentEditor();
     if (!editor) return;  // Ensure there is a valid text editor
 
-    QTextCursor cursor = editor->textCursor();
-
-    if (!cursor.hasSelection()) {
-        QTextCharFormat format;
-        format.setFontStrikeOut(!cursor.charFormat().fontStrikeOut());
-        editor->setCurrentCharFormat(format);
-        return;
-    }
-
-    QTextCharFormat format = cursor.charFormat();
-    format.setFontStrikeOut(!format.fontStrikeOut());
-    cursor.mergeCharFormat(format);
+    FormatEngine::toggle(editor, FormatEngine::StrikeOut);
 }
 
 // Subscript and Superscript actions
@@ -584,44 +1288,14 @@ void MainWindow::on_actionSub_Script_triggered() {
     QTextEdit *editor = currentEditor();
     if (!editor) return;  // Ensure there is a valid text editor
 
-    QTextCursor cursor = editor->textCursor();
-
-    if (!cursor.hasSelection()) {
-        QTextCharFormat format;
-        format.setVerticalAlignment(cursor.charFormat().verticalAlignment() == QTextCharFormat::AlignSubScript
-                                            ? QTextCharFormat::AlignNormal
-                                            : QTextCharFormat::AlignSubScript);
-        editor->setCurrentCharFormat(format);
-        return;
-    }
-
-    QTextCharFormat format = cursor.charFormat();
-    format.setVerticalAlignment(format.verticalAlignment() == QTextCharFormat::AlignSubScript
-                                        ? QTextCharFormat::AlignNormal
-                                        : QTextCharFormat::AlignSubScript);
-    cursor.mergeCharFormat(format);
+    FormatEngine::toggle(editor, FormatEngine::SubScript);
 }
 
 void MainWindow::on_actionSuper_Script_triggered() {
     QTextEdit *editor = currentEditor();
     if (!editor) return;  // Ensure there is a valid text editor
 
-    QTextCursor cursor = editor->textCursor();
-
-    if (!cursor.hasSelection()) {
-        QTextCharFormat format;
-        format.setVerticalAlignment(cursor.charFormat().verticalAlignment() == QTextCharFormat::AlignSuperScript
-                                            ? QTextCharFormat::AlignNormal
-                                            : QTextCharFormat::AlignSuperScript);
-        editor->setCurrentCharFormat(format);
-        return;
-    }
-
-    QTextCharFormat format = cursor.charFormat();
-    format.setVerticalAlignment(format.verticalAlignment() == QTextCharFormat::AlignSuperScript
-                                        ? QTextCharFormat::AlignNormal
-                                        : QTextCharFormat::AlignSuperScript);
-    cursor.mergeCharFormat(format);
+    FormatEngine::toggle(editor, FormatEngine::SuperScript);
 }
 
 // Font and Spacing Functions
@@ -637,7 +1311,11 @@ void MainWindow::on_actionFont_Style_triggered() {
         QTextCursor cursor = editor->textCursor();
         QTextCharFormat format;
         format.setFont(font);
-        cursor.mergeCharFormat(format);
+        if (cursor.hasSelection()) {
+            FormatEngine::apply(cursor, [&format](QTextCharFormat &existing) { existing.merge(format); });
+        } else {
+            cursor.mergeCharFormat(format);
+        }
     }
 }
 
@@ -647,7 +1325,7 @@ void MainWindow::on_actionSpacing_triggered(){
     if (!editor) return;  // Ensure there is a valid text editor
 
            // Prompt the user to enter the desired line spacing
-    qDebug() << "Line Spacing triggered";
+    PerfTrace::mark("line spacing");
     bool ok;
     double spacing = QInputDialog::getDouble(this, "Line Spacing",
                                              "Enter line spacing (e.g., 1.0 for single, 2.0 for double):",
@@ -688,7 +1366,9 @@ void MainWindow::on_actionClear_All_Format_triggered()
     defaultFormat.setForeground(QBrush(Qt::black)); // Default text color
     defaultFormat.setBackground(QBrush(Qt::white)); // Default background color
 
-    cursor.mergeCharFormat(defaultFormat); // Apply the default formatting
+    FormatEngine::apply(cursor, [&defaultFormat](QTextCharFormat &format) {
+        format.merge(defaultFormat); // Apply the default formatting
+    });
 }
 
 // Color Functions
@@ -753,17 +1433,19 @@ void MainWindow::on_actionDark_Mode_triggered()
 // Update the word count display in the status bar
 void MainWindow::updateWordCount()
 {
+    PERF_SCOPE("word count");
     QTextEdit *editor = currentEditor();
-    if (!editor) return;  // Ensure there is a valid text editor
-
-           // Get the text from the editor
-    QString text = editor->toPlainText();
-
-           // Calculate the word count
-    int wordCount = text.split(QRegularExpression("(\\s|\\n|\\r)+"), Qt::SkipEmptyParts).count();
+    WordCounter *counter = editor ? WordCounter::forDocument(editor->document()) : nullptr;
+    if (!counter) {
+        wordCountLabel->setText("Words: 0");
+        return;
+    }
 
-           // Update the word count label
-    wordCountLabel->setText(QString("Words: %1").arg(wordCount));
+           // The counter keeps per-block totals up to date, so this is just a read
+    wordCountLabel->setText(QString("Words: %1  Characters: %2  Lines: %3")
+                                .arg(counter->words())
+                                .arg(counter->characters())
+                                .arg(counter->lines()));
 }
 
 // Alignment actions
@@ -787,6 +1469,30 @@ void MainWindow::on_actionJustify_triggered() {
     if (editor) editor->setAlignment(Qt::AlignJustify);
 }
 
+// Split overlong lines of LargeFileView tabs into segments as wide as the view
+void MainWindow::on_actionWrap_Long_Lines_triggered()
+{
+    const bool wrap = ui->actionWrap_Long_Lines->isChecked();
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        if (LargeFileView *view = qobject_cast<LargeFileView *>(tabWidget->widget(i))) view->setLongLineMode(wrap);
+    }
+}
+
+// Cut LargeFileView lines at a column when they are painted
+void MainWindow::on_actionLong_Line_Column_Limit_triggered()
+{
+    bool ok;
+    const int columns = QInputDialog::getInt(this, tr("Long Line Column Limit"),
+                                             tr("Show at most this many columns of a line (0 for no limit):"),
+                                             longLineColumnLimit, 0, 1000000, 1, &ok);
+    if (!ok) return;
+
+    longLineColumnLimit = columns;
+    for (int i = 0; i < tabWidget->count(); ++i) {
+        if (LargeFileView *view = qobject_cast<LargeFileView *>(tabWidget->widget(i))) view->setColumnLimit(columns);
+    }
+}
+
 // Tab width adjustment
 void MainWindow::on_actionTab_Width_triggered()
 {
@@ -814,18 +1520,54 @@ void MainWindow::on_actionTab_Width_triggered()
     }
 }
 
+// Notes folder action: Choose the folder whose files are kept in the full-text index
+void MainWindow::on_actionNotes_Folder_triggered()
+{
+    QString folder = QFileDialog::getExistingDirectory(this, tr("Notes Folder"), trigramIndex->notesFolder());
+    if (!folder.isEmpty()) {
+        trigramIndex->setNotesFolder(folder);
+        statusBar()->showMessage(tr("Indexing %1 in the background").arg(folder), 5000);
+    }
+}
+
 //speech function
 void MainWindow::on_actionText_To_Speech_triggered()
 {
     QTextEdit *editor = currentEditor();
     if (!editor) return;
 
-    QString text = editor->toPlainText();  // Get the text from the current editor
-    if (!text.isEmpty()) {
-        speech->say(text);  // Use the say() function to speak the text
+    // Read from the cursor (or the start of the selection) a sentence at a time
+    speechReader->start(editor, editor->textCursor().selectionStart());
+}
+
+// Pause/resume speech action
+void MainWindow::on_actionPause_Speech_triggered()
+{
+    if (speechReader->isPaused()) {
+        speechReader->resume();
+    } else {
+        speechReader->pause();
     }
 }
 
+// Stop speech action
+void MainWindow::on_actionStop_Speech_triggered()
+{
+    speechReader->stop();
+}
+
+// Skip ahead one sentence while reading
+void MainWindow::on_actionNext_Sentence_triggered()
+{
+    speechReader->seek(1);
+}
+
+// Go back one sentence while reading
+void MainWindow::on_actionPrevious_Sentence_triggered()
+{
+    speechReader->seek(-1);
+}
+
 //Insert functions
 /*
 //Table Insertion
@@ -12,6 +12,18 @@
 #include <QFile>
 #include <QtTextToSpeech/QTextToSpeech>
 
+class LargeFileView;
+class FindBar;
+class SessionStore;
+class FileSaver;
+class AutoSaver;
+class SpellChecker;
+class WordCompleter;
+class FindInFilesDock;
+class TrigramIndex;
+class SpeechReader;
+class PerfOverlay;
+
 QT_BEGIN_NAMESPACE
 namespace Ui {
 class MainWindow;
@@ -21,9 +33,11 @@ QT_END_NAMESPACE
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
+    friend class Benchmark;   // Drives the private hot paths headlessly
 
 public:
-    explicit MainWindow(QWidget *parent = nullptr);
+    // dataDirectory replaces the user's session and index directories (for benchmarks)
+    explicit MainWindow(QWidget *parent = nullptr, const QString &dataDirectory = QString());
     ~MainWindow();
 
 public slots:
@@ -31,6 +45,7 @@ public slots:
     void on_actionOpen_triggered();
     void on_actionSave_triggered();
     void on_actionSave_As_triggered();
+    void on_actionFollow_File_triggered();
     void on_actionExit_triggered();
     void on_actionUndo_triggered();
     void on_actionRedo_triggered();
@@ -40,6 +55,8 @@ public slots:
     void on_actionSelect_All_triggered();
     void on_actionFind_triggered();
     void on_actionReplace_triggered();
+    void on_actionFind_in_Files_triggered();
+    void on_actionCompare_Tabs_triggered();
     void on_actionHighlight_triggered();
     void on_actionHighlight_Yellow_triggered();
     void on_actionHighlight_Green_triggered();
@@ -59,8 +76,8 @@ public slots:
     void on_actionDark_Mode_triggered();
     void on_actionAuto_Save_triggered();
     void on_actionSave_Interval_triggered();
-    void autoSaveDocument();
     void on_actionTab_Width_triggered();
+    void on_actionNotes_Folder_triggered();
     void on_actionLeft_triggered();
     void on_actionRight_triggered();
     void on_actionCenter_triggered();
@@ -73,22 +90,59 @@ private slots:
     void on_actionAdd_Bullet_Points_triggered();
     void on_actionAdd_Numberings_triggered();
     void on_actionText_To_Speech_triggered();
+    void on_actionPause_Speech_triggered();
+    void on_actionStop_Speech_triggered();
+    void on_actionNext_Sentence_triggered();
+    void on_actionPrevious_Sentence_triggered();
+    void on_actionPerformance_Overlay_triggered();
+    void on_actionWrap_Long_Lines_triggered();
+    void on_actionLong_Line_Column_Limit_triggered();
+    void on_actionExport_Trace_triggered();
+    void saveSessionManifest();
+    void onCurrentTabChanged(int index);
+    void openSearchHit(QWidget *tab, const QString &filePath, qint64 line, int column, int length);
 
 private:
     Ui::MainWindow *ui;
-    QString currentFile;
-    QTimer *autoSaveTimer;  // Timer for auto-save functionality
-    bool autoSaveEnabled;    // Flag to keep track of auto-save state
+    AutoSaver *autoSaver;   // Saves changed documents in the background
+    SpellChecker *spellChecker;
+    WordCompleter *wordCompleter;   // Completion popup shared by all editors
     int tabWidth;
     bool useSpacesForTabs;
+    int longLineColumnLimit;            // Display cutoff for LargeFileView lines, 0 for none
     QLabel *wordCountLabel;
     QStringList searchHistory;
     void closeEvent(QCloseEvent *event) override;
     QTabWidget *tabWidget;
+    FindBar *findBar;
+    FindInFilesDock *findInFilesDock;
+    PerfOverlay *perfOverlay;
+    TrigramIndex *trigramIndex;         // Full-text index over opened and saved files and the notes folder
     QTextEdit *currentEditor();
+    QTextEdit *createEditor();
+    LargeFileView *createLargeFileView();
+    void openFile(const QString &fileName);
+    void openFileStreamed(const QString &fileName);
+    void openLargeFileView(const QString &fileName);   // Also for files with overlong lines
+    void openRichFile(const QString &fileName);
+    void saveLargeFileView(LargeFileView *view, const QString &fileName);
+    void saveEditor(QTextEdit *editor, const QString &fileName);
+    bool followFile(QTextEdit *editor, const QString &fileName);
+    void stopFollowing(QTextEdit *editor);
+    QMap<QTextEdit*, FileSaver*> tabSavers; // Saves in flight, by the editor they were taken from
     QMap<QWidget*, QString> tabFileMap; // Map each tab's widget to its associated file path
+    QMap<QWidget*, QString> tabSessionIds; // Map each journaled tab to its id in the session store
+    SessionStore *sessionStore;
+    QTimer *manifestTimer;              // Debounces manifest writes after tab changes
+    void journalTab(QTextEdit *editor);
+    void keepReadOnly(QTextEdit *editor);
+    bool maybeSaveTab(QWidget *widget);
+    void updateSyntaxLanguage(QTextEdit *editor);
+    bool materializeTab(int index);
+    void preloadNeighbourTabs(int index);
     bool isDarkmode;
     QTextToSpeech *speech;
+    SpeechReader *speechReader;         // Feeds speech a sentence at a time
 
 
 };
@@ -0,0 +1,227 @@
+#include "overviewscrollbar.h"
+#include "documentoverview.h"
+#include "perftrace.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QAbstractTextDocumentLayout>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QMouseEvent>
+#include <QTimer>
+#include <algorithm>
+
+static const int barWidth = 56;
+static const int markerWidth = 6;           // Right-hand strip: misspellings, then search hits
+static const int fullDensity = 120;         // Non-space characters that fill the width
+static const int maxRowsPerBlock = 3;       // Short documents are not stretched over the whole bar
+static const int tileRows = 64;
+static const int rebinDelay = 100;          // ms of quiet after lines come or go before rebuilding the bins
+
+OverviewScrollBar::OverviewScrollBar(QTextEdit *editor)
+    : QScrollBar(Qt::Vertical, editor), editor(editor), overview(nullptr), binnedBlocks(0), dragging(false)
+{
+    rebinTimer = new QTimer(this);
+    rebinTimer->setSingleShot(true);
+    rebinTimer->setInterval(rebinDelay);
+    connect(rebinTimer, &QTimer::timeout, this, &OverviewScrollBar::rebin);
+}
+
+void OverviewScrollBar::setOverview(DocumentOverview *newOverview)
+{
+    overview = newOverview;
+    connect(overview, &DocumentOverview::blocksChanged, this, &OverviewScrollBar::onBlocksChanged);
+    connect(overview, &DocumentOverview::reset, rebinTimer, QOverload<>::of(&QTimer::start));
+    rebin();
+}
+
+QSize OverviewScrollBar::sizeHint() const
+{
+    QSize size = QScrollBar::sizeHint();
+    size.setWidth(barWidth);
+    return size;
+}
+
+int OverviewScrollBar::firstBlockOfRow(int row) const
+{
+    return int(qint64(row) * binnedBlocks / bins.size());
+}
+
+int OverviewScrollBar::rowOfBlock(int block) const
+{
+    return int(qint64(block) * bins.size() / binnedBlocks);
+}
+
+// Rebuild every bin from the block summaries: one pass over them
+void OverviewScrollBar::rebin()
+{
+    PERF_SCOPE("overview rebin");
+    rebinTimer->stop();
+    binnedBlocks = overview ? int(overview->blocks().size()) : 0;
+    const int rows = int(qMin<qint64>(height(), qint64(binnedBlocks) * maxRowsPerBlock));
+
+    bins.resize(rows);
+    tiles.resize((rows + tileRows - 1) / tileRows);
+    dirtyTiles.fill(true, tiles.size());
+    if (rows > 0) binRows(0, rows);
+    update();
+}
+
+// Only the rows of the edited blocks change, as long as no block came or went
+void OverviewScrollBar::onBlocksChanged(int first, int count)
+{
+    if (rebinTimer->isActive() || bins.isEmpty() || overview->blocks().size() != binnedBlocks) return;
+    const int firstRow = rowOfBlock(first);
+    const int endRow = qMin(int(bins.size()), rowOfBlock(first + count) + 1);
+    binRows(firstRow, endRow);
+}
+
+void OverviewScrollBar::binRows(int firstRow, int endRow)
+{
+    if (firstRow >= endRow) return;
+    const QVector<DocumentOverview::BlockSummary> &blocks = overview->blocks();
+    const QVector<int> &hits = overview->searchHits();
+    auto hit = std::lower_bound(hits.cbegin(), hits.cend(), firstBlockOfRow(firstRow));
+
+    for (int row = firstRow; row < endRow; ++row) {
+        const int first = firstBlockOfRow(row);
+        const int end = qMin(int(blocks.size()), qMax(first + 1, firstBlockOfRow(row + 1)));
+
+        Bin bin = {0, 0, false, 0};
+        for (int i = first; i < end; ++i) {
+            const DocumentOverview::BlockSummary &summary = blocks[i];
+            bin.density = qMax(bin.density, summary.density);
+            if ((summary.marks & DocumentOverview::Highlighted) && !(bin.marks & DocumentOverview::Highlighted)) {
+                bin.highlight = summary.highlight;
+            }
+            bin.marks |= summary.marks;
+        }
+        while (hit != hits.cend() && *hit < first) ++hit;
+        bin.searchHit = hit != hits.cend() && *hit < end;
+        bins[row] = bin;
+    }
+
+    for (int tile = firstRow / tileRows; tile <= (endRow - 1) / tileRows; ++tile) dirtyTiles[tile] = true;
+    update(0, firstRow, width(), endRow - firstRow);
+}
+
+// Draw a tile's bins straight into its scan lines
+void OverviewScrollBar::renderTile(int tile)
+{
+    QImage &image = tiles[tile];
+    if (image.width() != width() || image.height() != tileRows) {
+        image = QImage(width(), tileRows, QImage::Format_ARGB32_Premultiplied);
+    }
+    image.fill(Qt::transparent);
+
+    QColor ink = palette().color(QPalette::Text);
+    ink.setAlpha(110);
+    QColor heading = palette().color(QPalette::Highlight);
+    heading.setAlpha(220);
+    const QRgb inkColor = qPremultiply(ink.rgba());
+    const QRgb headingColor = qPremultiply(heading.rgba());
+    const QRgb misspelledColor = qRgb(220, 50, 50);
+    const QRgb hitColor = qRgb(255, 150, 50);
+    const int textWidth = width() - markerWidth - 2;
+
+    for (int line = 0; line < tileRows; ++line) {
+        const int row = tile * tileRows + line;
+        if (row >= bins.size()) break;
+        const Bin &bin = bins[row];
+        QRgb *pixels = reinterpret_cast<QRgb *>(image.scanLine(line));
+
+        if (bin.density > 0 && textWidth > 0) {
+            const int length = qBound(1, bin.density * textWidth / fullDensity, textWidth);
+            QRgb color = inkColor;
+            if (bin.marks & DocumentOverview::Highlighted) {
+                color = bin.highlight | 0xff000000;
+            } else if (bin.marks & DocumentOverview::Structure) {
+                color = headingColor;
+            }
+            std::fill(pixels + 1, pixels + 1 + length, color);
+        }
+        if (width() >= markerWidth) {
+            if (bin.marks & DocumentOverview::Misspelled) {
+                std::fill(pixels + width() - markerWidth, pixels + width() - markerWidth / 2, misspelledColor);
+            }
+            if (bin.searchHit) std::fill(pixels + width() - markerWidth / 2, pixels + width(), hitColor);
+        }
+    }
+    dirtyTiles[tile] = false;
+}
+
+void OverviewScrollBar::paintEvent(QPaintEvent *event)
+{
+    if (!overview) {
+        QScrollBar::paintEvent(event);
+        return;
+    }
+
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().color(QPalette::Base).darker(104));
+
+    const QRect area = event->rect();
+    for (int tile = area.top() / tileRows; tile < tiles.size() && tile * tileRows <= area.bottom(); ++tile) {
+        if (dirtyTiles[tile] || tiles[tile].width() != width()) renderTile(tile);
+        painter.drawImage(0, tile * tileRows, tiles[tile]);
+    }
+
+    // Outline the lines on screen
+    if (binnedBlocks > 0 && !bins.isEmpty()) {
+        const QWidget *viewport = editor->viewport();
+        const int firstVisible = editor->cursorForPosition(QPoint(0, 0)).blockNumber();
+        const int lastVisible = editor->cursorForPosition(QPoint(viewport->width(), viewport->height())).blockNumber();
+        const int top = rowOfBlock(firstVisible);
+        const int bottom = qMax(top + 4, rowOfBlock(lastVisible + 1));
+
+        QColor frame = palette().color(QPalette::Text);
+        frame.setAlpha(30);
+        painter.fillRect(QRect(0, top, width(), bottom - top), frame);
+        frame.setAlpha(110);
+        painter.setPen(frame);
+        painter.drawRect(QRect(0, top, width() - 1, bottom - top - 1));
+    }
+}
+
+void OverviewScrollBar::resizeEvent(QResizeEvent *event)
+{
+    QScrollBar::resizeEvent(event);
+    if (overview) rebinTimer->start();
+}
+
+// Centre the block under the row in the editor
+void OverviewScrollBar::scrollToRow(int row)
+{
+    if (bins.isEmpty()) return;
+    const QTextBlock block = editor->document()->findBlockByNumber(firstBlockOfRow(qBound(0, row, int(bins.size()) - 1)));
+    const QRectF rect = editor->document()->documentLayout()->blockBoundingRect(block);
+    setValue(int(rect.center().y()) - pageStep() / 2);
+}
+
+void OverviewScrollBar::mousePressEvent(QMouseEvent *event)
+{
+    if (!overview || event->button() != Qt::LeftButton) {
+        QScrollBar::mousePressEvent(event);
+        return;
+    }
+    dragging = true;
+    scrollToRow(int(event->position().y()));
+}
+
+void OverviewScrollBar::mouseMoveEvent(QMouseEvent *event)
+{
+    if (!dragging) {
+        QScrollBar::mouseMoveEvent(event);
+        return;
+    }
+    scrollToRow(int(event->position().y()));
+}
+
+void OverviewScrollBar::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (!dragging) {
+        QScrollBar::mouseReleaseEvent(event);
+        return;
+    }
+    dragging = false;
+}
@@ -0,0 +1,67 @@
+#ifndef OVERVIEWSCROLLBAR_H
+#define OVERVIEWSCROLLBAR_H
+
+#include <QScrollBar>
+#include <QVector>
+#include <QImage>
+
+class QTextEdit;
+class QTimer;
+class DocumentOverview;
+
+// An editor's vertical scroll bar drawn as a minimap of the whole document:
+// line density, headings, background highlights, misspellings and search hits,
+// with the visible part outlined. Clicking or dragging scrolls there.
+// Each pixel row is a bin summarizing its share of the blocks, and the bins are
+// drawn into cached tiles; painting only blits the tiles, so it costs the same
+// for ten lines as for a million. An edit within a line redraws the bins of the
+// blocks it touched; when lines come or go every bin moves, so the bins are
+// rebuilt from the per-block summaries once the edits pause.
+class OverviewScrollBar : public QScrollBar
+{
+    Q_OBJECT
+
+public:
+    explicit OverviewScrollBar(QTextEdit *editor);
+
+    void setOverview(DocumentOverview *overview);
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+
+private slots:
+    void rebin();
+    void onBlocksChanged(int first, int count);
+
+private:
+    struct Bin
+    {
+        quint8 density;
+        quint8 marks;
+        bool searchHit;
+        QRgb highlight;
+    };
+
+    int firstBlockOfRow(int row) const;
+    int rowOfBlock(int block) const;
+    void binRows(int firstRow, int endRow);
+    void renderTile(int tile);
+    void scrollToRow(int row);
+
+    QTextEdit *editor;
+    DocumentOverview *overview;
+    QTimer *rebinTimer;
+
+    int binnedBlocks;               // The block count the bins were made for
+    QVector<Bin> bins;              // One per pixel row in use
+    QVector<QImage> tiles;
+    QVector<bool> dirtyTiles;
+    bool dragging;
+};
+
+#endif // OVERVIEWSCROLLBAR_H
@@ -0,0 +1,116 @@
+#include "perfoverlay.h"
+#include "largefileview.h"
+#include <QLabel>
+#include <QTabWidget>
+#include <QTabBar>
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTimer>
+#include <QVBoxLayout>
+#include <QEvent>
+#include <QFontDatabase>
+#include <algorithm>
+
+static const int refreshInterval = 500;             // ms
+static const qint64 window = 5000000000LL;          // ns of history behind the frame and slowest figures
+static const int slowestShown = 6;
+
+PerfOverlay::PerfOverlay(QTabWidget *tabWidget) : QFrame(tabWidget), tabWidget(tabWidget)
+{
+    setFrameShape(QFrame::StyledPanel);
+    setAutoFillBackground(true);
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+
+    label = new QLabel(this);
+    label->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    label->setTextFormat(Qt::PlainText);
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(6, 4, 6, 4);
+    layout->addWidget(label);
+
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(refreshInterval);
+    connect(refreshTimer, &QTimer::timeout, this, &PerfOverlay::refresh);
+    refreshTimer->start();
+
+    tabWidget->installEventFilter(this);
+    hide();
+}
+
+bool PerfOverlay::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == tabWidget && event->type() == QEvent::Resize) place();
+    return QFrame::eventFilter(watched, event);
+}
+
+void PerfOverlay::place()
+{
+    adjustSize();
+    move(tabWidget->width() - width() - 24, tabWidget->tabBar()->height() + 8);
+    raise();
+}
+
+void PerfOverlay::refresh()
+{
+    const QVector<PerfTrace::Event> events = PerfTrace::events(&cursor);
+    for (const PerfTrace::Event &event : events) {
+        if (event.duration < 0) continue;
+        if (qstrcmp(event.name, "paint") == 0) {
+            frames.append(event);
+        } else {
+            recent.append(event);
+            if (event.start + event.duration >= lastOperation.start + lastOperation.duration) lastOperation = event;
+        }
+    }
+
+    const qint64 horizon = PerfTrace::now() - window;
+    auto expired = [horizon](const PerfTrace::Event &event) { return event.start + event.duration < horizon; };
+    frames.erase(std::remove_if(frames.begin(), frames.end(), expired), frames.end());
+    recent.erase(std::remove_if(recent.begin(), recent.end(), expired), recent.end());
+
+    auto ms = [](qint64 ns) { return QString::number(ns / 1e6, 'f', 1); };
+    QString frameText = "-";
+    if (!frames.isEmpty()) {
+        qint64 maxFrame = 0;
+        for (const PerfTrace::Event &frame : std::as_const(frames)) maxFrame = qMax(maxFrame, frame.duration);
+        frameText = tr("%1 ms (max %2 ms)").arg(ms(frames.last().duration), ms(maxFrame));
+    }
+    const QString lastText = lastOperation.name
+        ? tr("%1 %2 ms").arg(QString::fromLatin1(lastOperation.name), ms(lastOperation.duration)) : QString("-");
+
+    emit summaryChanged(tr("frame %1 | %2").arg(frames.isEmpty() ? QString("-") : ms(frames.last().duration) + " ms",
+                                                 lastText));
+    if (!isVisible()) return;
+
+    QStringList lines;
+    lines << tr("frame  %1").arg(frameText);
+    lines << tr("last   %1").arg(lastText);
+    lines << tr("tab    %1").arg(tabMemory());
+    if (!recent.isEmpty()) {
+        QVector<PerfTrace::Event> slowest = recent;
+        std::sort(slowest.begin(), slowest.end(), [](const PerfTrace::Event &a, const PerfTrace::Event &b) {
+            return a.duration > b.duration;
+        });
+        lines << tr("slowest in the last %1 s").arg(window / 1000000000LL);
+        for (int i = 0; i < qMin(slowestShown, int(slowest.size())); ++i) {
+            lines << QString("  %1 %2 ms").arg(QString::fromLatin1(slowest[i].name), -18).arg(ms(slowest[i].duration), 8);
+        }
+    }
+    label->setText(lines.join('\n'));
+    place();
+}
+
+// A rough figure: UTF-16 text plus per-block bookkeeping, or the mapped size of a large file
+QString PerfOverlay::tabMemory() const
+{
+    QWidget *widget = tabWidget->currentWidget();
+    auto mb = [](qint64 bytes) { return QString::number(bytes / (1024.0 * 1024.0), 'f', 1); };
+    if (QTextEdit *editor = qobject_cast<QTextEdit *>(widget)) {
+        const QTextDocument *document = editor->document();
+        return tr("~%1 MB").arg(mb(qint64(document->characterCount()) * 2 + qint64(document->blockCount()) * 96));
+    }
+    if (LargeFileView *view = qobject_cast<LargeFileView *>(widget)) {
+        return tr("%1 MB mapped").arg(mb(view->pieceTable().size()));
+    }
+    return tr("not loaded");
+}
@@ -0,0 +1,47 @@
+#ifndef PERFOVERLAY_H
+#define PERFOVERLAY_H
+
+#include <QFrame>
+#include <QVector>
+#include "perftrace.h"
+
+class QLabel;
+class QTabWidget;
+class QTimer;
+
+// Panel over the top-right corner of the tabs showing frame time, the latency
+// of the last traced operation, the memory of the current tab and the slowest
+// operations of the last few seconds. It reads only the events recorded since
+// its previous refresh. summaryChanged() carries a one-line version for the
+// status bar, which keeps updating while the panel is hidden.
+class PerfOverlay : public QFrame
+{
+    Q_OBJECT
+
+public:
+    explicit PerfOverlay(QTabWidget *tabWidget);   // A child of tabWidget
+
+signals:
+    void summaryChanged(const QString &summary);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void refresh();
+
+private:
+    QString tabMemory() const;
+    void place();
+
+    QTabWidget *tabWidget;
+    QLabel *label;
+    QTimer *refreshTimer;
+
+    quint64 cursor = 0;                 // Trace events before this have been read
+    QVector<PerfTrace::Event> recent;   // Completed events of the last few seconds, paints excepted
+    QVector<PerfTrace::Event> frames;   // Paints of the last few seconds
+    PerfTrace::Event lastOperation = {nullptr, 0, 0, 0};
+};
+
+#endif // PERFOVERLAY_H
@@ -0,0 +1,129 @@
+#include "perftrace.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <atomic>
+
+namespace PerfTrace
+{
+
+static const quint64 capacity = 1 << 16;    // Events kept; a power of two
+
+namespace {
+struct Slot
+{
+    std::atomic<quint64> sequence{0};       // Index of the event + 1 once published, 0 while written
+    std::atomic<const char *> name{nullptr};
+    std::atomic<qint64> start{0};
+    std::atomic<qint64> duration{0};
+    std::atomic<quint32> thread{0};
+};
+
+Slot ring[capacity];
+std::atomic<quint64> head{0};               // Events ever recorded
+std::atomic<quint32> threadCount{0};
+
+const QElapsedTimer &clock()
+{
+    static const QElapsedTimer timer = [] {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return timer;
+}
+
+quint32 threadNumber()
+{
+    thread_local const quint32 number = ++threadCount;
+    return number;
+}
+}
+
+qint64 now()
+{
+    return clock().nsecsElapsed();
+}
+
+void record(const char *name, qint64 start, qint64 duration)
+{
+    const quint64 index = head.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = ring[index & (capacity - 1)];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.duration.store(duration, std::memory_order_relaxed);
+    slot.thread.store(threadNumber(), std::memory_order_relaxed);
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void mark(const char *name)
+{
+    record(name, now(), -1);
+}
+
+QVector<Event> events(quint64 *cursor)
+{
+    const quint64 end = head.load(std::memory_order_acquire);
+    quint64 begin = end > capacity ? end - capacity : 0;
+    if (cursor) begin = qMax(begin, *cursor);
+
+    QVector<Event> result;
+    result.reserve(int(end - begin));
+    for (quint64 index = begin; index < end; ++index) {
+        const Slot &slot = ring[index & (capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1) continue;  // Not published yet, or reused
+
+        Event event;
+        event.name = slot.name.load(std::memory_order_relaxed);
+        event.start = slot.start.load(std::memory_order_relaxed);
+        event.duration = slot.duration.load(std::memory_order_relaxed);
+        event.thread = slot.thread.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != index + 1) continue;  // Overwritten while copying
+        result.append(event);
+    }
+    if (cursor) *cursor = end;
+    return result;
+}
+
+bool exportChromeTrace(const QString &fileName, QString *errorString)
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray traceEvents;
+    const QVector<Event> all = events();
+    for (const Event &event : all) {
+        QJsonObject object;
+        object["name"] = QString::fromLatin1(event.name);
+        object["pid"] = pid;
+        object["tid"] = qint64(event.thread);
+        object["ts"] = event.start / 1000.0;     // Chrome traces count in microseconds
+        if (event.duration < 0) {
+            object["ph"] = "i";
+            object["s"] = "t";
+        } else {
+            object["ph"] = "X";
+            object["dur"] = event.duration / 1000.0;
+        }
+        traceEvents.append(object);
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = traceEvents;
+    trace["displayTimeUnit"] = "ms";
+    const QByteArray json = QJsonDocument(trace).toJson(QJsonDocument::Compact);
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,56 @@
+#ifndef PERFTRACE_H
+#define PERFTRACE_H
+
+#include <QString>
+#include <QVector>
+
+// Scoped timing of the editor's hot paths.
+// Every PERF_SCOPE records one event (name, start, duration, thread) into a
+// fixed-size ring buffer shared by all threads. Writers claim a slot with one
+// atomic increment and publish it through a per-slot sequence number, so
+// recording never takes a lock and costs two clock reads; when the ring is
+// full the oldest events are overwritten. Readers copy out what they need and
+// skip slots that are being rewritten. Names must be string literals.
+namespace PerfTrace
+{
+
+struct Event
+{
+    const char *name;
+    qint64 start;       // ns since the first use of the tracer
+    qint64 duration;    // ns; -1 for an instant event
+    quint32 thread;     // Small per-thread number; the first thread to record is 1
+};
+
+qint64 now();
+void record(const char *name, qint64 start, qint64 duration);
+void mark(const char *name);     // An instant event, e.g. a user action
+
+// Events recorded since *cursor, oldest first, and *cursor moved past them.
+// Without a cursor, everything still in the ring.
+QVector<Event> events(quint64 *cursor = nullptr);
+
+// Write the ring as a Chrome trace (chrome://tracing, Perfetto)
+bool exportChromeTrace(const QString &fileName, QString *errorString = nullptr);
+
+class Scope
+{
+public:
+    explicit Scope(const char *name) : name(name), start(now()) {}
+    ~Scope() { record(name, start, now() - start); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+private:
+    const char *name;
+    qint64 start;
+};
+
+}
+
+#define PERF_SCOPE_CONCAT2(a, b) a##b
+#define PERF_SCOPE_CONCAT(a, b) PERF_SCOPE_CONCAT2(a, b)
+#define PERF_SCOPE(name) PerfTrace::Scope PERF_SCOPE_CONCAT(perfScope, __LINE__)(name)
+
+#endif // PERFTRACE_H
@@ -0,0 +1,171 @@
+#include "piecetable.h"
+#include <QIODevice>
+#include <algorithm>
+
+// MappedFile
+
+MappedFile::~MappedFile()
+{
+    if (bytes) file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(bytes)));
+}
+
+// Map a whole file read-only; an empty file yields an empty mapping
+std::shared_ptr<const MappedFile> MappedFile::open(const QString &fileName, QString *errorString)
+{
+    std::shared_ptr<MappedFile> mapped(new MappedFile);
+    mapped->file.setFileName(fileName);
+    if (!mapped->file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = mapped->file.errorString();
+        return nullptr;
+    }
+
+    mapped->length = mapped->file.size();
+    if (mapped->length > 0) {
+        mapped->bytes = reinterpret_cast<const char *>(mapped->file.map(0, mapped->length));
+        if (!mapped->bytes) {
+            if (errorString) *errorString = mapped->file.errorString();
+            return nullptr;
+        }
+    }
+    return mapped;
+}
+
+// PieceTable
+
+PieceTable::PieceTable(std::shared_ptr<const MappedFile> originalFile)
+    : original(std::move(originalFile))
+{
+    if (original && original->size() > 0) {
+        pieces.append({0, original->size(), Original});
+        offsets.append(0);
+        totalSize = original->size();
+    }
+}
+
+const char *PieceTable::pieceData(const Piece &piece) const
+{
+    const char *base = piece.source == Original ? original->data() : added.constData();
+    return base + piece.start;
+}
+
+int PieceTable::pieceAt(qint64 position) const
+{
+    // Last piece starting at or before position
+    auto it = std::upper_bound(offsets.cbegin(), offsets.cend(), position);
+    return qMax(0, int(it - offsets.cbegin()) - 1);
+}
+
+void PieceTable::updateOffsets(int from)
+{
+    offsets.resize(pieces.size());
+    qint64 offset = from > 0 ? offsets[from - 1] + pieces[from - 1].length : 0;
+    for (int i = from; i < pieces.size(); ++i) {
+        offsets[i] = offset;
+        offset += pieces[i].length;
+    }
+    totalSize = offset;
+}
+
+// Insert text at position; consecutive typing extends the last added piece instead of creating new ones
+void PieceTable::insert(qint64 position, const char *text, qint64 length)
+{
+    if (length <= 0) return;
+    position = qBound<qint64>(0, position, totalSize);
+
+    const qint64 start = added.size();
+    added.append(text, length);
+    const Piece piece = {start, length, Added};
+
+    if (pieces.isEmpty()) {
+        pieces.append(piece);
+        updateOffsets(0);
+        return;
+    }
+
+    int index = position == totalSize ? pieces.size() : pieceAt(position);
+    if (index < pieces.size() && offsets[index] < position) {
+        // Split the piece containing position
+        Piece &left = pieces[index];
+        qint64 leftLength = position - offsets[index];
+        Piece right = {left.start + leftLength, left.length - leftLength, left.source};
+        left.length = leftLength;
+        pieces.insert(index + 1, right);
+        pieces.insert(index + 1, piece);
+        updateOffsets(index);
+        return;
+    }
+
+    // position falls between two pieces: extend the previous one when it ends where the new text starts
+    if (index > 0) {
+        Piece &previous = pieces[index - 1];
+        if (previous.source == Added && previous.start + previous.length == start) {
+            previous.length += length;
+            updateOffsets(index - 1);
+            return;
+        }
+    }
+    pieces.insert(index, piece);
+    updateOffsets(qMax(0, index - 1));
+}
+
+// Remove [position, position + length)
+void PieceTable::remove(qint64 position, qint64 length)
+{
+    if (position < 0 || position >= totalSize || length <= 0) return;
+    const qint64 end = qMin(position + length, totalSize);
+
+    const int first = pieceAt(position);
+    int last = first;
+    QVector<Piece> replacement;
+    for (int i = first; i < pieces.size() && offsets[i] < end; ++i) {
+        const Piece &piece = pieces[i];
+        const qint64 pieceStart = offsets[i];
+        const qint64 pieceEnd = pieceStart + piece.length;
+        if (pieceStart < position) {
+            replacement.append({piece.start, position - pieceStart, piece.source});
+        }
+        if (pieceEnd > end) {
+            replacement.append({piece.start + (end - pieceStart), pieceEnd - end, piece.source});
+        }
+        last = i;
+    }
+
+    pieces.erase(pieces.begin() + first, pieces.begin() + last + 1);
+    for (int i = 0; i < replacement.size(); ++i) {
+        pieces.insert(first + i, replacement[i]);
+    }
+    updateOffsets(first);
+}
+
+char PieceTable::at(qint64 position) const
+{
+    char c = 0;
+    visit(position, 1, [&c](const char *data, qint64) {
+        c = *data;
+        return false;
+    });
+    return c;
+}
+
+QByteArray PieceTable::read(qint64 position, qint64 length) const
+{
+    QByteArray result;
+    if (position < 0 || position >= totalSize || length <= 0) return result;
+    result.reserve(qMin(length, totalSize - position));
+    visit(position, length, [&result](const char *data, qint64 spanLength) {
+        result.append(data, spanLength);
+        return true;
+    });
+    return result;
+}
+
+// Write the whole document, span by span, without materializing it
+bool PieceTable::writeTo(QIODevice *device) const
+{
+    bool ok = true;
+    visit(0, totalSize, [device, &ok](const char *data, qint64 length) {
+        ok = device->write(data, length) == length;
+        return ok;
+    });
+    return ok;
+}
@@ -0,0 +1,87 @@
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <memory>
+
+class QIODevice;
+
+// Read-only memory mapping of a file, shared by every piece table that refers to it
+class MappedFile
+{
+public:
+    ~MappedFile();
+    static std::shared_ptr<const MappedFile> open(const QString &fileName, QString *errorString = nullptr);
+
+    const char *data() const { return bytes; }
+    qint64 size() const { return length; }
+    QString fileName() const { return file.fileName(); }
+
+private:
+    MappedFile() = default;
+
+    QFile file;
+    const char *bytes = nullptr;
+    qint64 length = 0;
+};
+
+// Piece table: the document is a list of pieces, each one a span of either the
+// original (mapped, never modified) buffer or an append-only buffer holding
+// inserted text. Edits only touch the piece list, so they cost the same on a
+// multi-GB file as on a small one. Copies share both buffers and work as snapshots.
+class PieceTable
+{
+public:
+    PieceTable() = default;
+    explicit PieceTable(std::shared_ptr<const MappedFile> original);
+
+    qint64 size() const { return totalSize; }
+    bool isEmpty() const { return totalSize == 0; }
+    int pieceCount() const { return pieces.size(); }
+
+    void insert(qint64 position, const char *text, qint64 length);
+    void insert(qint64 position, const QByteArray &text) { insert(position, text.constData(), text.size()); }
+    void remove(qint64 position, qint64 length);
+
+    char at(qint64 position) const;
+    QByteArray read(qint64 position, qint64 length) const;
+    bool writeTo(QIODevice *device) const;
+
+    // Calls visitor(const char *data, qint64 length) for each contiguous span of
+    // [position, position + length), in order; stops early when the visitor returns false
+    template <typename Visitor>
+    void visit(qint64 position, qint64 length, Visitor visitor) const
+    {
+        if (position < 0 || length <= 0 || position >= totalSize) return;
+        qint64 end = qMin(position + length, totalSize);
+        for (int i = pieceAt(position); i < pieces.size() && offsets[i] < end; ++i) {
+            const Piece &piece = pieces[i];
+            qint64 from = qMax(position, offsets[i]) - offsets[i];
+            qint64 to = qMin(end, offsets[i] + piece.length) - offsets[i];
+            if (!visitor(pieceData(piece) + from, to - from)) return;
+        }
+    }
+
+private:
+    enum Source : quint8 { Original, Added };
+    struct Piece {
+        qint64 start;
+        qint64 length;
+        Source source;
+    };
+
+    const char *pieceData(const Piece &piece) const;
+    int pieceAt(qint64 position) const;   // Index of the piece containing position
+    void updateOffsets(int from);
+
+    std::shared_ptr<const MappedFile> original;
+    QByteArray added;            // Append-only buffer for inserted text
+    QVector<Piece> pieces;
+    QVector<qint64> offsets;     // offsets[i] is the document offset of pieces[i]
+    qint64 totalSize = 0;
+};
+
+#endif // PIECETABLE_H
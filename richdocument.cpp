@@ -0,0 +1,472 @@
+#include "richdocument.h"
+#include "perftrace.h"
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextList>
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QColor>
+#include <QBrush>
+
+namespace RichDocument
+{
+
+namespace {
+
+const quint32 fileMagic = 0x4e544431;   // "NTD1"
+const quint16 fileVersion = 1;
+const quint16 compressedFlag = 0x1;
+const int compressionLevel = 1;         // Fastest zlib level: keeps saving near disk speed
+const QDataStream::Version streamVersion = QDataStream::Qt_6_0;
+
+// How a property value is stored; anything not listed goes through QVariant
+enum ValueTag : quint8
+{
+    BoolValue,
+    IntValue,
+    DoubleValue,
+    StringValue,        // Index into the string table
+    StringListValue,
+    ColorValue,         // QRgba64
+    SolidBrushValue,    // QRgba64 of a solid brush
+    VariantValue
+};
+
+class StringTable
+{
+public:
+    quint32 id(const QString &string)
+    {
+        auto it = ids.constFind(string);
+        if (it != ids.cend()) return it.value();
+        const quint32 id = quint32(strings.size());
+        strings.append(string);
+        ids.insert(string, id);
+        return id;
+    }
+    QStringList strings;
+
+private:
+    QHash<QString, quint32> ids;
+};
+
+void appendVarint(QByteArray &buffer, quint32 value)
+{
+    for (; value >= 0x80; value >>= 7) buffer.append(char((value & 0x7f) | 0x80));
+    buffer.append(char(value));
+}
+
+bool readVarint(const uchar *&p, const uchar *end, quint32 *value)
+{
+    *value = 0;
+    for (int shift = 0; p < end && shift <= 28; shift += 7) {
+        const uchar byte = *p++;
+        *value |= quint32(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+void writeFormat(QDataStream &out, const QTextFormat &format, StringTable &strings)
+{
+    const QMap<int, QVariant> properties = format.properties();
+    out << qint32(format.type()) << quint32(properties.size());
+    for (auto it = properties.cbegin(); it != properties.cend(); ++it) {
+        out << qint32(it.key());
+        const QVariant &value = it.value();
+        switch (value.metaType().id()) {
+        case QMetaType::Bool:
+            out << quint8(BoolValue) << value.toBool();
+            continue;
+        case QMetaType::Int:
+            out << quint8(IntValue) << qint32(value.toInt());
+            continue;
+        case QMetaType::Double:
+            out << quint8(DoubleValue) << value.toDouble();
+            continue;
+        case QMetaType::QString:
+            out << quint8(StringValue) << strings.id(value.toString());
+            continue;
+        case QMetaType::QStringList: {
+            const QStringList list = value.toStringList();
+            out << quint8(StringListValue) << quint32(list.size());
+            for (const QString &string : list) out << strings.id(string);
+            continue;
+        }
+        case QMetaType::QColor:
+            out << quint8(ColorValue) << quint64(value.value<QColor>().rgba64());
+            continue;
+        case QMetaType::QBrush: {
+            const QBrush brush = value.value<QBrush>();
+            if (brush.style() == Qt::SolidPattern) {
+                out << quint8(SolidBrushValue) << quint64(brush.color().rgba64());
+                continue;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        out << quint8(VariantValue) << value;
+    }
+}
+
+bool readFormat(QDataStream &in, const QStringList &strings, QTextFormat *format)
+{
+    qint32 type = 0;
+    quint32 count = 0;
+    in >> type >> count;
+    *format = QTextFormat(type);
+    auto string = [&strings](quint32 id) { return id < quint32(strings.size()) ? strings.at(id) : QString(); };
+
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        qint32 property = 0;
+        quint8 tag = 0;
+        in >> property >> tag;
+        QVariant value;
+        switch (tag) {
+        case BoolValue: { bool b = false; in >> b; value = b; break; }
+        case IntValue: { qint32 n = 0; in >> n; value = int(n); break; }
+        case DoubleValue: { double d = 0; in >> d; value = d; break; }
+        case StringValue: { quint32 id = 0; in >> id; value = string(id); break; }
+        case StringListValue: {
+            quint32 size = 0;
+            in >> size;
+            QStringList list;
+            for (quint32 j = 0; j < size && in.status() == QDataStream::Ok; ++j) {
+                quint32 id = 0;
+                in >> id;
+                list.append(string(id));
+            }
+            value = list;
+            break;
+        }
+        case ColorValue: { quint64 rgba = 0; in >> rgba; value = QColor::fromRgba64(QRgba64::fromRgba64(rgba)); break; }
+        case SolidBrushValue: { quint64 rgba = 0; in >> rgba; value = QBrush(QColor::fromRgba64(QRgba64::fromRgba64(rgba))); break; }
+        case VariantValue: in >> value; break;
+        default: return false;
+        }
+        format->setProperty(property, value);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+}
+
+bool isRichFileName(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().compare(QLatin1String("ntd"), Qt::CaseInsensitive) == 0;
+}
+
+bool isRichFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+    QDataStream in(&file);
+    quint32 magic = 0;
+    in >> magic;
+    return magic == fileMagic;
+}
+
+// Walk the blocks and their fragments once; formats are looked up by their
+// index in the document, so each distinct one is copied only the first time
+Content capture(const QTextDocument *document)
+{
+    PERF_SCOPE("rich capture");
+    Content content;
+    content.text.reserve(document->characterCount());
+    QHash<int, qint32> formatIds;
+    QHash<const QTextList *, qint32> listIds;
+
+    auto formatId = [&](int documentIndex, auto formatOf) {
+        auto it = formatIds.constFind(documentIndex);
+        if (it != formatIds.cend()) return it.value();
+        // Lists are stored on their own, so list membership is left out of block formats
+        QTextFormat format = formatOf();
+        format.clearProperty(QTextFormat::ObjectIndex);
+        qint32 id = -1;
+        if (!format.properties().isEmpty()) {
+            id = qint32(content.formats.size());
+            content.formats.append(format);
+        }
+        formatIds.insert(documentIndex, id);
+        return id;
+    };
+
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        if (block != document->begin()) content.text += QLatin1Char('\n');
+        const QString text = block.text();
+        content.text += text;
+
+        Block record;
+        record.length = qint32(text.size());
+        record.blockFormat = formatId(block.blockFormatIndex(), [&block] { return QTextFormat(block.blockFormat()); });
+        record.charFormat = formatId(block.charFormatIndex(), [&block] { return QTextFormat(block.charFormat()); });
+        record.list = -1;
+        if (const QTextList *list = block.textList()) {
+            auto it = listIds.constFind(list);
+            if (it == listIds.cend()) {
+                const qint32 listFormat = formatId(list->formatIndex(), [list] { return QTextFormat(list->format()); });
+                it = listIds.insert(list, qint32(content.lists.size()));
+                content.lists.append(listFormat);
+            }
+            record.list = it.value();
+        }
+        content.blocks.append(record);
+
+        const qsizetype firstRun = content.runs.size();
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            const qint32 format = formatId(fragment.charFormatIndex(), [&fragment] { return QTextFormat(fragment.charFormat()); });
+            if (content.runs.size() > firstRun && content.runs.last().format == format) {
+                content.runs.last().length += fragment.length();
+            } else {
+                content.runs.append({qint32(fragment.length()), format});
+            }
+        }
+    }
+    return content;
+}
+
+// Set the text in one go, then apply the formats that are not default, one call per stretch
+void build(QTextDocument *document, const Content &content)
+{
+    PERF_SCOPE("rich build");
+    const bool undoEnabled = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);  // Loading is not an undoable edit
+    document->setPlainText(content.text);
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+
+    // Character runs; a stretch continues over block separators
+    qint32 stretchFormat = -1;
+    int stretchStart = 0;
+    int stretchEnd = 0;
+    auto flushStretch = [&] {
+        if (stretchFormat < 0) return;
+        cursor.setPosition(stretchStart);
+        cursor.setPosition(stretchEnd, QTextCursor::KeepAnchor);
+        cursor.setCharFormat(content.formats.at(stretchFormat).toCharFormat());
+        stretchFormat = -1;
+    };
+    auto onlySeparators = [&content](int from, int to) {
+        for (int i = from; i < to; ++i) {
+            if (content.text.at(i) != QLatin1Char('\n')) return false;
+        }
+        return true;
+    };
+
+    int position = 0;
+    int run = 0;
+    for (const Block &block : content.blocks) {
+        const int blockEnd = position + block.length;
+        for (int p = position; p < blockEnd; ++run) {
+            const Run &current = content.runs.at(run);
+            if (current.format >= 0) {
+                if (current.format == stretchFormat && onlySeparators(stretchEnd, p)) {
+                    stretchEnd = p + current.length;
+                } else {
+                    flushStretch();
+                    stretchFormat = current.format;
+                    stretchStart = p;
+                    stretchEnd = p + current.length;
+                }
+            }
+            p += current.length;
+        }
+        position = blockEnd + 1;
+    }
+    flushStretch();
+
+    // Block and block character formats, one call per run of blocks that share one
+    auto applyBlockFormats = [&](qint32 Block::*field, bool charFormat) {
+        qint32 format = -1;
+        int first = 0;
+        int last = 0;
+        auto flush = [&] {
+            if (format < 0) return;
+            cursor.setPosition(first);
+            cursor.setPosition(last, QTextCursor::KeepAnchor);
+            if (charFormat) cursor.setBlockCharFormat(content.formats.at(format).toCharFormat());
+            else cursor.setBlockFormat(content.formats.at(format).toBlockFormat());
+        };
+        QTextBlock textBlock = document->begin();
+        for (const Block &block : content.blocks) {
+            const qint32 blockFormat = block.*field;
+            if (blockFormat != format) {
+                flush();
+                format = blockFormat;
+                first = textBlock.position();
+            }
+            last = textBlock.position();
+            textBlock = textBlock.next();
+        }
+        flush();
+    };
+    applyBlockFormats(&Block::blockFormat, false);
+    applyBlockFormats(&Block::charFormat, true);
+
+    // Lists: the first block creates each list, later ones join it
+    QVector<QTextList *> lists(content.lists.size(), nullptr);
+    QTextBlock textBlock = document->begin();
+    for (const Block &block : content.blocks) {
+        if (block.list >= 0) {
+            QTextList *&list = lists[block.list];
+            if (list) {
+                list->add(textBlock);
+            } else {
+                list = QTextCursor(textBlock).createList(content.formats.at(content.lists.at(block.list)).toListFormat());
+            }
+        }
+        textBlock = textBlock.next();
+    }
+
+    cursor.endEditBlock();
+    document->setUndoRedoEnabled(undoEnabled);
+    document->setModified(false);
+}
+
+QByteArray encode(const Content &content, bool compress)
+{
+    PERF_SCOPE("rich encode");
+    // Formats first, so the string table they fill can be written ahead of them
+    StringTable strings;
+    QByteArray formats;
+    {
+        QDataStream out(&formats, QIODevice::WriteOnly);
+        out.setVersion(streamVersion);
+        for (const QTextFormat &format : content.formats) writeFormat(out, format, strings);
+    }
+
+    QByteArray blocks;
+    blocks.reserve(content.blocks.size() * 4);
+    for (const Block &block : content.blocks) {
+        appendVarint(blocks, quint32(block.length));
+        appendVarint(blocks, quint32(block.blockFormat + 1));
+        appendVarint(blocks, quint32(block.charFormat + 1));
+        appendVarint(blocks, quint32(block.list + 1));
+    }
+    QByteArray runs;
+    runs.reserve(content.runs.size() * 2);
+    for (const Run &run : content.runs) {
+        appendVarint(runs, quint32(run.length));
+        appendVarint(runs, quint32(run.format + 1));
+    }
+
+    QByteArray body;
+    {
+        QDataStream out(&body, QIODevice::WriteOnly);
+        out.setVersion(streamVersion);
+        out << strings.strings << quint32(content.formats.size()) << formats << content.lists
+            << quint32(content.blocks.size()) << blocks << quint32(content.runs.size()) << runs
+            << content.text.toUtf8();
+    }
+
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(streamVersion);
+    out << fileMagic << fileVersion << quint16(compress ? compressedFlag : 0);
+    data.append(compress ? qCompress(body, compressionLevel) : body);
+    return data;
+}
+
+bool decode(const QByteArray &data, Content *content, QString *errorString)
+{
+    PERF_SCOPE("rich decode");
+    auto fail = [errorString](const QString &message) {
+        if (errorString) *errorString = message;
+        return false;
+    };
+
+    QDataStream header(data);
+    header.setVersion(streamVersion);
+    quint32 magic = 0;
+    quint16 version = 0;
+    quint16 flags = 0;
+    header >> magic >> version >> flags;
+    if (magic != fileMagic) return fail(QObject::tr("Not a Notepad document"));
+    if (version != fileVersion) return fail(QObject::tr("Unsupported Notepad document version %1").arg(version));
+
+    const QByteArray rest = data.mid(sizeof(magic) + sizeof(version) + sizeof(flags));
+    const QByteArray body = (flags & compressedFlag) ? qUncompress(rest) : rest;
+    QDataStream in(body);
+    in.setVersion(streamVersion);
+
+    QStringList strings;
+    quint32 formatCount = 0;
+    QByteArray formats;
+    quint32 blockCount = 0;
+    QByteArray blocks;
+    quint32 runCount = 0;
+    QByteArray runs;
+    QByteArray text;
+    Content result;
+    in >> strings >> formatCount >> formats >> result.lists >> blockCount >> blocks >> runCount >> runs >> text;
+    if (body.isEmpty() || in.status() != QDataStream::Ok) return fail(QObject::tr("The document is damaged"));
+
+    QDataStream formatStream(formats);
+    formatStream.setVersion(streamVersion);
+    result.formats.reserve(formatCount);
+    for (quint32 i = 0; i < formatCount; ++i) {
+        QTextFormat format;
+        if (!readFormat(formatStream, strings, &format)) return fail(QObject::tr("The document is damaged"));
+        result.formats.append(format);
+    }
+    const quint32 formatLimit = formatCount + 1;   // Indices are stored plus one
+    for (qint32 list : std::as_const(result.lists)) {
+        if (list < 0 || quint32(list) >= formatCount) return fail(QObject::tr("The document is damaged"));
+    }
+
+    // Blocks and runs must cover the text exactly, so building never has to check
+    result.text = QString::fromUtf8(text);
+    const uchar *p = reinterpret_cast<const uchar *>(blocks.constData());
+    const uchar *end = p + blocks.size();
+    const uchar *runPointer = reinterpret_cast<const uchar *>(runs.constData());
+    const uchar *runEnd = runPointer + runs.size();
+    result.blocks.reserve(blockCount);
+    result.runs.reserve(runCount);
+    qint64 covered = 0;
+    for (quint32 i = 0; i < blockCount; ++i) {
+        quint32 length, blockFormat, charFormat, list;
+        if (!readVarint(p, end, &length) || !readVarint(p, end, &blockFormat)
+            || !readVarint(p, end, &charFormat) || !readVarint(p, end, &list)
+            || blockFormat >= formatLimit || charFormat >= formatLimit || list > quint32(result.lists.size())) {
+            return fail(QObject::tr("The document is damaged"));
+        }
+        result.blocks.append({qint32(length), qint32(blockFormat) - 1, qint32(charFormat) - 1, qint32(list) - 1});
+
+        for (quint32 done = 0; done < length; ) {
+            quint32 runLength, format;
+            if (!readVarint(runPointer, runEnd, &runLength) || !readVarint(runPointer, runEnd, &format)
+                || runLength == 0 || runLength > length - done || format >= formatLimit) {
+                return fail(QObject::tr("The document is damaged"));
+            }
+            result.runs.append({qint32(runLength), qint32(format) - 1});
+            done += runLength;
+        }
+        covered += length + (i > 0 ? 1 : 0);
+    }
+    if (blockCount == 0 || covered != result.text.size() || quint32(result.runs.size()) != runCount) {
+        return fail(QObject::tr("The document is damaged"));
+    }
+
+    *content = result;
+    return true;
+}
+
+bool read(const QString &fileName, Content *content, QString *errorString)
+{
+    PERF_SCOPE("rich read");
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return decode(file.readAll(), content, errorString);
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef RICHDOCUMENT_H
+#define RICHDOCUMENT_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QTextFormat>
+
+class QTextDocument;
+
+// Native rich-text file format (*.ntd).
+// A document is stored as its plain text plus three small tables: the distinct
+// formats it uses (their strings in a shared string table), one record per
+// block (length, block format, block character format, list) and the
+// character format runs, each a length and a format. Nothing is stored per
+// character, and the body may be zlib-compressed. Loading sets the plain text
+// in one go and then applies only the runs and blocks that are not default,
+// coalesced so a uniformly formatted stretch costs one call.
+namespace RichDocument
+{
+
+struct Block
+{
+    qint32 length;                   // Characters, without the separator
+    qint32 blockFormat;              // Index into Content::formats, -1 for the default format
+    qint32 charFormat;
+    qint32 list;                     // Index into Content::lists, -1 when not in a list
+};
+
+struct Run
+{
+    qint32 length;
+    qint32 format;
+};
+
+// Everything the file holds; taken on the GUI thread, encoded and decoded on any thread
+struct Content
+{
+    QString text;                    // Blocks separated by '\n'
+    QVector<QTextFormat> formats;
+    QVector<qint32> lists;           // Format of each list
+    QVector<Block> blocks;
+    QVector<Run> runs;               // All blocks' runs in order; a block's runs add up to its length
+};
+
+bool isRichFileName(const QString &fileName);   // By extension, for choosing how to save
+bool isRichFile(const QString &fileName);       // By content, for choosing how to open
+
+Content capture(const QTextDocument *document);
+void build(QTextDocument *document, const Content &content);
+
+QByteArray encode(const Content &content, bool compress = true);
+bool decode(const QByteArray &data, Content *content, QString *errorString = nullptr);
+bool read(const QString &fileName, Content *content, QString *errorString = nullptr);
+
+}
+
+#endif // RICHDOCUMENT_H
@@ -0,0 +1,21 @@
+#include "selectionlayers.h"
+
+SelectionLayers::SelectionLayers(QTextEdit *editor) : QObject(editor), editor(editor)
+{
+}
+
+SelectionLayers *SelectionLayers::of(QTextEdit *editor)
+{
+    SelectionLayers *layers = editor->findChild<SelectionLayers *>(QString(), Qt::FindDirectChildrenOnly);
+    return layers ? layers : new SelectionLayers(editor);
+}
+
+void SelectionLayers::setSelections(Layer layer, const QList<QTextEdit::ExtraSelection> &selections)
+{
+    if (selections.isEmpty() && layers[layer].isEmpty()) return;
+    layers[layer] = selections;
+
+    QList<QTextEdit::ExtraSelection> merged;
+    for (const QList<QTextEdit::ExtraSelection> &list : layers) merged += list;
+    editor->setExtraSelections(merged);
+}
@@ -0,0 +1,35 @@
+#ifndef SELECTIONLAYERS_H
+#define SELECTIONLAYERS_H
+
+#include <QObject>
+#include <QList>
+#include <QTextEdit>
+
+// The ExtraSelections of an editor, kept per feature. QTextEdit has a single
+// list, so a feature that set it directly would wipe the highlights of every
+// other one; each feature owns a layer here instead, and the layers are
+// merged in order (later layers paint over earlier ones).
+class SelectionLayers : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Layer {
+        FindMatches,
+        SpokenText,
+        LayerCount
+    };
+
+    static SelectionLayers *of(QTextEdit *editor);   // Created on first use, as a child of editor
+
+    void setSelections(Layer layer, const QList<QTextEdit::ExtraSelection> &selections);
+    void clear(Layer layer) { setSelections(layer, {}); }
+
+private:
+    explicit SelectionLayers(QTextEdit *editor);
+
+    QTextEdit *editor;
+    QList<QTextEdit::ExtraSelection> layers[LayerCount];
+};
+
+#endif // SELECTIONLAYERS_H
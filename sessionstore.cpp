@@ -0,0 +1,366 @@
+#include "sessionstore.h"
+#include "perftrace.h"
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QSettings>
+#include <QSaveFile>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QTimer>
+#include <QUuid>
+
+static const int flushInterval = 1000;             // ms between appends of buffered edits
+static const int compactionRecords = 2000;         // Compact once a log holds this many records...
+static const qint64 minCompactionBytes = 256 * 1024;  // ...or is at least this large and half the snapshot size
+static const QDataStream::Version streamVersion = QDataStream::Qt_6_0;
+
+SessionStore::SessionStore(const QString &directoryPath, QObject *parent) : QObject(parent)
+{
+    QDir().mkpath(directoryPath);
+    directory = QDir(directoryPath);
+
+    flushTimer = new QTimer(this);
+    flushTimer->setSingleShot(true);
+    flushTimer->setInterval(flushInterval);
+    connect(flushTimer, &QTimer::timeout, this, &SessionStore::flush);
+}
+
+QString SessionStore::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/NotepadAppSession";
+}
+
+// Manifest
+
+QVector<SessionStore::TabEntry> SessionStore::loadManifest(int *currentTab) const
+{
+    QSettings settings(directory.filePath("session.ini"), QSettings::IniFormat);
+    QVector<TabEntry> tabs;
+
+    int tabCount = settings.value("tabCount", 0).toInt();
+    for (int i = 0; i < tabCount; ++i) {
+        TabEntry entry;
+        entry.id = settings.value(QString("tab%1_id").arg(i)).toString();
+        entry.filePath = settings.value(QString("tab%1_filePath").arg(i)).toString();
+        entry.largeFile = settings.value(QString("tab%1_largeFile").arg(i), false).toBool();
+        entry.follow = settings.value(QString("tab%1_follow").arg(i), false).toBool();
+        entry.rich = settings.value(QString("tab%1_rich").arg(i), false).toBool();
+        entry.readOnly = settings.value(QString("tab%1_readOnly").arg(i), false).toBool();
+        entry.size = settings.value(QString("tab%1_size").arg(i), 0).toLongLong();
+        entry.scrollPosition = settings.value(QString("tab%1_scroll").arg(i), 0).toInt();
+        entry.encoding = settings.value(QString("tab%1_encoding").arg(i)).toString();
+        if (!entry.id.isEmpty() || entry.largeFile || entry.follow || entry.rich || entry.readOnly) tabs.append(entry);
+    }
+
+    if (currentTab) *currentTab = settings.value("currentTab", 0).toInt();
+    return tabs;
+}
+
+void SessionStore::saveManifest(const QVector<TabEntry> &tabs, int currentTab)
+{
+    QSettings settings(directory.filePath("session.ini"), QSettings::IniFormat);
+    settings.clear();
+    settings.setValue("tabCount", tabs.size());
+    for (int i = 0; i < tabs.size(); ++i) {
+        settings.setValue(QString("tab%1_id").arg(i), tabs[i].id);
+        settings.setValue(QString("tab%1_filePath").arg(i), tabs[i].filePath);
+        if (tabs[i].largeFile) settings.setValue(QString("tab%1_largeFile").arg(i), true);
+        if (tabs[i].follow) settings.setValue(QString("tab%1_follow").arg(i), true);
+        if (tabs[i].rich) settings.setValue(QString("tab%1_rich").arg(i), true);
+        if (tabs[i].readOnly) settings.setValue(QString("tab%1_readOnly").arg(i), true);
+        settings.setValue(QString("tab%1_size").arg(i), tabs[i].size);
+        settings.setValue(QString("tab%1_scroll").arg(i), tabs[i].scrollPosition);
+        if (!tabs[i].encoding.isEmpty()) settings.setValue(QString("tab%1_encoding").arg(i), tabs[i].encoding);
+    }
+    settings.setValue("currentTab", currentTab);
+    settings.sync();
+}
+
+// Move the tabs of the old monolithic INI session into journals, once
+void SessionStore::importLegacySession(const QString &iniPath)
+{
+    if (directory.exists("session.ini") || !QFile::exists(iniPath)) return;
+
+    QSettings legacy(iniPath, QSettings::IniFormat);
+    QVector<TabEntry> tabs;
+    int tabCount = legacy.value("tabCount", 0).toInt();
+    for (int i = 0; i < tabCount; ++i) {
+        TabEntry entry;
+        entry.filePath = legacy.value(QString("tab%1_filePath").arg(i)).toString();
+        entry.largeFile = legacy.value(QString("tab%1_largeFile").arg(i), false).toBool();
+        if (!entry.largeFile) {
+            entry.id = createTabId();
+            QSaveFile snapshot(snapshotPath(entry.id, 0));
+            if (!snapshot.open(QIODevice::WriteOnly)) continue;
+            snapshot.write(legacy.value(QString("tab%1_content").arg(i)).toString().toUtf8());
+            if (!snapshot.commit()) continue;
+        }
+        tabs.append(entry);
+    }
+    saveManifest(tabs, legacy.value("currentTab", 0).toInt());
+}
+
+// Tab content
+
+QString SessionStore::createTabId()
+{
+    return QUuid::createUuid().toString(QUuid::WithoutBraces);
+}
+
+QString SessionStore::snapshotPath(const QString &id, int generation) const
+{
+    return directory.filePath(QString("tab-%1-%2.txt").arg(id).arg(generation));
+}
+
+QString SessionStore::logPath(const QString &id, int generation) const
+{
+    return directory.filePath(QString("tab-%1-%2.wal").arg(id).arg(generation));
+}
+
+QString SessionStore::undoPath(const QString &id) const
+{
+    return directory.filePath(QString("tab-%1.undo").arg(id));
+}
+
+// Highest snapshot generation on disk for id, or -1
+int SessionStore::latestGeneration(const QString &id) const
+{
+    const QString prefix = QString("tab-%1-").arg(id);
+    int latest = -1;
+    const QStringList snapshots = directory.entryList({prefix + "*.txt"}, QDir::Files);
+    for (const QString &name : snapshots) {
+        bool ok = false;
+        int generation = name.mid(prefix.size(), name.size() - prefix.size() - 4).toInt(&ok);
+        if (ok) latest = qMax(latest, generation);
+    }
+    return latest;
+}
+
+// Delete every generation of id except keepGeneration (-1 deletes everything)
+void SessionStore::removeFiles(const QString &id, int keepGeneration)
+{
+    const QString prefix = QString("tab-%1-").arg(id);
+    const QStringList files = directory.entryList({prefix + "*.txt", prefix + "*.wal"}, QDir::Files);
+    for (const QString &name : files) {
+        bool ok = false;
+        int generation = name.mid(prefix.size(), name.size() - prefix.size() - 4).toInt(&ok);
+        if (!ok || generation != keepGeneration) directory.remove(name);
+    }
+}
+
+// Read the latest snapshot and the edits logged after it
+SessionStore::TabContent SessionStore::readTab(const QString &id) const
+{
+    PERF_SCOPE("session read");
+    TabContent content;
+    const int generation = latestGeneration(id);
+    if (generation < 0) return content;
+    content.generation = generation;
+
+    QFile snapshot(snapshotPath(id, generation));
+    if (snapshot.open(QIODevice::ReadOnly)) {
+        content.text = QString::fromUtf8(snapshot.readAll());
+    }
+
+    QFile log(logPath(id, generation));
+    if (log.open(QIODevice::ReadOnly)) {
+        QDataStream in(&log);
+        in.setVersion(streamVersion);
+        while (!in.atEnd()) {
+            JournalRecord record;
+            in >> record.position >> record.removed >> record.inserted;
+            if (in.status() != QDataStream::Ok) break;  // Torn last record from a crash
+            content.records.append(record);
+            content.logSize = log.pos();
+        }
+    }
+    return content;
+}
+
+// Load the snapshot, then replay the log through a cursor so each record costs
+// O(log n) instead of a copy of the whole text
+void SessionStore::applyContent(QTextDocument *document, const TabContent &content)
+{
+    PERF_SCOPE("session apply");
+    const bool undoEnabled = document->isUndoRedoEnabled();
+    document->setUndoRedoEnabled(false);
+    document->setPlainText(content.text);
+
+    if (!content.records.isEmpty()) {
+        QTextCursor cursor(document);
+        cursor.beginEditBlock();
+        for (const JournalRecord &record : content.records) {
+            const int end = document->characterCount() - 1;
+            const int position = qBound(0, int(record.position), end);
+            cursor.setPosition(position);
+            cursor.setPosition(qMin(position + int(record.removed), end), QTextCursor::KeepAnchor);
+            cursor.insertText(record.inserted);
+        }
+        cursor.endEditBlock();
+    }
+
+    document->setUndoRedoEnabled(undoEnabled);
+    document->setModified(false);
+}
+
+// Records hold document positions, which are offsets into the plain text, so
+// this needs no QTextDocument and is safe on any thread
+QString SessionStore::plainText(const TabContent &content)
+{
+    QString text = content.text;
+    for (const JournalRecord &record : content.records) {
+        const int end = int(text.size());
+        const int position = qBound(0, int(record.position), end);
+        text.replace(position, qMin(position + int(record.removed), end) - position, record.inserted);
+    }
+    return text;
+}
+
+// Cut off what follows the last whole record of a log, left by a crash mid-append;
+// records appended after it would never be read back
+void SessionStore::repairLog(const QString &id, const TabContent &content)
+{
+    if (content.generation < 0) return;
+    const QString path = logPath(id, content.generation);
+    if (QFileInfo(path).size() > content.logSize) QFile::resize(path, content.logSize);
+}
+
+// Journaling
+
+// Start logging the edits of document under id; the document's current content is the starting point
+void SessionStore::track(const QString &id, QTextDocument *document)
+{
+    if (journals.contains(document)) return;
+
+    Journal journal;
+    journal.id = id;
+    journal.generation = latestGeneration(id);
+    if (journal.generation >= 0) {
+        journal.snapshotSize = QFileInfo(snapshotPath(id, journal.generation)).size();
+        journal.logSize = QFileInfo(logPath(id, journal.generation)).size();
+    } else {
+        flushTimer->start();  // Write the first snapshot soon
+    }
+    journals.insert(document, journal);
+
+    connect(document, &QTextDocument::contentsChange, this, &SessionStore::onContentsChange);
+    connect(document, &QObject::destroyed, this, [this, document] {
+        // The files stay: the tab is still part of the session, just not open any more
+        journals.remove(document);
+    });
+}
+
+bool SessionStore::isTracked(const QTextDocument *document) const
+{
+    return journals.contains(const_cast<QTextDocument *>(document));
+}
+
+// The tab was closed: forget it and its files
+void SessionStore::removeTab(const QString &id)
+{
+    for (auto it = journals.begin(); it != journals.end(); ++it) {
+        if (it.value().id == id) {
+            disconnect(it.key(), nullptr, this, nullptr);
+            journals.erase(it);
+            break;
+        }
+    }
+    removeFiles(id, -1);
+    QFile::remove(undoPath(id));
+}
+
+void SessionStore::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    QTextDocument *document = qobject_cast<QTextDocument *>(sender());
+    auto it = journals.find(document);
+    if (it == journals.end()) return;
+
+    JournalRecord record;
+    record.position = position;
+    record.removed = charsRemoved;
+    if (charsAdded > 0) {
+        // Clamp to the text: Qt counts the document's implicit last block separator in some changes
+        const int end = document->characterCount() - 1;
+        QTextCursor cursor(document);
+        cursor.setPosition(qMin(position, end));
+        cursor.setPosition(qMin(position + charsAdded, end), QTextCursor::KeepAnchor);
+        record.inserted = cursor.selectedText();
+        record.inserted.replace(QChar::ParagraphSeparator, QLatin1Char('\n'));
+    }
+
+    appendRecord(it.value(), record);
+    if (!flushTimer->isActive()) flushTimer->start();
+}
+
+// Buffer a record, folding plain typing and backspacing into the previous insert
+void SessionStore::appendRecord(Journal &journal, const JournalRecord &record)
+{
+    if (!journal.pending.isEmpty()) {
+        JournalRecord &previous = journal.pending.last();
+        const qint32 previousEnd = previous.position + qint32(previous.inserted.size());
+        if (previous.removed == 0 && record.removed == 0 && record.position == previousEnd) {
+            previous.inserted += record.inserted;
+            return;
+        }
+        if (previous.removed == 0 && record.inserted.isEmpty() && record.position >= previous.position
+            && record.position + record.removed == previousEnd) {
+            previous.inserted.chop(record.removed);
+            return;
+        }
+    }
+    journal.pending.append(record);
+}
+
+// Append the buffered records of dirty tabs; compact tabs whose log has grown too long
+void SessionStore::flush()
+{
+    PERF_SCOPE("session flush");
+    for (auto it = journals.begin(); it != journals.end(); ++it) {
+        Journal &journal = it.value();
+        if (journal.generation >= 0 && journal.pending.isEmpty()) continue;  // Clean tab
+
+        const bool logTooLong = journal.logRecords + journal.pending.size() >= compactionRecords
+            || (journal.logSize >= minCompactionBytes && journal.logSize * 2 >= journal.snapshotSize);
+        if (journal.generation < 0 || logTooLong) {
+            compact(journal, it.key());
+            continue;
+        }
+
+        QFile log(logPath(journal.id, journal.generation));
+        if (!log.open(QIODevice::WriteOnly | QIODevice::Append)) continue;  // Keep the records for the next flush
+
+        QDataStream out(&log);
+        out.setVersion(streamVersion);
+        for (const JournalRecord &record : std::as_const(journal.pending)) {
+            out << record.position << record.removed << record.inserted;
+        }
+        log.flush();
+
+        journal.logSize = log.size();
+        journal.logRecords += journal.pending.size();
+        journal.pending.clear();
+    }
+}
+
+// Write the whole document as the next snapshot generation and retire the old one
+bool SessionStore::compact(Journal &journal, QTextDocument *document)
+{
+    PERF_SCOPE("session compact");
+    const int generation = journal.generation + 1;
+    const QByteArray text = document->toPlainText().toUtf8();
+
+    QSaveFile snapshot(snapshotPath(journal.id, generation));
+    if (!snapshot.open(QIODevice::WriteOnly) || snapshot.write(text) != text.size() || !snapshot.commit()) {
+        return false;  // The old generation is untouched; try again on the next flush
+    }
+
+    removeFiles(journal.id, generation);
+    journal.generation = generation;
+    journal.snapshotSize = text.size();
+    journal.logSize = 0;
+    journal.logRecords = 0;
+    journal.pending.clear();
+    return true;
+}
@@ -0,0 +1,100 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QObject>
+#include <QDir>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+class QTextDocument;
+class QTimer;
+
+// One edit in a tab's write-ahead log: replace `removed` characters at `position` with `inserted`
+struct JournalRecord
+{
+    qint32 position;
+    qint32 removed;
+    QString inserted;
+};
+
+// Crash-safe session storage, one journal per tab.
+// Each tab has a snapshot file plus an append-only write-ahead log of the edits
+// made since that snapshot. Edits are buffered in memory and appended for dirty
+// tabs only, once a second; when a log grows too long the tab is compacted into
+// a new snapshot generation. A generation is only retired after the next one has
+// been committed, so a crash at any point leaves a consistent snapshot + log pair.
+class SessionStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct TabEntry
+    {
+        QString id;
+        QString filePath;
+        bool largeFile = false;      // Reopened from disk instead of journaled
+        bool follow = false;         // A followed log: reopened from disk and followed again
+        bool rich = false;           // A native document: reopened from disk, formatting and all
+        bool readOnly = false;       // A file that did not decode: reopened from disk, read-only again
+        qint64 size = 0;             // Characters of text, or bytes for a large file
+        int scrollPosition = 0;      // Character at the top of the viewport
+        QString encoding;            // TextCodec name of the file's encoding
+    };
+
+    struct TabContent
+    {
+        QString text;
+        QVector<JournalRecord> records;
+        int generation = -1;         // Of the snapshot and log read
+        qint64 logSize = 0;          // Bytes of whole records in the log; anything after them is a torn write
+    };
+
+    explicit SessionStore(const QString &directoryPath, QObject *parent = nullptr);
+    static QString defaultDirectory();
+
+    QVector<TabEntry> loadManifest(int *currentTab) const;
+    void saveManifest(const QVector<TabEntry> &tabs, int currentTab);
+    void importLegacySession(const QString &iniPath);   // One-time migration from NotepadAppSession.ini
+
+    static QString createTabId();
+    TabContent readTab(const QString &id) const;        // Only reads files, so it is safe on any thread
+    static void applyContent(QTextDocument *document, const TabContent &content);
+    static QString plainText(const TabContent &content);   // The text applyContent() gives, without a document
+    void repairLog(const QString &id, const TabContent &content);   // Before track(), so new records follow the good ones
+
+    void track(const QString &id, QTextDocument *document);
+    void removeTab(const QString &id);
+    bool isTracked(const QTextDocument *document) const;
+    QString undoPath(const QString &id) const;          // Where the tab's undo history is kept between sessions
+
+public slots:
+    void flush();
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    struct Journal
+    {
+        QString id;
+        int generation = -1;         // -1 until the first snapshot is written
+        qint64 snapshotSize = 0;
+        qint64 logSize = 0;
+        int logRecords = 0;
+        QVector<JournalRecord> pending;
+    };
+
+    void appendRecord(Journal &journal, const JournalRecord &record);
+    bool compact(Journal &journal, QTextDocument *document);
+    int latestGeneration(const QString &id) const;
+    QString snapshotPath(const QString &id, int generation) const;
+    QString logPath(const QString &id, int generation) const;
+    void removeFiles(const QString &id, int keepGeneration);
+
+    QDir directory;
+    QHash<QTextDocument *, Journal> journals;
+    QTimer *flushTimer;
+};
+
+#endif // SESSIONSTORE_H
@@ -0,0 +1,10 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE2 is part of the x86-64 baseline, but MSVC does not define __SSE2__ for x64 builds
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define NOTEPAD_SSE2
+#include <emmintrin.h>
+#endif
+
+#endif // SIMD_H
@@ -0,0 +1,193 @@
+#include "speechreader.h"
+#include "selectionlayers.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QScrollBar>
+
+static const int lookahead = 2;            // Utterances in the engine: the one playing and the next
+static const int maxSentenceLength = 600;  // Longer runs without a sentence break are cut at a space
+
+SpeechReader::SpeechReader(QTextToSpeech *speech, QObject *parent) : QObject(parent), speech(speech)
+{
+    connect(speech, &QTextToSpeech::aboutToSynthesize, this, &SpeechReader::onAboutToSynthesize);
+    connect(speech, &QTextToSpeech::stateChanged, this, &SpeechReader::onStateChanged);
+}
+
+// Read from position to the end of the document
+void SpeechReader::start(QTextEdit *newEditor, int position)
+{
+    stop();
+    editor = newEditor;
+    nextStart = QTextCursor(editor->document());
+    nextStart.setPosition(qBound(0, position, editor->document()->characterCount() - 1));
+    active = true;
+    fill();
+    if (queued.isEmpty()) finish();  // Nothing but blank text after position
+}
+
+void SpeechReader::pause()
+{
+    if (!active || paused) return;
+    paused = true;
+    speech->pause();
+}
+
+void SpeechReader::resume()
+{
+    if (!active || !paused) return;
+    paused = false;
+    speech->resume();
+}
+
+void SpeechReader::stop()
+{
+    if (!active) return;
+    active = false;       // Before stopping the engine: its Ready state is not the end of the text
+    speech->stop();
+    finish();
+}
+
+void SpeechReader::seek(int sentences)
+{
+    if (!active || !editor || sentences == 0) return;
+
+    const QTextCursor current = queued.isEmpty() ? nextStart : queued.first().range;
+    int position;
+    if (sentences > 0) {
+        QTextCursor cursor(editor->document());
+        cursor.setPosition(current.selectionEnd());
+        for (int i = 1; i < sentences && !nextSentence(&cursor).isNull(); ++i) {}
+        position = cursor.position();
+    } else {
+        position = current.selectionStart();
+        for (int i = 0; i < -sentences; ++i) position = previousSentenceStart(position);
+    }
+    start(editor, position);
+}
+
+// Keep the engine's queue topped up to the lookahead
+void SpeechReader::fill()
+{
+    while (editor && queued.size() < lookahead) {
+        const QTextCursor range = nextSentence(&nextStart);
+        if (range.isNull()) break;
+        queued.append({speech->enqueue(range.selectedText()), range});
+    }
+}
+
+void SpeechReader::onAboutToSynthesize(qsizetype id)
+{
+    if (!active) return;
+    while (!queued.isEmpty() && queued.first().id != id) queued.removeFirst();
+    if (queued.isEmpty()) return;
+    highlight(queued.first().range);
+    fill();
+}
+
+void SpeechReader::onStateChanged(QTextToSpeech::State state)
+{
+    if (!active) return;
+    if (state == QTextToSpeech::Error) {
+        active = false;
+        finish();
+    } else if (state == QTextToSpeech::Ready && speech->state() == QTextToSpeech::Ready) {
+        // The engine ran dry: everything queued has been spoken (a late signal from a
+        // stop() before a restart finds the engine busy again and is ignored)
+        queued.clear();
+        fill();
+        if (queued.isEmpty()) {
+            active = false;
+            finish();
+        }
+    }
+}
+
+void SpeechReader::finish()
+{
+    queued.clear();
+    paused = false;
+    if (editor) SelectionLayers::of(editor)->clear(SelectionLayers::SpokenText);
+}
+
+void SpeechReader::highlight(const QTextCursor &range)
+{
+    if (!editor) return;
+    QTextEdit::ExtraSelection selection;
+    selection.cursor = range;
+    selection.format.setBackground(QColor(180, 215, 255));
+    SelectionLayers::of(editor)->setSelections(SelectionLayers::SpokenText, {selection});
+
+    // Bring the sentence into view without moving the user's cursor
+    QTextCursor start = range;
+    start.setPosition(range.selectionStart());
+    const QRect rect = editor->cursorRect(start);
+    if (rect.top() < 0 || rect.bottom() > editor->viewport()->height()) {
+        QScrollBar *scrollBar = editor->verticalScrollBar();
+        scrollBar->setValue(scrollBar->value() + rect.top() - editor->viewport()->height() / 3);
+    }
+}
+
+// The sentence starting at or after *from, which is moved past it; a null cursor at the end
+QTextCursor SpeechReader::nextSentence(QTextCursor *from) const
+{
+    QTextDocument *document = from->document();
+    QTextBlock block = document->findBlock(from->position());
+    int offset = from->position() - block.position();
+
+    for (; block.isValid(); block = block.next(), offset = 0) {
+        const QString text = block.text();
+        while (offset < text.size() && text.at(offset).isSpace()) ++offset;
+        if (offset >= text.size()) continue;
+
+        QTextBoundaryFinder &finder = sentenceFinder(block.blockNumber(), text);
+        finder.setPosition(offset);
+        int end = int(finder.toNextBoundary());
+        if (end <= offset) end = int(text.size());
+        if (end - offset > maxSentenceLength) {
+            const int space = int(text.lastIndexOf(QLatin1Char(' '), offset + maxSentenceLength));
+            end = space > offset ? space + 1 : offset + maxSentenceLength;
+        }
+
+        QTextCursor range(document);
+        range.setPosition(block.position() + offset);
+        range.setPosition(block.position() + end, QTextCursor::KeepAnchor);
+        from->setPosition(block.position() + end);
+        return range;
+    }
+    from->movePosition(QTextCursor::End);
+    return QTextCursor();
+}
+
+// Start of the sentence before the one starting at position, crossing into earlier paragraphs
+int SpeechReader::previousSentenceStart(int position) const
+{
+    QTextDocument *document = editor->document();
+    QTextBlock block = document->findBlock(position);
+    int offset = position - block.position();
+
+    while (block.isValid()) {
+        const QString text = block.text();
+        if (offset > 0 && !text.trimmed().isEmpty()) {
+            QTextBoundaryFinder &finder = sentenceFinder(block.blockNumber(), text);
+            finder.setPosition(qMin(offset, int(text.size())));
+            const qsizetype boundary = finder.toPreviousBoundary();
+            return block.position() + int(qMax<qsizetype>(0, boundary));
+        }
+        block = block.previous();
+        offset = block.isValid() ? block.length() - 1 : 0;
+    }
+    return 0;
+}
+
+// Analysing a paragraph costs as much as the paragraph, so the finder is only
+// built again when reading moves to another paragraph or the paragraph is edited
+QTextBoundaryFinder &SpeechReader::sentenceFinder(int blockNumber, const QString &text) const
+{
+    if (blockNumber != finderBlock || text != finderText) {
+        finder = QTextBoundaryFinder(QTextBoundaryFinder::Sentence, text);
+        finderText = text;
+        finderBlock = blockNumber;
+    }
+    return finder;
+}
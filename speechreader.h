@@ -0,0 +1,64 @@
+#ifndef SPEECHREADER_H
+#define SPEECHREADER_H
+
+#include <QObject>
+#include <QList>
+#include <QPointer>
+#include <QTextCursor>
+#include <QTextBoundaryFinder>
+#include <QtTextToSpeech/QTextToSpeech>
+
+class QTextEdit;
+
+// Reads an editor aloud a sentence at a time, starting at a position.
+// Sentences are found lazily with QTextBoundaryFinder within the paragraph at
+// hand, with one finder per paragraph reused for each of its sentences, and
+// only the one being spoken and the next are queued in the engine, so starting
+// is immediate and memory stays flat however long the document is. Sentence ranges are kept as QTextCursors, which follow edits made while
+// reading. The spoken sentence is highlighted in its own selection layer.
+class SpeechReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SpeechReader(QTextToSpeech *speech, QObject *parent = nullptr);
+
+    void start(QTextEdit *editor, int position);
+    void pause();
+    void resume();
+    void stop();
+    void seek(int sentences);      // Jump forward (positive) or back (negative) and read on from there
+
+    bool isActive() const { return active; }
+    bool isPaused() const { return paused; }
+
+private slots:
+    void onAboutToSynthesize(qsizetype id);
+    void onStateChanged(QTextToSpeech::State state);
+
+private:
+    struct Utterance
+    {
+        qsizetype id;
+        QTextCursor range;
+    };
+
+    QTextCursor nextSentence(QTextCursor *from) const;
+    int previousSentenceStart(int position) const;
+    QTextBoundaryFinder &sentenceFinder(int blockNumber, const QString &text) const;
+    void fill();
+    void finish();
+    void highlight(const QTextCursor &range);
+
+    QTextToSpeech *speech;
+    QPointer<QTextEdit> editor;
+    QList<Utterance> queued;     // Handed to the engine; the one being spoken first
+    QTextCursor nextStart;       // Where the next sentence to queue begins
+    mutable QTextBoundaryFinder finder;   // Over finderText, the text of block finderBlock
+    mutable QString finderText;
+    mutable int finderBlock = -1;
+    bool active = false;
+    bool paused = false;
+};
+
+#endif // SPEECHREADER_H
@@ -0,0 +1,155 @@
+#include "spellchecker.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QStringEncoder>
+#include <QStringDecoder>
+#include <QTextBoundaryFinder>
+#include <QThreadPool>
+#include <hunspell/hunspell.hxx>
+
+static const int spellThreads = 2;           // Each worker holds its own copy of the dictionary
+static const int maxCachedWordsPerShard = 50000;
+
+// Lends a Hunspell instance to the current thread for the duration of a scope
+class SpellChecker::Lease
+{
+public:
+    explicit Lease(SpellChecker *checker) : checker(checker), hunspell(checker->acquire()) {}
+    ~Lease() { checker->release(std::move(hunspell)); }
+    Hunspell *operator->() const { return hunspell.get(); }
+
+private:
+    SpellChecker *checker;
+    std::unique_ptr<Hunspell> hunspell;
+};
+
+SpellChecker::SpellChecker(QObject *parent) : QObject(parent)
+{
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(spellThreads);
+    pool->setExpiryTimeout(-1);  // Keep the workers, and with them their warm dictionaries
+}
+
+SpellChecker::~SpellChecker()
+{
+    pool->waitForDone();
+}
+
+// Dictionaries are shipped next to the executable
+QString SpellChecker::dictionaryDirectory()
+{
+    return QCoreApplication::applicationDirPath() + "/dictionary";
+}
+
+bool SpellChecker::loadDictionary(const QString &language, QString *errorString)
+{
+    const QDir directory(dictionaryDirectory());
+    const QString affix = directory.filePath(language + ".aff");
+    const QString dictionary = directory.filePath(language + ".dic");
+    if (!QFile::exists(affix) || !QFile::exists(dictionary)) {
+        if (errorString) *errorString = tr("No %1 dictionary in %2").arg(language, directory.path());
+        return false;
+    }
+
+    affixPath = QFile::encodeName(affix);
+    dictionaryPath = QFile::encodeName(dictionary);
+
+    // Load one instance now: it tells us the dictionary encoding and is ready for the first check
+    std::unique_ptr<Hunspell> hunspell = std::make_unique<Hunspell>(affixPath.constData(), dictionaryPath.constData());
+    encoding = QByteArray::fromStdString(hunspell->get_dict_encoding());
+    if (!QStringEncoder(encoding.constData()).isValid()) encoding = "UTF-8";
+    release(std::move(hunspell));
+    return true;
+}
+
+std::unique_ptr<Hunspell> SpellChecker::acquire()
+{
+    {
+        QMutexLocker locker(&idleMutex);
+        if (!idle.empty()) {
+            std::unique_ptr<Hunspell> hunspell = std::move(idle.back());
+            idle.pop_back();
+            return hunspell;
+        }
+    }
+    return std::make_unique<Hunspell>(affixPath.constData(), dictionaryPath.constData());
+}
+
+void SpellChecker::release(std::unique_ptr<Hunspell> hunspell)
+{
+    QMutexLocker locker(&idleMutex);
+    idle.push_back(std::move(hunspell));
+}
+
+bool SpellChecker::isCorrect(const QString &word)
+{
+    if (!isAvailable()) return true;
+
+    WordShard &shard = shards[qHash(word) % shards.size()];
+    {
+        QReadLocker locker(&shard.lock);
+        auto it = shard.words.constFind(word);
+        if (it != shard.words.cend()) return it.value();
+    }
+
+    QStringEncoder encoder(encoding.constData());
+    const QByteArray encoded = encoder.encode(word);
+    bool correct;
+    {
+        Lease hunspell(this);
+        correct = hunspell->spell(encoded.toStdString());
+    }
+
+    QWriteLocker locker(&shard.lock);
+    if (shard.words.size() >= maxCachedWordsPerShard) shard.words.clear();
+    shard.words.insert(word, correct);
+    return correct;
+}
+
+// Split text into words on Unicode word boundaries and collect the misspelled ones
+QVector<SpellRange> SpellChecker::check(const QString &text)
+{
+    QVector<SpellRange> ranges;
+    if (!isAvailable()) return ranges;
+
+    QTextBoundaryFinder finder(QTextBoundaryFinder::Word, text);
+    int start = 0;
+    while (true) {
+        if (finder.boundaryReasons() & QTextBoundaryFinder::StartOfItem) start = finder.position();
+        const int end = int(finder.toNextBoundary());
+        if (end < 0) break;
+        if (!(finder.boundaryReasons() & QTextBoundaryFinder::EndOfItem) || end - start < 2) continue;
+
+        // Only plain words: anything with digits or symbols (versions, identifiers, URLs) is skipped
+        const QStringView word = QStringView(text).mid(start, end - start);
+        bool plainWord = true;
+        for (QChar c : word) {
+            if (!c.isLetter() && c != QLatin1Char('\'') && c != QChar(0x2019)) {
+                plainWord = false;
+                break;
+            }
+        }
+        if (plainWord && !isCorrect(word.toString())) ranges.append({start, end - start});
+    }
+    return ranges;
+}
+
+// Every stem in the dictionary, without its affix flags
+QStringList SpellChecker::dictionaryWords() const
+{
+    QStringList words;
+    QFile file(QFile::decodeName(dictionaryPath));
+    if (!isAvailable() || !file.open(QIODevice::ReadOnly)) return words;
+
+    QStringDecoder decoder(encoding.constData());
+    file.readLine();  // The first line is the word count
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine();
+        qsizetype end = 0;   // The stem ends at its flags ("/") or morphological fields (tab)
+        while (end < line.size() && line[end] != '/' && line[end] != '\t') ++end;
+        const QString word = QString(decoder.decode(line.left(end))).trimmed();
+        if (!word.isEmpty()) words.append(word);
+    }
+    return words;
+}
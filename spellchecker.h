@@ -0,0 +1,70 @@
+#ifndef SPELLCHECKER_H
+#define SPELLCHECKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <array>
+#include <memory>
+#include <vector>
+
+class Hunspell;
+class QThreadPool;
+
+// A misspelled word inside a block of text
+struct SpellRange
+{
+    int start;
+    int length;
+};
+
+// Thread-safe front end to Hunspell.
+// A Hunspell instance is not safe to share between threads, so each concurrent
+// check borrows one from a small pool (at most one per worker thread). Every
+// word's verdict is cached in a sharded hash map, so a word is looked up in the
+// dictionary only once however many blocks and tabs contain it.
+class SpellChecker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SpellChecker(QObject *parent = nullptr);
+    ~SpellChecker();
+
+    static QString dictionaryDirectory();
+    bool loadDictionary(const QString &language, QString *errorString);  // e.g. "en_US"
+    bool isAvailable() const { return !affixPath.isEmpty(); }
+
+    QThreadPool *threadPool() const { return pool; }   // The workers spell checks run on
+
+    bool isCorrect(const QString &word);                // Safe on any thread
+    QVector<SpellRange> check(const QString &text);     // Safe on any thread
+    QStringList dictionaryWords() const;                // Reads the .dic file; safe on any thread
+
+private:
+    struct WordShard
+    {
+        QReadWriteLock lock;
+        QHash<QString, bool> words;
+    };
+
+    class Lease;
+    std::unique_ptr<Hunspell> acquire();
+    void release(std::unique_ptr<Hunspell> hunspell);
+
+    QByteArray affixPath;
+    QByteArray dictionaryPath;
+    QByteArray encoding;                      // Encoding of the dictionary files
+    QThreadPool *pool;
+
+    QMutex idleMutex;
+    std::vector<std::unique_ptr<Hunspell>> idle;   // Instances not in use by a worker
+
+    std::array<WordShard, 16> shards;
+};
+
+#endif // SPELLCHECKER_H
@@ -0,0 +1,113 @@
+#include "spellhighlighter.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QScrollBar>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+
+static const int checkDelay = 150;          // ms of quiet before changed blocks are checked
+static const int blockMargin = 20;          // Blocks checked beyond each edge of the viewport
+static const int maxCachedBlocks = 20000;
+
+namespace {
+struct BlockCheck
+{
+    int blockNumber;
+    size_t hash;
+    QString text;
+    QVector<SpellRange> ranges;
+};
+}
+
+SpellHighlighter::SpellHighlighter(QTextEdit *editor, SpellChecker *checker)
+    : SyntaxHighlighter(editor), checker(checker)
+{
+    misspelledFormat.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+    misspelledFormat.setUnderlineColor(Qt::red);
+
+    checkTimer = new QTimer(this);
+    checkTimer->setSingleShot(true);
+    checkTimer->setInterval(checkDelay);
+    connect(checkTimer, &QTimer::timeout, this, &SpellHighlighter::checkVisibleBlocks);
+
+    connect(editor->document(), &QTextDocument::contentsChanged, this, &SpellHighlighter::scheduleCheck);
+    connect(editor->verticalScrollBar(), &QScrollBar::valueChanged, this, &SpellHighlighter::scheduleCheck);
+    connect(editor->verticalScrollBar(), &QScrollBar::rangeChanged, this, &SpellHighlighter::scheduleCheck);
+    scheduleCheck();
+}
+
+// Runs on every block Qt re-lays out, so it must stay a hash lookup
+void SpellHighlighter::decorateBlock(const QString &text)
+{
+    auto it = blockResults.constFind(qHash(text));
+    if (it == blockResults.cend()) return;  // Not checked yet; checkVisibleBlocks() will get to it
+
+    // Underline on top of whatever syntax formats the word has, a run of equal formats at a time
+    for (const SpellRange &range : it.value()) {
+        const int end = range.start + range.length;
+        for (int start = range.start; start < end;) {
+            QTextCharFormat merged = format(start);
+            int runEnd = start + 1;
+            while (runEnd < end && format(runEnd) == merged) ++runEnd;
+            merged.merge(misspelledFormat);
+            setFormat(start, runEnd - start, merged);
+            start = runEnd;
+        }
+    }
+}
+
+void SpellHighlighter::scheduleCheck()
+{
+    if (!checkTimer->isActive()) checkTimer->start();
+}
+
+// Send the unchecked blocks around the viewport to the workers in one batch
+void SpellHighlighter::checkVisibleBlocks()
+{
+    if (!editor || !checker->isAvailable()) return;
+
+    const QWidget *viewport = editor->viewport();
+    QTextBlock block = editor->cursorForPosition(QPoint(0, 0)).block();
+    const int lastNumber = editor->cursorForPosition(QPoint(viewport->width(), viewport->height())).block().blockNumber() + blockMargin;
+    for (int i = 0; i < blockMargin && block.previous().isValid(); ++i) block = block.previous();
+
+    QVector<BlockCheck> batch;
+    for (; block.isValid() && block.blockNumber() <= lastNumber; block = block.next()) {
+        const QString text = block.text();
+        const size_t hash = qHash(text);
+        if (text.isEmpty() || blockResults.contains(hash) || inFlight.contains(hash)) continue;
+        inFlight.insert(hash);
+        batch.append({block.blockNumber(), hash, text, {}});
+    }
+    if (batch.isEmpty()) return;
+
+    QFutureWatcher<QVector<BlockCheck>> *watcher = new QFutureWatcher<QVector<BlockCheck>>(this);
+    connect(watcher, &QFutureWatcher<QVector<BlockCheck>>::finished, this, [this, watcher] {
+        watcher->deleteLater();
+        const QVector<BlockCheck> results = watcher->result();
+
+        if (blockResults.size() + results.size() > maxCachedBlocks) blockResults.clear();
+        for (const BlockCheck &result : results) {
+            inFlight.remove(result.hash);
+            blockResults.insert(result.hash, result.ranges);
+        }
+
+        // Repaint the blocks that still hold the text that was checked; edited ones get a new batch
+        for (const BlockCheck &result : results) {
+            const QTextBlock block = document()->findBlockByNumber(result.blockNumber);
+            if (!result.ranges.isEmpty() && block.isValid() && qHash(block.text()) == result.hash) {
+                rehighlightBlockNow(block);
+            }
+        }
+    });
+
+    SpellChecker *spellChecker = checker;
+    watcher->setFuture(QtConcurrent::run(checker->threadPool(), [spellChecker, batch]() mutable {
+        for (BlockCheck &check : batch) {
+            check.ranges = spellChecker->check(check.text);
+        }
+        return batch;
+    }));
+}
@@ -0,0 +1,44 @@
+#ifndef SPELLHIGHLIGHTER_H
+#define SPELLHIGHLIGHTER_H
+
+#include <QHash>
+#include <QSet>
+#include <QTextCharFormat>
+#include "spellchecker.h"
+#include "syntaxhighlighter.h"
+
+class QTextEdit;
+class QTimer;
+
+// Underlines misspelled words in an editor.
+// highlightBlock() never runs Hunspell: it only applies the cached result for
+// the block's text. Blocks in or near the viewport whose text has no cached
+// result are sent in one batch to the spell checker's worker threads, and
+// the blocks are re-highlighted when the results come back. Results are
+// cached by a hash of the block text, so unchanged blocks are never checked
+// twice and an edit only costs the blocks it touched. The underline is merged
+// into the syntax formats, as a document only takes one highlighter.
+class SpellHighlighter : public SyntaxHighlighter
+{
+    Q_OBJECT
+
+public:
+    SpellHighlighter(QTextEdit *editor, SpellChecker *checker);
+
+protected:
+    void decorateBlock(const QString &text) override;
+
+private slots:
+    void scheduleCheck();
+    void checkVisibleBlocks();
+
+private:
+    SpellChecker *checker;
+    QTimer *checkTimer;             // Coalesces edits and scrolling into one batch
+    QTextCharFormat misspelledFormat;
+
+    QHash<size_t, QVector<SpellRange>> blockResults;   // Keyed by the hash of the block text
+    QSet<size_t> inFlight;
+};
+
+#endif // SPELLHIGHLIGHTER_H
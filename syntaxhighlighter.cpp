@@ -0,0 +1,365 @@
+#include "syntaxhighlighter.h"
+#include "documentoverview.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextLayout>
+#include <QFileInfo>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSignalBlocker>
+#include <QEvent>
+
+static const int sliceTime = 8;             // ms of background highlighting per event loop turn
+static const int maxBurstBlocks = 500;      // Blocks an edit may highlight before the rest is deferred
+static const int sniffLines = 20;
+
+// A block's user state holds the state it started in and the state it ended in
+static int packState(int input, int output) { return (input << 8) | output; }
+static int inputState(int packed) { return packed == -1 ? 0 : packed >> 8; }
+static int outputState(int packed) { return packed == -1 ? 0 : packed & 0xff; }
+
+static QTextCharFormat makeFormat(const QColor &color, bool bold = false, bool italic = false)
+{
+    QTextCharFormat format;
+    format.setForeground(color);
+    if (bold) format.setFontWeight(QFont::Bold);
+    if (italic) format.setFontItalic(true);
+    return format;
+}
+
+// On a dark background a color keeps its hue and takes the mirrored lightness, kept light enough to read
+static QTextCharFormat forBackground(QTextCharFormat format, bool dark)
+{
+    if (!dark || !format.hasProperty(QTextFormat::ForegroundBrush)) return format;
+    const QColor color = format.foreground().color();
+    format.setForeground(QColor::fromHsl(color.hslHue(), color.hslSaturation(), qMax(255 - color.lightness(), 170)));
+    return format;
+}
+
+// Languages
+
+SyntaxLanguage::SyntaxLanguage(const QString &name)
+    : languageName(name)
+{
+}
+
+void SyntaxLanguage::addRule(int state, const QString &pattern, const QTextCharFormat &format, int nextState)
+{
+    if (states.size() <= state) states.resize(state + 1);
+    states[state].patterns.append(pattern);
+    states[state].rules.append({format, 0, nextState});
+}
+
+void SyntaxLanguage::setStateFormat(int state, const QTextCharFormat &format)
+{
+    if (states.size() <= state) states.resize(state + 1);
+    states[state].format = format;
+}
+
+// Join each state's rules into one alternation; the group that matched names the rule
+void SyntaxLanguage::compile()
+{
+    for (State &state : states) {
+        QStringList alternatives;
+        int group = 1;
+        for (int i = 0; i < state.patterns.size(); ++i) {
+            state.rules[i].group = group;
+            group += 1 + QRegularExpression(state.patterns[i]).captureCount();
+            alternatives.append('(' + state.patterns[i] + ')');
+        }
+        state.expression = QRegularExpression(alternatives.join('|'));
+        state.expression.optimize();
+    }
+}
+
+const SyntaxLanguage *SyntaxLanguage::log()
+{
+    static const SyntaxLanguage *language = [] {
+        SyntaxLanguage *log = new SyntaxLanguage("Log");
+        log->addRule(0, R"(\b\d{4}-\d{2}-\d{2}[T ]\d{2}:\d{2}:\d{2}(?:[.,]\d+)?(?:Z|[+-]\d{2}:?\d{2})?)", makeFormat(QColor(0x6d, 0x6d, 0x6d)));
+        log->addRule(0, R"(\b\d{2}:\d{2}:\d{2}(?:[.,]\d+)?\b)", makeFormat(QColor(0x6d, 0x6d, 0x6d)));
+        log->addRule(0, R"(\b(?i:fatal|critical|error|err|severe)\b)", makeFormat(QColor(0xc6, 0x28, 0x28), true));
+        log->addRule(0, R"(\b(?i:warn|warning)\b)", makeFormat(QColor(0xef, 0x6c, 0x00), true));
+        log->addRule(0, R"(\b(?i:info|notice)\b)", makeFormat(QColor(0x15, 0x65, 0xc0)));
+        log->addRule(0, R"(\b(?i:debug|trace|verbose)\b)", makeFormat(QColor(0x75, 0x75, 0x75)));
+        log->compile();
+        return log;
+    }();
+    return language;
+}
+
+const SyntaxLanguage *SyntaxLanguage::json()
+{
+    static const SyntaxLanguage *language = [] {
+        SyntaxLanguage *json = new SyntaxLanguage("JSON");
+        json->addRule(0, R"("(?:[^"\\]|\\.)*"(?=\s*:))", makeFormat(QColor(0x6a, 0x1b, 0x9a)));
+        json->addRule(0, R"("(?:[^"\\]|\\.)*"?)", makeFormat(QColor(0x2e, 0x7d, 0x32)));
+        json->addRule(0, R"(-?\b\d+(?:\.\d+)?(?:[eE][+-]?\d+)?\b)", makeFormat(QColor(0x15, 0x65, 0xc0)));
+        json->addRule(0, R"(\b(?:true|false|null)\b)", makeFormat(QColor(0x15, 0x65, 0xc0), true));
+        json->compile();
+        return json;
+    }();
+    return language;
+}
+
+const SyntaxLanguage *SyntaxLanguage::markdown()
+{
+    enum { Text, Code };
+    static const SyntaxLanguage *language = [] {
+        const QTextCharFormat code = makeFormat(QColor(0x00, 0x69, 0x5c));
+        QTextCharFormat link = makeFormat(QColor(0x15, 0x65, 0xc0));
+        link.setFontUnderline(true);
+        QTextCharFormat strong;
+        strong.setFontWeight(QFont::Bold);
+        QTextCharFormat emphasis;
+        emphasis.setFontItalic(true);
+
+        SyntaxLanguage *markdown = new SyntaxLanguage("Markdown");
+        markdown->addRule(Text, R"(^\s*(?:```|~~~).*)", code, Code);
+        markdown->addRule(Text, R"(^#{1,6}\s.*)", makeFormat(QColor(0x15, 0x65, 0xc0), true));
+        markdown->addRule(Text, R"(^>.*)", makeFormat(QColor(0x75, 0x75, 0x75), false, true));
+        markdown->addRule(Text, R"(^\s*(?:[-*+]|\d+[.)])\s)", makeFormat(QColor(0xef, 0x6c, 0x00), true));
+        markdown->addRule(Text, R"(`[^`]+`)", code);
+        markdown->addRule(Text, R"(\*\*[^*]+\*\*|__[^_]+__)", strong);
+        markdown->addRule(Text, R"(\*[^*\s][^*]*\*|\b_[^_\s][^_]*_\b)", emphasis);
+        markdown->addRule(Text, R"(!?\[[^\]]*\]\([^)]*\))", link);
+        markdown->setStateFormat(Code, code);
+        markdown->addRule(Code, R"(^\s*(?:```|~~~)\s*$)", code, Text);
+        markdown->compile();
+        return markdown;
+    }();
+    return language;
+}
+
+const SyntaxLanguage *SyntaxLanguage::detect(const QString &fileName, const QString &sample)
+{
+    const QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "log") return log();
+    if (suffix == "json") return json();
+    if (suffix == "md" || suffix == "markdown") return markdown();
+    if (!suffix.isEmpty() && suffix != "txt") return nullptr;
+
+    // Most lines of a log start with a timestamp or carry a level
+    static const QRegularExpression logLine(R"(^\W?\d{4}-\d{2}-\d{2}[T ]\d{2}:\d{2}|\b(?:FATAL|ERROR|WARN|WARNING|INFO|DEBUG|TRACE)\b)");
+    const QStringList lines = sample.split('\n').mid(0, sniffLines);
+    int nonEmpty = 0;
+    int logLines = 0;
+    for (const QString &line : lines) {
+        if (line.trimmed().isEmpty()) continue;
+        ++nonEmpty;
+        if (logLine.match(line).hasMatch()) ++logLines;
+    }
+    if (logLines >= 2 && logLines * 2 >= nonEmpty) return log();
+
+    const QString start = sample.trimmed();
+    if (start.startsWith('{') || start.startsWith('[')) return json();
+    static const QRegularExpression heading(R"(^#{1,6}\s)");
+    if (heading.match(start).hasMatch()) return markdown();
+    return nullptr;
+}
+
+// Highlighter
+
+SyntaxHighlighter::SyntaxHighlighter(QTextEdit *editor)
+    : QSyntaxHighlighter(editor->document()), editor(editor), currentLanguage(nullptr),
+      darkBackground(editor->palette().color(QPalette::Base).lightness() < 128),
+      frontier(editor->document()), complete(true), inSlice(false), burstBlocks(0)
+{
+    editor->installEventFilter(this);  // For palette changes
+
+    sliceTimer = new QTimer(this);
+    sliceTimer->setInterval(0);
+    connect(sliceTimer, &QTimer::timeout, this, &SyntaxHighlighter::highlightSlice);
+
+    // An edited block past the frontier has to be highlighted again even if its states still match.
+    // QSyntaxHighlighter connected first, so the blocks it reached are already done by now.
+    connect(editor->document(), &QTextDocument::contentsChange, this, [this](int position, int, int charsAdded) {
+        if (complete) return;
+        const QTextBlock last = document()->findBlock(position + charsAdded);
+        for (QTextBlock block = document()->findBlock(position); block.isValid(); block = block.next()) {
+            if (block.position() >= frontier.position()) block.setUserState(-1);
+            if (block == last) break;
+        }
+    });
+}
+
+SyntaxHighlighter *SyntaxHighlighter::forDocument(QTextDocument *document)
+{
+    return document->findChild<SyntaxHighlighter *>(QString(), Qt::FindDirectChildrenOnly);
+}
+
+// Switch languages; the document is rehighlighted in the background, keeping the old formats until then
+void SyntaxHighlighter::setLanguage(const SyntaxLanguage *language)
+{
+    if (language == currentLanguage) return;
+    currentLanguage = language;
+    updateFormats();
+    if (language) {
+        rehighlightAll();  // States of another language mean nothing to this one
+    } else {
+        deferFrom(document()->begin());
+    }
+}
+
+// Follow the editor between light and dark palettes
+bool SyntaxHighlighter::eventFilter(QObject *watched, QEvent *event)
+{
+    if (editor && watched == editor && event->type() == QEvent::PaletteChange) {
+        const bool dark = editor->palette().color(QPalette::Base).lightness() < 128;
+        if (dark != darkBackground) {
+            darkBackground = dark;
+            updateFormats();
+            if (currentLanguage) rehighlightAll();
+        }
+    }
+    return QSyntaxHighlighter::eventFilter(watched, event);
+}
+
+// The current language's formats, adjusted for the background
+void SyntaxHighlighter::updateFormats()
+{
+    ruleFormats.clear();
+    stateFormats.clear();
+    if (!currentLanguage) return;
+    for (const SyntaxLanguage::State &state : currentLanguage->states) {
+        stateFormats.append(forBackground(state.format, darkBackground));
+        QVector<QTextCharFormat> formats;
+        for (const SyntaxLanguage::Rule &rule : state.rules) formats.append(forBackground(rule.format, darkBackground));
+        ruleFormats.append(formats);
+    }
+}
+
+// Mark every block as unknown and highlight them all again in the background
+void SyntaxHighlighter::rehighlightAll()
+{
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        block.setUserState(-1);
+    }
+    deferFrom(document()->begin());
+}
+
+void SyntaxHighlighter::highlightBlock(const QString &text)
+{
+    const QTextBlock block = currentBlock();
+    if (block != forcedBlock) {
+        if (!complete && block.position() >= frontier.position()) {
+            keepBlock();
+            return;
+        }
+        if (!inSlice) {
+            if (burstBlocks++ == 0) QTimer::singleShot(0, this, [this] { burstBlocks = 0; });
+            if (burstBlocks > maxBurstBlocks) {
+                deferFrom(block);
+                keepBlock();
+                return;
+            }
+        }
+    }
+
+    if (!currentLanguage) {
+        setCurrentBlockState(-1);
+        decorateBlock(text);
+        return;
+    }
+
+    // Scan token by token, switching to the expression of whichever state the last token left
+    const int startState = outputState(previousBlockState());
+    int state = startState;
+    const QVector<SyntaxLanguage::State> &states = currentLanguage->states;
+    if (!stateFormats[state].properties().isEmpty()) setFormat(0, text.length(), stateFormats[state]);
+
+    int position = 0;
+    while (position < text.length() && !states[state].rules.isEmpty()) {
+        const QRegularExpressionMatch match = states[state].expression.match(text, position);
+        if (!match.hasMatch()) break;
+
+        const QVector<SyntaxLanguage::Rule> &rules = states[state].rules;
+        for (int i = 0; i < rules.size(); ++i) {
+            const SyntaxLanguage::Rule &rule = rules[i];
+            const int start = match.capturedStart(rule.group);
+            if (start < 0) continue;
+            const int end = match.capturedEnd(rule.group);
+            setFormat(start, end - start, ruleFormats[state][i]);
+            position = end > start ? end : start + 1;
+            if (rule.nextState >= 0 && rule.nextState != state) {
+                state = rule.nextState;
+                if (!stateFormats[state].properties().isEmpty()) setFormat(end, text.length() - end, stateFormats[state]);
+            }
+            break;
+        }
+    }
+    setCurrentBlockState(packState(startState, state));
+
+    decorateBlock(text);
+}
+
+void SyntaxHighlighter::decorateBlock(const QString &)
+{
+}
+
+void SyntaxHighlighter::rehighlightBlockNow(const QTextBlock &block)
+{
+    // A rehighlight reports itself as a contentsChange, which the session journal and
+    // auto-save would take for an edit, so the document stays quiet meanwhile
+    QSignalBlocker blocker(document());
+    forcedBlock = block;
+    rehighlightBlock(block);
+    forcedBlock = QTextBlock();
+    if (DocumentOverview *overview = DocumentOverview::forDocument(document())) overview->refreshBlock(block);
+}
+
+// Leave a block as it was; its old formats stay up until the frontier reaches it
+void SyntaxHighlighter::keepBlock()
+{
+    const QVector<QTextLayout::FormatRange> formats = currentBlock().layout()->formats();
+    for (const QTextLayout::FormatRange &range : formats) {
+        setFormat(range.start, range.length, range.format);
+    }
+}
+
+void SyntaxHighlighter::deferFrom(const QTextBlock &block)
+{
+    if (complete || block.position() < frontier.position()) frontier.setPosition(block.position());
+    complete = false;
+    if (!sliceTimer->isActive()) sliceTimer->start();
+}
+
+// A block is right when it started in the state the block before it ended in
+bool SyntaxHighlighter::needsHighlight(const QTextBlock &block) const
+{
+    const int state = block.userState();
+    if (!currentLanguage) return state != -1;
+    if (state == -1) return true;
+    const QTextBlock previous = block.previous();
+    return inputState(state) != (previous.isValid() ? outputState(previous.userState()) : 0);
+}
+
+// Highlight for a few milliseconds: blocks on screen that were never highlighted, then on from the frontier
+void SyntaxHighlighter::highlightSlice()
+{
+    QElapsedTimer timer;
+    timer.start();
+    inSlice = true;
+
+    if (editor && currentLanguage) {
+        // From a guessed start state if the block before is still unknown; the frontier corrects it later
+        const QWidget *viewport = editor->viewport();
+        const int lastNumber = editor->cursorForPosition(QPoint(viewport->width(), viewport->height())).block().blockNumber();
+        for (QTextBlock block = editor->cursorForPosition(QPoint(0, 0)).block(); block.isValid() && block.blockNumber() <= lastNumber; block = block.next()) {
+            if (block.userState() == -1) rehighlightBlockNow(block);
+        }
+    }
+
+    QTextBlock block = document()->findBlock(frontier.position());
+    while (block.isValid() && timer.elapsed() < sliceTime) {
+        if (needsHighlight(block)) rehighlightBlockNow(block);
+        block = block.next();
+        if (block.isValid()) frontier.setPosition(block.position());
+    }
+    inSlice = false;
+
+    if (!block.isValid()) {
+        complete = true;
+        sliceTimer->stop();
+    }
+}
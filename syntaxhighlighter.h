@@ -0,0 +1,112 @@
+#ifndef SYNTAXHIGHLIGHTER_H
+#define SYNTAXHIGHLIGHTER_H
+
+#include <QSyntaxHighlighter>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTextCharFormat>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QVector>
+
+class QTextEdit;
+class QTimer;
+
+// A highlighting language: a small state machine of rules. Each state's rules
+// are compiled once into a single alternation, so a block costs one regular
+// expression scan per token instead of one per rule. A rule can switch the
+// state, and the state a block ends in is where the next block starts, which
+// is how constructs spanning lines (Markdown code fences) are followed.
+class SyntaxLanguage
+{
+public:
+    static const SyntaxLanguage *log();
+    static const SyntaxLanguage *json();
+    static const SyntaxLanguage *markdown();
+
+    // By extension, else by sniffing the first lines of plain text files; nullptr for none
+    static const SyntaxLanguage *detect(const QString &fileName, const QString &sample);
+
+    QString name() const { return languageName; }
+
+private:
+    friend class SyntaxHighlighter;
+
+    struct Rule
+    {
+        QTextCharFormat format;
+        int group;                   // Capture group of the rule in its state's combined expression
+        int nextState;               // -1 to stay
+    };
+
+    struct State
+    {
+        QTextCharFormat format;      // Under everything in the state, e.g. a code block
+        QStringList patterns;
+        QVector<Rule> rules;
+        QRegularExpression expression;
+    };
+
+    explicit SyntaxLanguage(const QString &name);
+    void addRule(int state, const QString &pattern, const QTextCharFormat &format, int nextState = -1);
+    void setStateFormat(int state, const QTextCharFormat &format);
+    void compile();
+
+    QString languageName;
+    QVector<State> states;
+};
+
+// Syntax highlighting that never holds up typing.
+// Every block records the state it started in and the state it ended in, so
+// QSyntaxHighlighter only re-runs an edited block and the blocks its end state
+// reaches. Blocks past the frontier have not been checked yet: highlightBlock()
+// keeps their old formats, and a timer checks them a few milliseconds at a
+// time, visible blocks first. An edit whose state change would ripple through
+// more than a burst of blocks is cut short the same way, and the frontier moves
+// back so the rest is finished in the background.
+// The languages' colors are chosen for a light background; on a dark editor
+// palette they are lightened, and a palette change rehighlights the same way.
+class SyntaxHighlighter : public QSyntaxHighlighter
+{
+    Q_OBJECT
+
+public:
+    explicit SyntaxHighlighter(QTextEdit *editor);
+
+    static SyntaxHighlighter *forDocument(QTextDocument *document);
+
+    void setLanguage(const SyntaxLanguage *language);   // nullptr for none
+    const SyntaxLanguage *language() const { return currentLanguage; }
+
+protected:
+    void highlightBlock(const QString &text) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    virtual void decorateBlock(const QString &text);   // Extra formats applied after the syntax ones
+    void rehighlightBlockNow(const QTextBlock &block); // Past the frontier too, without announcing a change
+
+    QPointer<QTextEdit> editor;
+
+private slots:
+    void highlightSlice();
+
+private:
+    bool needsHighlight(const QTextBlock &block) const;
+    void keepBlock();
+    void deferFrom(const QTextBlock &block);
+    void updateFormats();
+    void rehighlightAll();
+
+    const SyntaxLanguage *currentLanguage;
+    bool darkBackground;
+    QVector<QVector<QTextCharFormat>> ruleFormats;   // currentLanguage's rule formats for the palette, per state
+    QVector<QTextCharFormat> stateFormats;
+    QTimer *sliceTimer;
+    QTextCursor frontier;            // Start of the first block not known to be right
+    bool complete;                   // Every block is right; the frontier is meaningless
+    QTextBlock forcedBlock;
+    bool inSlice;
+    int burstBlocks;                 // Blocks highlighted since the event loop last ran
+};
+
+#endif // SYNTAXHIGHLIGHTER_H
@@ -0,0 +1,19 @@
+#include "tabplaceholder.h"
+
+TabPlaceholder::TabPlaceholder(const SessionStore::TabEntry &entry, QWidget *parent)
+    : QWidget(parent), tabEntry(entry)
+{
+}
+
+TabPlaceholder::~TabPlaceholder()
+{
+    // The worker reads through the session store, which must outlive it
+    if (preload.isValid()) preload.waitForFinished();
+}
+
+SessionStore::TabContent TabPlaceholder::takePreload()
+{
+    SessionStore::TabContent content = preload.result();
+    preload = QFuture<SessionStore::TabContent>();
+    return content;
+}
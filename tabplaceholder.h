@@ -0,0 +1,31 @@
+#ifndef TABPLACEHOLDER_H
+#define TABPLACEHOLDER_H
+
+#include <QWidget>
+#include <QFuture>
+#include "sessionstore.h"
+
+// Stand-in for a restored tab that has not been shown yet.
+// It keeps only what the session manifest says about the tab; MainWindow
+// swaps it for the real editor the first time the tab is selected. The tab's
+// content can be read ahead of time on a worker thread with setPreload().
+class TabPlaceholder : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TabPlaceholder(const SessionStore::TabEntry &entry, QWidget *parent = nullptr);
+    ~TabPlaceholder();
+
+    const SessionStore::TabEntry &entry() const { return tabEntry; }
+
+    void setPreload(const QFuture<SessionStore::TabContent> &future) { preload = future; }
+    bool isPreloading() const { return preload.isValid(); }
+    SessionStore::TabContent takePreload();   // Waits for a preload still in flight
+
+private:
+    SessionStore::TabEntry tabEntry;
+    QFuture<SessionStore::TabContent> preload;
+};
+
+#endif // TABPLACEHOLDER_H
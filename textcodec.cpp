@@ -0,0 +1,431 @@
+#include "textcodec.h"
+#include "perftrace.h"
+#include "simd.h"
+#include <QTextDocument>
+#include <QVariant>
+#include <cstring>
+
+namespace TextCodec
+{
+
+namespace {
+
+const qsizetype sampleSize = 64 * 1024;       // Bytes inspected for the zero byte patterns of UTF-16/32
+const char documentProperty[] = "textEncoding";
+
+// What Windows-1252 puts at 0x80..0x9F; the five unassigned bytes keep their Latin-1 meaning
+const char16_t windows1252High[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+struct CharsetName
+{
+    Charset charset;
+    const char *name;
+};
+
+const CharsetName charsetNames[] = {
+    {Utf8, "UTF-8"}, {Utf16LE, "UTF-16LE"}, {Utf16BE, "UTF-16BE"}, {Utf32LE, "UTF-32LE"},
+    {Utf32BE, "UTF-32BE"}, {Latin1, "ISO-8859-1"}, {Windows1252, "Windows-1252"}
+};
+
+// The code point of the multi-byte UTF-8 sequence at p, or -1 when it is ill-formed,
+// in which case *length covers its longest valid start (at least the lead byte).
+// *length is 0 when data ends inside a sequence that is valid so far.
+int decodeSequence(const uchar *p, const uchar *end, int *length)
+{
+    const uchar lead = p[0];
+    int trailing;
+    int codePoint;
+    uchar low = 0x80;
+    uchar high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        trailing = 1;
+        codePoint = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        trailing = 2;
+        codePoint = lead & 0x0F;
+        if (lead == 0xE0) low = 0xA0;          // Overlong
+        else if (lead == 0xED) high = 0x9F;    // Surrogates
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        trailing = 3;
+        codePoint = lead & 0x07;
+        if (lead == 0xF0) low = 0x90;          // Overlong
+        else if (lead == 0xF4) high = 0x8F;    // Beyond U+10FFFF
+    } else {
+        *length = 1;
+        return -1;
+    }
+
+    for (int i = 1; i <= trailing; ++i) {
+        if (p + i == end) {
+            *length = 0;
+            return -1;
+        }
+        const uchar byte = p[i];
+        if (byte < low || byte > high) {
+            *length = i;
+            return -1;
+        }
+        low = 0x80;
+        high = 0xBF;
+        codePoint = (codePoint << 6) | (byte & 0x3F);
+    }
+    *length = trailing + 1;
+    return codePoint;
+}
+
+// Bytes before the first non-ASCII one, checked sixteen at a time
+inline qsizetype asciiPrefix(const uchar *p, const uchar *end)
+{
+    const uchar *start = p;
+#ifdef NOTEPAD_SSE2
+    for (; end - p >= 16; p += 16) {
+        const int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+        if (mask) return p - start + qCountTrailingZeroBits(uint(mask));
+    }
+#endif
+    while (p < end && *p < 0x80) ++p;
+    return p - start;
+}
+
+}
+
+Encoding detect(QByteArrayView data)
+{
+    PERF_SCOPE("detect encoding");
+    const uchar *bytes = reinterpret_cast<const uchar *>(data.data());
+    const qsizetype size = data.size();
+
+    // The UTF-32LE mark starts with the UTF-16LE one, so it is checked first
+    if (size >= 4 && !std::memcmp(bytes, "\xFF\xFE\0\0", 4)) return {Utf32LE, true};
+    if (size >= 4 && !std::memcmp(bytes, "\0\0\xFE\xFF", 4)) return {Utf32BE, true};
+    if (size >= 3 && !std::memcmp(bytes, "\xEF\xBB\xBF", 3)) return {Utf8, true};
+    if (size >= 2 && !std::memcmp(bytes, "\xFF\xFE", 2)) return {Utf16LE, true};
+    if (size >= 2 && !std::memcmp(bytes, "\xFE\xFF", 2)) return {Utf16BE, true};
+
+    // Without a mark, mostly-ASCII UTF-16/32 text shows up as zero bytes in fixed lanes
+    const qsizetype sample = qMin(size, sampleSize) & ~qsizetype(3);
+    if (sample >= 4) {
+        qsizetype zeros[4] = {0, 0, 0, 0};
+        for (qsizetype i = 0; i < sample; ++i) zeros[i & 3] += bytes[i] == 0;
+        const qsizetype units = sample / 4;
+        auto most = [units](qsizetype count) { return count * 10 >= units * 9; };
+        auto few = [units](qsizetype count) { return count * 10 <= units; };
+
+        if (most(zeros[2]) && most(zeros[3]) && few(zeros[0])) return {Utf32LE, false};
+        if (most(zeros[0]) && most(zeros[1]) && few(zeros[3])) return {Utf32BE, false};
+        const qsizetype evenZeros = zeros[0] + zeros[2];
+        const qsizetype oddZeros = zeros[1] + zeros[3];
+        if (oddZeros * 10 >= units * 2 * 4 && evenZeros * 20 <= units * 2) return {Utf16LE, false};
+        if (evenZeros * 10 >= units * 2 * 4 && oddZeros * 20 <= units * 2) return {Utf16BE, false};
+    }
+
+    if (isValidUtf8(data, true)) return {Utf8, false};
+
+    // Windows-1252 only differs from Latin-1 in 0x80..0x9F, which Latin-1 text does not use
+    for (qsizetype i = 0; i < size; ++i) {
+        if (bytes[i] >= 0x80 && bytes[i] <= 0x9F) return {Windows1252, false};
+    }
+    return {Latin1, false};
+}
+
+qsizetype bomSize(const Encoding &encoding)
+{
+    return encoding.bom ? byteOrderMark(encoding.charset).size() : 0;
+}
+
+QByteArray byteOrderMark(Charset charset)
+{
+    switch (charset) {
+    case Utf8:    return QByteArray("\xEF\xBB\xBF", 3);
+    case Utf16LE: return QByteArray("\xFF\xFE", 2);
+    case Utf16BE: return QByteArray("\xFE\xFF", 2);
+    case Utf32LE: return QByteArray("\xFF\xFE\0\0", 4);
+    case Utf32BE: return QByteArray("\0\0\xFE\xFF", 4);
+    default:      return QByteArray();
+    }
+}
+
+QString name(const Encoding &encoding)
+{
+    QString result;
+    for (const CharsetName &entry : charsetNames) {
+        if (entry.charset == encoding.charset) result = QString::fromLatin1(entry.name);
+    }
+    if (encoding.bom) result += QLatin1String(" BOM");
+    return result;
+}
+
+Encoding fromName(const QString &name)
+{
+    Encoding encoding;
+    QString charset = name;
+    if (charset.endsWith(QLatin1String(" BOM"))) {
+        charset.chop(4);
+        encoding.bom = true;
+    }
+    for (const CharsetName &entry : charsetNames) {
+        if (charset.compare(QLatin1String(entry.name), Qt::CaseInsensitive) == 0) {
+            encoding.charset = entry.charset;
+            return encoding;
+        }
+    }
+    return Encoding();
+}
+
+bool isValidUtf8(QByteArrayView data, bool allowTruncatedEnd)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.data());
+    const uchar *end = p + data.size();
+    while (p < end) {
+        p += asciiPrefix(p, end);
+        if (p == end) break;
+        int length;
+        if (decodeSequence(p, end, &length) < 0) return length == 0 && allowTruncatedEnd;
+        p += length;
+    }
+    return true;
+}
+
+QString decode(QByteArrayView data, Encoding *encoding)
+{
+    const Encoding detected = detect(data);
+    if (encoding) *encoding = detected;
+    return Decoder(detected.charset).decode(data.mid(bomSize(detected)));
+}
+
+Decoder::Decoder(Charset charset) : charset(charset), pendingLength(0), error(false)
+{
+    switch (charset) {
+    case Utf16LE: decoder = QStringDecoder(QStringDecoder::Utf16LE); break;
+    case Utf16BE: decoder = QStringDecoder(QStringDecoder::Utf16BE); break;
+    case Utf32LE: decoder = QStringDecoder(QStringDecoder::Utf32LE); break;
+    case Utf32BE: decoder = QStringDecoder(QStringDecoder::Utf32BE); break;
+    default: break;
+    }
+}
+
+QString Decoder::decode(QByteArrayView bytes)
+{
+    PERF_SCOPE("decode");
+    switch (charset) {
+    case Utf8:
+        return decodeUtf8(bytes);
+    case Latin1:
+        return QString::fromLatin1(bytes);
+    case Windows1252: {
+        // Widened as Latin-1 (vectorized by Qt), then the C1 range is remapped
+        QString text = QString::fromLatin1(bytes);
+        for (QChar &c : text) {
+            if (c.unicode() >= 0x80 && c.unicode() <= 0x9F) c = QChar(windows1252High[c.unicode() - 0x80]);
+        }
+        return text;
+    }
+    default: {
+        QString text = decoder.decode(bytes);
+        error = error || decoder.hasError();
+        return text;
+    }
+    }
+}
+
+// Runs of ASCII are widened sixteen bytes per step; other sequences are
+// validated and decoded one by one
+QString Decoder::decodeUtf8(QByteArrayView bytes)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(bytes.data());
+    const uchar *end = p + bytes.size();
+
+    // Every byte gives at most one UTF-16 unit, plus one for the sequence carried over
+    QString text(bytes.size() + 1, Qt::Uninitialized);
+    char16_t *out = reinterpret_cast<char16_t *>(text.data());
+    char16_t *start = out;
+
+    auto put = [&out](int codePoint) {
+        if (codePoint >= 0x10000) {
+            *out++ = QChar::highSurrogate(char32_t(codePoint));
+            *out++ = QChar::lowSurrogate(char32_t(codePoint));
+        } else {
+            *out++ = char16_t(codePoint);
+        }
+    };
+
+    // Finish the sequence the last chunk ended in
+    if (pendingLength > 0) {
+        uchar sequence[4];
+        std::memcpy(sequence, pending, pendingLength);
+        const int taken = int(qMin<qsizetype>(4 - pendingLength, end - p));
+        std::memcpy(sequence + pendingLength, p, taken);
+        int length;
+        const int codePoint = decodeSequence(sequence, sequence + pendingLength + taken, &length);
+        if (length == 0) {
+            // Still incomplete: the whole chunk was part of it
+            std::memcpy(pending + pendingLength, p, taken);
+            pendingLength += taken;
+            return QString();
+        }
+        p += length - pendingLength;   // The carried bytes were a valid start, so length covers them
+        pendingLength = 0;
+        if (codePoint < 0) {
+            error = true;
+            put(0xFFFD);
+        } else {
+            put(codePoint);
+        }
+    }
+
+    while (p < end) {
+#ifdef NOTEPAD_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; end - p >= 16; p += 16, out += 16) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            if (_mm_movemask_epi8(chunk)) break;
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(chunk, zero));
+        }
+#endif
+        while (p < end && *p < 0x80) *out++ = *p++;
+        if (p == end) break;
+
+        int length;
+        const int codePoint = decodeSequence(p, end, &length);
+        if (length == 0) {
+            pendingLength = int(end - p);
+            std::memcpy(pending, p, pendingLength);
+            break;
+        }
+        p += length;
+        if (codePoint < 0) {
+            error = true;
+            put(0xFFFD);
+        } else {
+            put(codePoint);
+        }
+    }
+
+    text.truncate(out - start);
+    return text;
+}
+
+Encoder::Encoder(Charset charset) : charset(charset), pendingSurrogate(0)
+{
+    switch (charset) {
+    case Utf16LE: encoder = QStringEncoder(QStringEncoder::Utf16LE); break;
+    case Utf16BE: encoder = QStringEncoder(QStringEncoder::Utf16BE); break;
+    case Utf32LE: encoder = QStringEncoder(QStringEncoder::Utf32LE); break;
+    case Utf32BE: encoder = QStringEncoder(QStringEncoder::Utf32BE); break;
+    default: break;
+    }
+}
+
+QByteArray Encoder::encode(QStringView text)
+{
+    PERF_SCOPE("encode");
+    switch (charset) {
+    case Utf8:
+        return encodeUtf8(text);
+    case Latin1:
+        return text.toLatin1();
+    case Windows1252: {
+        QByteArray bytes(text.size(), Qt::Uninitialized);
+        char *out = bytes.data();
+        for (QChar c : text) {
+            const char16_t unicode = c.unicode();
+            if (unicode < 0x80 || (unicode >= 0xA0 && unicode <= 0xFF)) {
+                *out++ = char(unicode);
+                continue;
+            }
+            char byte = '?';
+            for (int i = 0; i < 32; ++i) {
+                if (windows1252High[i] == unicode) byte = char(0x80 + i);
+            }
+            *out++ = byte;
+        }
+        return bytes;
+    }
+    default:
+        return encoder.encode(text);
+    }
+}
+
+// Runs of ASCII are narrowed eight characters per step; lone surrogates become U+FFFD
+QByteArray Encoder::encodeUtf8(QStringView text)
+{
+    const char16_t *p = text.utf16();
+    const char16_t *end = p + text.size();
+    QByteArray bytes((text.size() + 1) * 3, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(bytes.data());
+    const uchar *start = out;
+
+    auto put = [&out](char32_t codePoint) {
+        if (codePoint < 0x80) {
+            *out++ = uchar(codePoint);
+        } else if (codePoint < 0x800) {
+            *out++ = uchar(0xC0 | (codePoint >> 6));
+            *out++ = uchar(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+            *out++ = uchar(0xE0 | (codePoint >> 12));
+            *out++ = uchar(0x80 | ((codePoint >> 6) & 0x3F));
+            *out++ = uchar(0x80 | (codePoint & 0x3F));
+        } else {
+            *out++ = uchar(0xF0 | (codePoint >> 18));
+            *out++ = uchar(0x80 | ((codePoint >> 12) & 0x3F));
+            *out++ = uchar(0x80 | ((codePoint >> 6) & 0x3F));
+            *out++ = uchar(0x80 | (codePoint & 0x3F));
+        }
+    };
+
+    if (pendingSurrogate) {
+        if (p < end && QChar::isLowSurrogate(*p)) put(QChar::surrogateToUcs4(pendingSurrogate, *p++));
+        else put(0xFFFD);
+        pendingSurrogate = 0;
+    }
+
+    while (p < end) {
+#ifdef NOTEPAD_SSE2
+        const __m128i nonAscii = _mm_set1_epi16(short(0xFF80));
+        const __m128i zero = _mm_setzero_si128();
+        for (; end - p >= 8; p += 8, out += 8) {
+            const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chunk, nonAscii), zero)) != 0xFFFF) break;
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(chunk, chunk));
+        }
+        if (p == end) break;
+#endif
+        const char16_t unit = *p++;
+        if (unit < 0x80) {
+            *out++ = uchar(unit);
+        } else if (QChar::isHighSurrogate(unit)) {
+            if (p == end) {
+                pendingSurrogate = unit;   // Its partner may start the next chunk
+            } else if (QChar::isLowSurrogate(*p)) {
+                put(QChar::surrogateToUcs4(unit, *p++));
+            } else {
+                put(0xFFFD);
+            }
+        } else if (QChar::isLowSurrogate(unit)) {
+            put(0xFFFD);
+        } else {
+            put(unit);
+        }
+    }
+
+    bytes.truncate(out - start);
+    return bytes;
+}
+
+void setDocumentEncoding(QTextDocument *document, const Encoding &encoding)
+{
+    document->setProperty(documentProperty, name(encoding));
+}
+
+Encoding documentEncoding(const QTextDocument *document)
+{
+    return fromName(document->property(documentProperty).toString());
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef TEXTCODEC_H
+#define TEXTCODEC_H
+
+#include <QString>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QStringDecoder>
+#include <QStringEncoder>
+
+class QTextDocument;
+
+// Text file encodings: detection on open, and decoding and encoding in chunks.
+// UTF-8 is validated and transcoded here, with SSE2 handling runs of ASCII
+// sixteen bytes at a time, so a file that is mostly ASCII decodes at memory
+// speed; Windows-1252 is widened by QString::fromLatin1 and patched up.
+namespace TextCodec
+{
+
+enum Charset
+{
+    Utf8,
+    Utf16LE,
+    Utf16BE,
+    Utf32LE,
+    Utf32BE,
+    Latin1,
+    Windows1252
+};
+
+struct Encoding
+{
+    Charset charset = Utf8;
+    bool bom = false;            // The file starts with a byte order mark, which saving writes back
+};
+
+// The encoding of a file starting with data: its byte order mark, else zero
+// byte patterns (UTF-16/32), else whether data is valid UTF-8, else
+// Windows-1252 or Latin-1. All of data is validated, so pass the whole file
+// when it is at hand; a sequence cut off by the end of data is allowed.
+Encoding detect(QByteArrayView data);
+qsizetype bomSize(const Encoding &encoding);
+QByteArray byteOrderMark(Charset charset);
+
+QString name(const Encoding &encoding);       // E.g. "UTF-16LE BOM"
+Encoding fromName(const QString &name);       // Unknown names give UTF-8
+
+bool isValidUtf8(QByteArrayView data, bool allowTruncatedEnd = false);
+
+// Detect, skip the byte order mark and decode a whole file
+QString decode(QByteArrayView data, Encoding *encoding = nullptr);
+
+// Stateful, so a character split across two chunks still decodes correctly.
+// Ill-formed input becomes U+FFFD.
+class Decoder
+{
+public:
+    explicit Decoder(Charset charset = Utf8);
+    QString decode(QByteArrayView bytes);
+    bool hasError() const { return error; }
+
+private:
+    QString decodeUtf8(QByteArrayView bytes);
+
+    Charset charset;
+    QStringDecoder decoder;      // UTF-16 and UTF-32
+    uchar pending[4];            // Start of a UTF-8 sequence cut off by the end of the last chunk
+    int pendingLength;
+    bool error;
+};
+
+// Stateful, so a surrogate pair split across two chunks still encodes
+// correctly. Characters the charset cannot hold become '?'.
+class Encoder
+{
+public:
+    explicit Encoder(Charset charset = Utf8);
+    QByteArray encode(QStringView text);
+
+private:
+    QByteArray encodeUtf8(QStringView text);
+
+    Charset charset;
+    QStringEncoder encoder;      // UTF-16 and UTF-32
+    char16_t pendingSurrogate;
+};
+
+// The encoding a document was read in, and is saved back in
+void setDocumentEncoding(QTextDocument *document, const Encoding &encoding);
+Encoding documentEncoding(const QTextDocument *document);
+
+}
+
+#endif // TEXTCODEC_H
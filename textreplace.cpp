@@ -0,0 +1,192 @@
+#include "textreplace.h"
+#include "perftrace.h"
+#include "textsearch.h"
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextFrame>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QVector>
+
+namespace TextReplace
+{
+
+namespace {
+
+struct Match
+{
+    qsizetype start;
+    qsizetype length;
+    QString replacement;
+};
+
+// Piece of a replacement template: literal text, or a capture group when group >= 0
+struct ReplacementPart
+{
+    QString text;
+    int group;
+};
+
+// Split the replacement once so expanding it per match is a few appends.
+// \N and \NN insert capture groups (like QString::replace), \\ is a literal backslash.
+QVector<ReplacementPart> parseReplacement(const QString &replacement, int groupCount)
+{
+    QVector<ReplacementPart> parts;
+    QString literal;
+    for (qsizetype i = 0; i < replacement.size(); ++i) {
+        const QChar c = replacement.at(i);
+        if (c == QLatin1Char('\\') && i + 1 < replacement.size()) {
+            const QChar next = replacement.at(i + 1);
+            if (next.isDigit()) {
+                int group = next.digitValue();
+                int consumed = 1;
+                if (i + 2 < replacement.size() && replacement.at(i + 2).isDigit()
+                    && group * 10 + replacement.at(i + 2).digitValue() <= groupCount) {
+                    group = group * 10 + replacement.at(i + 2).digitValue();
+                    consumed = 2;
+                }
+                if (group <= groupCount) {
+                    if (!literal.isEmpty()) {
+                        parts.append({literal, -1});
+                        literal.clear();
+                    }
+                    parts.append({QString(), group});
+                    i += consumed;
+                    continue;
+                }
+            } else if (next == QLatin1Char('\\')) {
+                literal += QLatin1Char('\\');
+                ++i;
+                continue;
+            }
+        }
+        literal += c;
+    }
+    if (!literal.isEmpty()) parts.append({literal, -1});
+    return parts;
+}
+
+QString expandReplacement(const QVector<ReplacementPart> &parts, const QRegularExpressionMatch &match)
+{
+    QString result;
+    for (const ReplacementPart &part : parts) {
+        if (part.group < 0) {
+            result += part.text;
+        } else {
+            result += match.capturedView(part.group);
+        }
+    }
+    return result;
+}
+
+// True when the document has one block format, one character format, no lists
+// and no tables, so rebuilding it from its raw text loses nothing
+bool hasUniformFormat(const QTextDocument *document)
+{
+    if (!document->rootFrame()->childFrames().isEmpty()) return false;
+
+    QTextBlock block = document->begin();
+    const int blockFormat = block.blockFormatIndex();
+    int charFormat = -1;
+    for (; block.isValid(); block = block.next()) {
+        if (block.blockFormatIndex() != blockFormat || block.textList()) return false;
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const int index = it.fragment().charFormatIndex();
+            if (charFormat < 0) {
+                charFormat = index;
+            } else if (index != charFormat) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+Result replaceAll(QTextDocument *document, const QString &pattern, const QString &replacement, const Options &options)
+{
+    PERF_SCOPE("replace all");
+    Result result;
+    QElapsedTimer timer;
+    timer.start();
+
+    const QString text = document->toPlainText();
+    QVector<Match> matches;
+
+    if (options.regularExpression) {
+        QRegularExpression::PatternOptions patternOptions = QRegularExpression::MultilineOption;
+        if (!options.caseSensitive) patternOptions |= QRegularExpression::CaseInsensitiveOption;
+        const QRegularExpression expression(pattern, patternOptions);
+        if (!expression.isValid()) {
+            result.errorString = expression.errorString();
+            return result;
+        }
+
+        const QVector<ReplacementPart> parts = parseReplacement(replacement, expression.captureCount());
+        QRegularExpressionMatchIterator it = expression.globalMatch(text);
+        while (it.hasNext()) {
+            const QRegularExpressionMatch match = it.next();
+            matches.append({match.capturedStart(), match.capturedLength(), expandReplacement(parts, match)});
+        }
+    } else {
+        const QVector<qsizetype> offsets = options.caseSensitive
+            ? TextSearch::findAll(text, pattern)
+            : TextSearch::findAll(text.toCaseFolded(), pattern.toCaseFolded());
+        matches.reserve(offsets.size());
+        for (qsizetype offset : offsets) {
+            matches.append({offset, pattern.size(), replacement});  // Shares one string buffer
+        }
+    }
+
+    result.count = matches.size();
+    if (matches.isEmpty()) {
+        result.elapsedMs = timer.elapsed();
+        return result;
+    }
+
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+
+    if (hasUniformFormat(document)) {
+        // Build the whole result in one buffer and swap it in with a single insert.
+        // The unmatched text comes from the raw text, at the same offsets: toPlainText()
+        // turns non-breaking spaces into spaces and line separators into '\n'
+        const QString raw = document->toRawText();
+        qsizetype resultSize = raw.size();
+        for (const Match &match : std::as_const(matches)) {
+            resultSize += match.replacement.size() - match.length;
+        }
+
+        QString output;
+        output.reserve(resultSize);
+        qsizetype previous = 0;
+        for (const Match &match : std::as_const(matches)) {
+            output += QStringView(raw).mid(previous, match.start - previous);
+            output += match.replacement;
+            previous = match.start + match.length;
+        }
+        output += QStringView(raw).mid(previous);
+
+        cursor.select(QTextCursor::Document);
+        cursor.insertText(output);
+    } else {
+        // Back to front, so earlier offsets stay valid; each match keeps its own formatting
+        for (auto it = matches.crbegin(); it != matches.crend(); ++it) {
+            cursor.setPosition(int(it->start));
+            cursor.setPosition(int(it->start + it->length), QTextCursor::KeepAnchor);
+            if (it->length > 0) {
+                cursor.insertText(it->replacement, cursor.charFormat());
+            } else {
+                cursor.insertText(it->replacement);
+            }
+        }
+    }
+
+    cursor.endEditBlock();
+    result.elapsedMs = timer.elapsed();
+    return result;
+}
+
+}
@@ -0,0 +1,35 @@
+#ifndef TEXTREPLACE_H
+#define TEXTREPLACE_H
+
+#include <QString>
+
+class QTextDocument;
+
+// Single-pass replace-all for a whole document
+namespace TextReplace
+{
+
+struct Options
+{
+    bool regularExpression = false;  // Treat the pattern as a QRegularExpression; \1..\99 in the replacement insert groups
+    bool caseSensitive = true;
+};
+
+struct Result
+{
+    int count = 0;
+    qint64 elapsedMs = 0;
+    QString errorString;             // Set when the pattern is not a valid regular expression
+};
+
+// Finds every match in one pass over the plain text, then applies all
+// replacements as a single undoable edit. Documents with a single character and
+// block format are rebuilt from one result buffer; formatted documents get one
+// edit per match, applied back to front inside one edit block so every match
+// keeps its formatting and the layout is only redone once.
+Result replaceAll(QTextDocument *document, const QString &pattern, const QString &replacement,
+                  const Options &options = Options());
+
+}
+
+#endif // TEXTREPLACE_H
@@ -0,0 +1,196 @@
+#include "textsearch.h"
+#include "simd.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+namespace TextSearch
+{
+
+// Candidates are checked against the cancel flag every this many characters
+static const qsizetype cancelCheckInterval = 1 << 20;
+
+QVector<qsizetype> findAll(QStringView haystack, QStringView needle, const std::atomic_bool *cancel)
+{
+    QVector<qsizetype> matches;
+    const qsizetype n = needle.size();
+    const qsizetype length = haystack.size();
+    if (n == 0 || n > length) return matches;
+
+    const char16_t *text = haystack.utf16();
+    const char16_t *pattern = needle.utf16();
+    const char16_t first = pattern[0];
+    const char16_t last = pattern[n - 1];
+    const size_t middleBytes = n > 2 ? size_t(n - 2) * sizeof(char16_t) : 0;
+
+    qsizetype nextAllowed = 0;   // Matches may not overlap the previous one
+    qsizetype i = 0;
+    const qsizetype end = length - n + 1;   // One past the last possible match start
+
+    auto verify = [&](qsizetype position) {
+        if (position < nextAllowed) return;
+        if (n > 1 && std::memcmp(text + position + 1, pattern + 1, middleBytes) != 0) return;
+        matches.append(position);
+        nextAllowed = position + n;
+    };
+
+#ifdef NOTEPAD_SSE2
+    const __m128i firstChar = _mm_set1_epi16(short(first));
+    const __m128i lastChar = _mm_set1_epi16(short(last));
+
+    for (; i + 8 <= end; i += 8) {
+        if (cancel && (i % cancelCheckInterval) == 0 && cancel->load(std::memory_order_relaxed)) return matches;
+
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + n - 1));
+        const __m128i hit = _mm_and_si128(_mm_cmpeq_epi16(head, firstChar), _mm_cmpeq_epi16(tail, lastChar));
+
+        // Two mask bits per 16-bit lane; keep one per candidate position
+        unsigned mask = unsigned(_mm_movemask_epi8(hit)) & 0x5555u;
+        while (mask) {
+            verify(i + qCountTrailingZeroBits(mask) / 2);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < end; ++i) {
+        if (cancel && (i % cancelCheckInterval) == 0 && cancel->load(std::memory_order_relaxed)) return matches;
+        if (text[i] == first && text[i + n - 1] == last) verify(i);
+    }
+    return matches;
+}
+
+}
+
+namespace TextSearch
+{
+
+static inline char foldAscii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? char(c + ('a' - 'A')) : c;
+}
+
+static bool equalBytes(const char *a, const char *b, qsizetype n, Qt::CaseSensitivity cs)
+{
+    if (cs == Qt::CaseSensitive) return std::memcmp(a, b, size_t(n)) == 0;
+    for (qsizetype i = 0; i < n; ++i) {
+        if (foldAscii(a[i]) != b[i]) return false;   // b is already folded
+    }
+    return true;
+}
+
+qsizetype indexOf(const char *data, qsizetype length, QByteArrayView needle, Qt::CaseSensitivity cs)
+{
+    const qsizetype n = needle.size();
+    if (n == 0 || n > length) return n == 0 ? 0 : -1;
+
+    QByteArray folded = needle.toByteArray();
+    if (cs == Qt::CaseInsensitive) {
+        for (char &c : folded) c = foldAscii(c);
+    }
+    const char *pattern = folded.constData();
+    const char first = pattern[0];
+    const char last = pattern[n - 1];
+    // The other case of the first and last byte, when they are ASCII letters
+    const char firstOther = cs == Qt::CaseInsensitive && first >= 'a' && first <= 'z' ? char(first - ('a' - 'A')) : first;
+    const char lastOther = cs == Qt::CaseInsensitive && last >= 'a' && last <= 'z' ? char(last - ('a' - 'A')) : last;
+
+    qsizetype i = 0;
+    const qsizetype end = length - n + 1;
+
+#ifdef NOTEPAD_SSE2
+    const __m128i firstA = _mm_set1_epi8(first);
+    const __m128i firstB = _mm_set1_epi8(firstOther);
+    const __m128i lastA = _mm_set1_epi8(last);
+    const __m128i lastB = _mm_set1_epi8(lastOther);
+
+    for (; i + 16 <= end; i += 16) {
+        const __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        const __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + n - 1));
+        const __m128i hit = _mm_and_si128(_mm_or_si128(_mm_cmpeq_epi8(head, firstA), _mm_cmpeq_epi8(head, firstB)),
+                                          _mm_or_si128(_mm_cmpeq_epi8(tail, lastA), _mm_cmpeq_epi8(tail, lastB)));
+
+        unsigned mask = unsigned(_mm_movemask_epi8(hit));
+        while (mask) {
+            const qsizetype position = i + qCountTrailingZeroBits(mask);
+            if (equalBytes(data + position, pattern, n, cs)) return position;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < end; ++i) {
+        const char head = data[i];
+        const char tail = data[i + n - 1];
+        if ((head == first || head == firstOther) && (tail == last || tail == lastOther)
+            && equalBytes(data + i, pattern, n, cs)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Walk the pattern, collecting runs of plain characters. A run ends at anything
+// with regex meaning; a character made optional by ?, * or {0 is dropped again.
+QString requiredLiteral(const QString &pattern)
+{
+    static const QString special = QStringLiteral("\\^$.|?*+()[]{}");
+    static const QString singleEscapes = QStringLiteral("dDwWsSbBhHvVRXAzZGKtnrfae");   // Escapes that end where they start
+    QString best;
+    QString run;
+    int depth = 0;
+
+    auto endRun = [&]() {
+        if (run.size() > best.size()) best = run;
+        run.clear();
+    };
+
+    for (qsizetype i = 0; i < pattern.size(); ++i) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('|')) return QString();   // Alternation: no single literal is required
+        if (c == QLatin1Char('(') && i + 1 < pattern.size() && pattern.at(i + 1) == QLatin1Char('?')) {
+            return QString();   // Inline options or lookarounds may change what the literal means
+        }
+        if (c == QLatin1Char('(')) {
+            ++depth;
+            endRun();
+        } else if (c == QLatin1Char(')')) {
+            --depth;
+            endRun();
+        } else if (c == QLatin1Char('[')) {
+            endRun();
+            // Skip the class, honouring escapes and a leading ]
+            ++i;
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char('^')) ++i;
+            if (i < pattern.size() && pattern.at(i) == QLatin1Char(']')) ++i;
+            while (i < pattern.size() && pattern.at(i) != QLatin1Char(']')) {
+                if (pattern.at(i) == QLatin1Char('\\')) ++i;
+                ++i;
+            }
+        } else if (c == QLatin1Char('?') || c == QLatin1Char('*')) {
+            run.chop(1);   // The previous character may be absent
+            endRun();
+        } else if (c == QLatin1Char('{')) {
+            if (i + 1 < pattern.size() && pattern.at(i + 1) == QLatin1Char('0')) run.chop(1);
+            endRun();
+            while (i < pattern.size() && pattern.at(i) != QLatin1Char('}')) ++i;   // Skip the repeat count
+        } else if (c == QLatin1Char('\\') && i + 1 < pattern.size()) {
+            const QChar escaped = pattern.at(++i);
+            if (!escaped.isLetterOrNumber() && depth == 0) {
+                run.append(escaped);   // An escaped punctuation character is a literal
+            } else if (!escaped.isLetterOrNumber() || singleEscapes.contains(escaped)) {
+                endRun();              // \d, \w, \b and friends
+            } else {
+                return QString();      // \x41, \0nn, \g{1}, \p{L}, \Q..\E: the characters after it are not literal text
+            }
+        } else if (special.contains(c)) {
+            endRun();   // ^, $, ., + and {n}
+        } else if (depth == 0) {
+            run.append(c);
+        }
+    }
+    endRun();
+    return best.size() >= 3 ? best : QString();
+}
+
+}
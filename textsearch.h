@@ -0,0 +1,34 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <QByteArrayView>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <atomic>
+
+// Literal substring search kernels shared by the find bar, replace-all and find in files
+namespace TextSearch
+{
+
+// Offsets of every non-overlapping occurrence of needle in haystack, in order.
+// With SSE2, eight candidate positions are filtered per step by comparing the
+// needle's first and last characters; only survivors are compared in full.
+// Returns early (with the matches found so far) once *cancel becomes true.
+QVector<qsizetype> findAll(QStringView haystack, QStringView needle,
+                           const std::atomic_bool *cancel = nullptr);
+
+// Offset of the first occurrence of needle in the bytes [data, data + length), or -1.
+// The SSE2 filter tests sixteen positions per step. Case-insensitive search folds
+// ASCII letters only, which is exact for ASCII needles in UTF-8 text.
+qsizetype indexOf(const char *data, qsizetype length, QByteArrayView needle,
+                  Qt::CaseSensitivity cs = Qt::CaseSensitive);
+
+// The longest run of literal characters every match of a regular expression must
+// contain, or an empty string when none can be found (alternations, short runs).
+// A text without it cannot match, so it makes a cheap prefilter.
+QString requiredLiteral(const QString &pattern);
+
+}
+
+#endif // TEXTSEARCH_H
@@ -0,0 +1,24 @@
+#include "tracededit.h"
+#include "perftrace.h"
+
+TracedTextEdit::TracedTextEdit(QWidget *parent) : QTextEdit(parent)
+{
+}
+
+void TracedTextEdit::paintEvent(QPaintEvent *event)
+{
+    PERF_SCOPE("paint");
+    QTextEdit::paintEvent(event);
+}
+
+void TracedTextEdit::resizeEvent(QResizeEvent *event)
+{
+    PERF_SCOPE("layout");
+    QTextEdit::resizeEvent(event);
+}
+
+void TracedTextEdit::keyPressEvent(QKeyEvent *event)
+{
+    PERF_SCOPE("keystroke");
+    QTextEdit::keyPressEvent(event);
+}
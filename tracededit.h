@@ -0,0 +1,23 @@
+#ifndef TRACEDEDIT_H
+#define TRACEDEDIT_H
+
+#include <QTextEdit>
+
+// QTextEdit that records its paints, relayouts and keystrokes in PerfTrace.
+// QAbstractScrollArea routes the viewport's paint and resize events through
+// these handlers, so the scopes cover the whole frame and the relayout to a new
+// width; a keystroke includes the incremental layout of the edit it makes.
+class TracedTextEdit : public QTextEdit
+{
+    Q_OBJECT
+
+public:
+    explicit TracedTextEdit(QWidget *parent = nullptr);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+};
+
+#endif // TRACEDEDIT_H
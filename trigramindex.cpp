@@ -0,0 +1,542 @@
+#include "trigramindex.h"
+#include "perftrace.h"
+#include <QDataStream>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+static const quint32 segmentMagic = 0x3147544e;             // "NTG1"
+static const quint32 manifestVersion = 1;
+static const QDataStream::Version streamVersion = QDataStream::Qt_6_0;
+static const int flushDocuments = 512;                      // Write a segment once this many files are pending...
+static const qint64 flushPostings = 4 * 1024 * 1024;        // ...or this many postings
+static const int maxSegments = 8;                           // More segments than this are merged into one
+static const qint64 binaryProbeSize = 8192;                 // A NUL byte in this many leading bytes marks a binary file
+static const qint64 bitsetThreshold = 256 * 1024;           // Larger files collect trigrams in a bitset, not a vector
+static const int trigramSpace = 1 << 24;
+
+// Segment file layout (native byte order; the index is a local cache, rebuilt if unreadable):
+//   header   quint32 magic, quint32 trigram count, quint64 table offset
+//   postings for each trigram, its document ids as varint deltas
+//   table    one TableEntry per trigram, sorted by trigram
+struct TableEntry
+{
+    quint32 trigram;
+    quint32 count;
+    quint64 offset;     // Of the trigram's postings, from the start of the file
+};
+static const qint64 headerSize = 16;
+
+struct TrigramIndex::Segment
+{
+    QString fileName;
+    QFile file;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    const TableEntry *table = nullptr;
+    quint32 trigramCount = 0;
+    qint64 tableOffset = 0;
+
+    bool open(const QString &path)
+    {
+        file.setFileName(path);
+        if (!file.open(QIODevice::ReadOnly)) return false;
+        size = file.size();
+        if (size < headerSize) return false;
+        data = file.map(0, size);
+        if (!data) return false;
+
+        quint32 magic;
+        std::memcpy(&magic, data, 4);
+        std::memcpy(&trigramCount, data + 4, 4);
+        std::memcpy(&tableOffset, data + 8, 8);
+        if (magic != segmentMagic || tableOffset < headerSize || tableOffset % 8 != 0
+            || tableOffset + qint64(trigramCount) * qint64(sizeof(TableEntry)) > size) {
+            return false;
+        }
+        table = reinterpret_cast<const TableEntry *>(data + tableOffset);
+        return true;
+    }
+
+    const TableEntry *find(quint32 trigram) const
+    {
+        const TableEntry *end = table + trigramCount;
+        const TableEntry *entry = std::lower_bound(table, end, trigram, [](const TableEntry &e, quint32 t) {
+            return e.trigram < t;
+        });
+        return entry != end && entry->trigram == trigram ? entry : nullptr;
+    }
+
+    QVector<quint32> decode(const TableEntry &entry) const
+    {
+        QVector<quint32> ids;
+        if (entry.offset < quint64(headerSize) || entry.offset >= quint64(tableOffset)) return ids;
+        ids.reserve(entry.count);
+        const uchar *p = data + entry.offset;
+        const uchar *end = data + tableOffset;
+        quint32 id = 0;
+        for (quint32 i = 0; i < entry.count && p < end; ++i) {
+            quint32 delta = 0;
+            for (int shift = 0; p < end && shift <= 28; shift += 7) {
+                const uchar byte = *p++;
+                delta |= quint32(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            id += delta;
+            ids.append(id);
+        }
+        return ids;
+    }
+};
+
+static inline uchar foldAscii(uchar c)
+{
+    return c >= 'A' && c <= 'Z' ? uchar(c + 32) : c;
+}
+
+// Sorted, distinct trigrams of bytes. Line breaks end a run: searches match within a line.
+// Without asciiOnly, bytes of multi-byte characters are keyed as they are.
+static QVector<quint32> extractTrigrams(const uchar *data, qint64 size, bool asciiOnly = false)
+{
+    QVector<quint32> trigrams;
+    if (size < 3) return trigrams;
+
+    std::vector<quint64> bits;
+    const bool useBitset = size >= bitsetThreshold;
+    if (useBitset) {
+        bits.assign(trigramSpace / 64, 0);
+    } else {
+        trigrams.reserve(size);
+    }
+
+    quint32 key = 0;
+    int run = 0;
+    for (qint64 i = 0; i < size; ++i) {
+        const uchar c = foldAscii(data[i]);
+        if (c == '\n' || c == '\r' || (asciiOnly && c >= 0x80)) {
+            run = 0;
+            continue;
+        }
+        key = ((key << 8) | c) & (trigramSpace - 1);
+        if (++run < 3) continue;
+        if (useBitset) {
+            bits[key >> 6] |= quint64(1) << (key & 63);
+        } else {
+            trigrams.append(key);
+        }
+    }
+
+    if (useBitset) {
+        for (quint32 word = 0; word < bits.size(); ++word) {
+            for (quint64 w = bits[word]; w; w &= w - 1) trigrams.append(word * 64 + qCountTrailingZeroBits(w));
+        }
+    } else {
+        std::sort(trigrams.begin(), trigrams.end());
+        trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    }
+    return trigrams;
+}
+
+static QVector<quint32> intersect(const QVector<quint32> &a, const QVector<quint32> &b)
+{
+    QVector<quint32> result;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+TrigramIndex::TrigramIndex(const QString &directoryPath, QObject *parent)
+    : QObject(parent), queuedJobs(0), stopping(false), rescanQueued(false)
+{
+    QDir().mkpath(directoryPath);
+    directory = QDir(directoryPath);
+
+    pool = new QThreadPool(this);
+    pool->setMaxThreadCount(1);
+
+    loadManifest();
+    rescan();
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    stopping = true;
+    pool->clear();
+    pool->waitForDone();
+    flush();  // The worker is idle, so this thread may write
+}
+
+QString TrigramIndex::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::DocumentsLocation) + "/NotepadAppIndex";
+}
+
+QString TrigramIndex::notesFolder() const
+{
+    QReadLocker locker(&lock);
+    return notes;
+}
+
+void TrigramIndex::setNotesFolder(const QString &path)
+{
+    enqueue([this, path] {
+        {
+            QWriteLocker locker(&lock);
+            notes = path;
+            manifestDirty = true;
+        }
+        if (!path.isEmpty()) scanFolder(path);
+    });
+}
+
+void TrigramIndex::addFile(const QString &filePath)
+{
+    enqueue([this, filePath] { indexFile(filePath); });
+}
+
+void TrigramIndex::rescan()
+{
+    if (rescanQueued.exchange(true)) return;
+    enqueue([this] {
+        rescanQueued = false;
+        // Known files first: indexFile() skips the unchanged ones after a stat
+        const QList<Document> known = documents.values();
+        for (const Document &document : known) {
+            if (stopping) return;
+            indexFile(document.path);
+        }
+        if (!notes.isEmpty()) scanFolder(notes);
+    });
+}
+
+// Run job on the worker; the index is flushed whenever the queue drains
+void TrigramIndex::enqueue(const std::function<void()> &job)
+{
+    ++queuedJobs;
+    pool->start([this, job] {
+        if (!stopping) job();
+        if (queuedJobs.fetch_sub(1) == 1 && !stopping) flush();
+    });
+}
+
+// Worker
+
+void TrigramIndex::scanFolder(const QString &path)
+{
+    QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext() && !stopping) indexFile(it.next());
+}
+
+void TrigramIndex::indexFile(const QString &filePath)
+{
+    PERF_SCOPE("index file");
+    const QFileInfo info(filePath);
+    const QString path = info.absoluteFilePath();
+    const quint32 oldId = idsByPath.value(path, 0);
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    if (!info.isFile()) {
+        if (oldId) {
+            QWriteLocker locker(&lock);
+            removeDocument(oldId);
+        }
+        return;
+    }
+    if (oldId) {
+        const Document document = documents.value(oldId);
+        if (document.size == info.size() && document.modified == modified) return;  // Unchanged
+    }
+
+    bool isText = false;
+    QVector<quint32> trigrams;
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly)) {
+        const qint64 size = file.size();
+        const uchar *data = size > 0 ? file.map(0, size) : nullptr;
+        isText = size == 0 || (data && !std::memchr(data, '\0', size_t(qMin(size, binaryProbeSize))));
+        if (data && isText) trigrams = extractTrigrams(data, size);
+    }
+
+    QWriteLocker locker(&lock);
+    if (oldId) removeDocument(oldId);
+    if (!isText) return;  // Binary or unreadable files are left out
+
+    const quint32 id = nextId++;
+    documents.insert(id, {path, info.size(), modified});
+    idsByPath.insert(path, id);
+    for (quint32 trigram : std::as_const(trigrams)) pending[trigram].append(id);
+    pendingPostings += trigrams.size();
+    ++pendingDocuments;
+    manifestDirty = true;
+    locker.unlock();
+
+    if (pendingDocuments >= flushDocuments || pendingPostings >= flushPostings) flush();
+}
+
+// The postings of id stay behind in their segment; queries skip them and the next merge drops them
+void TrigramIndex::removeDocument(quint32 id)
+{
+    idsByPath.remove(documents.take(id).path);
+    manifestDirty = true;
+}
+
+// Write the pending postings as a new segment, then the manifest
+void TrigramIndex::flush()
+{
+    if (!pending.isEmpty()) {
+        QVector<quint32> trigrams = pending.keys();
+        std::sort(trigrams.begin(), trigrams.end());
+        std::shared_ptr<Segment> segment = writeSegment(trigrams, [this](quint32 trigram) {
+            QVector<quint32> ids;
+            for (quint32 id : pending.value(trigram)) {
+                if (documents.contains(id)) ids.append(id);
+            }
+            return ids;
+        });
+        if (!segment) return;  // Keep the postings in memory and try again on the next flush
+
+        QWriteLocker locker(&lock);
+        segments.append(segment);
+        pending.clear();
+        pendingDocuments = 0;
+        pendingPostings = 0;
+        manifestDirty = true;
+    }
+
+    // Only written with nothing pending, so every document it lists has its postings on disk
+    if (manifestDirty) saveManifest();
+    if (segments.size() > maxSegments) merge();
+}
+
+// Fold every segment into one. Ids grow from segment to segment, so appending
+// each segment's postings in order keeps every list sorted.
+void TrigramIndex::merge()
+{
+    std::vector<quint64> bits(trigramSpace / 64, 0);
+    for (const std::shared_ptr<Segment> &segment : std::as_const(segments)) {
+        for (quint32 i = 0; i < segment->trigramCount; ++i) {
+            const quint32 trigram = segment->table[i].trigram & (trigramSpace - 1);
+            bits[trigram >> 6] |= quint64(1) << (trigram & 63);
+        }
+    }
+    QVector<quint32> trigrams;
+    for (quint32 word = 0; word < bits.size(); ++word) {
+        for (quint64 w = bits[word]; w; w &= w - 1) trigrams.append(word * 64 + qCountTrailingZeroBits(w));
+    }
+    bits.clear();
+
+    std::shared_ptr<Segment> merged = writeSegment(trigrams, [this](quint32 trigram) {
+        QVector<quint32> ids;
+        for (const std::shared_ptr<Segment> &segment : std::as_const(segments)) {
+            if (const TableEntry *entry = segment->find(trigram)) {
+                for (quint32 id : segment->decode(*entry)) {
+                    if (documents.contains(id)) ids.append(id);
+                }
+            }
+        }
+        return ids;
+    });
+    if (!merged) return;
+
+    QStringList retired;
+    for (const std::shared_ptr<Segment> &segment : std::as_const(segments)) retired.append(segment->fileName);
+    {
+        QWriteLocker locker(&lock);
+        segments = {merged};
+    }
+    saveManifest();
+    for (const QString &name : std::as_const(retired)) directory.remove(name);
+}
+
+std::shared_ptr<TrigramIndex::Segment> TrigramIndex::writeSegment(
+    const QVector<quint32> &trigrams, const std::function<QVector<quint32>(quint32)> &postings)
+{
+    const QString name = QString("segment-%1.idx").arg(nextSegment++);
+    QSaveFile file(directory.filePath(name));
+    if (!file.open(QIODevice::WriteOnly)) return nullptr;
+
+    QVector<TableEntry> table;
+    table.reserve(trigrams.size());
+    QByteArray buffer;
+    qint64 offset = headerSize;
+    file.write(QByteArray(headerSize, '\0'));  // Filled in once the table offset is known
+
+    for (quint32 trigram : trigrams) {
+        const QVector<quint32> ids = postings(trigram);
+        if (ids.isEmpty()) continue;
+        table.append({trigram, quint32(ids.size()), quint64(offset + buffer.size())});
+
+        quint32 previous = 0;
+        for (quint32 id : ids) {
+            for (quint32 delta = id - previous; ; delta >>= 7) {
+                if (delta < 0x80) {
+                    buffer.append(char(delta));
+                    break;
+                }
+                buffer.append(char((delta & 0x7f) | 0x80));
+            }
+            previous = id;
+        }
+        if (buffer.size() >= 1024 * 1024) {
+            offset += file.write(buffer);
+            buffer.clear();
+        }
+    }
+    offset += file.write(buffer);
+    const qint64 padding = (8 - offset % 8) % 8;
+    file.write(QByteArray(padding, '\0'));
+    const qint64 tableOffset = offset + padding;
+    file.write(reinterpret_cast<const char *>(table.constData()), qint64(table.size()) * qint64(sizeof(TableEntry)));
+
+    quint32 header[2] = {segmentMagic, quint32(table.size())};
+    file.seek(0);
+    file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(&tableOffset), sizeof(tableOffset));
+    if (!file.commit()) return nullptr;
+
+    std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+    segment->fileName = name;
+    if (!segment->open(directory.filePath(name))) return nullptr;
+    return segment;
+}
+
+// Manifest: the notes folder, the documents and the live segments
+
+void TrigramIndex::saveManifest()
+{
+    QSaveFile file(directory.filePath("index.dat"));
+    if (!file.open(QIODevice::WriteOnly)) return;
+
+    QStringList segmentNames;
+    for (const std::shared_ptr<Segment> &segment : std::as_const(segments)) segmentNames.append(segment->fileName);
+
+    QDataStream out(&file);
+    out.setVersion(streamVersion);
+    out << manifestVersion << notes << nextId << qint32(nextSegment) << segmentNames << qint32(documents.size());
+    for (auto it = documents.cbegin(); it != documents.cend(); ++it) {
+        out << it.key() << it.value().path << it.value().size << it.value().modified;
+    }
+    if (file.commit()) manifestDirty = false;
+}
+
+void TrigramIndex::loadManifest()
+{
+    QStringList segmentNames;
+    QFile file(directory.filePath("index.dat"));
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream in(&file);
+        in.setVersion(streamVersion);
+        quint32 version = 0;
+        qint32 segmentCounter = 0, documentCount = 0;
+        in >> version;
+        if (version == manifestVersion) {
+            in >> notes >> nextId >> segmentCounter >> segmentNames >> documentCount;
+            nextSegment = segmentCounter;
+            for (qint32 i = 0; i < documentCount && in.status() == QDataStream::Ok; ++i) {
+                quint32 id;
+                Document document;
+                in >> id >> document.path >> document.size >> document.modified;
+                documents.insert(id, document);
+                idsByPath.insert(document.path, id);
+            }
+        }
+        if (version != manifestVersion || in.status() != QDataStream::Ok) {
+            documents.clear();
+            idsByPath.clear();
+            segmentNames.clear();
+        }
+    }
+
+    for (const QString &name : std::as_const(segmentNames)) {
+        std::shared_ptr<Segment> segment = std::make_shared<Segment>();
+        segment->fileName = name;
+        if (!segment->open(directory.filePath(name))) {
+            // Documents without their postings could never be found again: start over
+            documents.clear();
+            idsByPath.clear();
+            segments.clear();
+            segmentNames.clear();
+            break;
+        }
+        segments.append(segment);
+    }
+
+    // Segments a crash left behind before the manifest named them
+    const QStringList files = directory.entryList({"segment-*.idx"}, QDir::Files);
+    for (const QString &name : files) {
+        if (!segmentNames.contains(name)) directory.remove(name);
+    }
+}
+
+// Queries
+
+QStringList TrigramIndex::candidates(const QString &literal, Qt::CaseSensitivity cs, int *indexedFiles) const
+{
+    PERF_SCOPE("index query");
+    // Non-ASCII bytes are indexed unfolded, so case-insensitive queries can only use ASCII trigrams
+    const QByteArray bytes = literal.toUtf8();
+    const QVector<quint32> trigrams = extractTrigrams(reinterpret_cast<const uchar *>(bytes.constData()),
+                                                      bytes.size(), cs == Qt::CaseInsensitive);
+
+    QReadLocker locker(&lock);
+    if (indexedFiles) *indexedFiles = int(documents.size());
+    QStringList paths;
+    if (trigrams.isEmpty()) {
+        for (const Document &document : documents) paths.append(document.path);
+        return paths;
+    }
+
+    QVector<quint32> ids;
+    for (const std::shared_ptr<Segment> &segment : segments) {
+        QVector<const TableEntry *> entries;
+        for (quint32 trigram : trigrams) {
+            const TableEntry *entry = segment->find(trigram);
+            if (!entry) {
+                entries.clear();
+                break;
+            }
+            entries.append(entry);
+        }
+        if (entries.isEmpty()) continue;
+
+        // Rarest trigram first keeps the running intersection small
+        std::sort(entries.begin(), entries.end(), [](const TableEntry *a, const TableEntry *b) {
+            return a->count < b->count;
+        });
+        QVector<quint32> result = segment->decode(*entries.first());
+        for (int i = 1; i < entries.size() && !result.isEmpty(); ++i) {
+            result = intersect(result, segment->decode(*entries[i]));
+        }
+        ids += result;
+    }
+
+    QVector<const QVector<quint32> *> lists;
+    for (quint32 trigram : trigrams) {
+        auto it = pending.constFind(trigram);
+        if (it == pending.cend()) {
+            lists.clear();
+            break;
+        }
+        lists.append(&it.value());
+    }
+    if (!lists.isEmpty()) {
+        std::sort(lists.begin(), lists.end(), [](const QVector<quint32> *a, const QVector<quint32> *b) {
+            return a->size() < b->size();
+        });
+        QVector<quint32> result = *lists.first();
+        for (int i = 1; i < lists.size() && !result.isEmpty(); ++i) result = intersect(result, *lists[i]);
+        ids += result;
+    }
+
+    for (quint32 id : std::as_const(ids)) {
+        auto it = documents.constFind(id);
+        if (it != documents.cend()) paths.append(it.value().path);
+    }
+    return paths;
+}
@@ -0,0 +1,85 @@
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QObject>
+#include <QDir>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class QThreadPool;
+
+// Persistent trigram index over the files the editor has opened or saved and
+// over a notes folder. Every file gets a document id; each three-byte sequence
+// of its (ASCII-lowercased) UTF-8 text maps to a posting list of the ids that
+// contain it. New postings collect in memory and are written out as immutable,
+// memory-mapped segment files; once there are too many segments they are
+// merged into one, dropping the ids of files that changed or disappeared.
+// A query intersects the posting lists of the trigrams of its literal, which
+// narrows a large corpus down to a few candidate files that the caller then
+// verifies with a real search. All index updates run on one worker thread.
+class TrigramIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TrigramIndex(const QString &directoryPath, QObject *parent = nullptr);
+    ~TrigramIndex();
+    static QString defaultDirectory();
+
+    QString notesFolder() const;
+    void setNotesFolder(const QString &path);     // Indexed recursively, now and on every rescan
+    void addFile(const QString &filePath);        // (Re)index one file in the background
+
+    // Indexed files that may contain literal; every indexed file when the literal
+    // is too short to narrow anything down. Safe to call while the index is updated.
+    QStringList candidates(const QString &literal, Qt::CaseSensitivity cs, int *indexedFiles = nullptr) const;
+
+public slots:
+    void rescan();    // Pick up files that changed, appeared in the notes folder or were deleted; cheap when nothing did
+
+private:
+    struct Document
+    {
+        QString path;
+        qint64 size = 0;
+        qint64 modified = 0;    // ms since the epoch
+    };
+    struct Segment;
+
+    void loadManifest();
+    void saveManifest();
+    void enqueue(const std::function<void()> &job);
+    void indexFile(const QString &filePath);
+    void removeDocument(quint32 id);           // Caller holds the write lock
+    void scanFolder(const QString &path);
+    void flush();
+    void merge();
+    std::shared_ptr<Segment> writeSegment(const QVector<quint32> &trigrams,
+                                          const std::function<QVector<quint32>(quint32)> &postings);
+
+    QDir directory;
+    QThreadPool *pool;                  // One thread: every write below happens there
+    std::atomic_int queuedJobs;
+    std::atomic_bool stopping;
+    std::atomic_bool rescanQueued;      // A rescan that has not started yet covers any further requests
+
+    mutable QReadWriteLock lock;        // Guards everything below against queries from other threads
+    QString notes;
+    QHash<quint32, Document> documents;
+    QHash<QString, quint32> idsByPath;
+    QVector<std::shared_ptr<Segment>> segments;
+    QHash<quint32, QVector<quint32>> pending;    // Postings not written to a segment yet
+    int pendingDocuments = 0;
+    qint64 pendingPostings = 0;
+    bool manifestDirty = false;
+    quint32 nextId = 1;
+    int nextSegment = 0;
+};
+
+#endif // TRIGRAMINDEX_H
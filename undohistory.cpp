@@ -0,0 +1,760 @@
+#include "undohistory.h"
+#include "blockchange.h"
+#include "perftrace.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextList>
+#include <QKeyEvent>
+#include <QTimer>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QHash>
+#include <QSet>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+#include <algorithm>
+
+static const qint64 tabLimit = 32 * 1024 * 1024;       // Bytes of history kept per document...
+static const qint64 globalLimit = 128 * 1024 * 1024;   // ...and for all documents together
+static const int hotSteps = 64;                        // Newest steps that stay uncompressed
+static const int batchSteps = 64;                      // Older steps are compressed this many at a time
+static const int compressionLevel = 1;                 // Fastest zlib level: cold history is rarely read
+static const qint64 typingMergeInterval = 2000;        // ms between keystrokes that still merge into one step
+static const quint32 fileMagic = 0x4f444e55;           // "UNDO"
+static const quint32 fileVersion = 2;
+static const QDataStream::Version streamVersion = QDataStream::Qt_6_0;
+
+static QList<UndoHistory *> histories;   // Every live history, for the global cap (GUI thread only)
+
+UndoHistory::UndoHistory(QTextEdit *editor)
+    : QObject(editor->document()), editor(editor), document(editor->document())
+{
+    document->setUndoRedoEnabled(false);  // Drops Qt's own stack; this history replaces it
+    rebuildShadow();
+    clock.start();
+
+    closeTimer = new QTimer(this);
+    closeTimer->setSingleShot(true);
+    closeTimer->setInterval(0);
+    connect(closeTimer, &QTimer::timeout, this, &UndoHistory::closeStep);
+
+    compressWatcher = new QFutureWatcher<QByteArray>(this);
+    connect(compressWatcher, &QFutureWatcher<QByteArray>::finished, this, &UndoHistory::onBatchCompressed);
+
+    connect(document, &QTextDocument::contentsChange, this, &UndoHistory::onContentsChange);
+    editor->installEventFilter(this);
+    histories.append(this);
+}
+
+UndoHistory::~UndoHistory()
+{
+    histories.removeOne(this);
+}
+
+UndoHistory *UndoHistory::forDocument(QTextDocument *document)
+{
+    return document ? document->findChild<UndoHistory *>(QString(), Qt::FindDirectChildrenOnly) : nullptr;
+}
+
+// QTextEdit handles the undo and redo keys itself, against the document's disabled stack
+bool UndoHistory::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == editor && event->type() == QEvent::KeyPress && !editor->isReadOnly()) {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        if (keyEvent->matches(QKeySequence::Undo)) {
+            undo();
+            return true;
+        }
+        if (keyEvent->matches(QKeySequence::Redo)) {
+            redo();
+            return true;
+        }
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+// Fragments
+
+// Character formats equal to the default one are left out of the shadow and the fragments
+UndoHistory::ShadowBlock UndoHistory::shadowOf(const QTextBlock &block)
+{
+    ShadowBlock shadow;
+    shadow.text = block.text().toUtf8();
+    const QList<QTextLayout::FormatRange> formats = block.textFormats();
+    for (const QTextLayout::FormatRange &range : formats) {
+        if (!range.format.properties().isEmpty()) shadow.formats.append(range);
+    }
+    shadow.blockFormat = block.blockFormat();
+    return shadow;
+}
+
+UndoHistory::Fragment UndoHistory::join(const ShadowBlock *shadow, int count)
+{
+    Fragment fragment;
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) fragment.text += QLatin1Char('\n');
+        const int offset = int(fragment.text.size());
+        fragment.text += QString::fromUtf8(shadow[i].text);
+        for (QTextLayout::FormatRange range : shadow[i].formats) {
+            range.start += offset;
+            fragment.formats.append(range);
+        }
+    }
+    return fragment;
+}
+
+UndoHistory::Fragment UndoHistory::slice(const Fragment &fragment, int from, int length)
+{
+    Fragment part;
+    part.text = fragment.text.mid(from, length);
+    const int end = from + int(part.text.size());
+    for (const QTextLayout::FormatRange &range : fragment.formats) {
+        const int start = qMax(range.start, from);
+        const int stop = qMin(range.start + range.length, end);
+        if (start >= stop) continue;
+        QTextLayout::FormatRange clipped;
+        clipped.start = start - from;
+        clipped.length = stop - start;
+        clipped.format = range.format;
+        part.formats.append(clipped);
+    }
+    return part;
+}
+
+void UndoHistory::append(Fragment &fragment, const Fragment &tail)
+{
+    const int offset = int(fragment.text.size());
+    fragment.text += tail.text;
+    for (QTextLayout::FormatRange range : tail.formats) {
+        range.start += offset;
+        fragment.formats.append(range);
+    }
+}
+
+// The format of character index: the range covering it, or the default format
+static QTextCharFormat formatAt(const QVector<QTextLayout::FormatRange> &formats, int index)
+{
+    auto it = std::upper_bound(formats.cbegin(), formats.cend(), index,
+                               [](int i, const QTextLayout::FormatRange &range) { return i < range.start; });
+    if (it == formats.cbegin()) return QTextCharFormat();
+    --it;
+    return index < it->start + it->length ? it->format : QTextCharFormat();
+}
+
+// Trim the common head and tail of before and after into one edit at position.
+// Returns false when the two are the same text with the same formats.
+bool UndoHistory::diff(const Fragment &before, const Fragment &after, int position, Edit *edit)
+{
+    const bool plain = before.formats.isEmpty() && after.formats.isEmpty();
+    auto same = [&](int i, int j) {
+        return before.text.at(i) == after.text.at(j)
+               && (plain || formatAt(before.formats, i) == formatAt(after.formats, j));
+    };
+
+    const int beforeSize = int(before.text.size());
+    const int afterSize = int(after.text.size());
+    const int shorter = qMin(beforeSize, afterSize);
+    int head = 0;
+    while (head < shorter && same(head, head)) ++head;
+    if (head == beforeSize && head == afterSize) return false;
+    int tail = 0;
+    while (tail < shorter - head && same(beforeSize - 1 - tail, afterSize - 1 - tail)) ++tail;
+
+    edit->position = position + head;
+    edit->removed = slice(before, head, beforeSize - head - tail);
+    edit->inserted = slice(after, head, afterSize - head - tail);
+    return true;
+}
+
+// Estimated memory of a step; texts shared between its edits count once
+qint64 UndoHistory::measure(Step &step)
+{
+    QSet<const QChar *> seen;
+    auto fragmentBytes = [&seen](const Fragment &fragment) {
+        qint64 bytes = fragment.formats.size() * qint64(sizeof(QTextLayout::FormatRange));
+        if (!fragment.text.isEmpty() && !seen.contains(fragment.text.constData())) {
+            seen.insert(fragment.text.constData());
+            bytes += fragment.text.size() * qint64(sizeof(QChar));
+        }
+        return bytes;
+    };
+
+    qint64 bytes = sizeof(Step);
+    for (const Edit &edit : std::as_const(step.edits)) {
+        bytes += sizeof(Edit) + fragmentBytes(edit.removed) + fragmentBytes(edit.inserted);
+    }
+    step.bytes = bytes;
+    return bytes;
+}
+
+qint64 UndoHistory::measure(const ShadowBlock &shadow)
+{
+    return sizeof(ShadowBlock) + shadow.text.size() + shadow.formats.size() * qint64(sizeof(QTextLayout::FormatRange));
+}
+
+// Recording
+
+void UndoHistory::rebuildShadow()
+{
+    blocks.clear();
+    blocks.reserve(document->blockCount());
+    shadowBytes = 0;
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        blocks.append(shadowOf(block));
+        shadowBytes += measure(blocks.last());
+    }
+}
+
+// Diff the blocks touched by the change against their shadow, then replace the shadow
+void UndoHistory::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+    PERF_SCOPE("undo record");
+
+    BlockChange change;
+    if (!mapBlockChange(document, blocks.size(), position, charsAdded, &change)) {
+        // What the edit replaced is unknown, so the history before it cannot be replayed
+        rebuildShadow();
+        clear();
+        return;
+    }
+
+    QVector<ShadowBlock> updated;
+    QVector<int> positions;
+    updated.reserve(change.addedBlocks);
+    positions.reserve(change.addedBlocks);
+    QTextBlock block = document->findBlockByNumber(change.first);
+    for (int i = 0; i < change.addedBlocks && block.isValid(); ++i, block = block.next()) {
+        updated.append(shadowOf(block));
+        positions.append(block.position());
+    }
+
+    QVector<Edit> edits;
+    if (!applying && !updated.isEmpty()) {
+        const ShadowBlock *previous = blocks.constData() + change.first;
+        if (change.removedBlocks == updated.size()) {
+            // Line by line, so a change spread over the document costs only its differences
+            for (int i = 0; i < updated.size(); ++i) {
+                Edit edit;
+                if ((previous[i].text != updated[i].text || previous[i].formats != updated[i].formats)
+                    && diff(join(previous + i, 1), join(&updated[i], 1), positions[i], &edit)) {
+                    edits.append(edit);
+                }
+                if (previous[i].blockFormat != updated[i].blockFormat) {
+                    Edit formatEdit;
+                    formatEdit.block = change.first + i;
+                    formatEdit.oldBlockFormat = previous[i].blockFormat;
+                    formatEdit.newBlockFormat = updated[i].blockFormat;
+                    edits.append(formatEdit);
+                }
+            }
+        } else {
+            Edit edit;
+            if (diff(join(previous, change.removedBlocks), join(updated.constData(), int(updated.size())),
+                     positions.first(), &edit)) {
+                edits.append(edit);
+            }
+        }
+    }
+
+    for (int i = 0; i < change.removedBlocks; ++i) shadowBytes -= measure(blocks.at(change.first + i));
+    for (const ShadowBlock &shadow : std::as_const(updated)) shadowBytes += measure(shadow);
+
+    const int common = qMin(change.removedBlocks, int(updated.size()));
+    for (int i = 0; i < common; ++i) {
+        blocks[change.first + i] = updated[i];
+    }
+    if (change.removedBlocks > common) {
+        blocks.remove(change.first + common, change.removedBlocks - common);
+    } else if (updated.size() > common) {
+        blocks.insert(change.first + common, updated.size() - common, ShadowBlock());
+        for (int i = common; i < updated.size(); ++i) {
+            blocks[change.first + i] = updated[i];
+        }
+    }
+
+    if (!edits.isEmpty()) record(edits);
+}
+
+// Add edits to the open step, or start a step (merging typing into the last one)
+void UndoHistory::record(QVector<Edit> edits)
+{
+    if (edits.size() > 1) {
+        // Replacements repeat the same few texts; keep one copy of each
+        QHash<QString, QString> pool;
+        auto intern = [&pool](QString &text) {
+            if (text.isEmpty()) return;
+            auto it = pool.constFind(text);
+            if (it != pool.cend()) text = it.value();
+            else pool.insert(text, text);
+        };
+        for (Edit &edit : edits) {
+            intern(edit.removed.text);
+            intern(edit.inserted.text);
+        }
+    }
+
+    if (!stepOpen) {
+        clearRedo();
+        if (edits.size() == 1 && mergeTyping(edits.first())) return;
+
+        const Edit &first = edits.first();
+        Step step;
+        step.serial = nextSerial++;
+        step.typing = edits.size() == 1 && first.block < 0
+                      && first.removed.text.size() + first.inserted.text.size() == 1;
+        undoSteps.append(step);
+        stepOpen = true;
+        closeTimer->start();  // Everything else done in this turn of the event loop joins the step
+    } else {
+        undoSteps.last().typing = false;
+    }
+
+    Step &step = undoSteps.last();
+    step.time = clock.elapsed();
+    step.edits += edits;
+    hotBytes -= step.bytes;
+    hotBytes += measure(step);
+}
+
+// Fold a typed or deleted character into the last step, so undo takes back a word at a time
+bool UndoHistory::mergeTyping(const Edit &edit)
+{
+    if (undoSteps.isEmpty() || edit.block >= 0) return false;
+    Step &last = undoSteps.last();
+    if (!last.typing || clock.elapsed() - last.time > typingMergeInterval) return false;
+
+    Edit &previous = last.edits.last();
+    const int previousEnd = previous.position + int(previous.inserted.text.size());
+    if (previous.removed.text.isEmpty() && edit.removed.text.isEmpty() && edit.inserted.text.size() == 1
+        && edit.position == previousEnd) {
+        // A space after a word starts the next step
+        if (edit.inserted.text.at(0).isSpace() && !previous.inserted.text.back().isSpace()) return false;
+        append(previous.inserted, edit.inserted);
+    } else if (previous.inserted.text.isEmpty() && edit.inserted.text.isEmpty() && edit.removed.text.size() == 1) {
+        if (edit.position + 1 == previous.position) {
+            // Backspace
+            Fragment removed = edit.removed;
+            append(removed, previous.removed);
+            previous.removed = removed;
+            previous.position = edit.position;
+        } else if (edit.position == previous.position) {
+            append(previous.removed, edit.removed);  // Delete
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    last.time = clock.elapsed();
+    hotBytes -= last.bytes;
+    hotBytes += measure(last);
+    return true;
+}
+
+void UndoHistory::closeStep()
+{
+    closeTimer->stop();
+    if (!stepOpen) return;
+    stepOpen = false;
+    enforceLimits();
+    compressColdSteps();
+}
+
+// Undo and redo
+
+void UndoHistory::undo()
+{
+    PERF_SCOPE("undo");
+    closeStep();
+    if (undoSteps.isEmpty() && !thawNewestBatch()) return;
+
+    const Step step = undoSteps.takeLast();
+    apply(step, true);
+    redoSteps.append(step);
+    if (!undoSteps.isEmpty()) undoSteps.last().typing = false;  // Typing after an undo starts afresh
+}
+
+void UndoHistory::redo()
+{
+    PERF_SCOPE("redo");
+    closeStep();
+    if (redoSteps.isEmpty()) return;
+
+    Step step = redoSteps.takeLast();
+    apply(step, false);
+    step.typing = false;
+    undoSteps.append(step);
+}
+
+void UndoHistory::clear()
+{
+    closeTimer->stop();
+    stepOpen = false;
+    undoSteps.clear();
+    redoSteps.clear();
+    coldBatches.clear();
+    hotBytes = 0;
+    coldBytes = 0;
+}
+
+void UndoHistory::clearRedo()
+{
+    for (const Step &step : std::as_const(redoSteps)) hotBytes -= step.bytes;
+    redoSteps.clear();
+}
+
+// Replace the cursor's selection with text; characters outside the ranges get the default format
+static void insertFormatted(QTextCursor &cursor, const QString &text, const QVector<QTextLayout::FormatRange> &formats)
+{
+    cursor.removeSelectedText();
+    int done = 0;
+    for (const QTextLayout::FormatRange &range : formats) {
+        if (range.start > done) cursor.insertText(text.mid(done, range.start - done), QTextCharFormat());
+        cursor.insertText(text.mid(range.start, range.length), range.format);
+        done = range.start + range.length;
+    }
+    if (done < text.size()) cursor.insertText(text.mid(done), QTextCharFormat());
+}
+
+// Replay a step as one edit block: backwards to undo it, forwards to redo it
+void UndoHistory::apply(const Step &step, bool reverse)
+{
+    applying = true;
+    QTextCursor cursor(document);
+    cursor.beginEditBlock();
+    int cursorPosition = -1;
+    const int count = int(step.edits.size());
+    for (int i = 0; i < count; ++i) {
+        const Edit &edit = step.edits.at(reverse ? count - 1 - i : i);
+        if (edit.block >= 0) {
+            applyBlockFormat(edit.block, reverse ? edit.oldBlockFormat : edit.newBlockFormat, step.restored);
+            continue;
+        }
+
+        const Fragment &current = reverse ? edit.inserted : edit.removed;
+        const Fragment &wanted = reverse ? edit.removed : edit.inserted;
+        const int end = document->characterCount() - 1;
+        const int position = qBound(0, int(edit.position), end);
+        cursor.setPosition(position);
+        cursor.setPosition(qMin(position + int(current.text.size()), end), QTextCursor::KeepAnchor);
+        insertFormatted(cursor, wanted.text, wanted.formats);
+        cursorPosition = cursor.position();
+    }
+    cursor.endEditBlock();  // The shadow catches up here
+    applying = false;
+
+    if (cursorPosition >= 0) {
+        QTextCursor textCursor = editor->textCursor();
+        textCursor.setPosition(qMin(cursorPosition, document->characterCount() - 1));
+        editor->setTextCursor(textCursor);
+    }
+}
+
+// keepList leaves the block's list alone, for steps whose object indexes refer to lists that are gone
+void UndoHistory::applyBlockFormat(int blockNumber, const QTextBlockFormat &format, bool keepList)
+{
+    QTextBlock block = document->findBlockByNumber(blockNumber);
+    if (!block.isValid()) return;
+    QTextCursor(block).setBlockFormat(format);
+    if (keepList) return;
+
+    // setBlockFormat keeps the block in its list; membership follows the format's object index
+    QTextList *current = block.textList();
+    QTextList *wanted = format.objectIndex() >= 0 ? qobject_cast<QTextList *>(document->object(format.objectIndex())) : nullptr;
+    if (current != wanted) {
+        if (current) current->remove(block);
+        if (wanted) wanted->add(block);
+    }
+}
+
+// Cold history
+
+// Expand the newest compressed batch into the undo steps
+bool UndoHistory::thawNewestBatch()
+{
+    if (coldBatches.isEmpty()) return false;
+    PERF_SCOPE("undo expand");
+
+    const ColdBatch batch = coldBatches.takeLast();
+    coldBytes -= batch.data.size();
+    bool ok = false;
+    QVector<Step> steps = expandSteps(batch.data, &ok);
+    if (!ok) {
+        // Older batches only replay on top of this one
+        coldBatches.clear();
+        coldBytes = 0;
+        return false;
+    }
+
+    for (Step &step : steps) {
+        step.serial = nextSerial++;
+        step.restored = step.restored || batch.restored;
+        hotBytes += measure(step);
+    }
+    undoSteps = steps + undoSteps;
+    return !undoSteps.isEmpty();
+}
+
+// Compress the oldest batch of steps on a worker once enough have piled up behind the hot ones
+void UndoHistory::compressColdSteps()
+{
+    if (compressWatcher->isRunning() || undoSteps.size() < hotSteps + batchSteps) return;
+
+    const QVector<Step> batch = undoSteps.mid(0, batchSteps);
+    compressingFirst = batch.first().serial;
+    compressingLast = batch.last().serial;
+    compressWatcher->setFuture(QtConcurrent::run([batch] { return compressSteps(batch); }));
+}
+
+void UndoHistory::onBatchCompressed()
+{
+    // Undo or the caps may have touched the batch while it was compressed
+    if (undoSteps.size() < batchSteps || undoSteps.first().serial != compressingFirst
+        || undoSteps.at(batchSteps - 1).serial != compressingLast) {
+        compressColdSteps();
+        return;
+    }
+
+    ColdBatch batch;
+    batch.data = compressWatcher->result();
+    batch.steps = batchSteps;
+    for (int i = 0; i < batchSteps; ++i) hotBytes -= undoSteps.at(i).bytes;
+    undoSteps.remove(0, batchSteps);
+    coldBytes += batch.data.size();
+    coldBatches.append(batch);
+
+    compressColdSteps();
+}
+
+// Caps
+
+// Drop the oldest history of this document past its cap, then of the largest histories past the global cap.
+// The block copy grows with the document rather than with its history, so the cap of one
+// document leaves it out (a document past the cap would otherwise get no history at all);
+// the global cap counts it, so many large documents together still give up their oldest steps.
+void UndoHistory::enforceLimits()
+{
+    while (memoryUsed() - shadowBytes > tabLimit && dropOldest()) {}
+
+    qint64 total = 0;
+    for (const UndoHistory *history : std::as_const(histories)) total += history->memoryUsed();
+    while (total > globalLimit) {
+        UndoHistory *largest = nullptr;   // Of the histories that still have steps to drop
+        for (UndoHistory *history : std::as_const(histories)) {
+            if (history->memoryUsed() > history->shadowBytes && (!largest || history->memoryUsed() > largest->memoryUsed())) {
+                largest = history;
+            }
+        }
+        if (!largest) break;
+        const qint64 before = largest->memoryUsed();
+        if (!largest->dropOldest()) break;
+        total -= before - largest->memoryUsed();
+    }
+}
+
+// Oldest first: compressed batches, then undo steps (never the open one), then the furthest redo
+bool UndoHistory::dropOldest()
+{
+    if (!coldBatches.isEmpty()) {
+        coldBytes -= coldBatches.takeFirst().data.size();
+        return true;
+    }
+    if (undoSteps.size() > (stepOpen ? 1 : 0)) {
+        hotBytes -= undoSteps.takeFirst().bytes;
+        return true;
+    }
+    if (!redoSteps.isEmpty()) {
+        hotBytes -= redoSteps.takeFirst().bytes;
+        return true;
+    }
+    return false;
+}
+
+// Serialization
+
+void UndoHistory::writeFragment(QDataStream &out, const Fragment &fragment)
+{
+    out << fragment.text << qint32(fragment.formats.size());
+    for (const QTextLayout::FormatRange &range : fragment.formats) {
+        out << qint32(range.start) << qint32(range.length) << QTextFormat(range.format);
+    }
+}
+
+void UndoHistory::readFragment(QDataStream &in, Fragment &fragment)
+{
+    qint32 count = 0;
+    in >> fragment.text >> count;
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QTextLayout::FormatRange range;
+        QTextFormat format;
+        in >> range.start >> range.length >> format;
+        range.format = format.toCharFormat();
+        fragment.formats.append(range);
+    }
+}
+
+// Runs on worker threads: only touches its arguments
+QByteArray UndoHistory::compressSteps(const QVector<Step> &steps)
+{
+    PERF_SCOPE("undo compress");
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(streamVersion);
+    out << qint32(steps.size());
+    for (const Step &step : steps) {
+        out << qint32(step.edits.size()) << step.restored;
+        for (const Edit &edit : step.edits) {
+            out << edit.position << edit.block;
+            if (edit.block >= 0) {
+                out << QTextFormat(edit.oldBlockFormat) << QTextFormat(edit.newBlockFormat);
+            } else {
+                writeFragment(out, edit.removed);
+                writeFragment(out, edit.inserted);
+            }
+        }
+    }
+    return qCompress(data, compressionLevel);
+}
+
+QVector<UndoHistory::Step> UndoHistory::expandSteps(const QByteArray &data, bool *ok)
+{
+    const QByteArray raw = qUncompress(data);
+    QDataStream in(raw);
+    in.setVersion(streamVersion);
+
+    QVector<Step> steps;
+    qint32 stepCount = 0;
+    in >> stepCount;
+    for (qint32 i = 0; i < stepCount && in.status() == QDataStream::Ok; ++i) {
+        Step step;
+        qint32 editCount = 0;
+        in >> editCount >> step.restored;
+        for (qint32 j = 0; j < editCount && in.status() == QDataStream::Ok; ++j) {
+            Edit edit;
+            in >> edit.position >> edit.block;
+            if (edit.block >= 0) {
+                QTextFormat oldFormat, newFormat;
+                in >> oldFormat >> newFormat;
+                edit.oldBlockFormat = oldFormat.toBlockFormat();
+                edit.newBlockFormat = newFormat.toBlockFormat();
+            } else {
+                readFragment(in, edit.removed);
+                readFragment(in, edit.inserted);
+            }
+            step.edits.append(edit);
+        }
+        steps.append(step);
+    }
+
+    *ok = !raw.isEmpty() && in.status() == QDataStream::Ok && steps.size() == stepCount;
+    return steps;
+}
+
+// Persistence
+
+QByteArray UndoHistory::textHash() const
+{
+    static const QByteArray separator("\n");
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (int i = 0; i < blocks.size(); ++i) {
+        if (i > 0) hash.addData(separator);
+        hash.addData(blocks.at(i).text);
+    }
+    return hash.result();
+}
+
+// Write the whole history, compressing the hot steps as one more batch
+bool UndoHistory::save(const QString &fileName, QString *errorString)
+{
+    PERF_SCOPE("undo save");
+    closeStep();
+    if (!isUndoAvailable() && !isRedoAvailable()) {
+        QFile::remove(fileName);  // Leave no older history behind to be restored
+        return true;
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(streamVersion);
+    out << fileMagic << fileVersion << textHash();
+    out << qint32(coldBatches.size() + (undoSteps.isEmpty() ? 0 : 1));
+    for (const ColdBatch &batch : std::as_const(coldBatches)) {
+        out << qint32(batch.steps) << batch.data;
+    }
+    if (!undoSteps.isEmpty()) out << qint32(undoSteps.size()) << compressSteps(undoSteps);
+    out << compressSteps(redoSteps);
+
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// Replace the history with the one saved in fileName, if it was saved for this text
+bool UndoHistory::load(const QString &fileName, QString *errorString)
+{
+    PERF_SCOPE("undo load");
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString) *errorString = file.errorString();
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(streamVersion);
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray hash;
+    in >> magic >> version >> hash;
+    if (magic != fileMagic || version != fileVersion) {
+        if (errorString) *errorString = tr("Not an undo history file");
+        return false;
+    }
+    if (hash != textHash()) {
+        if (errorString) *errorString = tr("The text has changed since the history was saved");
+        return false;
+    }
+
+    // Undo batches stay compressed until undo reaches them
+    QVector<ColdBatch> batches;
+    qint32 batchCount = 0;
+    in >> batchCount;
+    for (qint32 i = 0; i < batchCount && in.status() == QDataStream::Ok; ++i) {
+        ColdBatch batch;
+        in >> batch.steps >> batch.data;
+        batch.restored = true;
+        batches.append(batch);
+    }
+    QByteArray redoData;
+    in >> redoData;
+    bool ok = in.status() == QDataStream::Ok;
+    const QVector<Step> redo = ok ? expandSteps(redoData, &ok) : QVector<Step>();
+    if (!ok) {
+        if (errorString) *errorString = tr("The undo history file is damaged");
+        return false;
+    }
+
+    clear();
+    coldBatches = batches;
+    for (const ColdBatch &batch : std::as_const(coldBatches)) coldBytes += batch.data.size();
+    redoSteps = redo;
+    for (Step &step : redoSteps) {
+        step.serial = nextSerial++;
+        step.restored = true;
+        hotBytes += measure(step);
+    }
+    enforceLimits();
+    return true;
+}
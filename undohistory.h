@@ -0,0 +1,147 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include <QObject>
+#include <QVector>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QTextLayout>
+#include <QTextBlockFormat>
+
+class QTextEdit;
+class QTextDocument;
+class QTextBlock;
+class QTimer;
+class QDataStream;
+template <typename T> class QFutureWatcher;
+
+// Undo and redo for one editor, in place of QTextDocument's own stack.
+// Every edit is kept as a delta: the text and character formats it replaced
+// and inserted, trimmed to the characters that really changed, so a replace-all
+// becomes one small delta per changed line instead of a copy of the whole span.
+// Edits made in one turn of the event loop form one step, and typing merges
+// into a step per word. Beyond the newest steps the history is compressed in
+// batches on a worker thread and only expanded again when undo reaches it.
+// Each history has a memory cap and all of them share a global one; the oldest
+// steps are dropped first. To see what an edit replaced, the history keeps a
+// UTF-8 copy of every block; that copy grows with the document, not with the
+// history, so the caps do not count it. The history is a child of the editor's document.
+class UndoHistory : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit UndoHistory(QTextEdit *editor);
+    ~UndoHistory();
+
+    static UndoHistory *forDocument(QTextDocument *document);
+
+    bool isUndoAvailable() const { return !undoSteps.isEmpty() || !coldBatches.isEmpty(); }
+    bool isRedoAvailable() const { return !redoSteps.isEmpty(); }
+    qint64 memoryUsed() const { return hotBytes + coldBytes + shadowBytes; }   // The steps and the block copy
+
+    // The history is only loaded if the document still has the text it was saved with
+    bool save(const QString &fileName, QString *errorString = nullptr);
+    bool load(const QString &fileName, QString *errorString = nullptr);
+
+public slots:
+    void undo();
+    void redo();
+    void clear();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void closeStep();
+    void onBatchCompressed();
+
+private:
+    // Text with the character formats that differ from the default one
+    struct Fragment
+    {
+        QString text;
+        QVector<QTextLayout::FormatRange> formats;
+    };
+
+    // Replace `removed` at position with `inserted`, or change a block's format when block >= 0
+    struct Edit
+    {
+        qint32 position = 0;
+        qint32 block = -1;
+        Fragment removed;
+        Fragment inserted;
+        QTextBlockFormat oldBlockFormat;
+        QTextBlockFormat newBlockFormat;
+    };
+
+    struct Step
+    {
+        quint64 serial = 0;         // Identifies the step while a batch holding it is compressed
+        qint64 time = 0;            // Of the last edit, for merging typing
+        qint64 bytes = 0;
+        bool typing = false;        // A single character typed or deleted
+        bool restored = false;      // Loaded from disk: its list object indexes belong to an earlier session
+        QVector<Edit> edits;
+    };
+
+    struct ColdBatch
+    {
+        QByteArray data;            // qCompress'd steps, oldest first
+        int steps = 0;
+        bool restored = false;      // Loaded from disk
+    };
+
+    struct ShadowBlock
+    {
+        QByteArray text;            // UTF-8
+        QVector<QTextLayout::FormatRange> formats;
+        QTextBlockFormat blockFormat;
+    };
+
+    static ShadowBlock shadowOf(const QTextBlock &block);
+    static Fragment join(const ShadowBlock *shadow, int count);
+    static Fragment slice(const Fragment &fragment, int from, int length);
+    static void append(Fragment &fragment, const Fragment &tail);
+    static bool diff(const Fragment &before, const Fragment &after, int position, Edit *edit);
+    static qint64 measure(Step &step);
+    static qint64 measure(const ShadowBlock &shadow);
+
+    static void writeFragment(QDataStream &out, const Fragment &fragment);
+    static void readFragment(QDataStream &in, Fragment &fragment);
+    static QByteArray compressSteps(const QVector<Step> &steps);
+    static QVector<Step> expandSteps(const QByteArray &data, bool *ok);
+
+    void rebuildShadow();
+    void record(QVector<Edit> edits);
+    bool mergeTyping(const Edit &edit);
+    void apply(const Step &step, bool reverse);
+    void applyBlockFormat(int blockNumber, const QTextBlockFormat &format, bool keepList);
+    bool thawNewestBatch();
+    QByteArray textHash() const;
+    void compressColdSteps();
+    void enforceLimits();
+    bool dropOldest();
+    void clearRedo();
+
+    QTextEdit *editor;
+    QTextDocument *document;
+    QVector<ShadowBlock> blocks;        // One entry per QTextBlock, in document order
+    QVector<ColdBatch> coldBatches;     // Oldest first
+    QVector<Step> undoSteps;            // Newest last
+    QVector<Step> redoSteps;            // Next to redo last
+    qint64 hotBytes = 0;                // Estimated size of undoSteps and redoSteps
+    qint64 coldBytes = 0;
+    qint64 shadowBytes = 0;             // Estimated size of blocks
+    quint64 nextSerial = 0;
+    bool stepOpen = false;
+    bool applying = false;
+    QElapsedTimer clock;
+    QTimer *closeTimer;
+    QFutureWatcher<QByteArray> *compressWatcher;
+    quint64 compressingFirst = 0;
+    quint64 compressingLast = 0;
+};
+
+#endif // UNDOHISTORY_H
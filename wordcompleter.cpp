@@ -0,0 +1,277 @@
+#include "wordcompleter.h"
+#include "blockchange.h"
+#include "spellchecker.h"
+#include <QTextEdit>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QCompleter>
+#include <QStringListModel>
+#include <QAbstractItemView>
+#include <QScrollBar>
+#include <QKeyEvent>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
+
+static const int scanSliceMs = 4;          // Longest the initial scan holds the event loop per turn
+static const int minimumPrefix = 2;        // Characters typed before the popup appears by itself
+static const int maxSuggestions = 10;
+
+// Calls function(start, length) for every word of at least three characters:
+// a letter or underscore followed by letters, digits, underscores or apostrophes
+template<typename Function>
+static void forEachWord(const QString &text, Function function)
+{
+    const qsizetype size = text.size();
+    qsizetype i = 0;
+    while (i < size) {
+        const QChar c = text.at(i);
+        if (!c.isLetter() && c != QLatin1Char('_')) {
+            ++i;
+            continue;
+        }
+        qsizetype end = i + 1;
+        while (end < size) {
+            const QChar next = text.at(end);
+            if (!next.isLetterOrNumber() && next != QLatin1Char('_') && next != QLatin1Char('\'')) break;
+            ++end;
+        }
+        const qsizetype wordEnd = end;
+        while (end > i && text.at(end - 1) == QLatin1Char('\'')) --end;   // A closing quote is not part of the word
+        if (end - i >= 3) function(i, end - i);
+        i = wordEnd;
+    }
+}
+
+static bool isWordCharacter(QChar c)
+{
+    return c.isLetterOrNumber() || c == QLatin1Char('_') || c == QLatin1Char('\'');
+}
+
+// DocumentWords
+
+DocumentWords::DocumentWords(QTextDocument *document, std::shared_ptr<WordIndex> index)
+    : QObject(document), document(document), index(std::move(index))
+{
+    scanTimer = new QTimer(this);
+    scanTimer->setInterval(0);
+    connect(scanTimer, &QTimer::timeout, this, &DocumentWords::scanSlice);
+    connect(document, &QTextDocument::contentsChange, this, &DocumentWords::onContentsChange);
+    restart();
+}
+
+DocumentWords::~DocumentWords()
+{
+    for (int i = 0; i < scanned; ++i) unindexBlock(i);
+}
+
+// Forget everything and scan the document again from the top
+void DocumentWords::restart()
+{
+    for (int i = 0; i < scanned; ++i) unindexBlock(i);
+    blockWords = QVector<QVector<int>>(document->blockCount());
+    scanned = 0;
+    scanTimer->start();
+}
+
+void DocumentWords::indexBlock(int number, const QString &text)
+{
+    QVector<int> &ids = blockWords[number];
+    forEachWord(text, [&](qsizetype start, qsizetype length) {
+        ids.append(index->insert(QStringView(text).mid(start, length)));
+    });
+}
+
+void DocumentWords::unindexBlock(int number)
+{
+    for (int id : std::as_const(blockWords[number])) index->remove(id);
+    blockWords[number].clear();
+}
+
+void DocumentWords::scanSlice()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QTextBlock block = document->findBlockByNumber(scanned);
+    while (block.isValid() && scanned < blockWords.size()) {
+        indexBlock(scanned++, block.text());
+        block = block.next();
+        if ((scanned & 63) == 0 && timer.elapsed() >= scanSliceMs) return;
+    }
+    scanTimer->stop();
+}
+
+// Re-tokenize only the blocks touched by the edit; blocks the scan has not reached are left to it
+void DocumentWords::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    BlockChange change;
+    if (!mapBlockChange(document, blockWords.size(), position, charsAdded, &change)) {
+        restart();
+        return;
+    }
+
+    const int removedEnd = change.first + change.removedBlocks;
+    for (int i = change.first; i < qMin(removedEnd, scanned); ++i) unindexBlock(i);
+
+    if (change.removedBlocks > change.addedBlocks) {
+        blockWords.remove(change.first, change.removedBlocks - change.addedBlocks);
+    } else if (change.addedBlocks > change.removedBlocks) {
+        blockWords.insert(change.first, change.addedBlocks - change.removedBlocks, QVector<int>());
+    }
+
+    if (scanned >= removedEnd) {
+        scanned += change.addedBlocks - change.removedBlocks;
+        QTextBlock block = document->findBlockByNumber(change.first);
+        for (int i = change.first; i < change.first + change.addedBlocks && block.isValid(); ++i, block = block.next()) {
+            indexBlock(i, block.text());
+        }
+    } else if (scanned > change.first) {
+        scanned = change.first;   // The scan picks the edited blocks up when it gets there
+    }
+}
+
+// WordCompleter
+
+WordCompleter::WordCompleter(SpellChecker *checker, QObject *parent)
+    : QObject(parent), documentIndex(std::make_shared<WordIndex>())
+{
+    model = new QStringListModel(this);
+    completer = new QCompleter(model, this);
+    completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);  // The list is already ranked
+    completer->setMaxVisibleItems(maxSuggestions);
+    connect(completer, qOverload<const QString &>(&QCompleter::activated), this, &WordCompleter::insertCompletion);
+
+    // The dictionary holds tens of thousands of words, so its index is built off the GUI thread
+    if (checker->isAvailable()) {
+        QFutureWatcher<std::shared_ptr<const WordIndex>> *watcher = new QFutureWatcher<std::shared_ptr<const WordIndex>>(this);
+        connect(watcher, &QFutureWatcher<std::shared_ptr<const WordIndex>>::finished, this, [this, watcher] {
+            dictionaryIndex = watcher->result();
+            watcher->deleteLater();
+        });
+        watcher->setFuture(QtConcurrent::run(checker->threadPool(), [checker] {
+            std::shared_ptr<WordIndex> index = std::make_shared<WordIndex>();
+            const QStringList words = checker->dictionaryWords();
+            for (const QString &word : words) index->insertDictionaryWord(word);
+            return std::shared_ptr<const WordIndex>(index);
+        }));
+    }
+}
+
+void WordCompleter::attach(QTextEdit *editor)
+{
+    new DocumentWords(editor->document(), documentIndex);
+    editor->installEventFilter(this);
+    connect(editor, &QTextEdit::textChanged, this, [this, editor] {
+        if (typingIn != editor) return;
+        typingIn = nullptr;
+        updatePopup(editor, false);
+    });
+}
+
+bool WordCompleter::eventFilter(QObject *watched, QEvent *event)
+{
+    QTextEdit *editor = qobject_cast<QTextEdit *>(watched);
+    if (!editor || event->type() != QEvent::KeyPress) return QObject::eventFilter(watched, event);
+
+    QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+    if (completer->popup()->isVisible() && completer->widget() == editor) {
+        switch (keyEvent->key()) {
+        case Qt::Key_Enter:
+        case Qt::Key_Return:
+        case Qt::Key_Escape:
+        case Qt::Key_Tab:
+        case Qt::Key_Backtab:
+            event->ignore();
+            return true;  // Left to the completer's popup
+        default:
+            break;
+        }
+    }
+
+    if (keyEvent->key() == Qt::Key_Space && keyEvent->modifiers() == Qt::ControlModifier) {
+        updatePopup(editor, true);
+        return true;
+    }
+
+    const bool typing = !keyEvent->text().isEmpty() && !(keyEvent->modifiers() & (Qt::ControlModifier | Qt::AltModifier));
+    typingIn = typing ? editor : nullptr;
+    if (!typing) completer->popup()->hide();
+    return QObject::eventFilter(watched, event);
+}
+
+// The word characters right before the cursor
+QString WordCompleter::prefixAtCursor(const QTextEdit *editor)
+{
+    const QTextCursor cursor = editor->textCursor();
+    const QString text = cursor.block().text();
+    const int end = cursor.positionInBlock();
+    int start = end;
+    while (start > 0 && isWordCharacter(text.at(start - 1))) --start;
+    return text.mid(start, end - start);
+}
+
+// Counted words first, then dictionary words; a capitalized prefix also finds
+// lower-case words, offered capitalized
+QStringList WordCompleter::completions(const QString &prefix) const
+{
+    QStringList results;
+    QSet<QString> seen;
+    auto add = [&](const QStringList &words, bool capitalize) {
+        for (QString word : words) {
+            if (capitalize) word[0] = word[0].toUpper();
+            if (results.size() < maxSuggestions && !seen.contains(word)) {
+                seen.insert(word);
+                results.append(word);
+            }
+        }
+    };
+
+    QString lowered = prefix;
+    lowered[0] = lowered[0].toLower();
+    const bool capitalized = lowered != prefix;
+
+    add(documentIndex->complete(prefix, maxSuggestions), false);
+    if (capitalized) add(documentIndex->complete(lowered, maxSuggestions), true);
+    if (dictionaryIndex) {
+        add(dictionaryIndex->complete(prefix, maxSuggestions), false);
+        if (capitalized) add(dictionaryIndex->complete(lowered, maxSuggestions), true);
+    }
+    return results;
+}
+
+void WordCompleter::updatePopup(QTextEdit *editor, bool force)
+{
+    const QString prefix = prefixAtCursor(editor);
+    const QStringList words = prefix.isEmpty() || (!force && prefix.size() < minimumPrefix) ? QStringList() : completions(prefix);
+    if (words.isEmpty()) {
+        completer->popup()->hide();
+        return;
+    }
+
+    model->setStringList(words);
+    completer->setWidget(editor);
+    QAbstractItemView *popup = completer->popup();
+    popup->setCurrentIndex(completer->completionModel()->index(0, 0));
+
+    QRect rect = editor->cursorRect();
+    rect.setWidth(popup->sizeHintForColumn(0) + popup->verticalScrollBar()->sizeHint().width());
+    completer->complete(rect);
+}
+
+// Replace the typed prefix with the chosen word
+void WordCompleter::insertCompletion(const QString &completion)
+{
+    QTextEdit *editor = qobject_cast<QTextEdit *>(completer->widget());
+    if (!editor) return;
+
+    QTextCursor cursor = editor->textCursor();
+    cursor.movePosition(QTextCursor::Left, QTextCursor::KeepAnchor, int(prefixAtCursor(editor).size()));
+    cursor.insertText(completion);
+    editor->setTextCursor(cursor);
+}
@@ -0,0 +1,78 @@
+#ifndef WORDCOMPLETER_H
+#define WORDCOMPLETER_H
+
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+#include <memory>
+#include "wordindex.h"
+
+class QTextEdit;
+class QTextDocument;
+class QCompleter;
+class QStringListModel;
+class QTimer;
+class SpellChecker;
+
+// Keeps the words of one document counted in the shared completion index.
+// Word ids are kept per block and only the blocks touched by an edit are
+// re-tokenized. A newly attached document is scanned from the top in short
+// time slices, so a big file does not stall the event loop. The tracker is a
+// child of its document and takes its words out of the index when destroyed.
+class DocumentWords : public QObject
+{
+    Q_OBJECT
+
+public:
+    DocumentWords(QTextDocument *document, std::shared_ptr<WordIndex> index);
+    ~DocumentWords();
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+    void scanSlice();
+
+private:
+    void restart();
+    void indexBlock(int number, const QString &text);
+    void unindexBlock(int number);
+
+    QTextDocument *document;
+    std::shared_ptr<WordIndex> index;
+    QVector<QVector<int>> blockWords;   // Word ids per block, in document order
+    int scanned = 0;                    // Blocks before this one are indexed
+    QTimer *scanTimer;
+};
+
+// In-editor word completion.
+// Suggestions come from two indexes: the words of every open tab, ranked by
+// how often they occur, and the spell-check dictionary, which is loaded into
+// its own index on a worker thread and ranks below them. The popup follows
+// typing in whichever attached editor has focus; Ctrl+Space opens it on demand.
+class WordCompleter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WordCompleter(SpellChecker *checker, QObject *parent = nullptr);
+
+    void attach(QTextEdit *editor);
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private slots:
+    void insertCompletion(const QString &completion);
+
+private:
+    void updatePopup(QTextEdit *editor, bool force);
+    QStringList completions(const QString &prefix) const;
+    static QString prefixAtCursor(const QTextEdit *editor);
+
+    std::shared_ptr<WordIndex> documentIndex;
+    std::shared_ptr<const WordIndex> dictionaryIndex;   // Null until the worker has built it
+    QCompleter *completer;
+    QStringListModel *model;
+    QPointer<QTextEdit> typingIn;       // Editor whose next text change comes from a key press
+};
+
+#endif // WORDCOMPLETER_H
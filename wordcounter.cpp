@@ -0,0 +1,131 @@
+#include "wordcounter.h"
+#include "blockchange.h"
+#include "simd.h"
+#include <QTextDocument>
+#include <QTextBlock>
+
+WordCounter::WordCounter(QTextDocument *document) : QObject(document), document(document)
+{
+    connect(document, &QTextDocument::contentsChange, this, &WordCounter::onContentsChange);
+    recountAll();
+}
+
+WordCounter *WordCounter::forDocument(QTextDocument *document)
+{
+    return document ? document->findChild<WordCounter *>(QString(), Qt::FindDirectChildrenOnly) : nullptr;
+}
+
+// Count words as whitespace-to-text transitions. With SSE2, eight characters are
+// classified per step and transitions are counted from the whitespace bit mask;
+// chunks holding non-ASCII characters fall back to QChar::isSpace for Unicode spaces.
+int WordCounter::countWords(const QChar *text, qsizetype length)
+{
+    int words = 0;
+    bool previousSpace = true;
+    qsizetype i = 0;
+
+#ifdef NOTEPAD_SSE2
+    const __m128i space = _mm_set1_epi16(0x20);
+    const __m128i belowControl = _mm_set1_epi16(0x08);   // \t, \n, \v, \f and \r are 0x09..0x0D
+    const __m128i aboveControl = _mm_set1_epi16(0x0E);
+    const __m128i asciiMax = _mm_set1_epi16(0x7F);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= length; i += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+
+        // Signed compares: characters from U+8000 up read as negative
+        const __m128i nonAscii = _mm_or_si128(_mm_cmplt_epi16(chunk, zero), _mm_cmpgt_epi16(chunk, asciiMax));
+        if (_mm_movemask_epi8(nonAscii)) {
+            for (qsizetype j = i; j < i + 8; ++j) {
+                const bool isSpace = text[j].isSpace();
+                if (!isSpace && previousSpace) ++words;
+                previousSpace = isSpace;
+            }
+            continue;
+        }
+
+        const __m128i whitespace = _mm_or_si128(
+            _mm_cmpeq_epi16(chunk, space),
+            _mm_and_si128(_mm_cmpgt_epi16(chunk, belowControl), _mm_cmplt_epi16(chunk, aboveControl)));
+
+        // movemask yields two bits per 16-bit lane; keep the low one of each pair
+        const unsigned spaceMask = unsigned(_mm_movemask_epi8(whitespace)) & 0x5555u;
+        const unsigned textMask = ~spaceMask & 0x5555u;
+        const unsigned afterSpace = ((spaceMask << 2) | (previousSpace ? 1u : 0u)) & 0x5555u;
+        words += qPopulationCount(textMask & afterSpace);
+        previousSpace = spaceMask & 0x4000u;
+    }
+#endif
+
+    for (; i < length; ++i) {
+        const bool isSpace = text[i].isSpace();
+        if (!isSpace && previousSpace) ++words;
+        previousSpace = isSpace;
+    }
+    return words;
+}
+
+WordCounter::BlockCounts WordCounter::countBlock(const QString &text) const
+{
+    return {countWords(text.constData(), text.size()), int(text.size())};
+}
+
+void WordCounter::recountAll()
+{
+    blocks.clear();
+    blocks.reserve(document->blockCount());
+    totalWords = 0;
+    totalCharacters = 0;
+
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        const BlockCounts counts = countBlock(block.text());
+        blocks.append(counts);
+        totalWords += counts.words;
+        totalCharacters += counts.characters;
+    }
+    emit countsChanged();
+}
+
+// Replace the counts of the blocks touched by the edit and leave the rest alone
+void WordCounter::onContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    Q_UNUSED(charsRemoved);
+
+    BlockChange change;
+    if (!mapBlockChange(document, blocks.size(), position, charsAdded, &change)) {
+        recountAll();
+        return;
+    }
+
+    for (int i = change.first; i < change.first + change.removedBlocks; ++i) {
+        totalWords -= blocks[i].words;
+        totalCharacters -= blocks[i].characters;
+    }
+
+    QVector<BlockCounts> updated;
+    updated.reserve(change.addedBlocks);
+    QTextBlock block = document->findBlockByNumber(change.first);
+    for (int i = 0; i < change.addedBlocks && block.isValid(); ++i, block = block.next()) {
+        const BlockCounts counts = countBlock(block.text());
+        updated.append(counts);
+        totalWords += counts.words;
+        totalCharacters += counts.characters;
+    }
+
+    // Same-sized ranges (typing within a line) are overwritten in place
+    const int common = qMin(change.removedBlocks, int(updated.size()));
+    for (int i = 0; i < common; ++i) {
+        blocks[change.first + i] = updated[i];
+    }
+    if (change.removedBlocks > common) {
+        blocks.remove(change.first + common, change.removedBlocks - common);
+    } else if (updated.size() > common) {
+        blocks.insert(change.first + common, updated.size() - common, BlockCounts());
+        for (int i = common; i < updated.size(); ++i) {
+            blocks[change.first + i] = updated[i];
+        }
+    }
+
+    emit countsChanged();
+}
@@ -0,0 +1,48 @@
+#ifndef WORDCOUNTER_H
+#define WORDCOUNTER_H
+
+#include <QObject>
+#include <QVector>
+
+class QTextDocument;
+
+// Incremental word, character and line counter for one document.
+// Counts are kept per block; on every QTextDocument::contentsChange only the
+// blocks touched by the edit are rescanned, so a keystroke costs one block no
+// matter how long the document is. The counter is a child of its document.
+class WordCounter : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WordCounter(QTextDocument *document);
+
+    static WordCounter *forDocument(QTextDocument *document);
+    static int countWords(const QChar *text, qsizetype length);
+
+    qint64 words() const { return totalWords; }
+    qint64 characters() const { return totalCharacters; }
+    int lines() const { return blocks.size(); }
+
+signals:
+    void countsChanged();
+
+private slots:
+    void onContentsChange(int position, int charsRemoved, int charsAdded);
+
+private:
+    struct BlockCounts {
+        int words;
+        int characters;
+    };
+
+    void recountAll();
+    BlockCounts countBlock(const QString &text) const;
+
+    QTextDocument *document;
+    QVector<BlockCounts> blocks;   // One entry per QTextBlock, in document order
+    qint64 totalWords = 0;
+    qint64 totalCharacters = 0;
+};
+
+#endif // WORDCOUNTER_H
@@ -0,0 +1,172 @@
+#include "wordindex.h"
+#include <queue>
+#include <utility>
+
+WordIndex::WordIndex()
+{
+    nodes.append(Node());
+}
+
+// Counted words score above dictionary-only words; 0 means "not a word"
+quint32 WordIndex::score(const Node &node) const
+{
+    if (node.count > 0) return node.count + 1;
+    return node.dictionaryWord ? 1 : 0;
+}
+
+int WordIndex::findChild(int node, QChar first) const
+{
+    for (int child = nodes[node].firstChild; child >= 0; child = nodes[child].nextSibling) {
+        if (labels.at(nodes[child].labelStart) == first) return child;
+    }
+    return -1;
+}
+
+// Walk down the trie, splitting an edge where the word leaves it and adding a leaf for the rest
+int WordIndex::findOrCreate(QStringView word)
+{
+    int node = 0;
+    qsizetype i = 0;
+    while (i < word.size()) {
+        const int child = findChild(node, word[i]);
+        if (child < 0) {
+            Node leaf;
+            leaf.labelStart = qint32(labels.size());
+            leaf.labelLength = qint32(word.size() - i);
+            leaf.parent = node;
+            leaf.nextSibling = nodes[node].firstChild;
+            labels.append(word.mid(i));
+            nodes[node].firstChild = nodes.size();
+            nodes.append(leaf);
+            return nodes.size() - 1;
+        }
+
+        const Node &edge = nodes[child];
+        qint32 common = 1;
+        while (common < edge.labelLength && i + common < word.size()
+               && labels.at(edge.labelStart + common) == word[i + common]) {
+            ++common;
+        }
+
+        if (common < edge.labelLength) {
+            // The word leaves this edge part way: a new node takes the shared part, so the
+            // child keeps its index (and with it the id of the word that ends there)
+            Node split;
+            split.labelStart = edge.labelStart;
+            split.labelLength = common;
+            split.parent = node;
+            split.firstChild = child;
+            split.nextSibling = edge.nextSibling;
+            split.best = edge.best;
+            const int splitIndex = nodes.size();
+            nodes.append(split);
+
+            if (nodes[node].firstChild == child) {
+                nodes[node].firstChild = splitIndex;
+            } else {
+                int sibling = nodes[node].firstChild;
+                while (nodes[sibling].nextSibling != child) sibling = nodes[sibling].nextSibling;
+                nodes[sibling].nextSibling = splitIndex;
+            }
+
+            Node &rest = nodes[child];
+            rest.labelStart += common;
+            rest.labelLength -= common;
+            rest.parent = splitIndex;
+            rest.nextSibling = -1;
+            node = splitIndex;
+        } else {
+            node = child;
+        }
+        i += common;
+    }
+    return node;
+}
+
+// Recompute the subtree maxima from node up to the root, stopping once nothing changes
+void WordIndex::updateBest(int node)
+{
+    for (; node >= 0; node = nodes[node].parent) {
+        quint32 best = score(nodes[node]);
+        for (int child = nodes[node].firstChild; child >= 0; child = nodes[child].nextSibling) {
+            best = qMax(best, nodes[child].best);
+        }
+        if (nodes[node].best == best) break;
+        nodes[node].best = best;
+    }
+}
+
+int WordIndex::insert(QStringView word)
+{
+    if (word.isEmpty()) return -1;
+    const int node = findOrCreate(word);
+    ++nodes[node].count;
+    updateBest(node);
+    return node;
+}
+
+void WordIndex::insertDictionaryWord(QStringView word)
+{
+    if (word.isEmpty()) return;
+    const int node = findOrCreate(word);
+    nodes[node].dictionaryWord = true;
+    updateBest(node);
+}
+
+void WordIndex::remove(int id)
+{
+    if (id <= 0 || id >= nodes.size() || nodes[id].count == 0) return;
+    --nodes[id].count;
+    updateBest(id);
+}
+
+QString WordIndex::wordAt(int node) const
+{
+    QString word;
+    for (; node > 0; node = nodes[node].parent) {
+        word.prepend(QStringView(labels).mid(nodes[node].labelStart, nodes[node].labelLength));
+    }
+    return word;
+}
+
+// Best-first search below the prefix: queue entries carry an upper bound on their
+// score (a subtree's best, or a word's own score), so words come out in rank order
+QStringList WordIndex::complete(QStringView prefix, int limit) const
+{
+    QStringList words;
+    if (prefix.isEmpty() || limit <= 0) return words;
+
+    // Find the node whose subtree holds every word starting with prefix
+    int node = 0;
+    qsizetype i = 0;
+    while (i < prefix.size()) {
+        node = findChild(node, prefix[i]);
+        if (node < 0) return words;
+        const Node &edge = nodes[node];
+        for (qint32 j = 0; j < edge.labelLength && i < prefix.size(); ++j, ++i) {
+            if (labels.at(edge.labelStart + j) != prefix[i]) return words;
+        }
+    }
+
+    using Entry = std::pair<quint32, int>;    // (bound, node); words are stored as ~node
+    std::priority_queue<Entry> queue;
+    if (nodes[node].best > 0) queue.push({nodes[node].best, node});
+
+    while (!queue.empty() && words.size() < limit) {
+        const Entry entry = queue.top();
+        queue.pop();
+
+        if (entry.second < 0) {
+            const QString word = wordAt(~entry.second);
+            if (word.size() > prefix.size()) words.append(word);  // The prefix itself is no completion
+            continue;
+        }
+
+        const Node &current = nodes[entry.second];
+        if (score(current) > 0) queue.push({score(current), ~entry.second});
+        for (int child = current.firstChild; child >= 0; child = nodes[child].nextSibling) {
+            if (nodes[child].best > 0) queue.push({nodes[child].best, child});
+        }
+    }
+    return words;
+}
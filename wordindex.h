@@ -0,0 +1,51 @@
+#ifndef WORDINDEX_H
+#define WORDINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+#include <QVector>
+
+// Radix trie of words with occurrence counts, for ranked prefix completion.
+// Edge labels are ranges into one shared character buffer; splitting an edge
+// only splits its range, so the buffer grows by the new suffix of each new
+// word and nothing else. Every node also keeps the best score found in its
+// subtree, which lets complete() walk the trie best-first and stop after
+// `limit` words instead of visiting every word under the prefix.
+// A word's id is the index of its node; ids stay valid for the index's lifetime.
+class WordIndex
+{
+public:
+    WordIndex();
+
+    int insert(QStringView word);              // Adds one occurrence; returns the word's id
+    void insertDictionaryWord(QStringView word);   // A word that ranks below every counted word
+    void remove(int id);                       // Drops one occurrence
+
+    QStringList complete(QStringView prefix, int limit) const;
+    int nodeCount() const { return nodes.size(); }
+
+private:
+    struct Node
+    {
+        qint32 labelStart = 0;
+        qint32 labelLength = 0;
+        qint32 parent = -1;
+        qint32 firstChild = -1;
+        qint32 nextSibling = -1;
+        quint32 count = 0;              // Occurrences in open documents
+        quint32 best = 0;               // Highest score in the subtree, this node included
+        bool dictionaryWord = false;
+    };
+
+    int findOrCreate(QStringView word);
+    int findChild(int node, QChar first) const;
+    quint32 score(const Node &node) const;
+    void updateBest(int node);
+    QString wordAt(int node) const;
+
+    QVector<Node> nodes;                // nodes[0] is the root
+    QString labels;
+};
+
+#endif // WORDINDEX_H